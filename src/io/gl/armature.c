@@ -197,18 +197,74 @@ void armature_matrices(Armature *a, int frame, mat4 *matrices)
              
         quaternion_to_mat4(q, tmp);
 
+        // bone matrices are always affine
         mat4_translate(matrices[i], -bone->head[0], -bone->head[1], -bone->head[2]);
-        mat4_mult(matrices[i], tmp, matrices[i]);
+        mat4_mult_affine(matrices[i], tmp, matrices[i]);
         mat4_translate(matrices[i], bone->head[0], bone->head[1], bone->head[2]);
         mat4_translate(matrices[i], bpose->position[0], bpose->position[1], bpose->position[2]);
 
         if(bone_hasparent(bone))
         {
-            mat4_mult(matrices[bone->parent->id], matrices[i], matrices[i]);
+            mat4_mult_affine(matrices[bone->parent->id], matrices[i], matrices[i]);
         }
     }
 }
 
+/**
+ * the same bone transforms as armature_matrices, as dual quaternions. Each
+ * bone takes 8 floats instead of 16, and concatenating a bone onto its 
+ * parent costs 3 quaternion multiplies instead of an affine mat4 multiply
+ */
+void armature_dualquats(Armature *a, int frame, dualquat *dqs)
+{
+    int i;
+    for(i = 0; i < a->nbones; i++)
+    {
+        Bone *bone = &a->bones[i];
+        Pose *bpose = &bone->poses[frame];
+        dualquat rot = dualquat_identity();
+        memcpy(&rot.real, bpose->rotation, sizeof(float) * 4);
+
+        // the steps of armature_matrices, in the same order
+        dqs[i] = dualquat_identity();
+        dualquat_translatep(&dqs[i], -bone->head[0], -bone->head[1], -bone->head[2]);
+        dqs[i] = dualquat_multp(&dqs[i], &rot);
+        dualquat_translatep(&dqs[i], bone->head[0], bone->head[1], bone->head[2]);
+        dualquat_translatep(&dqs[i], bpose->position[0], bpose->position[1], bpose->position[2]);
+
+        if(bone_hasparent(bone))
+        {
+            dqs[i] = dualquat_multp(&dqs[bone->parent->id], &dqs[i]);
+        }
+    }
+}
+
+/**
+ * the rigid transform of a pose, rotation then position. Dual quaternions
+ * cannot hold scale, so the pose scale is ignored
+ */
+dualquat pose_to_dualquat(const Pose *pose)
+{
+    quat q;
+    vec3 t;
+    memcpy(&q, pose->rotation, sizeof(float) * 4);
+    memcpy(&t, pose->position, sizeof(float) * 3);
+    return dualquat_set(&q, &t);
+}
+
+/**
+ * the inverse of pose_to_dualquat. the pose is given a scale of 1
+ */
+void dualquat_to_pose(const dualquat *dq, Pose *pose)
+{
+    quat q;
+    vec3 t;
+    dualquat_get(dq, &q, &t);
+    memcpy(pose->rotation, &q, sizeof(float) * 4);
+    memcpy(pose->position, &t, sizeof(float) * 3);
+    pose->scale = 1.0f;
+}
+
 void armature_finalize(Armature *a)
 {
 
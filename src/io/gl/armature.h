@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include "util/math/matrix.h"
+#include "util/math/dualquat.h"
 
 //XXX colesce bone data into one place?
 
@@ -69,6 +70,10 @@ int armature_addpose(Armature *a);
 void armature_removepose(Armature *a, int pose_i);
 void armature_posecopy(Armature *a, int frame_to, int frame_from);
 void armature_matrices(Armature *a, int frame, mat4 *matrices);
+void armature_dualquats(Armature *a, int frame, dualquat *dqs);
 void armature_finalize(Armature *a);
 
+dualquat pose_to_dualquat(const Pose *pose);
+void dualquat_to_pose(const dualquat *dq, Pose *pose);
+
 #endif
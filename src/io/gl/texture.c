@@ -21,6 +21,7 @@
 
 #include "io/tga.h"
 #include "util/noise.h"
+#include "util/math/half.h"
 
 #include "texture.h"
 
@@ -55,7 +56,8 @@ static struct TextureFormat texFormat[] =
     {4, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_FLOAT},       // DEPTH-STENCIL
     {4, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT},             // INT
     {2, GL_RG16UI, GL_RG_INTEGER, GL_UNSIGNED_SHORT},           // SHORT
-    {1, GL_R8UI, GL_RED, GL_UNSIGNED_BYTE}                      // BYTE 
+    {1, GL_R8UI, GL_RED, GL_UNSIGNED_BYTE},                     // BYTE 
+    {8, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT}                     // HALF
 };
 
 static int texture_pitch(struct Texture *texture);
@@ -266,6 +268,7 @@ uint32_t texture_getpixel(struct Texture *texture, int x, int y)
     } else 
     {
         assert(texture->options & TEXTURE_SOFTWARE);
+        assert(texture_depth(texture) <= sizeof(uint32_t) && "use texture_getpixelf");
         ret = ((uint8_t*) texture->read->bits) + 
                 texture_depth(texture) * x + texture_pitch(texture) * y;
     }
@@ -274,6 +277,7 @@ uint32_t texture_getpixel(struct Texture *texture, int x, int y)
 
 void texture_setpixel(struct Texture *texture, int x, int y, uint32_t val)
 {
+    assert(texture_depth(texture) <= sizeof(uint32_t) && "use texture_setpixelf");
     if(texture->options & TEXTURE_HARDWARE && !(texture->options & TEXTURE_SOFTWARE))
     {
         glTexSubImage2D(
@@ -295,3 +299,121 @@ void texture_setpixel(struct Texture *texture, int x, int y, uint32_t val)
         memcpy(pxl, &val, texture_depth(texture));
     }
 }
+
+/**
+ * reads an RGBA pixel from a TEXTURE_HALF texture, as floats
+ */
+void texture_getpixelf(struct Texture *texture, int x, int y, float rgba[4])
+{
+    assert(texture->format == TEXTURE_HALF);
+    assert(texture->options & TEXTURE_SOFTWARE && "cannot get pixel from hardware texture");
+    half *pxl = (half*) (((uint8_t*) texture->read->bits) +
+            texture_depth(texture) * x + texture_pitch(texture) * y);
+    f16_to_f32_n(pxl, rgba, 4);
+}
+
+/**
+ * writes an RGBA pixel to a TEXTURE_HALF texture. values are rounded to the
+ * nearest half; anything past 65504 becomes infinity
+ */
+void texture_setpixelf(struct Texture *texture, int x, int y, const float rgba[4])
+{
+    assert(texture->format == TEXTURE_HALF);
+    half val[4];
+    f32_to_f16_n(rgba, val, 4);
+    if(texture->options & TEXTURE_HARDWARE && !(texture->options & TEXTURE_SOFTWARE))
+    {
+        glTexSubImage2D(
+                texture->gltype,
+                0,
+                x,
+                y,
+                1,
+                1,
+                texture->fmt->format,
+                texture->fmt->type,
+                val
+                );
+    } else
+    {
+        assert(texture->options & TEXTURE_SOFTWARE);
+        uint8_t *pxl = ((uint8_t*) texture->write->bits) +
+                texture_depth(texture) * x + texture_pitch(texture) * y;
+        memcpy(pxl, val, sizeof(val));
+    }
+}
+
+/**
+ * writes a row of generated noise into the write buffer of a texture, as
+ * gray in its format
+ */
+static void texture_storenoise(void *arg, int x, int y, int n, const float *vals)
+{
+    struct Texture *texture = arg;
+    uint8_t *pxl = ((uint8_t*) texture->write->bits) +
+            texture_depth(texture) * x + texture_pitch(texture) * y;
+    int i;
+    switch(texture->format)
+    {
+        case TEXTURE_RGBA:
+            for(i = 0; i < n; i++)
+            {
+                uint8_t b = noise_tobyte(vals[i]);
+                pxl[i * 4 + 0] = b;
+                pxl[i * 4 + 1] = b;
+                pxl[i * 4 + 2] = b;
+                pxl[i * 4 + 3] = 0xff;
+            }
+            break;
+        case TEXTURE_RGB:
+            for(i = 0; i < n; i++)
+            {
+                uint8_t b = noise_tobyte(vals[i]);
+                pxl[i * 3 + 0] = b;
+                pxl[i * 3 + 1] = b;
+                pxl[i * 3 + 2] = b;
+            }
+            break;
+        case TEXTURE_STENCIL:
+        case TEXTURE_BYTE:
+            for(i = 0; i < n; i++)
+            {
+                pxl[i] = noise_tobyte(vals[i]);
+            }
+            break;
+        case TEXTURE_DEPTH:
+            memcpy(pxl, vals, sizeof(float) * n);
+            break;
+        case TEXTURE_HALF:
+        {
+            float rgba[4 * n];
+            for(i = 0; i < n; i++)
+            {
+                rgba[i * 4 + 0] = vals[i];
+                rgba[i * 4 + 1] = vals[i];
+                rgba[i * 4 + 2] = vals[i];
+                rgba[i * 4 + 3] = 1.0f;
+            }
+            f32_to_f16_n(rgba, (half*) pxl, 4 * n);
+            break;
+        }
+    }
+}
+
+/**
+ * fills the write buffer of a software texture with noise, a gray value in
+ * its format. Byte formats map [-1, 1] to [0, 255], float formats store the
+ * noise as is. 'type' is one of Noise_Type, with 'n' octaves, and pixel (i, j)
+ * samples (x0 + i * scale, y0 + j * scale). The image is split into tiles
+ * across the pool set with noise_threadpool. Commit the texture to upload it
+ */
+void texture_noise(struct Texture *texture, const struct NoiseContext *ctx, int type, int n,
+        float x0, float y0, float scale)
+{
+    assert(texture->options & TEXTURE_SOFTWARE);
+    assert(texture->format == TEXTURE_RGBA || texture->format == TEXTURE_RGB ||
+           texture->format == TEXTURE_STENCIL || texture->format == TEXTURE_BYTE ||
+           texture->format == TEXTURE_DEPTH || texture->format == TEXTURE_HALF);
+    noise2_generate(ctx, type, n, x0, y0, scale, scale, texture->w, texture->h,
+            texture_storenoise, texture);
+}
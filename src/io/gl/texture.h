@@ -30,10 +30,12 @@ enum Texture_Format
     TEXTURE_DEPTH_STENCIL   = 4,
     TEXTURE_INT             = 5,
     TEXTURE_SHORT           = 6,
-    TEXTURE_BYTE            = 7
+    TEXTURE_BYTE            = 7,
+    TEXTURE_HALF            = 8  ///< RGBA, 16 bit float per channel (HDR)
 };
 
 struct TextureFormat;
+struct NoiseContext;
 
 typedef struct Texture_Buffer 
 {
@@ -67,5 +69,9 @@ void texture_flip(struct Texture *texture);
 void texture_fill(struct Texture *texture, uint32_t color); //TODO: inconsistant with lighting float color
 uint32_t texture_getpixel(struct Texture *texture, int x, int y);
 void texture_setpixel(struct Texture *texture, int x, int y, uint32_t val);
+void texture_getpixelf(struct Texture *texture, int x, int y, float rgba[4]);
+void texture_setpixelf(struct Texture *texture, int x, int y, const float rgba[4]);
+void texture_noise(struct Texture *texture, const struct NoiseContext *ctx, int type, int n,
+        float x0, float y0, float scale);
 
 #endif
@@ -0,0 +1,67 @@
+/**
+ * cpu.c
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "cpu.h"
+
+static int features = -1;
+static int disabled = 0;
+
+static int cpu_detect(void)
+{
+    int ret = 0;
+#if CPU_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2"))   ret |= CPU_SSE2;
+    if(__builtin_cpu_supports("sse4.1")) ret |= CPU_SSE41;
+    if(__builtin_cpu_supports("avx"))    ret |= CPU_AVX;
+    if(__builtin_cpu_supports("avx2"))   ret |= CPU_AVX2;
+    if(__builtin_cpu_supports("fma"))    ret |= CPU_FMA;
+
+    // older compilers have no builtin for F16C, query cpuid leaf 1 directly
+    unsigned int eax, ebx, ecx, edx;
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_F16C))
+    {
+        ret |= CPU_F16C;
+    }
+#endif
+    return ret;
+}
+
+/**
+ * retrieves the bitmask of processor features (CPU_*) usable by the library.
+ * detection is done once, on the first call
+ */
+int cpu_features(void)
+{
+    if(features < 0)
+    {
+        features = cpu_detect();
+    }
+    return features & ~disabled;
+}
+
+/**
+ * @returns true if all of the features in the 'features' mask are available
+ */
+bool cpu_has(int f)
+{
+    return (cpu_features() & f) == f;
+}
+
+/**
+ * prevents the SIMD kernels from using the features in the given mask.
+ * passing 0 re-enables everything. Useful to compare kernels against the
+ * scalar paths
+ */
+void cpu_disable(int f)
+{
+    disabled = f;
+}
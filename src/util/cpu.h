@@ -0,0 +1,43 @@
+/**
+ * cpu.h
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * runtime detection of processor features, used to select SIMD kernels
+ */
+
+#ifndef _CPU_H
+#define _CPU_H
+
+#include <stdbool.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPU_X86 1
+#else
+#define CPU_X86 0
+#endif
+
+#define CPU_SSE2    0x01
+#define CPU_SSE41   0x02
+#define CPU_AVX     0x04
+#define CPU_AVX2    0x08
+#define CPU_FMA     0x10
+#define CPU_F16C    0x20
+
+/*
+ * marks a function as compiled for an instruction set extension (eg. "avx2"),
+ * so a kernel can be built without raising the baseline flags of the library.
+ * such a function may only be called after checking cpu_has()
+ */
+#if CPU_X86
+#define CPU_TARGET(t) __attribute__((target(t)))
+#else
+#define CPU_TARGET(t)
+#endif
+
+int  cpu_features(void);
+bool cpu_has(int features);
+void cpu_disable(int features);
+
+#endif
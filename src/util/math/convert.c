@@ -13,6 +13,24 @@
 #define M_PI 3.14159265358979323846
 #endif
 
+/*
+ * define FAST_TRIG to convert angles with the fast approximations from 
+ * scalar.h instead of libm
+ */
+#ifdef FAST_TRIG
+#define CONV_SIN    fsin
+#define CONV_COS    fcos
+#define CONV_ASIN   fasin
+#define CONV_ACOS   facos
+#define CONV_ATAN2  fatan2
+#else
+#define CONV_SIN    sin
+#define CONV_COS    cos
+#define CONV_ASIN   asin
+#define CONV_ACOS   acos
+#define CONV_ATAN2  atan2
+#endif
+
 float degrees_to_radians(float d)
 {
     return (d * M_PI / 180.0);
@@ -106,12 +124,12 @@ quat mat4_to_quaternion(mat4 m)
 quat angles_to_quaternion(angles a)
 {
     quat ret;
-    float sp = sin(a[PITCH] / 2.0f); 
-    float cp = cos(a[PITCH] / 2.0f);
-    float sy = sin(a[YAW] / 2.0f); 
-    float cy = cos(a[YAW] / 2.0f);
-    float sr = sin(a[ROLL] / 2.0f); 
-    float cr = cos(a[ROLL] / 2.0f);
+    float sp = CONV_SIN(a[PITCH] / 2.0f); 
+    float cp = CONV_COS(a[PITCH] / 2.0f);
+    float sy = CONV_SIN(a[YAW] / 2.0f); 
+    float cy = CONV_COS(a[YAW] / 2.0f);
+    float sr = CONV_SIN(a[ROLL] / 2.0f); 
+    float cr = CONV_COS(a[ROLL] / 2.0f);
 
     ret.w = cp * cy * cr + sp * sy * sr;
     ret.x = sp * cy * cr - cp * sy * sr;
@@ -122,21 +140,21 @@ quat angles_to_quaternion(angles a)
 
 void quaternion_to_angles(quaternion q, angles a)
 {
-    a[PITCH]    = atan2(2.0f * q.w * q.x + q.y * q.z,
-                        1.0f - (2.0f * (q.x * q.x + q.y * q.y)));
-    a[YAW]      = asin(2.0f * (q.w * q.y - q.z * q.x));
-    a[ROLL]    = atan2(2.0f * q.w * q.z + q.x * q.y,
-                        1.0f - (2.0f * (q.y * q.y + q.z * q.z)));
+    a[PITCH]    = CONV_ATAN2(2.0f * q.w * q.x + q.y * q.z,
+                             1.0f - (2.0f * (q.x * q.x + q.y * q.y)));
+    a[YAW]      = CONV_ASIN(2.0f * (q.w * q.y - q.z * q.x));
+    a[ROLL]    = CONV_ATAN2(2.0f * q.w * q.z + q.x * q.y,
+                             1.0f - (2.0f * (q.y * q.y + q.z * q.z)));
 }
 
 void angles_to_mat4(angles a, mat4 m)
 {
-    float sp = sin(a[PITCH]); 
-    float cp = cos(a[PITCH]);
-    float sy = sin(a[YAW]); 
-    float cy = cos(a[YAW]);
-    float sr = sin(a[ROLL]); 
-    float cr = cos(a[ROLL]);
+    float sp = CONV_SIN(a[PITCH]); 
+    float cp = CONV_COS(a[PITCH]);
+    float sy = CONV_SIN(a[YAW]); 
+    float cy = CONV_COS(a[YAW]);
+    float sr = CONV_SIN(a[ROLL]); 
+    float cr = CONV_COS(a[ROLL]);
 
     m[MAT_XX] = cy * cr;
     m[MAT_XY] = -cy * sr;
@@ -161,9 +179,9 @@ void angles_to_mat4(angles a, mat4 m)
 
 void mat4_to_angles(mat4 m, angles a)
 {
-    a[PITCH]    = atan2(m[MAT_XZ], m[MAT_YZ]);
-    a[YAW]      = acos(m[MAT_ZZ]); //TODO: if MAT_ZZ == 0
-    a[ROLL]     = -atan2(m[MAT_ZX], m[MAT_ZY]);
+    a[PITCH]    = CONV_ATAN2(m[MAT_XZ], m[MAT_YZ]);
+    a[YAW]      = CONV_ACOS(m[MAT_ZZ]); //TODO: if MAT_ZZ == 0
+    a[ROLL]     = -CONV_ATAN2(m[MAT_ZX], m[MAT_ZY]);
 }
 
 
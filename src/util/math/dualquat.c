@@ -0,0 +1,334 @@
+/**
+ * dualquat.c
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "util/cpu.h"
+#include "scalar.h"
+#include "dualquat.h"
+
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * the identity transform, real (1,0,0,0) and dual 0
+ */
+dualquat dualquat_identity(void)
+{
+    dualquat ret;
+    ret.real = quaternion_identity();
+    ret.dual = quaternion_set(0.0f, 0.0f, 0.0f, 0.0f);
+    return ret;
+}
+
+/**
+ * the transform that rotates by the unit quaternion 'rotation', then
+ * translates by 'translation'
+ */
+dualquat dualquat_set(const quat *rotation, const vec3 *translation)
+{
+    dualquat ret;
+    ret.real = *rotation;
+    ret.dual = quaternion_set(0.0f, 0.0f, 0.0f, 0.0f);
+    dualquat_translatep(&ret, translation->x, translation->y, translation->z);
+    return ret;
+}
+
+/**
+ * splits a unit dual quaternion back into its rotation and translation.
+ * the inverse of dualquat_set
+ */
+void dualquat_get(const dualquat *dq, quat *rotation, vec3 *translation)
+{
+    *rotation = dq->real;
+    *translation = dualquat_translationp(dq);
+}
+
+/**
+ * the translation of a unit dual quaternion, 2 * dual * conjugate(real)
+ */
+vec3 dualquat_translationp(const dualquat *dq)
+{
+    const quat *r = &dq->real;
+    const quat *d = &dq->dual;
+    vec3 ret;
+    ret.x = 2.0f * (r->w * d->x - d->w * r->x + r->y * d->z - r->z * d->y);
+    ret.y = 2.0f * (r->w * d->y - d->w * r->y + r->z * d->x - r->x * d->z);
+    ret.z = 2.0f * (r->w * d->z - d->w * r->z + r->x * d->y - r->y * d->x);
+    return ret;
+}
+
+/**
+ * the quaternion product a * b, summed in the same order as the SSE2 version
+ */
+static inline quat dualquat_qmult(const quat *a, const quat *b)
+{
+    quat ret;
+    ret.x = a->w * b->x + a->x * b->w + a->y * b->z - a->z * b->y;
+    ret.y = a->w * b->y - a->x * b->z + a->y * b->w + a->z * b->x;
+    ret.z = a->w * b->z + a->x * b->y - a->y * b->x + a->z * b->w;
+    ret.w = a->w * b->w - a->x * b->x - a->y * b->y - a->z * b->z;
+    return ret;
+}
+
+#if CPU_X86
+/**
+ * a * b, with the quaternions as (x, y, z, w) in lanes 0 to 3
+ */
+static inline CPU_TARGET("sse2") __m128 dualquat_qmult_sse2(__m128 a, __m128 b)
+{
+    const __m128 sx = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0, 0x80000000, 0));
+    const __m128 sy = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0x80000000, 0, 0));
+    const __m128 sz = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0, 0, 0x80000000));
+    __m128 ret = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b);
+    __m128 bx = _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 1, 2, 3)), sx);
+    __m128 by = _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2)), sy);
+    __m128 bz = _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1)), sz);
+    ret = _mm_add_ps(ret, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), bx));
+    ret = _mm_add_ps(ret, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), by));
+    ret = _mm_add_ps(ret, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), bz));
+    return ret;
+}
+
+static CPU_TARGET("sse2") void dualquat_multp_sse2(const dualquat *a, const dualquat *b, dualquat *dst)
+{
+    __m128 ar = _mm_loadu_ps(a->real.v);
+    __m128 ad = _mm_loadu_ps(a->dual.v);
+    __m128 br = _mm_loadu_ps(b->real.v);
+    __m128 bd = _mm_loadu_ps(b->dual.v);
+    _mm_storeu_ps(dst->real.v, dualquat_qmult_sse2(ar, br));
+    _mm_storeu_ps(dst->dual.v, _mm_add_ps(dualquat_qmult_sse2(ar, bd), dualquat_qmult_sse2(ad, br)));
+}
+#endif
+
+/**
+ * composes two transforms, the result applies 'b' then 'a'. The same order as
+ * mat4_mult(a, b), 'a' is the parent
+ */
+dualquat dualquat_multp(const dualquat *a, const dualquat *b)
+{
+    dualquat ret;
+#if CPU_X86
+    if(cpu_has(CPU_SSE2))
+    {
+        dualquat_multp_sse2(a, b, &ret);
+        return ret;
+    }
+#endif
+    quat rd = dualquat_qmult(&a->real, &b->dual);
+    quat dr = dualquat_qmult(&a->dual, &b->real);
+    ret.real = dualquat_qmult(&a->real, &b->real);
+    ret.dual = vec4_addp(&rd, &dr);
+    return ret;
+}
+
+/**
+ * applies a translation after the current transform, like mat4_translate
+ */
+void dualquat_translatep(dualquat *dq, float x, float y, float z)
+{
+    // dual += (t * real) / 2, t = (0, x, y, z)
+    const quat *r = &dq->real;
+    x *= 0.5f;
+    y *= 0.5f;
+    z *= 0.5f;
+    dq->dual.w += -x * r->x - y * r->y - z * r->z;
+    dq->dual.x +=  x * r->w + y * r->z - z * r->y;
+    dq->dual.y +=  y * r->w + z * r->x - x * r->z;
+    dq->dual.z +=  z * r->w + x * r->y - y * r->x;
+}
+
+/**
+ * scales 'dq' to unit length, and removes the part of the dual that is not
+ * orthogonal to the real, so 'dq' is a rigid transform again. Needed after
+ * blending, or to stop rounding from building up over long chains
+ */
+void dualquat_normalizep(dualquat *dq)
+{
+    float lensq = quaternion_lensqp(&dq->real);
+    assert(lensq > FLT_MIN && "cannot normalize a zero rotation");
+    float inv = 1.0f / sqrt(lensq);
+    vec4_scalep(&dq->real, inv);
+    vec4_scalep(&dq->dual, inv);
+
+    quat proj = dq->real;
+    vec4_scalep(&proj, quaternion_dotp(&dq->real, &dq->dual));
+    dq->dual = quaternion_subp(&dq->dual, &proj);
+}
+
+/**
+ * the inverse of a unit dual quaternion, conjugating both parts
+ */
+dualquat dualquat_inversep(const dualquat *dq)
+{
+    dualquat ret;
+    ret.real = quaternion_conjugatep(&dq->real);
+    ret.dual = quaternion_conjugatep(&dq->dual);
+    return ret;
+}
+
+/**
+ * dual quaternion linear blending (DLB) of 'n' transforms, as used when
+ * skinning a vertex with several bones. Each transform is flipped into the
+ * same hemisphere as the first, so blends take the shortest path. The
+ * weights do not need to add to 1
+ */
+dualquat dualquat_blend(const dualquat *dqs, const float *weights, int n)
+{
+    assert(n > 0);
+    dualquat ret;
+    memset(&ret, 0, sizeof(dualquat));
+
+    int i, j;
+    for(i = 0; i < n; i++)
+    {
+        float w = weights[i];
+        if(quaternion_dotp(&dqs[0].real, &dqs[i].real) < 0.0f)
+        {
+            w = -w;
+        }
+        for(j = 0; j < 4; j++)
+        {
+            ret.real.v[j] += w * dqs[i].real.v[j];
+            ret.dual.v[j] += w * dqs[i].dual.v[j];
+        }
+    }
+    dualquat_normalizep(&ret);
+    return ret;
+}
+
+/**
+ * transforms the point 'p' by the unit dual quaternion 'dq'
+ */
+vec3 dualquat_transformp(const dualquat *dq, const vec3 *p)
+{
+    const quat *r = &dq->real;
+    vec3 t = dualquat_translationp(dq);
+
+    // p' = p + 2 * r.xyz x (r.xyz x p + r.w * p) + t
+    vec3 a;
+    a.x = r->y * p->z - r->z * p->y + r->w * p->x;
+    a.y = r->z * p->x - r->x * p->z + r->w * p->y;
+    a.z = r->x * p->y - r->y * p->x + r->w * p->z;
+
+    vec3 ret;
+    ret.x = p->x + 2.0f * (r->y * a.z - r->z * a.y) + t.x;
+    ret.y = p->y + 2.0f * (r->z * a.x - r->x * a.z) + t.y;
+    ret.z = p->z + 2.0f * (r->x * a.y - r->y * a.x) + t.z;
+    return ret;
+}
+
+/**
+ * transforms an array of 'n' points by 'dq'. Works like mat4_transform_points:
+ * the first 3 floats of each element of 'in' are read, and the result written
+ * to the matching element of 'out'
+ * @param stride the distance in bytes between elements, in both 'in' and 'out'.
+ * If 0, the points are assumed to be tightly packed (3 floats each)
+ */
+void dualquat_transform_points(const dualquat *dq, const float *in, float *out,
+                               size_t n, size_t stride)
+{
+    const char *src = (const char*) in;
+    char *dst = (char*) out;
+    if(!stride)
+    {
+        stride = sizeof(float) * 3;
+    }
+
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        const float *p = (const float*) (src + i * stride);
+        float *o = (float*) (dst + i * stride);
+        vec3 v = vec3_setp(p[0], p[1], p[2]);
+        v = dualquat_transformp(dq, &v);
+        o[0] = v.x;
+        o[1] = v.y;
+        o[2] = v.z;
+    }
+}
+
+/**
+ * converts a unit dual quaternion to an affine matrix (@see mat4_isaffine).
+ * the rotation part matches quaternion_to_mat4
+ */
+void dualquat_to_mat4(const dualquat *dq, mat4 m)
+{
+    const quat *q = &dq->real;
+    float xx = q->x * q->x, yy = q->y * q->y, zz = q->z * q->z;
+    float xy = q->x * q->y, xz = q->x * q->z, yz = q->y * q->z;
+    float wx = q->w * q->x, wy = q->w * q->y, wz = q->w * q->z;
+    vec3 t = dualquat_translationp(dq);
+
+    m[MAT_XX] = 1.0f - 2.0f * (yy + zz);
+    m[MAT_XY] = 2.0f * (xy + wz);
+    m[MAT_XZ] = 2.0f * (xz - wy);
+    m[MAT_XW] = 0.0f;
+
+    m[MAT_YX] = 2.0f * (xy - wz);
+    m[MAT_YY] = 1.0f - 2.0f * (xx + zz);
+    m[MAT_YZ] = 2.0f * (yz + wx);
+    m[MAT_YW] = 0.0f;
+
+    m[MAT_ZX] = 2.0f * (xz + wy);
+    m[MAT_ZY] = 2.0f * (yz - wx);
+    m[MAT_ZZ] = 1.0f - 2.0f * (xx + yy);
+    m[MAT_ZW] = 0.0f;
+
+    m[MAT_WX] = t.x;
+    m[MAT_WY] = t.y;
+    m[MAT_WZ] = t.z;
+    m[MAT_WW] = 1.0f;
+}
+
+/**
+ * converts an affine matrix with no scale or shear (rotation and translation
+ * only) to a unit dual quaternion. the inverse of dualquat_to_mat4
+ */
+dualquat mat4_to_dualquat(mat4 m)
+{
+    quat q;
+    float trace = m[MAT_XX] + m[MAT_YY] + m[MAT_ZZ];
+
+    // build from the largest of w, x, y, z to avoid dividing by a small value
+    if(trace > 0.0f)
+    {
+        float s = 0.5f / sqrt(trace + 1.0f);
+        q.w = 0.25f / s;
+        q.x = (m[MAT_YZ] - m[MAT_ZY]) * s;
+        q.y = (m[MAT_ZX] - m[MAT_XZ]) * s;
+        q.z = (m[MAT_XY] - m[MAT_YX]) * s;
+    } else if(m[MAT_XX] > m[MAT_YY] && m[MAT_XX] > m[MAT_ZZ])
+    {
+        float s = 0.5f / sqrt(1.0f + m[MAT_XX] - m[MAT_YY] - m[MAT_ZZ]);
+        q.w = (m[MAT_YZ] - m[MAT_ZY]) * s;
+        q.x = 0.25f / s;
+        q.y = (m[MAT_YX] + m[MAT_XY]) * s;
+        q.z = (m[MAT_ZX] + m[MAT_XZ]) * s;
+    } else if(m[MAT_YY] > m[MAT_ZZ])
+    {
+        float s = 0.5f / sqrt(1.0f - m[MAT_XX] + m[MAT_YY] - m[MAT_ZZ]);
+        q.w = (m[MAT_ZX] - m[MAT_XZ]) * s;
+        q.x = (m[MAT_YX] + m[MAT_XY]) * s;
+        q.y = 0.25f / s;
+        q.z = (m[MAT_ZY] + m[MAT_YZ]) * s;
+    } else
+    {
+        float s = 0.5f / sqrt(1.0f - m[MAT_XX] - m[MAT_YY] + m[MAT_ZZ]);
+        q.w = (m[MAT_XY] - m[MAT_YX]) * s;
+        q.x = (m[MAT_ZX] + m[MAT_XZ]) * s;
+        q.y = (m[MAT_ZY] + m[MAT_YZ]) * s;
+        q.z = 0.25f / s;
+    }
+    quaternion_normalizep(&q);
+
+    vec3 t = vec3_setp(m[MAT_WX], m[MAT_WY], m[MAT_WZ]);
+    return dualquat_set(&q, &t);
+}
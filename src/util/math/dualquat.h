@@ -0,0 +1,56 @@
+/**
+ * dualquat.h
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * unit dual quaternions, rigid transforms (rotation and translation) in 8
+ * floats. They compose like affine mat4s, and blend without the volume loss
+ * of blending matrices, which makes them a good fit for skinning
+ */
+
+#ifndef _DUALQUAT_H
+#define _DUALQUAT_H
+
+#include <stddef.h>
+
+#include "vec.h"
+#include "matrix.h"
+
+/**
+ * the transform 'rotate by real, then translate by t' is stored as
+ * real + e * dual, where dual = (t * real) / 2 and t is the pure quaternion
+ * (0, tx, ty, tz)
+ */
+typedef struct dualquat
+{
+    quat real;  ///< the rotation
+    quat dual;  ///< half the translation, times the rotation
+} dualquat;
+
+dualquat    dualquat_identity(void);
+dualquat    dualquat_set(const quat *rotation, const vec3 *translation);
+void        dualquat_get(const dualquat *dq, quat *rotation, vec3 *translation);
+vec3        dualquat_translationp(const dualquat *dq);
+
+dualquat    dualquat_multp(const dualquat *a, const dualquat *b);
+void        dualquat_translatep(dualquat *dq, float x, float y, float z);
+void        dualquat_normalizep(dualquat *dq);
+dualquat    dualquat_inversep(const dualquat *dq);
+dualquat    dualquat_blend(const dualquat *dqs, const float *weights, int n);
+
+vec3        dualquat_transformp(const dualquat *dq, const vec3 *p);
+void        dualquat_transform_points(const dualquat *dq, const float *in, float *out,
+                                      size_t n, size_t stride);
+
+void        dualquat_to_mat4(const dualquat *dq, mat4 m);
+dualquat    mat4_to_dualquat(mat4 m);
+
+#define dualquat_translation(dq)    dualquat_translationp(&(dq))
+#define dualquat_mult(a, b)         dualquat_multp(&(a), &(b))
+#define dualquat_translate(dq, x, y, z) dualquat_translatep(&(dq), x, y, z)
+#define dualquat_normalize(dq)      dualquat_normalizep(&(dq))
+#define dualquat_inverse(dq)        dualquat_inversep(&(dq))
+#define dualquat_transform(dq, p)   dualquat_transformp(&(dq), &(p))
+
+#endif
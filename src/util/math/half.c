@@ -0,0 +1,177 @@
+/**
+ * half.c
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ */
+
+#include "util/cpu.h"
+#include "half.h"
+
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
+union f32_bits
+{
+    float f;
+    uint32_t i;
+};
+
+/**
+ * converts a float to the nearest half (ties to even). Values too large for a 
+ * half become infinity, and values too small become subnormals or zero. NaNs
+ * keep their sign and top mantissa bits, and become quiet. the result is the 
+ * same as the F16C instruction set gives
+ */
+half f32_to_f16(float f)
+{
+    union f32_bits u;
+    u.f = f;
+    uint32_t sign = (u.i >> 16) & 0x8000;
+    uint32_t bits = u.i & 0x7FFFFFFF;
+    uint32_t h, rem, halfway;
+
+    if(bits >= 0x7F800000) // infinity or NaN
+    {
+        h = 0x7C00;
+        if(bits > 0x7F800000)
+        {
+            h |= 0x0200 | ((bits >> 13) & 0x03FF);
+        }
+        return sign | h;
+    }
+
+    if(bits >= 0x477FF000) // 65520 and up round past HALF_MAX
+    {
+        return sign | 0x7C00;
+    }
+
+    if(bits < 0x38800000) // below 2^-14, the smallest normal half
+    {
+        int shift = 126 - (int)(bits >> 23);
+        if(shift > 24)
+        {
+            return sign;
+        }
+        uint32_t m = (bits & 0x007FFFFF) | 0x00800000;
+        h = m >> shift;
+        rem = m & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    } else
+    {
+        h = (bits - 0x38000000) >> 13; // rebias the exponent from 127 to 15
+        rem = bits & 0x1FFF;
+        halfway = 0x1000;
+    }
+
+    // a carry out of the mantissa correctly bumps the exponent
+    if(rem > halfway || (rem == halfway && (h & 1)))
+    {
+        h++;
+    }
+    return sign | h;
+}
+
+/**
+ * converts a half to a float. every half is exactly representable as a float
+ */
+float f16_to_f32(half h)
+{
+    union f32_bits u;
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t e = (h >> 10) & 0x1F;
+    uint32_t m = h & 0x03FF;
+
+    if(e == 0x1F) // infinity or NaN
+    {
+        u.i = sign | 0x7F800000 | (m << 13) | (m ? 0x00400000 : 0);
+    } else if(e == 0)
+    {
+        if(m == 0)
+        {
+            u.i = sign;
+        } else // subnormal, normalize it
+        {
+            e = 113;
+            while(!(m & 0x0400))
+            {
+                m <<= 1;
+                e--;
+            }
+            u.i = sign | (e << 23) | ((m & 0x03FF) << 13);
+        }
+    } else
+    {
+        u.i = sign | ((e + 112) << 23) | (m << 13);
+    }
+    return u.f;
+}
+
+#if CPU_X86
+static CPU_TARGET("avx,f16c") void f32_to_f16_n_f16c(const float *src, half *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(&src[i]), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*) &dst[i], h);
+    }
+    for(; i < n; i++)
+    {
+        dst[i] = f32_to_f16(src[i]);
+    }
+}
+
+static CPU_TARGET("avx,f16c") void f16_to_f32_n_f16c(const half *src, float *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        __m128i h = _mm_loadu_si128((const __m128i*) &src[i]);
+        _mm256_storeu_ps(&dst[i], _mm256_cvtph_ps(h));
+    }
+    for(; i < n; i++)
+    {
+        dst[i] = f16_to_f32(src[i]);
+    }
+}
+#endif
+
+/**
+ * converts 'n' floats to halfs
+ */
+void f32_to_f16_n(const float *src, half *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_F16C | CPU_AVX))
+    {
+        f32_to_f16_n_f16c(src, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = f32_to_f16(src[i]);
+    }
+}
+
+/**
+ * converts 'n' halfs to floats
+ */
+void f16_to_f32_n(const half *src, float *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_F16C | CPU_AVX))
+    {
+        f16_to_f32_n_f16c(src, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = f16_to_f32(src[i]);
+    }
+}
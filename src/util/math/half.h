@@ -0,0 +1,33 @@
+/**
+ * half.h
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * IEEE 754 half precision (binary16) floating point storage
+ */
+
+#ifndef _HALF_H
+#define _HALF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * a half precision float, stored as its bits. 1 sign, 5 exponent and 10 
+ * mantissa bits; magnitudes up to 65504, with 11 bits of precision
+ */
+typedef uint16_t half;
+
+#define HALF_ZERO   ((half) 0x0000)
+#define HALF_ONE    ((half) 0x3C00)
+#define HALF_INF    ((half) 0x7C00)
+#define HALF_MAX    65504.0f
+
+half    f32_to_f16(float f);
+float   f16_to_f32(half h);
+
+void    f32_to_f16_n(const float *src, half *dst, size_t n);
+void    f16_to_f32_n(const half *src, float *dst, size_t n);
+
+#endif
@@ -0,0 +1,638 @@
+/**
+ * inline.h
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * opt-in header only versions of the small scalar, vec2, vec3, vec4,
+ * quaternion and mat4 functions. Including this header (before any other
+ * math header) replaces the out of line functions from scalar.c, vec.c and
+ * matrix.c with static inline functions of the same name and semantics, so
+ * hot loops can inline and vectorize them without link time optimization.
+ *
+ * the batch functions (*_n), quaternion_slerpp and the heavier mat4 functions
+ * (rotate, orient, inverse, ...) stay out of line, and are still declared.
+ * mat4_mult and mat4_mult_affine are the plain scalar versions here, the
+ * compiler vectorizes them for the target it is building for, instead of the
+ * run time CPU dispatch in matrix.c
+ */
+
+#ifndef _MATH_INLINE_H
+#define _MATH_INLINE_H
+
+#if defined(_SCALAR_H) || defined(_VEC_H_) || defined(_MATRIX_H)
+#error "util/math/inline.h must be included before scalar.h, vec.h and matrix.h"
+#endif
+
+#define MATH_INLINE 1
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "scalar.h"
+#include "vec.h"
+#include "matrix.h"
+
+/*
+ *************************************
+ * SCALAR
+ *************************************
+ */
+
+static inline bool feq(float a, float b)
+{
+    float ab = a-b;
+    return ab <= EPSILON && ab >= -EPSILON;
+}
+
+static inline int fcmp(float a, float b)
+{
+    int ret = 0;
+    if(feq(a, b))
+    {
+        ret = 0;
+    } else if(a < b)
+    {
+        ret = -1;
+    } else if(a > b)
+    {
+        ret = 1;
+    }
+    return ret;
+}
+
+static inline float fsq(float val)
+{
+    return val * val;
+}
+
+static inline float fclamp(float val, float a, float b)
+{
+    float ret = val;
+    if(val < a)
+    {
+        ret = a;
+    } else if (val > b)
+    {
+        ret = b;
+    }
+    return ret;
+}
+
+/*
+ *************************************
+ * 2 DIMENSIONAL FLOATING POINT VECTOR
+ *************************************
+ */
+
+static inline void vec2_set(vec2 a, float x, float y)
+{
+    a[X] = x;
+    a[Y] = y;
+}
+
+static inline void vec2_scale(vec2 a, float scale)
+{
+    a[X] *= scale;
+    a[Y] *= scale;
+}
+
+static inline void vec2_copy(const vec2 src, vec2 dst)
+{
+    dst[X] = src[X];
+    dst[Y] = src[Y];
+}
+
+static inline float vec2_dot(const vec2 a, const vec2 b)
+{
+    return a[X] * b[X] + a[Y] * b[Y];
+}
+
+static inline void vec2_add(const vec2 a, const vec2 b, vec2 dest)
+{
+    dest[X] = a[X] + b[X];
+    dest[Y] = a[Y] + b[Y];
+}
+
+static inline void vec2_sub(const vec2 a, const vec2 b, vec2 dest)
+{
+    dest[X] = a[X] - b[X];
+    dest[Y] = a[Y] - b[Y];
+}
+
+static inline float vec2_lensq(const vec2 a)
+{
+    return vec2_dot(a, a);
+}
+
+static inline void vec2_normalize(vec2 a)
+{
+    float sqrtsumInv = 1.0f / sqrt(vec2_lensq(a));
+    a[X] *= sqrtsumInv;
+    a[Y] *= sqrtsumInv;
+}
+
+/*
+ *************************************
+ * 3 DIMENSIONAL FLOATING POINT VECTOR
+ *************************************
+ */
+
+static inline vec3 vec3_setp(float x, float y, float z)
+{
+    vec3 ret;
+    ret.x = x;
+    ret.y = y;
+    ret.z = z;
+    return ret;
+}
+
+static inline vec3 vec3_copyp(const vec3 *src)
+{
+    return *src;
+}
+
+static inline bool vec3_eqp(const vec3 *a, const vec3 *b)
+{
+    return  feq(a->x, b->x) &&
+            feq(a->y, b->y) &&
+            feq(a->z, b->z);
+}
+
+static inline ivec3 vec3_cmpp(const vec3 *a, const vec3 *b)
+{
+    ivec3 cmp;
+    cmp.x = fcmp(a->x, b->x);
+    cmp.y = fcmp(a->y, b->y);
+    cmp.z = fcmp(a->z, b->z);
+    return cmp;
+}
+
+static inline float vec3_dotp(const vec3 *a, const vec3 *b)
+{
+    return a->x * b->x + a->y * b->y + a->z * b->z;
+}
+
+static inline float vec3_lensqp(const vec3 *a)
+{
+    return vec3_dotp(a, a);
+}
+
+static inline float vec3_lenp(const vec3 *a)
+{
+    return sqrt(vec3_lensqp(a));
+}
+
+static inline vec3 vec3_addp(const vec3 *a, const vec3 *b)
+{
+    vec3 ret;
+    ret.x = a->x + b->x;
+    ret.y = a->y + b->y;
+    ret.z = a->z + b->z;
+    return ret;
+}
+
+static inline vec3 vec3_subp(const vec3 *a, const vec3 *b)
+{
+    vec3 ret;
+    ret.x = a->x - b->x;
+    ret.y = a->y - b->y;
+    ret.z = a->z - b->z;
+    return ret;
+}
+
+static inline float vec3_distsqp(const vec3 *a, const vec3 *b)
+{
+    vec3 tmp = vec3_subp(a, b);
+    return vec3_lensqp(&tmp);
+}
+
+static inline void vec3_normalizep(vec3 *a)
+{
+    float sqsum = vec3_lensqp(a);
+    if(!feq(sqsum, 0.0f))
+    {
+        float sqrtsumInv = 1.0f / sqrt(sqsum);
+        a->x *= sqrtsumInv;
+        a->y *= sqrtsumInv;
+        a->z *= sqrtsumInv;
+    }
+}
+
+static inline void vec3_scalep(vec3 *a, float val)
+{
+    a->x *= val;
+    a->y *= val;
+    a->z *= val;
+}
+
+static inline vec3 vec3_crossp(const vec3 *a, const vec3 *b)
+{
+    vec3 ret;
+    ret.x = a->y * b->z - a->z * b->y;
+    ret.y = a->z * b->x - a->x * b->z;
+    ret.z = a->x * b->y - a->y * b->x;
+    return ret;
+}
+
+static inline vec3 vec3_projp(const vec3 *v, const vec3 *axis)
+{
+    vec3 ret = *axis;
+    float numer = vec3_dotp(v, axis);
+    float denom = vec3_dotp(axis, axis);
+    if(fabs(denom) > FLT_EPSILON)
+    {
+        vec3_scalep(&ret, numer / denom);
+    }
+    return ret;
+}
+
+static inline vec3 vec3_orthp(const vec3 *v, const vec3 *axis)
+{
+    vec3 ret = vec3_projp(v, axis);
+    return vec3_subp(v, &ret);
+}
+
+/*
+ *************************************
+ * 4 DIMENSIONAL FLOATING POINT VECTOR
+ *************************************
+ */
+
+static inline vec4 vec4_setp(float x, float y, float z, float w)
+{
+    vec4 a;
+    a.x = x;
+    a.y = y;
+    a.z = z;
+    a.w = w;
+    return a;
+}
+
+static inline vec4 vec4_copyp(const vec4 *src)
+{
+    return *src;
+}
+
+static inline vec4 vec4_addp(const vec4 *a, const vec4 *b)
+{
+    vec4 ret;
+    ret.x = a->x + b->x;
+    ret.y = a->y + b->y;
+    ret.z = a->z + b->z;
+    ret.w = a->w + b->w;
+    return ret;
+}
+
+static inline vec4 vec4_subp(const vec4 *a, const vec4 *b)
+{
+    vec4 ret;
+    ret.x = a->x - b->x;
+    ret.y = a->y - b->y;
+    ret.z = a->z - b->z;
+    ret.w = a->w - b->w;
+    return ret;
+}
+
+static inline float vec4_dotp(const vec4 *a, const vec4 *b)
+{
+    return a->x * b->x + a->y * b->y + a->z * b->z + a->w * b->w;
+}
+
+static inline float vec4_lensqp(const vec4 *a)
+{
+    return vec4_dotp(a, a);
+}
+
+static inline void vec4_normalizep(vec4 *a)
+{
+    float sqsum = vec4_lensqp(a);
+    if(!feq(sqsum, 0.0f))
+    {
+        float sqrtsumInv = 1.0f / sqrt(sqsum);
+        a->w *= sqrtsumInv;
+        a->x *= sqrtsumInv;
+        a->y *= sqrtsumInv;
+        a->z *= sqrtsumInv;
+    }
+}
+
+static inline vec4 vec4_normalizedp(vec4 *a)
+{
+    vec4 ret = vec4_setp(0.0f, 0.0f, 0.0f, 0.0f);
+    float sqsum = vec4_lensqp(a);
+    if(!feq(sqsum, 0.0f))
+    {
+        float sqrtsumInv = 1.0f / sqrt(sqsum);
+        ret.x = sqrtsumInv * a->x;
+        ret.y = sqrtsumInv * a->y;
+        ret.z = sqrtsumInv * a->z;
+        ret.w = sqrtsumInv * a->w;
+    }
+    return ret;
+}
+
+static inline void vec4_scalep(vec4 *a, const float scale)
+{
+    a->x *= scale;
+    a->y *= scale;
+    a->z *= scale;
+    a->w *= scale;
+}
+
+static inline vec4 vec4_projp(const vec4 *v, const vec4 *refaxis)
+{
+    vec4 ret = *refaxis;
+    float numer = vec4_dotp(v, refaxis);
+    float denom = vec4_dotp(refaxis, refaxis);
+    vec4_scalep(&ret, numer / denom);
+    return ret;
+}
+
+static inline vec4 vec4_orthp(const vec4 *v, const vec4 *refaxis)
+{
+    vec4 ret = vec4_projp(v, refaxis);
+    return vec4_subp(v, &ret);
+}
+
+/*
+ *************
+ * QUATERNIONS
+ *************
+ */
+
+// out of line, these are function pointers to the vec4 functions
+
+static inline quat quaternion_copyp(const quat *src)
+{
+    return vec4_copyp(src);
+}
+
+static inline float quaternion_dotp(const quat *a, const quat *b)
+{
+    return vec4_dotp(a, b);
+}
+
+static inline quat quaternion_addp(const quat *a, const quat *b)
+{
+    return vec4_addp(a, b);
+}
+
+static inline quat quaternion_subp(const quat *a, const quat *b)
+{
+    return vec4_subp(a, b);
+}
+
+static inline void quaternion_normalizep(quat *a)
+{
+    vec4_normalizep(a);
+}
+
+static inline float quaternion_lensqp(const quat *a)
+{
+    return vec4_lensqp(a);
+}
+
+static inline quat quaternion_set(float w, float x, float y, float z)
+{
+    quat ret;
+    ret.w = w;
+    ret.x = x;
+    ret.y = y;
+    ret.z = z;
+    return ret;
+}
+
+static inline quat quaternion_identity(void)
+{
+    return quaternion_set(1.0f, 0.0f, 0.0f, 0.0f);
+}
+
+static inline quat quaternion_set_rotation(float angle, vec3 axis)
+{
+    vec3_normalizep(&axis);
+    float scale = sin(angle / 2.0f);
+    return quaternion_set(cos(angle / 2.0f), axis.x * scale, axis.y * scale, axis.z * scale);
+}
+
+static inline quat quaternion_lerpp(quat *a, quat *b, float t)
+{
+    quat ret;
+    ret.x = a->x * t + b->x * (1.0 - t);
+    ret.y = a->y * t + b->y * (1.0 - t);
+    ret.z = a->z * t + b->z * (1.0 - t);
+    ret.w = a->w * t + b->w * (1.0 - t);
+    return ret;
+}
+
+static inline float quaternion_normp(const quat *a)
+{
+    return quaternion_dotp(a, a);
+}
+
+static inline quat quaternion_conjugatep(const quat *a)
+{
+    return quaternion_set(a->w, -a->x, -a->y, -a->z);
+}
+
+static inline quat quaternion_inversep(const quat *a)
+{
+    float inv_norm = 1.0f / quaternion_normp(a);
+    quat ret = quaternion_conjugatep(a);
+    ret.x *= inv_norm;
+    ret.y *= inv_norm;
+    ret.z *= inv_norm;
+    ret.w *= inv_norm;
+    return ret;
+}
+
+static inline quat quaternion_realp(const quat *a)
+{
+    return quaternion_set(a->w, 0.0f, 0.0f, 0.0f);
+}
+
+static inline quat quaternion_imaginaryp(const quat *a)
+{
+    return quaternion_set(0.0f, a->x, a->y, a->z);
+}
+
+static inline quat quaternion_multp(const quat *a, const quat *b)
+{
+    quat ret;
+    ret.w = a->w * b->w - a->x * b->x - a->y * b->y - a->z * b->z;
+    ret.x = a->w * b->x + a->x * b->w + a->y * b->z - a->z * b->y;
+    ret.y = a->w * b->y + a->y * b->w + a->z * b->x - a->x * b->z;
+    ret.z = a->w * b->z + a->z * b->w + a->x * b->y - a->y * b->x;
+    return ret;
+}
+
+static inline quat quaternion_divp(const quat *a, const quat *b)
+{
+    quat inv = quaternion_inversep(b);
+    return quaternion_multp(a, &inv);
+}
+
+static inline void quaternion_rotatep(quat *a, float angle, vec3 axis)
+{
+    quat tmp = quaternion_set_rotation(angle, axis);
+    *a = quaternion_multp(a, &tmp);
+}
+
+static inline quat quaternion_vecRotatep(quat *a, vec4 *b)
+{
+    quat con = quaternion_conjugatep(a);
+    quat ret = quaternion_multp(a, b);
+    return quaternion_multp(&ret, &con);
+}
+
+/*
+ *************************************
+ * 4x4 MATRIX
+ *************************************
+ */
+
+static inline void mat4_identity(mat4 m)
+{
+    m[MAT_XX] = m[MAT_YY] = m[MAT_ZZ] = m[MAT_WW] = 1.0f;
+    m[MAT_XY] = m[MAT_XZ] = m[MAT_XW] = 0.0f;
+    m[MAT_YX] = m[MAT_YZ] = m[MAT_YW] = 0.0f;
+    m[MAT_ZX] = m[MAT_ZY] = m[MAT_ZW] = 0.0f;
+    m[MAT_WX] = m[MAT_WY] = m[MAT_WZ] = 0.0f;
+}
+
+static inline void mat4_set(mat4 m, int i, int j, float val)
+{
+    m[4 * i + j] = val;
+}
+
+static inline void mat4_setv(mat4 m, vec4 x, vec4 y, vec4 z, vec4 w)
+{
+    m[MAT_XX] = x.x; m[MAT_XY] = x.y; m[MAT_XZ] = x.z; m[MAT_XW] = x.w;
+    m[MAT_YX] = y.x; m[MAT_YY] = y.y; m[MAT_YZ] = y.z; m[MAT_YW] = y.w;
+    m[MAT_ZX] = z.x; m[MAT_ZY] = z.y; m[MAT_ZZ] = z.z; m[MAT_ZW] = z.w;
+    m[MAT_WX] = w.x; m[MAT_WY] = w.y; m[MAT_WZ] = w.z; m[MAT_WW] = w.w;
+}
+
+static inline float mat4_get(mat4 m, int i, int j)
+{
+    return m[i * 4 + j];
+}
+
+static inline vec4 mat4_getv(mat4 m, int j)
+{
+    return vec4_setp(m[j], m[4 + j], m[8 + j], m[12 + j]);
+}
+
+static inline void mat4_copy(mat4 a, mat4 b)
+{
+    memcpy(b, a, sizeof(mat4));
+}
+
+static inline void mat4_transpose(mat4 m)
+{
+    int i, j;
+    for(i = 0; i < 4; i++)
+    {
+        for(j = i + 1; j < 4; j++)
+        {
+            float tmp = m[MAT_IDX(i, j)];
+            m[MAT_IDX(i, j)] = m[MAT_IDX(j, i)];
+            m[MAT_IDX(j, i)] = tmp;
+        }
+    }
+}
+
+static inline void mat4_scale(mat4 m, float sx, float sy, float sz)
+{
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        m[MAT_IDX(i, X)] *= sx;
+        m[MAT_IDX(i, Y)] *= sy;
+        m[MAT_IDX(i, Z)] *= sz;
+    }
+}
+
+static inline void mat4_scalev(mat4 m, float *v)
+{
+    mat4_scale(m, v[0], v[1], v[2]);
+}
+
+static inline void mat4_translate(mat4 m, float dx, float dy, float dz)
+{
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        float w = m[MAT_IDX(i, W)];
+        m[MAT_IDX(i, X)] += dx * w;
+        m[MAT_IDX(i, Y)] += dy * w;
+        m[MAT_IDX(i, Z)] += dz * w;
+    }
+}
+
+static inline void mat4_translatev(mat4 m, float *v)
+{
+    mat4_translate(m, v[0], v[1], v[2]);
+}
+
+/**
+ * same operation order as the scalar mat4_mult, so the result is bit identical
+ */
+static inline void mat4_mult(mat4 l, mat4 r, mat4 dst)
+{
+    mat4 ret;
+    int i, j;
+    for(i = 0; i < 4; i++)
+    {
+        for(j = 0; j < 4; j++)
+        {
+            ret[MAT_IDX(i, j)] = l[MAT_IDX(X, j)] * r[MAT_IDX(i, X)] +
+                                 l[MAT_IDX(Y, j)] * r[MAT_IDX(i, Y)] +
+                                 l[MAT_IDX(Z, j)] * r[MAT_IDX(i, Z)] +
+                                 l[MAT_IDX(W, j)] * r[MAT_IDX(i, W)];
+        }
+    }
+    memcpy(dst, ret, sizeof(mat4));
+}
+
+static inline bool mat4_isaffine(mat4 m)
+{
+    return feq(m[MAT_XW], 0.0f) && feq(m[MAT_YW], 0.0f) &&
+           feq(m[MAT_ZW], 0.0f) && feq(m[MAT_WW], 1.0f);
+}
+
+static inline void mat4_mult_affine(mat4 l, mat4 r, mat4 dst)
+{
+    mat4 ret;
+    int i, j;
+    for(i = 0; i < 4; i++)
+    {
+        for(j = 0; j < 3; j++)
+        {
+            ret[MAT_IDX(i, j)] = l[MAT_IDX(X, j)] * r[MAT_IDX(i, X)] +
+                                 l[MAT_IDX(Y, j)] * r[MAT_IDX(i, Y)] +
+                                 l[MAT_IDX(Z, j)] * r[MAT_IDX(i, Z)];
+        }
+        ret[MAT_IDX(i, W)] = 0.0f;
+    }
+    for(j = 0; j < 3; j++)
+    {
+        ret[MAT_IDX(W, j)] += l[MAT_IDX(W, j)];
+    }
+    ret[MAT_WW] = 1.0f;
+    memcpy(dst, ret, sizeof(mat4));
+}
+
+static inline void mat4_multVec(mat4 m, vec4 *v)
+{
+    vec4 temp;
+    temp.x = m[MAT_XX] * v->x + m[MAT_YX] * v->y + m[MAT_ZX] * v->z + m[MAT_WX] * v->w;
+    temp.y = m[MAT_XY] * v->x + m[MAT_YY] * v->y + m[MAT_ZY] * v->z + m[MAT_WY] * v->w;
+    temp.z = m[MAT_XZ] * v->x + m[MAT_YZ] * v->y + m[MAT_ZZ] * v->z + m[MAT_WZ] * v->w;
+    temp.w = m[MAT_XW] * v->x + m[MAT_YW] * v->y + m[MAT_ZW] * v->z + m[MAT_WW] * v->w;
+    *v = temp;
+}
+
+#endif
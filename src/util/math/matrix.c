@@ -14,10 +14,41 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "util/cpu.h"
+#include "util/threadpool.h"
 #include "scalar.h"
 #include "vec.h"
 #include "matrix.h"
 
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * the SIMD kernels load rows of 4 contiguous floats, which assumes the
+ * MAT_ROW_MAJOR layout
+ */
+#define MAT_SIMD (CPU_X86 && MAT_ROW_MAJOR)
+
+/*
+ * large NxN operations work on MATN_BLOCK x MATN_BLOCK tiles, so the rows of 
+ * each operand tile stay in cache while they are reused
+ */
+#define MATN_BLOCK 64
+
+/*
+ * NxN temporaries bigger than this many bytes are malloc'd instead of put on the stack
+ */
+#define MATN_ALLOCA_THRESH 16384
+#define MATN_TMP(sz) ((sz) > MATN_ALLOCA_THRESH ? malloc(sz) : alloca(sz))
+#define MATN_TMP_FREE(p, sz) if((sz) > MATN_ALLOCA_THRESH) free(p)
+
+/*
+ * minimum number of multiply-adds in a tile product before it is split across
+ * the thread pool set with matn_threadpool
+ */
+#define MATN_PARALLEL_THRESH (1 << 21)
+
 void mat3_identity(mat3 m)
 {
     m[0] = m[4] = m[8] = 1.0f;
@@ -177,18 +208,40 @@ void mat4_transpose(mat4 m)
     mat4_copy(tmp, m);
 }
 
+/**
+ * left multiplies 'r' by 'l', where 'l' only has a 3x3 rotation/scale part 
+ * (no translation or projection), as built by mat4_rotate. 'r' may be any matrix
+ */
+static void mat4_mult_linear(mat4 l, mat4 r)
+{
+    mat4 ret;
+    int i, j;
+    for(i = 0; i < 4; i++)
+    {
+        for(j = 0; j < 3; j++)
+        {
+            ret[MAT_IDX(i, j)] = l[MAT_IDX(X, j)] * r[MAT_IDX(i, X)] + 
+                                 l[MAT_IDX(Y, j)] * r[MAT_IDX(i, Y)] +
+                                 l[MAT_IDX(Z, j)] * r[MAT_IDX(i, Z)];
+        }
+        ret[MAT_IDX(i, W)] = r[MAT_IDX(i, W)];
+    }
+    memcpy(r, ret, sizeof(mat4));
+}
+
 /**
  * applys a scale operation to the current matrix
  */
 void mat4_scale(mat4 m, float sx, float sy, float sz)
 {
-    mat4 sMat;
-    mat4_identity(sMat);
-    sMat[MAT_XX] = sx;
-    sMat[MAT_YY] = sy;
-    sMat[MAT_ZZ] = sz;
-
-    mat4_mult(sMat, m, m);
+    // equivilent to mat4_mult(scale, m, m), which only scales the entries of m
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        m[MAT_IDX(i, X)] *= sx;
+        m[MAT_IDX(i, Y)] *= sy;
+        m[MAT_IDX(i, Z)] *= sz;
+    }
 }
 
 void mat4_scalev(mat4 m, float *v)
@@ -201,13 +254,16 @@ void mat4_scalev(mat4 m, float *v)
  */
 void mat4_translate(mat4 m, float dx, float dy, float dz)
 {
-    mat4 tMat;
-    mat4_identity(tMat);
-    tMat[MAT_WX] = dx;
-    tMat[MAT_WY] = dy;
-    tMat[MAT_WZ] = dz;
-
-    mat4_mult(tMat, m, m);
+    // equivilent to mat4_mult(translation, m, m), which only adds a multiple 
+    // of the W entries of m to the X, Y and Z entries
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        float w = m[MAT_IDX(i, W)];
+        m[MAT_IDX(i, X)] += dx * w;
+        m[MAT_IDX(i, Y)] += dy * w;
+        m[MAT_IDX(i, Z)] += dz * w;
+    }
 }
 
 void mat4_translatev(mat4 m, float *v)
@@ -245,7 +301,7 @@ void mat4_rotate(mat4 m, float angle, float rx, float ry, float rz)
     aux [MAT_XW] = aux[MAT_YW] = aux[MAT_ZW] = 0.0f;
     aux[MAT_WW] = 1.0f;
 
-    mat4_mult(aux, m, m);
+    mat4_mult_linear(aux, m);
 }
 
 void mat4_rotatev(mat4 m, float angle, float *v)
@@ -325,11 +381,86 @@ void mat4_frustum(mat4 m, float l, float r, float b, float t, float n, float f)
     mat4_mult(aux, m, m);
 }
 
+#if MAT_SIMD
+/*
+ * row i of l*r is the sum over k of l[i][k] * (row k of r). Summing in order
+ * k = 0..3 keeps the kernels bit-identical to the scalar product below
+ */
+static CPU_TARGET("sse2") void mat4_mult_sse2(mat4 l, mat4 r, mat4 dst)
+{
+    __m128 r0 = _mm_loadu_ps(&r[0]);
+    __m128 r1 = _mm_loadu_ps(&r[4]);
+    __m128 r2 = _mm_loadu_ps(&r[8]);
+    __m128 r3 = _mm_loadu_ps(&r[12]);
+    __m128 ret[4];
+
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        __m128 row = _mm_mul_ps(_mm_set1_ps(l[4 * i + 0]), r0);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(l[4 * i + 1]), r1));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(l[4 * i + 2]), r2));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(l[4 * i + 3]), r3));
+        ret[i] = row;
+    }
+
+    for(i = 0; i < 4; i++)
+    {
+        _mm_storeu_ps(&dst[4 * i], ret[i]);
+    }
+}
+
+/*
+ * copies a 4 float vector into both halves of a 256-bit register
+ */
+static inline CPU_TARGET("avx") __m256 avx_dup(__m128 v)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(v), v, 1);
+}
+
+/*
+ * same as above, two rows of the result at a time
+ */
+static CPU_TARGET("avx") void mat4_mult_avx(mat4 l, mat4 r, mat4 dst)
+{
+    __m256 r0 = avx_dup(_mm_loadu_ps(&r[0]));
+    __m256 r1 = avx_dup(_mm_loadu_ps(&r[4]));
+    __m256 r2 = avx_dup(_mm_loadu_ps(&r[8]));
+    __m256 r3 = avx_dup(_mm_loadu_ps(&r[12]));
+    __m256 l01 = _mm256_loadu_ps(&l[0]);
+    __m256 l23 = _mm256_loadu_ps(&l[8]);
+
+    __m256 ret01 = _mm256_mul_ps(_mm256_shuffle_ps(l01, l01, 0x00), r0);
+    ret01 = _mm256_add_ps(ret01, _mm256_mul_ps(_mm256_shuffle_ps(l01, l01, 0x55), r1));
+    ret01 = _mm256_add_ps(ret01, _mm256_mul_ps(_mm256_shuffle_ps(l01, l01, 0xAA), r2));
+    ret01 = _mm256_add_ps(ret01, _mm256_mul_ps(_mm256_shuffle_ps(l01, l01, 0xFF), r3));
+
+    __m256 ret23 = _mm256_mul_ps(_mm256_shuffle_ps(l23, l23, 0x00), r0);
+    ret23 = _mm256_add_ps(ret23, _mm256_mul_ps(_mm256_shuffle_ps(l23, l23, 0x55), r1));
+    ret23 = _mm256_add_ps(ret23, _mm256_mul_ps(_mm256_shuffle_ps(l23, l23, 0xAA), r2));
+    ret23 = _mm256_add_ps(ret23, _mm256_mul_ps(_mm256_shuffle_ps(l23, l23, 0xFF), r3));
+
+    _mm256_storeu_ps(&dst[0], ret01);
+    _mm256_storeu_ps(&dst[8], ret23);
+}
+#endif
+
 /**
  * multiplies the left matrix, and the right matrix, and stores in the right matrix
  */
 void mat4_mult(mat4 l, mat4 r, mat4 dst)
 {
+#if MAT_SIMD
+    if(cpu_has(CPU_AVX))
+    {
+        mat4_mult_avx(l, r, dst);
+        return;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        mat4_mult_sse2(l, r, dst);
+        return;
+    }
+#endif
     mat4 ret;
 
      ret[MAT_XX] = l[MAT_XX] * r[MAT_XX] + l[MAT_YX] * r[MAT_XY] + 
@@ -387,6 +518,129 @@ void mat4_pow(mat4 m, int pow)
     }
 }
 
+/**
+ * tests if 'm' is affine, that is the W row is (0, 0, 0, 1), and 'm' only 
+ * rotates, scales, shears and translates. Matrices built from mat4_identity, 
+ * mat4_translate, mat4_rotate, mat4_scale and mat4_orient are affine.
+ * A mat4 is a bare float[16] with no room for a flag, so callers that know
+ * their matrices are affine call the *_affine functions directly, and this
+ * is for asserting it
+ */
+bool mat4_isaffine(mat4 m)
+{
+    return feq(m[MAT_XW], 0.0f) && feq(m[MAT_YW], 0.0f) &&
+           feq(m[MAT_ZW], 0.0f) && feq(m[MAT_WW], 1.0f);
+}
+
+#if MAT_SIMD
+static CPU_TARGET("sse2") void mat4_mult_affine_sse2(mat4 l, mat4 r, mat4 dst)
+{
+    __m128 r0 = _mm_loadu_ps(&r[0]);
+    __m128 r1 = _mm_loadu_ps(&r[4]);
+    __m128 r2 = _mm_loadu_ps(&r[8]);
+    __m128 ret[3];
+
+    int i;
+    for(i = 0; i < 3; i++)
+    {
+        __m128 row = _mm_mul_ps(_mm_set1_ps(l[4 * i + 0]), r0);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(l[4 * i + 1]), r1));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(l[4 * i + 2]), r2));
+        ret[i] = _mm_add_ps(row, _mm_set_ps(l[4 * i + 3], 0.0f, 0.0f, 0.0f));
+    }
+
+    for(i = 0; i < 3; i++)
+    {
+        _mm_storeu_ps(&dst[4 * i], ret[i]);
+    }
+    _mm_storeu_ps(&dst[12], _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f));
+}
+#endif
+
+/**
+ * multiplies two affine matrices (@see mat4_isaffine) and stores the result in
+ * 'dst'. Equivilent to mat4_mult, skipping the products with the constant W row:
+ * 36 multiplies instead of 64. 'dst' may be 'l' or 'r'.
+ * Affinity is not checked, the W rows of 'l' and 'r' are ignored
+ */
+void mat4_mult_affine(mat4 l, mat4 r, mat4 dst)
+{
+#if MAT_SIMD
+    if(cpu_has(CPU_SSE2))
+    {
+        mat4_mult_affine_sse2(l, r, dst);
+        return;
+    }
+#endif
+
+    mat4 ret;
+
+    ret[MAT_XX] = l[MAT_XX] * r[MAT_XX] + l[MAT_YX] * r[MAT_XY] + l[MAT_ZX] * r[MAT_XZ];
+    ret[MAT_XY] = l[MAT_XY] * r[MAT_XX] + l[MAT_YY] * r[MAT_XY] + l[MAT_ZY] * r[MAT_XZ];
+    ret[MAT_XZ] = l[MAT_XZ] * r[MAT_XX] + l[MAT_YZ] * r[MAT_XY] + l[MAT_ZZ] * r[MAT_XZ];
+    ret[MAT_XW] = 0.0f;
+
+    ret[MAT_YX] = l[MAT_XX] * r[MAT_YX] + l[MAT_YX] * r[MAT_YY] + l[MAT_ZX] * r[MAT_YZ];
+    ret[MAT_YY] = l[MAT_XY] * r[MAT_YX] + l[MAT_YY] * r[MAT_YY] + l[MAT_ZY] * r[MAT_YZ];
+    ret[MAT_YZ] = l[MAT_XZ] * r[MAT_YX] + l[MAT_YZ] * r[MAT_YY] + l[MAT_ZZ] * r[MAT_YZ];
+    ret[MAT_YW] = 0.0f;
+
+    ret[MAT_ZX] = l[MAT_XX] * r[MAT_ZX] + l[MAT_YX] * r[MAT_ZY] + l[MAT_ZX] * r[MAT_ZZ];
+    ret[MAT_ZY] = l[MAT_XY] * r[MAT_ZX] + l[MAT_YY] * r[MAT_ZY] + l[MAT_ZY] * r[MAT_ZZ];
+    ret[MAT_ZZ] = l[MAT_XZ] * r[MAT_ZX] + l[MAT_YZ] * r[MAT_ZY] + l[MAT_ZZ] * r[MAT_ZZ];
+    ret[MAT_ZW] = 0.0f;
+
+    ret[MAT_WX] = l[MAT_XX] * r[MAT_WX] + l[MAT_YX] * r[MAT_WY] + l[MAT_ZX] * r[MAT_WZ] + l[MAT_WX];
+    ret[MAT_WY] = l[MAT_XY] * r[MAT_WX] + l[MAT_YY] * r[MAT_WY] + l[MAT_ZY] * r[MAT_WZ] + l[MAT_WY];
+    ret[MAT_WZ] = l[MAT_XZ] * r[MAT_WX] + l[MAT_YZ] * r[MAT_WY] + l[MAT_ZZ] * r[MAT_WZ] + l[MAT_WZ];
+    ret[MAT_WW] = 1.0f;
+
+    memcpy(dst, ret, sizeof(mat4));
+}
+
+/**
+ * inverts an affine matrix (@see mat4_isaffine), storing the result in 'dst'.
+ * The 3x3 rotation/scale part is inverted through its cofactors, and the 
+ * translation is the negated original translation, transformed by that inverse.
+ * Much cheaper than solving through mat4_lu. 'dst' may be 'm'
+ */
+void mat4_inverse_affine(mat4 m, mat4 dst)
+{
+    assert(mat4_isaffine(m));
+
+    // m transforms as p' = A * p + t
+    float a = m[MAT_XX], b = m[MAT_YX], c = m[MAT_ZX];
+    float d = m[MAT_XY], e = m[MAT_YY], f = m[MAT_ZY];
+    float g = m[MAT_XZ], h = m[MAT_YZ], i = m[MAT_ZZ];
+    float tx = m[MAT_WX], ty = m[MAT_WY], tz = m[MAT_WZ];
+
+    float co0 = e * i - f * h;
+    float co1 = f * g - d * i;
+    float co2 = d * h - e * g;
+    float det = a * co0 + b * co1 + c * co2;
+    assert(fabs(det) > FLT_MIN && "singular matrix");
+    float idet = 1.0f / det;
+
+    mat4 ret;
+    ret[MAT_XX] = co0 * idet;
+    ret[MAT_YX] = (c * h - b * i) * idet;
+    ret[MAT_ZX] = (b * f - c * e) * idet;
+    ret[MAT_XY] = co1 * idet;
+    ret[MAT_YY] = (a * i - c * g) * idet;
+    ret[MAT_ZY] = (c * d - a * f) * idet;
+    ret[MAT_XZ] = co2 * idet;
+    ret[MAT_YZ] = (b * g - a * h) * idet;
+    ret[MAT_ZZ] = (a * e - b * d) * idet;
+
+    ret[MAT_WX] = -(ret[MAT_XX] * tx + ret[MAT_YX] * ty + ret[MAT_ZX] * tz);
+    ret[MAT_WY] = -(ret[MAT_XY] * tx + ret[MAT_YY] * ty + ret[MAT_ZY] * tz);
+    ret[MAT_WZ] = -(ret[MAT_XZ] * tx + ret[MAT_YZ] * ty + ret[MAT_ZZ] * tz);
+
+    ret[MAT_XW] = ret[MAT_YW] = ret[MAT_ZW] = 0.0f;
+    ret[MAT_WW] = 1.0f;
+    memcpy(dst, ret, sizeof(mat4));
+}
+
 /**
  * multiplies a vector 'v' by matrix 'm' according to matrix math definitions
  */
@@ -400,6 +654,115 @@ void mat4_multVec(mat4 m, vec4 *v)
     memcpy(v, &temp, sizeof(vec4));
 }
 
+#if MAT_SIMD
+static CPU_TARGET("sse2") void mat4_transform_points_sse2(mat4 m, const char *in, char *out, 
+                                                          size_t n, size_t stride)
+{
+    // columns of m, so that m * (x, y, z, 1) = c0 * x + c1 * y + c2 * z + c3
+    __m128 c0 = _mm_loadu_ps(&m[0]);
+    __m128 c1 = _mm_loadu_ps(&m[4]);
+    __m128 c2 = _mm_loadu_ps(&m[8]);
+    __m128 c3 = _mm_loadu_ps(&m[12]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        const float *p = (const float*) (in + i * stride);
+        float *o = (float*) (out + i * stride);
+        __m128 res = _mm_mul_ps(c0, _mm_set1_ps(p[0]));
+        res = _mm_add_ps(res, _mm_mul_ps(c1, _mm_set1_ps(p[1])));
+        res = _mm_add_ps(res, _mm_mul_ps(c2, _mm_set1_ps(p[2])));
+        res = _mm_add_ps(res, c3);
+        _mm_storel_pi((__m64*) o, res);
+        _mm_store_ss(&o[2], _mm_movehl_ps(res, res));
+    }
+}
+
+/*
+ * two points per iteration, one in each half of the register
+ */
+static CPU_TARGET("avx") void mat4_transform_points_avx(mat4 m, const char *in, char *out, 
+                                                        size_t n, size_t stride)
+{
+    __m128 c0 = _mm_loadu_ps(&m[0]);
+    __m128 c1 = _mm_loadu_ps(&m[4]);
+    __m128 c2 = _mm_loadu_ps(&m[8]);
+    __m128 c3 = _mm_loadu_ps(&m[12]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    __m256 cc0 = avx_dup(c0);
+    __m256 cc1 = avx_dup(c1);
+    __m256 cc2 = avx_dup(c2);
+    __m256 cc3 = avx_dup(c3);
+
+    size_t i;
+    for(i = 0; i + 2 <= n; i += 2)
+    {
+        const float *p0 = (const float*) (in + i * stride);
+        const float *p1 = (const float*) (in + (i + 1) * stride);
+        float *o0 = (float*) (out + i * stride);
+        float *o1 = (float*) (out + (i + 1) * stride);
+        __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(p0[0])), _mm_set1_ps(p1[0]), 1);
+        __m256 y = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(p0[1])), _mm_set1_ps(p1[1]), 1);
+        __m256 z = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(p0[2])), _mm_set1_ps(p1[2]), 1);
+        __m256 res = _mm256_mul_ps(cc0, x);
+        res = _mm256_add_ps(res, _mm256_mul_ps(cc1, y));
+        res = _mm256_add_ps(res, _mm256_mul_ps(cc2, z));
+        res = _mm256_add_ps(res, cc3);
+        __m128 r0 = _mm256_castps256_ps128(res);
+        __m128 r1 = _mm256_extractf128_ps(res, 1);
+        _mm_storel_pi((__m64*) o0, r0);
+        _mm_store_ss(&o0[2], _mm_movehl_ps(r0, r0));
+        _mm_storel_pi((__m64*) o1, r1);
+        _mm_store_ss(&o1[2], _mm_movehl_ps(r1, r1));
+    }
+    mat4_transform_points_sse2(m, in + i * stride, out + i * stride, n - i, stride);
+}
+#endif
+
+/**
+ * transforms an array of 'n' points by the matrix 'm'. Each point is read as
+ * (x, y, z, 1) from the first 3 floats of an element of 'in', and the x, y, z of
+ * the result are written to the matching element of 'out'. 
+ * Results are the same as mat4_multVec on each point.
+ * @param stride the distance in bytes between elements, in both 'in' and 'out'.
+ * eg: sizeof(Mesh_vert) to transform vertex positions in place. If 0, the points
+ * are assumed to be tightly packed (3 floats each)
+ */
+void mat4_transform_points(mat4 m, const float *in, float *out, size_t n, size_t stride)
+{
+    const char *src = (const char*) in;
+    char *dst = (char*) out;
+    if(!stride)
+    {
+        stride = sizeof(float) * 3;
+    }
+
+#if MAT_SIMD
+    if(cpu_has(CPU_AVX))
+    {
+        mat4_transform_points_avx(m, src, dst, n, stride);
+        return;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        mat4_transform_points_sse2(m, src, dst, n, stride);
+        return;
+    }
+#endif
+
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        const float *p = (const float*) (src + i * stride);
+        float *o = (float*) (dst + i * stride);
+        vec4 v = vec4_setp(p[0], p[1], p[2], 1.0f);
+        mat4_multVec(m, &v);
+        o[0] = v.x;
+        o[1] = v.y;
+        o[2] = v.z;
+    }
+}
+
 /**
  * orients a matrix such that it is aligned with the vectors 'up' and 'fwd'
  * even if 'up' and 'fwd' are not perpindicular, the matrix will still be orthogonal
@@ -538,25 +901,179 @@ void matn_add(matn a, int n, matn b, matn ret)
 }
 
 /**
- * multiplies two matrices 'a' and 'b' and stores the result into 'ret'
+ * the thread pool used by large NxN operations, or NULL to run them on the 
+ * calling thread
  */
-void matn_mult(matn a, int n, matn b, matn ret)
+static ThreadPool *matn_pool = NULL;
+
+/**
+ * computes c[0..len) += s * b[0..len)
+ */
+typedef void (*matn_axpy_func)(float *c, const float *b, float s, int len);
+
+static void matn_axpy_scalar(float *c, const float *b, float s, int len)
 {
-    matn tmp = alloca(sizeof(float) * n * n);
-    int i, j, k;
-    for(i = 0; i < n; i++)
+    int i;
+    for(i = 0; i < len; i++)
     {
-        for(j = 0; j < n; j++)
+        c[i] += s * b[i];
+    }
+}
+
+#if CPU_X86
+/*
+ * the SIMD kernels multiply then add, without fusing, so that every path 
+ * rounds the same way as the scalar loop
+ */
+static CPU_TARGET("sse2") void matn_axpy_sse2(float *c, const float *b, float s, int len)
+{
+    __m128 vs = _mm_set1_ps(s);
+    int i;
+    for(i = 0; i + 4 <= len; i += 4)
+    {
+        __m128 vc = _mm_loadu_ps(&c[i]);
+        vc = _mm_add_ps(vc, _mm_mul_ps(vs, _mm_loadu_ps(&b[i])));
+        _mm_storeu_ps(&c[i], vc);
+    }
+    for(; i < len; i++)
+    {
+        c[i] += s * b[i];
+    }
+}
+
+static CPU_TARGET("avx") void matn_axpy_avx(float *c, const float *b, float s, int len)
+{
+    __m256 vs = _mm256_set1_ps(s);
+    int i;
+    for(i = 0; i + 16 <= len; i += 16)
+    {
+        __m256 c0 = _mm256_loadu_ps(&c[i]);
+        __m256 c1 = _mm256_loadu_ps(&c[i + 8]);
+        c0 = _mm256_add_ps(c0, _mm256_mul_ps(vs, _mm256_loadu_ps(&b[i])));
+        c1 = _mm256_add_ps(c1, _mm256_mul_ps(vs, _mm256_loadu_ps(&b[i + 8])));
+        _mm256_storeu_ps(&c[i], c0);
+        _mm256_storeu_ps(&c[i + 8], c1);
+    }
+    for(; i + 8 <= len; i += 8)
+    {
+        __m256 vc = _mm256_loadu_ps(&c[i]);
+        vc = _mm256_add_ps(vc, _mm256_mul_ps(vs, _mm256_loadu_ps(&b[i])));
+        _mm256_storeu_ps(&c[i], vc);
+    }
+    for(; i < len; i++)
+    {
+        c[i] += s * b[i];
+    }
+}
+#endif
+
+static matn_axpy_func matn_axpy_select(void)
+{
+#if CPU_X86
+    if(cpu_has(CPU_AVX))
+    {
+        return matn_axpy_avx;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        return matn_axpy_sse2;
+    }
+#endif
+    return matn_axpy_scalar;
+}
+
+/**
+ * a tile product c += sign * a * b, where 'c' is m x ncols, 'a' is m x kdim and 
+ * 'b' is kdim x ncols. each operand is a view into a larger row-major matrix, 
+ * with 'ld' floats between the starts of its rows
+ */
+struct matn_gemm
+{
+    const float *a;
+    int lda;
+    const float *b;
+    int ldb;
+    float *c;
+    int ldc;
+    int m;
+    int kdim;
+    int ncols;
+    float sign;
+    matn_axpy_func axpy;
+};
+
+/**
+ * computes the rows of one MATN_BLOCK row tile of the product. Each entry of 
+ * 'c' is accumulated in increasing order of k, the same order as the naive 
+ * triple loop
+ */
+static void matn_gemm_task(void *arg, int task, int thread)
+{
+    struct matn_gemm *g = arg;
+    int i0 = task * MATN_BLOCK;
+    int i1 = i0 + MATN_BLOCK < g->m ? i0 + MATN_BLOCK : g->m;
+    int i, k, kk, jj;
+    for(kk = 0; kk < g->kdim; kk += MATN_BLOCK)
+    {
+        int k1 = kk + MATN_BLOCK < g->kdim ? kk + MATN_BLOCK : g->kdim;
+        for(jj = 0; jj < g->ncols; jj += MATN_BLOCK)
         {
-            float sol_ij = 0.0f;
-            for(k = 0; k < n; k++)
+            int jlen = jj + MATN_BLOCK < g->ncols ? MATN_BLOCK : g->ncols - jj;
+            for(i = i0; i < i1; i++)
             {
-                sol_ij += matn_get(a, n, i, k) * matn_get(b, n, k, j);  
+                float *crow = &g->c[i * g->ldc + jj];
+                const float *arow = &g->a[i * g->lda];
+                for(k = kk; k < k1; k++)
+                {
+                    g->axpy(crow, &g->b[k * g->ldb + jj], g->sign * arow[k], jlen);
+                }
             }
-            matn_set(tmp, n, i, j, sol_ij);
         }
     }
-    memcpy(ret, tmp, sizeof(float) * n * n);
+}
+
+static void matn_gemm(struct matn_gemm *g)
+{
+    int ntasks = (g->m + MATN_BLOCK - 1) / MATN_BLOCK;
+    double work = (double) g->m * g->kdim * g->ncols;
+    if(matn_pool && ntasks > 1 && work >= MATN_PARALLEL_THRESH)
+    {
+        threadpool_run(matn_pool, ntasks, matn_gemm_task, g);
+    } else
+    {
+        int i;
+        for(i = 0; i < ntasks; i++)
+        {
+            matn_gemm_task(g, i, 0);
+        }
+    }
+}
+
+/**
+ * sets the thread pool used to split large matn_mult and matn_lup operations 
+ * across threads. Pass NULL (the default) to run everything on the calling 
+ * thread. The pool must outlive any NxN operation that uses it
+ */
+void matn_threadpool(ThreadPool *pool)
+{
+    matn_pool = pool;
+}
+
+/**
+ * multiplies two matrices 'a' and 'b' and stores the result into 'ret'.
+ * 'ret' may alias either operand. the product is computed tile by tile, and 
+ * is bit for bit the same as the naive row by column sum
+ */
+void matn_mult(matn a, int n, matn b, matn ret)
+{
+    size_t sz = sizeof(float) * n * n;
+    matn tmp = MATN_TMP(sz);
+    memset(tmp, 0, sz);
+
+    struct matn_gemm g = {a, n, b, n, tmp, n, n, n, n, 1.0f, matn_axpy_select()};
+    matn_gemm(&g);
+
+    memcpy(ret, tmp, sz);
+    MATN_TMP_FREE(tmp, sz);
 }
 
 /**
@@ -686,7 +1203,7 @@ void matn_bwdsubstitute(const matn const upper, int n, const vec const eq, vec s
 
 /**
  * LU Decomposition using the 'Crout' algorithm
- * TODO: include P matrix, and permutations is case of a diagonal == 0
+ * does not pivot, so fails on matrices with a zero leading minor. see matn_lup
  */
 void matn_lu(matn a, int n, matn l, matn u)
 {
@@ -726,43 +1243,182 @@ void matn_lu(matn a, int n, matn l, matn u)
     }
 }
 
+/**
+ * in-place, blocked LU decomposition with partial pivoting, such that PA = LU.
+ * on return, 'a' holds U on and above the diagonal, and L bellow it (L has an
+ * implicit unit diagonal). row i of PA is row perm[i] of the original 'a'.
+ * columns are factored in panels of MATN_BLOCK, and the rest of the matrix is 
+ * updated a panel at a time with a tile product, which is split across the 
+ * matn_threadpool for large matrices
+ * @returns the sign of the permutation (1 or -1), or 0 if 'a' is singular
+ */
+int matn_lup(matn a, int n, int *perm)
+{
+    assert(a);
+    assert(perm);
+    assert(n > 0);
+
+    matn_axpy_func axpy = matn_axpy_select();
+    bool singular = false;
+    int sign = 1;
+    int i, j, k, kb;
+
+    for(i = 0; i < n; i++)
+    {
+        perm[i] = i;
+    }
+
+    for(kb = 0; kb < n; kb += MATN_BLOCK)
+    {
+        int kend = kb + MATN_BLOCK < n ? kb + MATN_BLOCK : n;
+
+        // factor the panel of columns [kb, kend)
+        for(j = kb; j < kend; j++)
+        {
+            int pivot = j;
+            float max = fabsf(a[j * n + j]);
+            for(i = j + 1; i < n; i++)
+            {
+                if(fabsf(a[i * n + j]) > max)
+                {
+                    max = fabsf(a[i * n + j]);
+                    pivot = i;
+                }
+            }
+
+            if(pivot != j)
+            {
+                for(k = 0; k < n; k++)
+                {
+                    float tmp = a[j * n + k];
+                    a[j * n + k] = a[pivot * n + k];
+                    a[pivot * n + k] = tmp;
+                }
+                int ptmp = perm[j];
+                perm[j] = perm[pivot];
+                perm[pivot] = ptmp;
+                sign = -sign;
+            }
+
+            if(!(max > 0.0f)) // column is already zero bellow the diagonal
+            {
+                singular = true;
+                continue;
+            }
+
+            for(i = j + 1; i < n; i++)
+            {
+                float lij = a[i * n + j] / a[j * n + j];
+                a[i * n + j] = lij;
+                axpy(&a[i * n + j + 1], &a[j * n + j + 1], -lij, kend - j - 1);
+            }
+        }
+
+        if(kend == n)
+        {
+            break;
+        }
+
+        // rows of U to the right of the panel
+        for(j = kb + 1; j < kend; j++)
+        {
+            for(k = kb; k < j; k++)
+            {
+                axpy(&a[j * n + kend], &a[k * n + kend], -a[j * n + k], n - kend);
+            }
+        }
+
+        // trailing matrix -= L (bellow the panel) * U (right of the panel)
+        struct matn_gemm g = {&a[kend * n + kb], n, &a[kb * n + kend], n,
+                              &a[kend * n + kend], n, n - kend, kend - kb, n - kend,
+                              -1.0f, axpy};
+        matn_gemm(&g);
+    }
+
+    return singular ? 0 : sign;
+}
+
+/**
+ * solves 'Ax = b' for 'x', given the factorization of 'A' and its permutation
+ * from matn_lup. 'x' may alias 'b'
+ */
+void matn_solvelup(matn lu, int n, const int *perm, const vec const b, vec x)
+{
+    size_t sz = n * sizeof(float);
+    vec y = MATN_TMP(sz);
+    int i, j;
+
+    for(i = 0; i < n; i++) // solve Ly = Pb
+    {
+        float yi = b[perm[i]];
+        for(j = 0; j < i; j++)
+        {
+            yi -= lu[i * n + j] * y[j];
+        }
+        y[i] = yi;
+    }
+
+    for(i = n - 1; i >= 0; i--) // solve Ux = y
+    {
+        for(j = i + 1; j < n; j++)
+        {
+            y[i] -= lu[i * n + j] * y[j];
+        }
+        assert(!feq(lu[i * n + i], 0.0f));
+        y[i] /= lu[i * n + i];
+    }
+
+    memcpy(x, y, sz);
+    MATN_TMP_FREE(y, sz);
+}
+
 /**
  * solves the equation 'Ax = b' for 'x', where 'A' is a square matrix of size n, 
- * and 'x' and 'b' are both vectors of dimension n. this is solved by lu decomposition,
- * and then solving the equations Ly = b, for some unknown vector y found through 
+ * and 'x' and 'b' are both vectors of dimension n. this is solved by a pivoted
+ * lu decomposition of a copy of 'A' (see matn_lup), then solving Ly = Pb through 
  * forward substitution, and finally Ux = y through back substitution, to get 'x'.
  */
 void matn_solvelu(matn a, int n, const vec const b, vec x)
 {
-    vec y = alloca(n * sizeof(float)); 
-    matn l = alloca(n * n *sizeof(float));
-    matn u = alloca(n * n * sizeof(float));
-    matn_lu(a, n, l, u);
-    matn_fwdsubstitute(l, n, b, y); // solve Ly = b
-    matn_bwdsubstitute(u, n, y, x); // solve Ux = y
+    size_t sz = sizeof(float) * n * n;
+    size_t psz = sizeof(int) * n;
+    matn lu = MATN_TMP(sz);
+    int *perm = MATN_TMP(psz);
+
+    memcpy(lu, a, sz);
+    int sign = matn_lup(lu, n, perm);
+    assert(sign && "singular matrix");
+    matn_solvelup(lu, n, perm, b, x);
+
+    MATN_TMP_FREE(perm, psz);
+    MATN_TMP_FREE(lu, sz);
 }
 
 /**
  * finds the determinant of the matrix. First, the matrix is decomposed into
- * it's LU triangular matrix decomposition, then the diagonals of the L matrix
- * and multiplied. This works because the determinant of a triangular matrix can
- * simply be found by multiplying the diagonals, and the method of LU decomposition
- * used leaves the U matrix with an identity along the diagonals.
+ * it's pivoted LU triangular matrix decomposition, then the diagonals of the U 
+ * matrix are multiplied. This works because the determinant of a triangular 
+ * matrix can simply be found by multiplying the diagonals, L has an identity 
+ * along the diagonals, and each row swap flips the sign.
  */
 float matn_det(matn m, int n)
 {
-    float ret = 1.0f;
+    size_t sz = sizeof(float) * n * n;
+    size_t psz = sizeof(int) * n;
+    matn lu = MATN_TMP(sz);
+    int *perm = MATN_TMP(psz);
 
-    matn l = alloca(sizeof(float) * n * n);
-    matn u = alloca(sizeof(float) * n * n);
-    matn_lu(m, n, l, u);
+    memcpy(lu, m, sz);
+    float ret = (float) matn_lup(lu, n, perm);
 
     int i;
     for(i = 0; i < n; i++)
     {
-        ret *= matn_get(u, n, i, i); // NOTE: not need for current method, should be all 1s
-        ret *= matn_get(l, n, i, i);       
+        ret *= lu[i * n + i];
     }
+
+    MATN_TMP_FREE(perm, psz);
+    MATN_TMP_FREE(lu, sz);
     return ret;
 }
 
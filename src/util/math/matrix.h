@@ -10,6 +10,7 @@
 #define _MATRIX_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "const.h"
 #include "vec.h"
@@ -59,6 +60,12 @@
 #define MAT_WZ 11
 #define MAT_WW 15
 #endif
+
+/*
+ * index of the entry [i][j] in a mat4, such that MAT_IDX(Y, Z) == MAT_YZ
+ */
+#define MAT_IDX(i, j) (MAT_XX + (i) * (MAT_YX - MAT_XX) + (j) * (MAT_XY - MAT_XX))
+
 ///@TODO: allow generic matricies. for all functions
 typedef float* mat;
 typedef float* matn;
@@ -71,6 +78,7 @@ void mat3_identity(mat3 m);
 void mat3_rotate(mat3 m, float x, float y, float z);
 void mat3_translate(mat3 m, float x, float y);
 
+#ifndef MATH_INLINE // defined inline by util/math/inline.h
 void mat4_identity(mat4 mat);
 void mat4_set(mat4 m, int i, int j, float val);
 void mat4_setv(mat4 m, vec4 x, vec4 y, vec4 z, vec4 w);
@@ -83,15 +91,20 @@ void mat4_scale(mat4 m, float x, float y, float z);
 void mat4_scalev(mat4 m, float *v);
 void mat4_translate(mat4 m, float x, float y, float z);
 void mat4_translatev(mat4 m, float *v);
+void mat4_mult(mat4 left, mat4 right, mat4 dst);
+bool mat4_isaffine(mat4 m);
+void mat4_mult_affine(mat4 left, mat4 right, mat4 dst);
+void mat4_multVec(mat4 m, vec4 *v);
+#endif
 void mat4_rotate(mat4 m, float angle, float x, float y, float z);
 void mat4_rotatev(mat4 m, float angle, float *v);
 void mat4_axisRotate(mat4 m, float rx, float ry, float rz);
 void mat4_frustum(mat4 m, float l, float r, float b, float t, float n, float f);
 //TODO:mat4_ortho(mat4 m, float l, float r, float b, float t, float n, float f);
-void mat4_mult(mat4 left, mat4 right, mat4 dst);
+void mat4_inverse_affine(mat4 m, mat4 dst);
 void mat4_pow(mat4 m, int pow);
 void mat4_orient(mat4 m, vec3 *up, vec3 *fwd);
-void mat4_multVec(mat4 m, vec4 *v);
+void mat4_transform_points(mat4 m, const float *in, float *out, size_t n, size_t stride);
 void mat4_print(mat4 m);
 
 void mat4_lu(mat4 m, mat4 l, mat4 u);
@@ -108,6 +121,9 @@ void mat4_w(mat4 m, vec4 v);
  * NxN dimensional Matricies
  */
 
+struct ThreadPool;
+void matn_threadpool(struct ThreadPool *pool);
+
 void matn_init(mat m, int n);
 void matn_identity(mat m, int n);
 void matn_add(matn a, int n, matn b, matn ret);
@@ -120,6 +136,8 @@ bool matn_isupper(matn a, int n);
 void matn_fwdsubstitute(const matn const lower, int n, const vec const b, vec x);
 void matn_bwdsubstitute(const matn const upper, int n, const vec const b, vec x);
 void matn_lu(matn m, int n, matn l, matn u);
+int  matn_lup(matn a, int n, int *perm);
+void matn_solvelup(matn lu, int n, const int *perm, const vec const b, vec x);
 void matn_solvelu(matn a, int n, const vec const b, vec x);
 float matn_det(matn m, int n);
 void matn_print(matn m, int n);
@@ -7,8 +7,14 @@
 
 #include <math.h>
 #include <stdlib.h>
+
+#include "util/cpu.h"
 #include "scalar.h"
 
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
 /**
  * converts a half precision (16-bit) integer value to a float between -1 to 1
  * @param h 16-bit integer
@@ -257,3 +263,396 @@ int iavg(int n, ...)
     va_end(vl);
     return (int) (sum / (int) n);
 }
+
+/*
+ *************************************
+ * FAST TRANSCENDENTAL FUNCTIONS
+ *************************************
+ *
+ * branch-free polynomial approximations (coefficients from Cephes). Each has 
+ * an array version, vectorized where SSE2 is available, which gives the same 
+ * results as the scalar function. Errors are the maximum measured over the 
+ * valid range against a double precision libm result, in units in the last 
+ * place of the float result
+ */
+
+/*
+ * adding and subtracting 1.5 * 2^23 rounds a float of magnitude under 2^22 to 
+ * the nearest integer
+ */
+#define FROUND_MAGIC 12582912.0f
+
+#define FPIO2   ((float)(PI / 2.0))
+#define FPIO4   ((float)(PI / 4.0))
+#define F2OPI   ((float)(2.0 / PI))
+#define FLOG2E  1.44269504088896341f
+
+// pi / 2 split into parts, such that k * FPIO2_1 and k * FPIO2_2 are exact for k < 2^16
+#define FPIO2_1 1.5703125f
+#define FPIO2_2 4.837512969970703125e-4f
+#define FPIO2_3 7.54978995489188216e-8f
+
+// ln(2) split into parts, so that n * FLN2_1 is exact
+#define FLN2_1  0.693359375f
+#define FLN2_2  -2.12194440e-4f
+
+#define FEXP_MAX 88.7228317f
+#define FEXP_MIN -87.3365479f
+
+static float fsin_poly(float r, float r2)
+{
+    return ((-1.9515295891e-4f * r2 + 8.3321608736e-3f) * r2 - 1.6666654611e-1f) * r2 * r + r;
+}
+
+static float fcos_poly(float r2)
+{
+    return ((2.443315711809948e-5f * r2 - 1.388731625493765e-3f) * r2 + 4.166664568298827e-2f) * r2 * r2 
+            - 0.5f * r2 + 1.0f;
+}
+
+/**
+ * sin(x) for x reduced to [-pi/4, pi/4], where 'quadrant' is the number of pi/2 
+ * steps taken off of x
+ */
+static float fsin_quadrant(float r, int quadrant)
+{
+    float r2 = r * r;
+    float s = fsin_poly(r, r2);
+    float c = fcos_poly(r2);
+    union { float f; uint32_t i; } ret;
+    ret.f = (quadrant & 1) ? c : s;
+    ret.i ^= (uint32_t)(quadrant & 2) << 30;
+    return ret.f;
+}
+
+/**
+ * reduces 'x' by the nearest multiple of pi / 2
+ */
+static float fpio2_reduce(float x, int *quadrant)
+{
+    float k = (x * F2OPI + FROUND_MAGIC) - FROUND_MAGIC;
+    *quadrant = (int) k;
+    return ((x - k * FPIO2_1) - k * FPIO2_2) - k * FPIO2_3;
+}
+
+/**
+ * fast sine approximation. max error 1.5 ulp for |x| <= pi. The absolute error
+ * stays under 8e-8 for |x| < 8192, but the relative error grows for results 
+ * close to 0 at large 'x'
+ */
+float fsin(float x)
+{
+    int q;
+    float r = fpio2_reduce(x, &q);
+    return fsin_quadrant(r, q);
+}
+
+/**
+ * fast cosine approximation. max error 1.5 ulp for |x| <= pi. The absolute 
+ * error stays under 8e-8 for |x| < 8192, but the relative error grows for 
+ * results close to 0
+ */
+float fcos(float x)
+{
+    int q;
+    float r = fpio2_reduce(x, &q);
+    return fsin_quadrant(r, q + 1);
+}
+
+/**
+ * fast exponential approximation. max error 1 ulp. results are clamped to 
+ * FLT_MIN (subnormals are flushed) and FLT_MAX
+ */
+float fexp(float x)
+{
+    x = fclamp(x, FEXP_MIN, FEXP_MAX);
+    float n = (x * FLOG2E + FROUND_MAGIC) - FROUND_MAGIC;
+    float r = (x - n * FLN2_1) - n * FLN2_2;
+    float p = (((((1.9875691500e-4f * r + 1.3981999507e-3f) * r + 8.3334519073e-3f) * r 
+                + 4.1665795894e-2f) * r + 1.6666665459e-1f) * r + 5.0000001201e-1f) * r * r + r + 1.0f;
+
+    // 2^n as two factors, since 2^128 can't be represented by itself
+    int ni = (int) n;
+    union { int32_t i; float f; } s1, s2;
+    s1.i = ((ni >> 1) + 127) << 23;
+    s2.i = ((ni - (ni >> 1)) + 127) << 23;
+    return p * s1.f * s2.f;
+}
+
+/**
+ * atan of 't' in [0, 1]
+ */
+static float fatan_unit(float t)
+{
+    bool mid = t > 0.414213562373095f; // tan(pi/8)
+    float y0 = mid ? FPIO4 : 0.0f;
+    t = mid ? (t - 1.0f) / (t + 1.0f) : t;
+    float z = t * t;
+    return y0 + ((((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z 
+                 - 3.33329491539e-1f) * z * t + t);
+}
+
+/**
+ * fast arctangent approximation. max error 3 ulp
+ */
+float fatan(float x)
+{
+    float ax = fabsf(x);
+    bool big = ax > 1.0f;
+    float r = fatan_unit(big ? 1.0f / ax : ax);
+    r = big ? FPIO2 - r : r;
+    return copysignf(r, x);
+}
+
+/**
+ * fast approximation of the angle of the point (x, y). max error 3.5 ulp. 
+ * fatan2(0, 0) is 0
+ */
+float fatan2(float y, float x)
+{
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float mn = ax < ay ? ax : ay;
+    float mx = ax < ay ? ay : ax;
+    float r = fatan_unit(mx > 0.0f ? mn / mx : 0.0f);
+    r = ay > ax ? FPIO2 - r : r;
+    r = x < 0.0f ? (float) PI - r : r;
+    return copysignf(r, y);
+}
+
+static float fasin_poly(float z, float s)
+{
+    return ((((4.2163199048e-2f * z + 2.4181311049e-2f) * z + 4.5470025998e-2f) * z 
+             + 7.4953002686e-2f) * z + 1.6666752422e-1f) * z * s + s;
+}
+
+/**
+ * fast arcsine approximation, for x in [-1, 1]. max error 2.5 ulp
+ */
+float fasin(float x)
+{
+    float a = fabsf(x);
+    bool big = a > 0.5f;
+    float z = big ? 0.5f * (1.0f - a) : a * a;
+    float p = fasin_poly(z, big ? sqrtf(z) : a);
+    float r = big ? FPIO2 - 2.0f * p : p;
+    return copysignf(r, x);
+}
+
+/**
+ * fast arccosine approximation, for x in [-1, 1]. max error 1.5 ulp
+ */
+float facos(float x)
+{
+    float a = fabsf(x);
+    bool big = a > 0.5f;
+    float z = big ? 0.5f * (1.0f - a) : a * a;
+    float p = fasin_poly(z, big ? sqrtf(z) : a);
+    float r;
+    if(big)
+    {
+        r = x < 0.0f ? (float) PI - 2.0f * p : 2.0f * p;
+    } else
+    {
+        r = FPIO2 - copysignf(p, x);
+    }
+    return r;
+}
+
+#if CPU_X86
+static inline CPU_TARGET("sse2") __m128 sse_select(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline CPU_TARGET("sse2") __m128 sse_fpio2_reduce(__m128 x, __m128i *quadrant)
+{
+    __m128 magic = _mm_set1_ps(FROUND_MAGIC);
+    __m128 k = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(F2OPI)), magic), magic);
+    *quadrant = _mm_cvttps_epi32(k);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(k, _mm_set1_ps(FPIO2_1)));
+    r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(FPIO2_2)));
+    return _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(FPIO2_3)));
+}
+
+static inline CPU_TARGET("sse2") __m128 sse_fsin_quadrant(__m128 r, __m128i quadrant)
+{
+    __m128 r2 = _mm_mul_ps(r, r);
+
+    __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), r2), _mm_set1_ps(8.3321608736e-3f));
+    s = _mm_sub_ps(_mm_mul_ps(s, r2), _mm_set1_ps(1.6666654611e-1f));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, r2), r), r);
+
+    __m128 c = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), r2), _mm_set1_ps(1.388731625493765e-3f));
+    c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(4.166664568298827e-2f));
+    c = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, r2), r2), _mm_mul_ps(_mm_set1_ps(0.5f), r2));
+    c = _mm_add_ps(c, _mm_set1_ps(1.0f));
+
+    __m128i one = _mm_set1_epi32(1);
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+    __m128 sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+    return _mm_xor_ps(sse_select(swap, c, s), sign);
+}
+
+static CPU_TARGET("sse2") void fsin_n_sse2(const float *x, float *dst, size_t n, int offset)
+{
+    __m128i off = _mm_set1_epi32(offset);
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128i q;
+        __m128 r = sse_fpio2_reduce(_mm_loadu_ps(&x[i]), &q);
+        _mm_storeu_ps(&dst[i], sse_fsin_quadrant(r, _mm_add_epi32(q, off)));
+    }
+    for(; i < n; i++)
+    {
+        int q;
+        float r = fpio2_reduce(x[i], &q);
+        dst[i] = fsin_quadrant(r, q + offset);
+    }
+}
+
+static CPU_TARGET("sse2") void fexp_n_sse2(const float *x, float *dst, size_t n)
+{
+    __m128 magic = _mm_set1_ps(FROUND_MAGIC);
+    __m128i bias = _mm_set1_epi32(127);
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_min_ps(_mm_set1_ps(FEXP_MAX), _mm_max_ps(_mm_set1_ps(FEXP_MIN), _mm_loadu_ps(&x[i])));
+        __m128 k = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(FLOG2E)), magic), magic);
+        __m128 r = _mm_sub_ps(v, _mm_mul_ps(k, _mm_set1_ps(FLN2_1)));
+        r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(FLN2_2)));
+
+        __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.9875691500e-4f), r), _mm_set1_ps(1.3981999507e-3f));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(8.3334519073e-3f));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(4.1665795894e-2f));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.6666665459e-1f));
+        p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(5.0000001201e-1f));
+        p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, r), r), r), _mm_set1_ps(1.0f));
+
+        __m128i ni = _mm_cvttps_epi32(k);
+        __m128i half = _mm_srai_epi32(ni, 1);
+        __m128 s1 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(half, bias), 23));
+        __m128 s2 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_sub_epi32(ni, half), bias), 23));
+        _mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_mul_ps(p, s1), s2));
+    }
+    for(; i < n; i++)
+    {
+        dst[i] = fexp(x[i]);
+    }
+}
+
+static CPU_TARGET("sse2") void fatan2_n_sse2(const float *y, const float *x, float *dst, size_t n)
+{
+    __m128 signbit = _mm_set1_ps(-0.0f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(&x[i]);
+        __m128 vy = _mm_loadu_ps(&y[i]);
+        __m128 ax = _mm_andnot_ps(signbit, vx);
+        __m128 ay = _mm_andnot_ps(signbit, vy);
+        __m128 mn = _mm_min_ps(ax, ay);
+        __m128 mx = _mm_max_ps(ay, ax);
+        __m128 t = _mm_and_ps(_mm_cmpgt_ps(mx, zero), _mm_div_ps(mn, mx));
+
+        __m128 mid = _mm_cmpgt_ps(t, _mm_set1_ps(0.414213562373095f));
+        __m128 y0 = _mm_and_ps(mid, _mm_set1_ps(FPIO4));
+        t = sse_select(mid, _mm_div_ps(_mm_sub_ps(t, one), _mm_add_ps(t, one)), t);
+        __m128 z = _mm_mul_ps(t, t);
+        __m128 p = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(8.05374449538e-2f), z), _mm_set1_ps(1.38776856032e-1f));
+        p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.99777106478e-1f));
+        p = _mm_sub_ps(_mm_mul_ps(p, z), _mm_set1_ps(3.33329491539e-1f));
+        p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, z), t), t);
+        __m128 r = _mm_add_ps(y0, p);
+
+        r = sse_select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(FPIO2), r), r);
+        r = sse_select(_mm_cmplt_ps(vx, zero), _mm_sub_ps(_mm_set1_ps((float) PI), r), r);
+        _mm_storeu_ps(&dst[i], _mm_or_ps(_mm_andnot_ps(signbit, r), _mm_and_ps(signbit, vy)));
+    }
+    for(; i < n; i++)
+    {
+        dst[i] = fatan2(y[i], x[i]);
+    }
+}
+#endif
+
+/**
+ * fsin of each of the 'n' values of 'x', into 'dst'. 'dst' may alias 'x'
+ */
+void fsin_n(const float *x, float *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_SSE2))
+    {
+        fsin_n_sse2(x, dst, n, 0);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = fsin(x[i]);
+    }
+}
+
+/**
+ * fcos of each of the 'n' values of 'x', into 'dst'. 'dst' may alias 'x'
+ */
+void fcos_n(const float *x, float *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_SSE2))
+    {
+        fsin_n_sse2(x, dst, n, 1);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = fcos(x[i]);
+    }
+}
+
+/**
+ * fexp of each of the 'n' values of 'x', into 'dst'. 'dst' may alias 'x'
+ */
+void fexp_n(const float *x, float *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_SSE2))
+    {
+        fexp_n_sse2(x, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = fexp(x[i]);
+    }
+}
+
+/**
+ * fatan2 of each of the 'n' pairs (y[i], x[i]), into 'dst'. 'dst' may alias 
+ * 'y' or 'x'
+ */
+void fatan2_n(const float *y, const float *x, float *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_SSE2))
+    {
+        fatan2_n_sse2(y, x, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = fatan2(y[i], x[i]);
+    }
+}
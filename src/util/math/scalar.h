@@ -9,6 +9,7 @@
 #define _SCALAR_H
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <float.h>
@@ -22,17 +23,32 @@ float       uhtof(uint16_t uh);
 int16_t     ftoh(float f);
 uint16_t    ftouh(float f);
 
+#ifndef MATH_INLINE // defined inline by util/math/inline.h
 bool        feq(float a, float b);
 int         fcmp(float a, float b);
 float       fsq(float val);
-float       fisqrt(float val);
 float       fclamp(float val, float a, float b);
+#endif
+float       fisqrt(float val);
 float       fwrap(float val, float max);
 float       favg(int n, ...);
 float       fwavg(int n, ...);
 float       flavg(int n, float *list);
 float       flwavg(int n, float *list, float *weights);
 
+float       fsin(float x);
+float       fcos(float x);
+float       fexp(float x);
+float       fatan(float x);
+float       fatan2(float y, float x);
+float       fasin(float x);
+float       facos(float x);
+
+void        fsin_n(const float *x, float *dst, size_t n);
+void        fcos_n(const float *x, float *dst, size_t n);
+void        fexp_n(const float *x, float *dst, size_t n);
+void        fatan2_n(const float *y, const float *x, float *dst, size_t n);
+
 int         iclamp(int val, int a, int b);
 int         iwrap(int val, int max);
 int         iavg(int n, ...);
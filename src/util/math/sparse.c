@@ -0,0 +1,434 @@
+/**
+ * sparse.c
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sparse.h"
+
+#define DEFAULT_MAX 16
+
+struct sparse_triplet
+{
+    int i;
+    int j;
+    float val;
+};
+
+static int triplet_cmp(const void *a, const void *b)
+{
+    const struct sparse_triplet *ta = a;
+    const struct sparse_triplet *tb = b;
+    if(ta->i != tb->i)
+    {
+        return ta->i < tb->i ? -1 : 1;
+    }
+    return (ta->j > tb->j) - (ta->j < tb->j);
+}
+
+void sparsebuilder_init(SparseBuilder *b, int nrows, int ncols)
+{
+    assert(nrows > 0 && ncols > 0);
+    b->nrows = nrows;
+    b->ncols = ncols;
+    b->n = 0;
+    b->max = DEFAULT_MAX;
+    b->entries = malloc(sizeof(struct sparse_triplet) * b->max);
+}
+
+void sparsebuilder_finalize(SparseBuilder *b)
+{
+    free(b->entries);
+    b->entries = NULL;
+    b->n = 0;
+    b->max = 0;
+}
+
+/**
+ * makes room for at least 'n' entries in total
+ */
+void sparsebuilder_reserve(SparseBuilder *b, size_t n)
+{
+    if(n > b->max)
+    {
+        b->max = n;
+        b->entries = realloc(b->entries, sizeof(struct sparse_triplet) * b->max);
+        assert(b->entries);
+    }
+}
+
+/**
+ * adds 'val' to the entry at row 'i', column 'j'
+ */
+void sparsebuilder_add(SparseBuilder *b, int i, int j, float val)
+{
+    assert(i >= 0 && i < b->nrows);
+    assert(j >= 0 && j < b->ncols);
+
+    if(b->n >= b->max)
+    {
+        sparsebuilder_reserve(b, b->max * 2);
+    }
+    b->entries[b->n].i = i;
+    b->entries[b->n].j = j;
+    b->entries[b->n].val = val;
+    b->n++;
+}
+
+/**
+ * builds the compressed matrix out of the entries in 'b'. Entries at the same
+ * position are summed. the entries of 'b' are sorted in the process, but 'b'
+ * remains valid, and may be finalized right after
+ */
+void sparse_init(SparseMatrix *m, SparseBuilder *b)
+{
+    qsort(b->entries, b->n, sizeof(struct sparse_triplet), triplet_cmp);
+
+    size_t nnz = 0;
+    size_t k;
+    for(k = 0; k < b->n; k++)
+    {
+        if(k == 0 || triplet_cmp(&b->entries[k], &b->entries[k-1]))
+        {
+            nnz++;
+        }
+    }
+
+    m->nrows = b->nrows;
+    m->ncols = b->ncols;
+    m->nnz = nnz;
+    m->rowstart = calloc(b->nrows + 1, sizeof(int));
+    m->cols = malloc(sizeof(int) * (nnz ? nnz : 1));
+    m->vals = malloc(sizeof(float) * (nnz ? nnz : 1));
+
+    size_t e = 0;
+    for(k = 0; k < b->n; k++)
+    {
+        struct sparse_triplet *t = &b->entries[k];
+        if(k == 0 || triplet_cmp(t, &b->entries[k-1]))
+        {
+            m->cols[e] = t->j;
+            m->vals[e] = t->val;
+            m->rowstart[t->i + 1]++;
+            e++;
+        } else
+        {
+            m->vals[e-1] += t->val;
+        }
+    }
+
+    int i;
+    for(i = 0; i < m->nrows; i++)
+    {
+        m->rowstart[i + 1] += m->rowstart[i];
+    }
+}
+
+void sparse_finalize(SparseMatrix *m)
+{
+    free(m->rowstart);
+    free(m->cols);
+    free(m->vals);
+    m->rowstart = NULL;
+    m->cols = NULL;
+    m->vals = NULL;
+    m->nnz = 0;
+}
+
+/**
+ * retrieves the entry at row 'i', column 'j', which is 0 if it is not stored
+ */
+float sparse_get(SparseMatrix *m, int i, int j)
+{
+    assert(i >= 0 && i < m->nrows);
+    assert(j >= 0 && j < m->ncols);
+
+    int lo = m->rowstart[i];
+    int hi = m->rowstart[i + 1];
+    while(lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if(m->cols[mid] < j)
+        {
+            lo = mid + 1;
+        } else
+        {
+            hi = mid;
+        }
+    }
+    return (lo < m->rowstart[i + 1] && m->cols[lo] == j) ? m->vals[lo] : 0.0f;
+}
+
+/**
+ * multiplies the matrix by the column vector 'v' (of dimension ncols), storing 
+ * the result into 'ret' (of dimension nrows). 'ret' must not alias 'v'
+ */
+void sparse_vmult(SparseMatrix *m, const float *v, vec ret)
+{
+    int i, k;
+    for(i = 0; i < m->nrows; i++)
+    {
+        float sum = 0.0f;
+        for(k = m->rowstart[i]; k < m->rowstart[i + 1]; k++)
+        {
+            sum += m->vals[k] * v[m->cols[k]];
+        }
+        ret[i] = sum;
+    }
+}
+
+static double sparse_dot(const float *a, const float *b, int n)
+{
+    double sum = 0.0;
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        sum += (double) a[i] * b[i];
+    }
+    return sum;
+}
+
+/**
+ * the incomplete Cholesky factor L of a symmetric matrix, with the same pattern
+ * as the lower triangle of the matrix (diagonal included, as the last entry of
+ * each row)
+ */
+struct sparse_ic
+{
+    int *rowstart;
+    int *cols;
+    float *vals;
+};
+
+static void sparse_ic_init(struct sparse_ic *ic, SparseMatrix *m)
+{
+    int n = m->nrows;
+    int i, k;
+
+    ic->rowstart = malloc(sizeof(int) * (n + 1));
+    ic->rowstart[0] = 0;
+    for(i = 0; i < n; i++)
+    {
+        int count = 0;
+        for(k = m->rowstart[i]; k < m->rowstart[i + 1] && m->cols[k] < i; k++)
+        {
+            count++;
+        }
+        ic->rowstart[i + 1] = ic->rowstart[i] + count + 1;
+    }
+
+    int nnz = ic->rowstart[n];
+    ic->cols = malloc(sizeof(int) * nnz);
+    ic->vals = malloc(sizeof(float) * nnz);
+
+    for(i = 0; i < n; i++)
+    {
+        int e = ic->rowstart[i];
+        float diag = 0.0f;
+        for(k = m->rowstart[i]; k < m->rowstart[i + 1] && m->cols[k] <= i; k++)
+        {
+            if(m->cols[k] == i)
+            {
+                diag = m->vals[k];
+            } else
+            {
+                ic->cols[e] = m->cols[k];
+                ic->vals[e] = m->vals[k];
+                e++;
+            }
+        }
+        ic->cols[e] = i;
+        ic->vals[e] = diag;
+
+        // L[i][j] = (A[i][j] - sum L[i][c] * L[j][c]) / L[j][j], over the shared pattern c < j
+        int p;
+        for(p = ic->rowstart[i]; p < e; p++)
+        {
+            int j = ic->cols[p];
+            int a = ic->rowstart[i];
+            int b = ic->rowstart[j];
+            int bend = ic->rowstart[j + 1] - 1;
+            double sum = ic->vals[p];
+            while(a < p && b < bend)
+            {
+                if(ic->cols[a] < ic->cols[b])
+                {
+                    a++;
+                } else if(ic->cols[a] > ic->cols[b])
+                {
+                    b++;
+                } else
+                {
+                    sum -= (double) ic->vals[a++] * ic->vals[b++];
+                }
+            }
+            ic->vals[p] = sum / ic->vals[bend];
+        }
+
+        double d = diag;
+        for(p = ic->rowstart[i]; p < e; p++)
+        {
+            d -= (double) ic->vals[p] * ic->vals[p];
+        }
+        // the factorization broke down (not positive definite enough), fall back to the diagonal
+        if(!(d > 0.0))
+        {
+            d = fabs(diag) > 0.0f ? fabs(diag) : 1.0;
+        }
+        ic->vals[e] = sqrt(d);
+    }
+}
+
+static void sparse_ic_finalize(struct sparse_ic *ic)
+{
+    free(ic->rowstart);
+    free(ic->cols);
+    free(ic->vals);
+}
+
+/**
+ * solves L * L^T * z = r for 'z'
+ */
+static void sparse_ic_apply(struct sparse_ic *ic, int n, const float *r, float *z)
+{
+    int i, k;
+    for(i = 0; i < n; i++) // L * y = r
+    {
+        int diag = ic->rowstart[i + 1] - 1;
+        float sum = r[i];
+        for(k = ic->rowstart[i]; k < diag; k++)
+        {
+            sum -= ic->vals[k] * z[ic->cols[k]];
+        }
+        z[i] = sum / ic->vals[diag];
+    }
+
+    for(i = n - 1; i >= 0; i--) // L^T * z = y, column by column
+    {
+        int diag = ic->rowstart[i + 1] - 1;
+        z[i] /= ic->vals[diag];
+        for(k = ic->rowstart[i]; k < diag; k++)
+        {
+            z[ic->cols[k]] -= ic->vals[k] * z[i];
+        }
+    }
+}
+
+/**
+ * solves 'Mx = b' for 'x' with the preconditioned conjugate gradient method.
+ * 'M' must be square, symmetric and positive definite. 'x' holds the initial
+ * guess (zeros will do), and receives the solution. Iteration stops when the 
+ * residual norm falls to 'tol' times the norm of 'b', or after 'maxiter' 
+ * iterations. Only a few vectors of dimension n are allocated beyond the 
+ * preconditioner, which is at most the size of the lower triangle of 'M'.
+ * @returns the number of iterations, or -1 if it did not converge (in which
+ * case 'x' holds the last estimate)
+ */
+int sparse_solvecg(SparseMatrix *m, const float *b, vec x, 
+                   enum Sparse_Precond precond, float tol, int maxiter)
+{
+    assert(m->nrows == m->ncols);
+
+    int n = m->nrows;
+    float *r = malloc(sizeof(float) * n);
+    float *z = malloc(sizeof(float) * n);
+    float *p = malloc(sizeof(float) * n);
+    float *q = malloc(sizeof(float) * n);
+    float *invdiag = NULL;
+    struct sparse_ic ic = {0};
+    int i;
+
+    if(precond == SPARSE_JACOBI)
+    {
+        invdiag = malloc(sizeof(float) * n);
+        for(i = 0; i < n; i++)
+        {
+            float d = sparse_get(m, i, i);
+            invdiag[i] = fabsf(d) > 0.0f ? 1.0f / d : 1.0f;
+        }
+    } else if(precond == SPARSE_IC)
+    {
+        sparse_ic_init(&ic, m);
+    }
+
+    sparse_vmult(m, x, q);
+    for(i = 0; i < n; i++)
+    {
+        r[i] = b[i] - q[i];
+    }
+
+    double bnorm = sqrt(sparse_dot(b, b, n));
+    double limit = tol * (bnorm > 0.0 ? bnorm : 1.0);
+    double rz = 0.0;
+    int iter = -1;
+    int k;
+    for(k = 0; k <= maxiter; k++)
+    {
+        if(sqrt(sparse_dot(r, r, n)) <= limit)
+        {
+            iter = k;
+            break;
+        }
+
+        if(k == maxiter)
+        {
+            break;
+        }
+
+        switch(precond)
+        {
+            case SPARSE_JACOBI:
+                for(i = 0; i < n; i++)
+                {
+                    z[i] = r[i] * invdiag[i];
+                }
+                break;
+            case SPARSE_IC:
+                sparse_ic_apply(&ic, n, r, z);
+                break;
+            default:
+                memcpy(z, r, sizeof(float) * n);
+        }
+
+        double rz_next = sparse_dot(r, z, n);
+        if(k == 0)
+        {
+            memcpy(p, z, sizeof(float) * n);
+        } else
+        {
+            float beta = rz_next / rz;
+            for(i = 0; i < n; i++)
+            {
+                p[i] = z[i] + beta * p[i];
+            }
+        }
+        rz = rz_next;
+
+        sparse_vmult(m, p, q);
+        float alpha = rz / sparse_dot(p, q, n);
+        for(i = 0; i < n; i++)
+        {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+        }
+    }
+
+    if(precond == SPARSE_JACOBI)
+    {
+        free(invdiag);
+    } else if(precond == SPARSE_IC)
+    {
+        sparse_ic_finalize(&ic);
+    }
+    free(q);
+    free(p);
+    free(z);
+    free(r);
+    return iter;
+}
@@ -0,0 +1,65 @@
+/**
+ * sparse.h
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * sparse matrices in compressed row (CSR) form, for large linear systems that
+ * are mostly zeros
+ */
+
+#ifndef _SPARSE_H
+#define _SPARSE_H
+
+#include <stddef.h>
+
+#include "vec.h"
+
+/**
+ * preconditioners for sparse_solvecg
+ */
+enum Sparse_Precond
+{
+    SPARSE_NONE     = 0,
+    SPARSE_JACOBI   = 1, ///< inverse of the diagonal
+    SPARSE_IC       = 2, ///< zero fill-in incomplete Cholesky
+};
+
+struct sparse_triplet;
+
+/**
+ * collects (row, column, value) entries in any order to build a SparseMatrix.
+ * entries added more than once at the same position are summed
+ */
+typedef struct SparseBuilder
+{
+    int nrows;
+    int ncols;
+    size_t n;
+    size_t max;
+    struct sparse_triplet *entries;
+} SparseBuilder;
+
+typedef struct SparseMatrix
+{
+    int nrows;
+    int ncols;
+    size_t nnz;
+    int *rowstart;  ///< row i is entries [rowstart[i], rowstart[i+1])
+    int *cols;      ///< column of each entry, ascending within a row
+    float *vals;
+} SparseMatrix;
+
+void sparsebuilder_init(SparseBuilder *b, int nrows, int ncols);
+void sparsebuilder_finalize(SparseBuilder *b);
+void sparsebuilder_reserve(SparseBuilder *b, size_t n);
+void sparsebuilder_add(SparseBuilder *b, int i, int j, float val);
+
+void sparse_init(SparseMatrix *m, SparseBuilder *b);
+void sparse_finalize(SparseMatrix *m);
+float sparse_get(SparseMatrix *m, int i, int j);
+void sparse_vmult(SparseMatrix *m, const float *v, vec ret);
+int sparse_solvecg(SparseMatrix *m, const float *b, vec x, 
+                   enum Sparse_Precond precond, float tol, int maxiter);
+
+#endif
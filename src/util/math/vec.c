@@ -6,17 +6,23 @@
  * @author  Brandon Surmanski
  */
 
+#include <assert.h>
 #include <math.h>
 #include <float.h>
 #include <string.h> //needed for matrix mult mempcy
 #include <stdio.h>
 
+#include "util/cpu.h"
 #include "util/random.h"
 #include "convert.h"
 #include "scalar.h"
 
 #include "vec.h"
 
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
 const float VEC4_ZERO[] = {0.0f, 0.0f, 0.0f, 0.0f};
 const float VEC4_ONE[] = {1.0f, 1.0f, 1.0f, 1.0f};
 const float VEC4_X[] = {1.0f, 0.0f, 0.0f, 0.0f};
@@ -533,6 +539,562 @@ void vec3_printp(const vec3 *a)
     printf("%f, %f, %f\n", a->x, a->y, a->z);
 }
 
+/*
+ *************************************
+ * 3 DIMENSIONAL BATCH OPERATIONS
+ *************************************
+ *
+ * each batch function applies the matching single-vector function to 'n'
+ * elements. The kernel is selected at runtime (AVX2, SSE2 or scalar). All
+ * kernels evaluate the same float expressions in the same order as the
+ * single-vector functions, so results are bit-identical to the scalar path.
+ * Outputs may alias inputs.
+ */
+
+#if CPU_X86
+/**
+ * computes 1/sqrt(sq) the way vec3_normalizep does: in double precision,
+ * then rounded to float. Lanes within FLT_EPSILON of 0 get a factor of 1,
+ * leaving the vector unchanged
+ */
+static inline CPU_TARGET("sse2") __m128 sse_normfactor(__m128 sq)
+{
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d lo = _mm_div_pd(one, _mm_sqrt_pd(_mm_cvtps_pd(sq)));
+    __m128d hi = _mm_div_pd(one, _mm_sqrt_pd(_mm_cvtps_pd(_mm_movehl_ps(sq, sq))));
+    __m128 inv = _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+    __m128 mask = _mm_cmpnle_ps(sq, _mm_set1_ps(EPSILON));
+    return _mm_or_ps(_mm_and_ps(mask, inv), _mm_andnot_ps(mask, _mm_set1_ps(1.0f)));
+}
+static inline CPU_TARGET("avx2") __m256 avx_normfactor(__m256 sq)
+{
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d lo = _mm256_div_pd(one, _mm256_sqrt_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(sq))));
+    __m256d hi = _mm256_div_pd(one, _mm256_sqrt_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(sq, 1))));
+    __m256 inv = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), 
+                                      _mm256_cvtpd_ps(hi), 1);
+    __m256 mask = _mm256_cmp_ps(sq, _mm256_set1_ps(EPSILON), _CMP_NLE_UQ);
+    return _mm256_blendv_ps(_mm256_set1_ps(1.0f), inv, mask);
+}
+
+static CPU_TARGET("sse2") void vec3_add_n_sse2(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(&dst.x[i], _mm_add_ps(_mm_loadu_ps(&a.x[i]), _mm_loadu_ps(&b.x[i])));
+        _mm_storeu_ps(&dst.y[i], _mm_add_ps(_mm_loadu_ps(&a.y[i]), _mm_loadu_ps(&b.y[i])));
+        _mm_storeu_ps(&dst.z[i], _mm_add_ps(_mm_loadu_ps(&a.z[i]), _mm_loadu_ps(&b.z[i])));
+    }
+}
+static CPU_TARGET("avx2") void vec3_add_n_avx2(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(&dst.x[i], _mm256_add_ps(_mm256_loadu_ps(&a.x[i]), _mm256_loadu_ps(&b.x[i])));
+        _mm256_storeu_ps(&dst.y[i], _mm256_add_ps(_mm256_loadu_ps(&a.y[i]), _mm256_loadu_ps(&b.y[i])));
+        _mm256_storeu_ps(&dst.z[i], _mm256_add_ps(_mm256_loadu_ps(&a.z[i]), _mm256_loadu_ps(&b.z[i])));
+    }
+}
+
+static CPU_TARGET("sse2") void vec3_sub_n_sse2(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(&dst.x[i], _mm_sub_ps(_mm_loadu_ps(&a.x[i]), _mm_loadu_ps(&b.x[i])));
+        _mm_storeu_ps(&dst.y[i], _mm_sub_ps(_mm_loadu_ps(&a.y[i]), _mm_loadu_ps(&b.y[i])));
+        _mm_storeu_ps(&dst.z[i], _mm_sub_ps(_mm_loadu_ps(&a.z[i]), _mm_loadu_ps(&b.z[i])));
+    }
+}
+static CPU_TARGET("avx2") void vec3_sub_n_avx2(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(&dst.x[i], _mm256_sub_ps(_mm256_loadu_ps(&a.x[i]), _mm256_loadu_ps(&b.x[i])));
+        _mm256_storeu_ps(&dst.y[i], _mm256_sub_ps(_mm256_loadu_ps(&a.y[i]), _mm256_loadu_ps(&b.y[i])));
+        _mm256_storeu_ps(&dst.z[i], _mm256_sub_ps(_mm256_loadu_ps(&a.z[i]), _mm256_loadu_ps(&b.z[i])));
+    }
+}
+
+static CPU_TARGET("sse2") void vec3_scale_n_sse2(vec3_soa a, float val, size_t n)
+{
+    __m128 s = _mm_set1_ps(val);
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(&a.x[i], _mm_mul_ps(_mm_loadu_ps(&a.x[i]), s));
+        _mm_storeu_ps(&a.y[i], _mm_mul_ps(_mm_loadu_ps(&a.y[i]), s));
+        _mm_storeu_ps(&a.z[i], _mm_mul_ps(_mm_loadu_ps(&a.z[i]), s));
+    }
+}
+
+static CPU_TARGET("avx2") void vec3_scale_n_avx2(vec3_soa a, float val, size_t n)
+{
+    __m256 s = _mm256_set1_ps(val);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(&a.x[i], _mm256_mul_ps(_mm256_loadu_ps(&a.x[i]), s));
+        _mm256_storeu_ps(&a.y[i], _mm256_mul_ps(_mm256_loadu_ps(&a.y[i]), s));
+        _mm256_storeu_ps(&a.z[i], _mm256_mul_ps(_mm256_loadu_ps(&a.z[i]), s));
+    }
+}
+
+static CPU_TARGET("sse2") void vec3_dot_n_sse2(vec3_soa a, vec3_soa b, float *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 d = _mm_mul_ps(_mm_loadu_ps(&a.x[i]), _mm_loadu_ps(&b.x[i]));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(&a.y[i]), _mm_loadu_ps(&b.y[i])));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(&a.z[i]), _mm_loadu_ps(&b.z[i])));
+        _mm_storeu_ps(&dst[i], d);
+    }
+}
+
+static CPU_TARGET("avx2") void vec3_dot_n_avx2(vec3_soa a, vec3_soa b, float *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        __m256 d = _mm256_mul_ps(_mm256_loadu_ps(&a.x[i]), _mm256_loadu_ps(&b.x[i]));
+        d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(&a.y[i]), _mm256_loadu_ps(&b.y[i])));
+        d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(&a.z[i]), _mm256_loadu_ps(&b.z[i])));
+        _mm256_storeu_ps(&dst[i], d);
+    }
+}
+
+static CPU_TARGET("sse2") void vec3_cross_n_sse2(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 ax = _mm_loadu_ps(&a.x[i]), ay = _mm_loadu_ps(&a.y[i]), az = _mm_loadu_ps(&a.z[i]);
+        __m128 bx = _mm_loadu_ps(&b.x[i]), by = _mm_loadu_ps(&b.y[i]), bz = _mm_loadu_ps(&b.z[i]);
+        _mm_storeu_ps(&dst.x[i], _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+        _mm_storeu_ps(&dst.y[i], _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)));
+        _mm_storeu_ps(&dst.z[i], _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)));
+    }
+}
+static CPU_TARGET("avx2") void vec3_cross_n_avx2(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        __m256 ax = _mm256_loadu_ps(&a.x[i]), ay = _mm256_loadu_ps(&a.y[i]), az = _mm256_loadu_ps(&a.z[i]);
+        __m256 bx = _mm256_loadu_ps(&b.x[i]), by = _mm256_loadu_ps(&b.y[i]), bz = _mm256_loadu_ps(&b.z[i]);
+        _mm256_storeu_ps(&dst.x[i], _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by)));
+        _mm256_storeu_ps(&dst.y[i], _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz)));
+        _mm256_storeu_ps(&dst.z[i], _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx)));
+    }
+}
+
+static CPU_TARGET("sse2") void vec3_normalize_n_sse2(vec3_soa a, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&a.x[i]), y = _mm_loadu_ps(&a.y[i]), z = _mm_loadu_ps(&a.z[i]);
+        __m128 sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        __m128 inv = sse_normfactor(sq);
+        _mm_storeu_ps(&a.x[i], _mm_mul_ps(x, inv));
+        _mm_storeu_ps(&a.y[i], _mm_mul_ps(y, inv));
+        _mm_storeu_ps(&a.z[i], _mm_mul_ps(z, inv));
+    }
+}
+
+static CPU_TARGET("avx2") void vec3_normalize_n_avx2(vec3_soa a, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(&a.x[i]), y = _mm256_loadu_ps(&a.y[i]), z = _mm256_loadu_ps(&a.z[i]);
+        __m256 sq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), 
+                                  _mm256_mul_ps(z, z));
+        __m256 inv = avx_normfactor(sq);
+        _mm256_storeu_ps(&a.x[i], _mm256_mul_ps(x, inv));
+        _mm256_storeu_ps(&a.y[i], _mm256_mul_ps(y, inv));
+        _mm256_storeu_ps(&a.z[i], _mm256_mul_ps(z, inv));
+    }
+}
+/*
+ * vec3 is padded to 16 bytes, so an array of vec3 can be loaded a vector per
+ * register. The padding lane is left untouched by the in-place functions
+ */
+static CPU_TARGET("sse2") void vec3_addp_n_sse2(const vec3 *a, const vec3 *b, vec3 *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        _mm_storeu_ps(dst[i].v, _mm_add_ps(_mm_loadu_ps(a[i].v), _mm_loadu_ps(b[i].v)));
+    }
+}
+
+static CPU_TARGET("avx2") void vec3_addp_n_avx2(const vec3 *a, const vec3 *b, vec3 *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 2 <= n; i += 2)
+    {
+        _mm256_storeu_ps(dst[i].v, _mm256_add_ps(_mm256_loadu_ps(a[i].v), _mm256_loadu_ps(b[i].v)));
+    }
+    vec3_addp_n_sse2(&a[i], &b[i], &dst[i], n - i);
+}
+
+static CPU_TARGET("sse2") void vec3_subp_n_sse2(const vec3 *a, const vec3 *b, vec3 *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        _mm_storeu_ps(dst[i].v, _mm_sub_ps(_mm_loadu_ps(a[i].v), _mm_loadu_ps(b[i].v)));
+    }
+}
+static CPU_TARGET("avx2") void vec3_subp_n_avx2(const vec3 *a, const vec3 *b, vec3 *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 2 <= n; i += 2)
+    {
+        _mm256_storeu_ps(dst[i].v, _mm256_sub_ps(_mm256_loadu_ps(a[i].v), _mm256_loadu_ps(b[i].v)));
+    }
+    vec3_subp_n_sse2(&a[i], &b[i], &dst[i], n - i);
+}
+static CPU_TARGET("sse2") void vec3_scalep_n_sse2(vec3 *a, float val, size_t n)
+{
+    __m128 s = _mm_set_ps(1.0f, val, val, val);
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        _mm_storeu_ps(a[i].v, _mm_mul_ps(_mm_loadu_ps(a[i].v), s));
+    }
+}
+static CPU_TARGET("avx2") void vec3_scalep_n_avx2(vec3 *a, float val, size_t n)
+{
+    __m256 s = _mm256_set_ps(1.0f, val, val, val, 1.0f, val, val, val);
+    size_t i;
+    for(i = 0; i + 2 <= n; i += 2)
+    {
+        _mm256_storeu_ps(a[i].v, _mm256_mul_ps(_mm256_loadu_ps(a[i].v), s));
+    }
+    vec3_scalep_n_sse2(&a[i], val, n - i);
+}
+
+static CPU_TARGET("sse2") void vec3_dotp_n_sse2(const vec3 *a, const vec3 *b, float *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 a0 = _mm_loadu_ps(a[i].v), a1 = _mm_loadu_ps(a[i+1].v);
+        __m128 a2 = _mm_loadu_ps(a[i+2].v), a3 = _mm_loadu_ps(a[i+3].v);
+        __m128 b0 = _mm_loadu_ps(b[i].v), b1 = _mm_loadu_ps(b[i+1].v);
+        __m128 b2 = _mm_loadu_ps(b[i+2].v), b3 = _mm_loadu_ps(b[i+3].v);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, b0), _mm_mul_ps(a1, b1)), _mm_mul_ps(a2, b2));
+        _mm_storeu_ps(&dst[i], d);
+    }
+    for(; i < n; i++)
+    {
+        dst[i] = vec3_dotp(&a[i], &b[i]);
+    }
+}
+
+static CPU_TARGET("sse2") void vec3_crossp_n_sse2(const vec3 *a, const vec3 *b, vec3 *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        // (a.y, a.z, a.x) * (b.z, b.x, b.y) - (a.z, a.x, a.y) * (b.y, b.z, b.x)
+        __m128 va = _mm_loadu_ps(a[i].v);
+        __m128 vb = _mm_loadu_ps(b[i].v);
+        __m128 a_yzx = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 a_zxy = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 1, 0, 2));
+        __m128 b_yzx = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 b_zxy = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 1, 0, 2));
+        _mm_storeu_ps(dst[i].v, _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+    }
+}
+
+static CPU_TARGET("sse2") void vec3_normalizep_n_sse2(vec3 *a, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(a[i].v), y = _mm_loadu_ps(a[i+1].v);
+        __m128 z = _mm_loadu_ps(a[i+2].v), w = _mm_loadu_ps(a[i+3].v);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        __m128 sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        __m128 inv = sse_normfactor(sq);
+        x = _mm_mul_ps(x, inv);
+        y = _mm_mul_ps(y, inv);
+        z = _mm_mul_ps(z, inv);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_storeu_ps(a[i].v, x);
+        _mm_storeu_ps(a[i+1].v, y);
+        _mm_storeu_ps(a[i+2].v, z);
+        _mm_storeu_ps(a[i+3].v, w);
+    }
+    for(; i < n; i++)
+    {
+        vec3_normalizep(&a[i]);
+    }
+}
+#endif
+
+void vec3_add_n(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n)
+{
+    size_t i = 0;
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec3_add_n_avx2(a, b, dst, n);
+        i = n & ~(size_t) 7;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec3_add_n_sse2(a, b, dst, n);
+        i = n & ~(size_t) 3;
+    }
+#endif
+    for(; i < n; i++)
+    {
+        dst.x[i] = a.x[i] + b.x[i];
+        dst.y[i] = a.y[i] + b.y[i];
+        dst.z[i] = a.z[i] + b.z[i];
+    }
+}
+
+void vec3_sub_n(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n)
+{
+    size_t i = 0;
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec3_sub_n_avx2(a, b, dst, n);
+        i = n & ~(size_t) 7;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec3_sub_n_sse2(a, b, dst, n);
+        i = n & ~(size_t) 3;
+    }
+#endif
+    for(; i < n; i++)
+    {
+        dst.x[i] = a.x[i] - b.x[i];
+        dst.y[i] = a.y[i] - b.y[i];
+        dst.z[i] = a.z[i] - b.z[i];
+    }
+}
+
+/**
+ * scales 'n' vectors of the stream 'a' in place
+ */
+void vec3_scale_n(vec3_soa a, float val, size_t n)
+{
+    size_t i = 0;
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec3_scale_n_avx2(a, val, n);
+        i = n & ~(size_t) 7;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec3_scale_n_sse2(a, val, n);
+        i = n & ~(size_t) 3;
+    }
+#endif
+    for(; i < n; i++)
+    {
+        a.x[i] *= val;
+        a.y[i] *= val;
+        a.z[i] *= val;
+    }
+}
+
+/**
+ * stores the dot product of each pair a[i], b[i] into dst[i]
+ */
+void vec3_dot_n(vec3_soa a, vec3_soa b, float *dst, size_t n)
+{
+    size_t i = 0;
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec3_dot_n_avx2(a, b, dst, n);
+        i = n & ~(size_t) 7;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec3_dot_n_sse2(a, b, dst, n);
+        i = n & ~(size_t) 3;
+    }
+#endif
+    for(; i < n; i++)
+    {
+        dst[i] = a.x[i] * b.x[i] + a.y[i] * b.y[i] + a.z[i] * b.z[i];
+    }
+}
+
+void vec3_cross_n(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n)
+{
+    size_t i = 0;
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec3_cross_n_avx2(a, b, dst, n);
+        i = n & ~(size_t) 7;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec3_cross_n_sse2(a, b, dst, n);
+        i = n & ~(size_t) 3;
+    }
+#endif
+    for(; i < n; i++)
+    {
+        vec3 va = vec3_setp(a.x[i], a.y[i], a.z[i]);
+        vec3 vb = vec3_setp(b.x[i], b.y[i], b.z[i]);
+        vec3 res = vec3_crossp(&va, &vb);
+        dst.x[i] = res.x;
+        dst.y[i] = res.y;
+        dst.z[i] = res.z;
+    }
+}
+
+/**
+ * normalizes 'n' vectors of the stream 'a' in place. Vectors of length zero
+ * remain unchanged
+ */
+void vec3_normalize_n(vec3_soa a, size_t n)
+{
+    size_t i = 0;
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec3_normalize_n_avx2(a, n);
+        i = n & ~(size_t) 7;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec3_normalize_n_sse2(a, n);
+        i = n & ~(size_t) 3;
+    }
+#endif
+    for(; i < n; i++)
+    {
+        vec3 v = vec3_setp(a.x[i], a.y[i], a.z[i]);
+        vec3_normalizep(&v);
+        a.x[i] = v.x;
+        a.y[i] = v.y;
+        a.z[i] = v.z;
+    }
+}
+
+void vec3_addp_n(const vec3 *a, const vec3 *b, vec3 *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec3_addp_n_avx2(a, b, dst, n);
+        return;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec3_addp_n_sse2(a, b, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = vec3_addp(&a[i], &b[i]);
+    }
+}
+
+void vec3_subp_n(const vec3 *a, const vec3 *b, vec3 *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec3_subp_n_avx2(a, b, dst, n);
+        return;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec3_subp_n_sse2(a, b, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = vec3_subp(&a[i], &b[i]);
+    }
+}
+
+void vec3_scalep_n(vec3 *a, float val, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec3_scalep_n_avx2(a, val, n);
+        return;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec3_scalep_n_sse2(a, val, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        vec3_scalep(&a[i], val);
+    }
+}
+
+void vec3_dotp_n(const vec3 *a, const vec3 *b, float *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_SSE2))
+    {
+        vec3_dotp_n_sse2(a, b, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = vec3_dotp(&a[i], &b[i]);
+    }
+}
+
+void vec3_crossp_n(const vec3 *a, const vec3 *b, vec3 *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_SSE2))
+    {
+        vec3_crossp_n_sse2(a, b, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = vec3_crossp(&a[i], &b[i]);
+    }
+}
+
+void vec3_normalizep_n(vec3 *a, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_SSE2))
+    {
+        vec3_normalizep_n_sse2(a, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        vec3_normalizep(&a[i]);
+    }
+}
+
 /*
  *************************************
  * 4 DIMENSIONAL FLOATING POINT VECTOR
@@ -572,9 +1134,9 @@ vec4 vec4_addp(const vec4 *a, const vec4 *b)
 {
     vec4 ret;
     ret.x = a->x + b->x;
-    ret.x = a->y + b->y;
-    ret.x = a->z + b->z;
-    ret.x = a->w + b->w;
+    ret.y = a->y + b->y;
+    ret.z = a->z + b->z;
+    ret.w = a->w + b->w;
     return ret;
 }
 
@@ -589,9 +1151,9 @@ vec4 vec4_subp(const vec4 *a, const vec4 *b)
 {
     vec4 ret;
     ret.x = a->x - b->x;
-    ret.x = a->y - b->y;
-    ret.x = a->z - b->z;
-    ret.x = a->w - b->w;
+    ret.y = a->y - b->y;
+    ret.z = a->z - b->z;
+    ret.w = a->w - b->w;
     return ret;
 }
 
@@ -737,6 +1299,213 @@ void vec4_printp(vec4 *a)
     printf("%f, %f, %f, %f\n", a->x, a->y, a->z, a->w);
 }
 
+/*
+ *************************************
+ * 4 DIMENSIONAL BATCH OPERATIONS
+ *************************************
+ */
+
+#if CPU_X86
+static CPU_TARGET("sse2") void vec4_addp_n_sse2(const vec4 *a, const vec4 *b, vec4 *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        _mm_storeu_ps(dst[i].v, _mm_add_ps(_mm_loadu_ps(a[i].v), _mm_loadu_ps(b[i].v)));
+    }
+}
+
+static CPU_TARGET("avx2") void vec4_addp_n_avx2(const vec4 *a, const vec4 *b, vec4 *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 2 <= n; i += 2)
+    {
+        _mm256_storeu_ps(dst[i].v, _mm256_add_ps(_mm256_loadu_ps(a[i].v), _mm256_loadu_ps(b[i].v)));
+    }
+    vec4_addp_n_sse2(&a[i], &b[i], &dst[i], n - i);
+}
+
+static CPU_TARGET("sse2") void vec4_subp_n_sse2(const vec4 *a, const vec4 *b, vec4 *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        _mm_storeu_ps(dst[i].v, _mm_sub_ps(_mm_loadu_ps(a[i].v), _mm_loadu_ps(b[i].v)));
+    }
+}
+
+static CPU_TARGET("avx2") void vec4_subp_n_avx2(const vec4 *a, const vec4 *b, vec4 *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 2 <= n; i += 2)
+    {
+        _mm256_storeu_ps(dst[i].v, _mm256_sub_ps(_mm256_loadu_ps(a[i].v), _mm256_loadu_ps(b[i].v)));
+    }
+    vec4_subp_n_sse2(&a[i], &b[i], &dst[i], n - i);
+}
+
+static CPU_TARGET("sse2") void vec4_scalep_n_sse2(vec4 *a, float val, size_t n)
+{
+    __m128 s = _mm_set1_ps(val);
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        _mm_storeu_ps(a[i].v, _mm_mul_ps(_mm_loadu_ps(a[i].v), s));
+    }
+}
+
+static CPU_TARGET("avx2") void vec4_scalep_n_avx2(vec4 *a, float val, size_t n)
+{
+    __m256 s = _mm256_set1_ps(val);
+    size_t i;
+    for(i = 0; i + 2 <= n; i += 2)
+    {
+        _mm256_storeu_ps(a[i].v, _mm256_mul_ps(_mm256_loadu_ps(a[i].v), s));
+    }
+    vec4_scalep_n_sse2(&a[i], val, n - i);
+}
+
+static CPU_TARGET("sse2") void vec4_dotp_n_sse2(const vec4 *a, const vec4 *b, float *dst, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 a0 = _mm_loadu_ps(a[i].v), a1 = _mm_loadu_ps(a[i+1].v);
+        __m128 a2 = _mm_loadu_ps(a[i+2].v), a3 = _mm_loadu_ps(a[i+3].v);
+        __m128 b0 = _mm_loadu_ps(b[i].v), b1 = _mm_loadu_ps(b[i+1].v);
+        __m128 b2 = _mm_loadu_ps(b[i+2].v), b3 = _mm_loadu_ps(b[i+3].v);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        __m128 d = _mm_add_ps(_mm_mul_ps(a0, b0), _mm_mul_ps(a1, b1));
+        d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(a2, b2)), _mm_mul_ps(a3, b3));
+        _mm_storeu_ps(&dst[i], d);
+    }
+    for(; i < n; i++)
+    {
+        dst[i] = vec4_dotp(&a[i], &b[i]);
+    }
+}
+
+static CPU_TARGET("sse2") void vec4_normalizep_n_sse2(vec4 *a, size_t n)
+{
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(a[i].v), y = _mm_loadu_ps(a[i+1].v);
+        __m128 z = _mm_loadu_ps(a[i+2].v), w = _mm_loadu_ps(a[i+3].v);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        __m128 sq = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+        sq = _mm_add_ps(_mm_add_ps(sq, _mm_mul_ps(z, z)), _mm_mul_ps(w, w));
+        __m128 inv = sse_normfactor(sq);
+        x = _mm_mul_ps(x, inv);
+        y = _mm_mul_ps(y, inv);
+        z = _mm_mul_ps(z, inv);
+        w = _mm_mul_ps(w, inv);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_storeu_ps(a[i].v, x);
+        _mm_storeu_ps(a[i+1].v, y);
+        _mm_storeu_ps(a[i+2].v, z);
+        _mm_storeu_ps(a[i+3].v, w);
+    }
+    for(; i < n; i++)
+    {
+        vec4_normalizep(&a[i]);
+    }
+}
+#endif
+
+void vec4_addp_n(const vec4 *a, const vec4 *b, vec4 *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec4_addp_n_avx2(a, b, dst, n);
+        return;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec4_addp_n_sse2(a, b, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = vec4_addp(&a[i], &b[i]);
+    }
+}
+
+void vec4_subp_n(const vec4 *a, const vec4 *b, vec4 *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec4_subp_n_avx2(a, b, dst, n);
+        return;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec4_subp_n_sse2(a, b, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = vec4_subp(&a[i], &b[i]);
+    }
+}
+
+void vec4_scalep_n(vec4 *a, float val, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        vec4_scalep_n_avx2(a, val, n);
+        return;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        vec4_scalep_n_sse2(a, val, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        vec4_scalep(&a[i], val);
+    }
+}
+
+void vec4_dotp_n(const vec4 *a, const vec4 *b, float *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_SSE2))
+    {
+        vec4_dotp_n_sse2(a, b, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = vec4_dotp(&a[i], &b[i]);
+    }
+}
+
+void vec4_normalizep_n(vec4 *a, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_SSE2))
+    {
+        vec4_normalizep_n_sse2(a, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        vec4_normalizep(&a[i]);
+    }
+}
+
 /*
  *************
  * QUATERNIONS
@@ -812,11 +1581,37 @@ quat quaternion_lerpp(quat *a, quat *b, float t)
     return ret;
 }
 
+/**
+ * spherical linear interpolation between the unit quaternions 'a' (t = 0) and
+ * 'b' (t = 1), along the shortest path
+ */
 quat quaternion_slerpp(quat *a, quat *b, float t)
 {
-    //TODO slerp
-    quat q = quaternion_set(0,0,0,0);
-    return q;
+    quat ret;
+    double cosom = quaternion_dotp(a, b);
+    double sign = 1.0;
+    if(cosom < 0.0)
+    {
+        cosom = -cosom;
+        sign = -1.0;
+    }
+
+    double wa = 1.0 - t;
+    double wb = t;
+    if(cosom < 1.0 - 1e-6) // otherwise too close to divide by sin(omega), lerp
+    {
+        double omega = acos(cosom);
+        double sinom = sin(omega);
+        wa = sin((1.0 - t) * omega) / sinom;
+        wb = sin(t * omega) / sinom;
+    }
+    wb *= sign;
+
+    ret.x = wa * a->x + wb * b->x;
+    ret.y = wa * a->y + wb * b->y;
+    ret.z = wa * a->z + wb * b->z;
+    ret.w = wa * a->w + wb * b->w;
+    return ret;
 }
 
 /**
@@ -956,3 +1751,371 @@ quat quaternion_orientp(vec3 up, vec3 fwd)
 }
 
 #endif
+
+/*
+ *************************************
+ * QUATERNION BATCH OPERATIONS
+ *************************************
+ */
+
+/*
+ * the approximate slerp tiers evaluate sin(t*omega)/sin(omega) as a polynomial
+ * in cos(omega) (Eberly, "A Fast and Accurate Algorithm for Computing SLERP"):
+ *
+ *   t * (1 + b[1](x-1) * (1 + b[2](x-1) * (... (1 + b[n](x-1)))))
+ *   b[i] = (t^2 - i^2) / (i(2i+1))
+ *
+ * with the last term scaled by 'mu' to make up for the truncated series. 'mu' 
+ * was fit to minimize the maximum weight error over t in [0,1] and 
+ * omega in [0, pi/2]. that error is 7.2e-7 for 12 terms, 1.1e-4 for 6 terms
+ */
+#define SLERP_MAX_TERMS 12
+
+struct slerp_tier
+{
+    int nterms;
+    float mu;
+};
+
+static const struct slerp_tier SLERP_TIERS[] = 
+{
+    {0, 0.0f},              // QUATERNION_SLERP_EXACT, uses quaternion_slerpp
+    {12, 1.89373065f},      // QUATERNION_SLERP_ACCURATE
+    {6, 1.81774864f},       // QUATERNION_SLERP_FAST
+};
+
+/**
+ * fills in the per-term factors b[i] for blend weight 't'
+ */
+static void slerp_factors(const struct slerp_tier *tier, float t, float *b)
+{
+    int i;
+    for(i = 1; i <= tier->nterms; i++)
+    {
+        float u = 1.0f / (i * (2 * i + 1));
+        float v = i / (2.0f * i + 1.0f);
+        b[i-1] = u * t * t - v;
+    }
+    b[tier->nterms - 1] *= tier->mu;
+}
+
+static quat quaternion_slerp_approx(const quat *a, const quat *b, 
+                                    const float *bt, const float *bd, int nterms, float t)
+{
+    quat ret;
+    float d = 1.0f - t;
+    float cosom = a->x * b->x + a->y * b->y + a->z * b->z + a->w * b->w;
+    float sign = cosom < 0.0f ? -1.0f : 1.0f;
+    float xm1 = cosom * sign - 1.0f;
+    float ct = 1.0f;
+    float cd = 1.0f;
+    int k;
+    for(k = nterms - 1; k >= 0; k--)
+    {
+        ct = 1.0f + bt[k] * xm1 * ct;
+        cd = 1.0f + bd[k] * xm1 * cd;
+    }
+    ct = ct * t * sign;
+    cd = cd * d;
+    ret.x = cd * a->x + ct * b->x;
+    ret.y = cd * a->y + ct * b->y;
+    ret.z = cd * a->z + ct * b->z;
+    ret.w = cd * a->w + ct * b->w;
+    return ret;
+}
+
+static quat quaternion_nlerp(const quat *a, const quat *b, float t)
+{
+    quat ret;
+    float d = 1.0f - t;
+    float cosom = a->x * b->x + a->y * b->y + a->z * b->z + a->w * b->w;
+    float ct = cosom < 0.0f ? -t : t;
+    ret.x = d * a->x + ct * b->x;
+    ret.y = d * a->y + ct * b->y;
+    ret.z = d * a->z + ct * b->z;
+    ret.w = d * a->w + ct * b->w;
+    float inv = 1.0f / sqrtf(ret.x * ret.x + ret.y * ret.y + ret.z * ret.z + ret.w * ret.w);
+    ret.x *= inv;
+    ret.y *= inv;
+    ret.z *= inv;
+    ret.w *= inv;
+    return ret;
+}
+
+#if CPU_X86
+/*
+ * the SIMD kernels hold 4 (or 8) quaternions transposed, one component per 
+ * register, and follow the operation order of the scalar versions above
+ */
+static inline CPU_TARGET("avx") void avx_transpose4(__m256 *r0, __m256 *r1, __m256 *r2, __m256 *r3)
+{
+    __m256 t0 = _mm256_unpacklo_ps(*r0, *r1);
+    __m256 t1 = _mm256_unpackhi_ps(*r0, *r1);
+    __m256 t2 = _mm256_unpacklo_ps(*r2, *r3);
+    __m256 t3 = _mm256_unpackhi_ps(*r2, *r3);
+    *r0 = _mm256_shuffle_ps(t0, t2, 0x44);
+    *r1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+    *r2 = _mm256_shuffle_ps(t1, t3, 0x44);
+    *r3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+}
+
+/**
+ * loads quaternions q[0..3] into the low halves and q[4..7] into the high halves, transposed
+ */
+static inline CPU_TARGET("avx") void avx_loadquat8(const quat *q, __m256 *x, __m256 *y, __m256 *z, __m256 *w)
+{
+    *x = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(q[0].v)), _mm_loadu_ps(q[4].v), 1);
+    *y = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(q[1].v)), _mm_loadu_ps(q[5].v), 1);
+    *z = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(q[2].v)), _mm_loadu_ps(q[6].v), 1);
+    *w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(q[3].v)), _mm_loadu_ps(q[7].v), 1);
+    avx_transpose4(x, y, z, w);
+}
+
+static inline CPU_TARGET("avx") void avx_storequat8(quat *q, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+    avx_transpose4(&x, &y, &z, &w);
+    _mm_storeu_ps(q[0].v, _mm256_castps256_ps128(x));
+    _mm_storeu_ps(q[1].v, _mm256_castps256_ps128(y));
+    _mm_storeu_ps(q[2].v, _mm256_castps256_ps128(z));
+    _mm_storeu_ps(q[3].v, _mm256_castps256_ps128(w));
+    _mm_storeu_ps(q[4].v, _mm256_extractf128_ps(x, 1));
+    _mm_storeu_ps(q[5].v, _mm256_extractf128_ps(y, 1));
+    _mm_storeu_ps(q[6].v, _mm256_extractf128_ps(z, 1));
+    _mm_storeu_ps(q[7].v, _mm256_extractf128_ps(w, 1));
+}
+
+static CPU_TARGET("sse2") void quaternion_slerp_n_sse2(const quat *a, const quat *b, float t, quat *dst, size_t n,
+                                                      const float *bt, const float *bd, int nterms)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 signbit = _mm_set1_ps(-0.0f);
+    __m128 vt = _mm_set1_ps(t);
+    __m128 vd = _mm_set1_ps(1.0f - t);
+    size_t i;
+    int k;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 ax = _mm_loadu_ps(a[i].v), ay = _mm_loadu_ps(a[i+1].v);
+        __m128 az = _mm_loadu_ps(a[i+2].v), aw = _mm_loadu_ps(a[i+3].v);
+        __m128 bx = _mm_loadu_ps(b[i].v), by = _mm_loadu_ps(b[i+1].v);
+        __m128 bz = _mm_loadu_ps(b[i+2].v), bw = _mm_loadu_ps(b[i+3].v);
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+        __m128 cosom = _mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by));
+        cosom = _mm_add_ps(_mm_add_ps(cosom, _mm_mul_ps(az, bz)), _mm_mul_ps(aw, bw));
+        __m128 sign = _mm_and_ps(_mm_cmplt_ps(cosom, _mm_setzero_ps()), signbit);
+        __m128 xm1 = _mm_sub_ps(_mm_xor_ps(cosom, sign), one);
+        __m128 ct = one;
+        __m128 cd = one;
+        for(k = nterms - 1; k >= 0; k--)
+        {
+            ct = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(bt[k]), xm1), ct));
+            cd = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(bd[k]), xm1), cd));
+        }
+        ct = _mm_xor_ps(_mm_mul_ps(ct, vt), sign);
+        cd = _mm_mul_ps(cd, vd);
+
+        ax = _mm_add_ps(_mm_mul_ps(cd, ax), _mm_mul_ps(ct, bx));
+        ay = _mm_add_ps(_mm_mul_ps(cd, ay), _mm_mul_ps(ct, by));
+        az = _mm_add_ps(_mm_mul_ps(cd, az), _mm_mul_ps(ct, bz));
+        aw = _mm_add_ps(_mm_mul_ps(cd, aw), _mm_mul_ps(ct, bw));
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        _mm_storeu_ps(dst[i].v, ax);
+        _mm_storeu_ps(dst[i+1].v, ay);
+        _mm_storeu_ps(dst[i+2].v, az);
+        _mm_storeu_ps(dst[i+3].v, aw);
+    }
+    for(; i < n; i++)
+    {
+        dst[i] = quaternion_slerp_approx(&a[i], &b[i], bt, bd, nterms, t);
+    }
+}
+
+static CPU_TARGET("avx") void quaternion_slerp_n_avx(const quat *a, const quat *b, float t, quat *dst, size_t n,
+                                                    const float *bt, const float *bd, int nterms)
+{
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 signbit = _mm256_set1_ps(-0.0f);
+    __m256 vt = _mm256_set1_ps(t);
+    __m256 vd = _mm256_set1_ps(1.0f - t);
+    size_t i;
+    int k;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        __m256 ax, ay, az, aw, bx, by, bz, bw;
+        avx_loadquat8(&a[i], &ax, &ay, &az, &aw);
+        avx_loadquat8(&b[i], &bx, &by, &bz, &bw);
+
+        __m256 cosom = _mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by));
+        cosom = _mm256_add_ps(_mm256_add_ps(cosom, _mm256_mul_ps(az, bz)), _mm256_mul_ps(aw, bw));
+        __m256 sign = _mm256_and_ps(_mm256_cmp_ps(cosom, _mm256_setzero_ps(), _CMP_LT_OQ), signbit);
+        __m256 xm1 = _mm256_sub_ps(_mm256_xor_ps(cosom, sign), one);
+        __m256 ct = one;
+        __m256 cd = one;
+        for(k = nterms - 1; k >= 0; k--)
+        {
+            ct = _mm256_add_ps(one, _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(bt[k]), xm1), ct));
+            cd = _mm256_add_ps(one, _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(bd[k]), xm1), cd));
+        }
+        ct = _mm256_xor_ps(_mm256_mul_ps(ct, vt), sign);
+        cd = _mm256_mul_ps(cd, vd);
+
+        ax = _mm256_add_ps(_mm256_mul_ps(cd, ax), _mm256_mul_ps(ct, bx));
+        ay = _mm256_add_ps(_mm256_mul_ps(cd, ay), _mm256_mul_ps(ct, by));
+        az = _mm256_add_ps(_mm256_mul_ps(cd, az), _mm256_mul_ps(ct, bz));
+        aw = _mm256_add_ps(_mm256_mul_ps(cd, aw), _mm256_mul_ps(ct, bw));
+        avx_storequat8(&dst[i], ax, ay, az, aw);
+    }
+    quaternion_slerp_n_sse2(&a[i], &b[i], t, &dst[i], n - i, bt, bd, nterms);
+}
+
+static CPU_TARGET("sse2") void quaternion_nlerp_n_sse2(const quat *a, const quat *b, float t, quat *dst, size_t n)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 signbit = _mm_set1_ps(-0.0f);
+    __m128 vt = _mm_set1_ps(t);
+    __m128 vd = _mm_set1_ps(1.0f - t);
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 ax = _mm_loadu_ps(a[i].v), ay = _mm_loadu_ps(a[i+1].v);
+        __m128 az = _mm_loadu_ps(a[i+2].v), aw = _mm_loadu_ps(a[i+3].v);
+        __m128 bx = _mm_loadu_ps(b[i].v), by = _mm_loadu_ps(b[i+1].v);
+        __m128 bz = _mm_loadu_ps(b[i+2].v), bw = _mm_loadu_ps(b[i+3].v);
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+        __m128 cosom = _mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by));
+        cosom = _mm_add_ps(_mm_add_ps(cosom, _mm_mul_ps(az, bz)), _mm_mul_ps(aw, bw));
+        __m128 ct = _mm_xor_ps(vt, _mm_and_ps(_mm_cmplt_ps(cosom, _mm_setzero_ps()), signbit));
+
+        ax = _mm_add_ps(_mm_mul_ps(vd, ax), _mm_mul_ps(ct, bx));
+        ay = _mm_add_ps(_mm_mul_ps(vd, ay), _mm_mul_ps(ct, by));
+        az = _mm_add_ps(_mm_mul_ps(vd, az), _mm_mul_ps(ct, bz));
+        aw = _mm_add_ps(_mm_mul_ps(vd, aw), _mm_mul_ps(ct, bw));
+        __m128 sq = _mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay));
+        sq = _mm_add_ps(_mm_add_ps(sq, _mm_mul_ps(az, az)), _mm_mul_ps(aw, aw));
+        __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(sq));
+        ax = _mm_mul_ps(ax, inv);
+        ay = _mm_mul_ps(ay, inv);
+        az = _mm_mul_ps(az, inv);
+        aw = _mm_mul_ps(aw, inv);
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        _mm_storeu_ps(dst[i].v, ax);
+        _mm_storeu_ps(dst[i+1].v, ay);
+        _mm_storeu_ps(dst[i+2].v, az);
+        _mm_storeu_ps(dst[i+3].v, aw);
+    }
+    for(; i < n; i++)
+    {
+        dst[i] = quaternion_nlerp(&a[i], &b[i], t);
+    }
+}
+
+static CPU_TARGET("avx") void quaternion_nlerp_n_avx(const quat *a, const quat *b, float t, quat *dst, size_t n)
+{
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 signbit = _mm256_set1_ps(-0.0f);
+    __m256 vt = _mm256_set1_ps(t);
+    __m256 vd = _mm256_set1_ps(1.0f - t);
+    size_t i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        __m256 ax, ay, az, aw, bx, by, bz, bw;
+        avx_loadquat8(&a[i], &ax, &ay, &az, &aw);
+        avx_loadquat8(&b[i], &bx, &by, &bz, &bw);
+
+        __m256 cosom = _mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by));
+        cosom = _mm256_add_ps(_mm256_add_ps(cosom, _mm256_mul_ps(az, bz)), _mm256_mul_ps(aw, bw));
+        __m256 ct = _mm256_xor_ps(vt, _mm256_and_ps(_mm256_cmp_ps(cosom, _mm256_setzero_ps(), _CMP_LT_OQ), signbit));
+
+        ax = _mm256_add_ps(_mm256_mul_ps(vd, ax), _mm256_mul_ps(ct, bx));
+        ay = _mm256_add_ps(_mm256_mul_ps(vd, ay), _mm256_mul_ps(ct, by));
+        az = _mm256_add_ps(_mm256_mul_ps(vd, az), _mm256_mul_ps(ct, bz));
+        aw = _mm256_add_ps(_mm256_mul_ps(vd, aw), _mm256_mul_ps(ct, bw));
+        __m256 sq = _mm256_add_ps(_mm256_mul_ps(ax, ax), _mm256_mul_ps(ay, ay));
+        sq = _mm256_add_ps(_mm256_add_ps(sq, _mm256_mul_ps(az, az)), _mm256_mul_ps(aw, aw));
+        __m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(sq));
+        ax = _mm256_mul_ps(ax, inv);
+        ay = _mm256_mul_ps(ay, inv);
+        az = _mm256_mul_ps(az, inv);
+        aw = _mm256_mul_ps(aw, inv);
+        avx_storequat8(&dst[i], ax, ay, az, aw);
+    }
+    quaternion_nlerp_n_sse2(&a[i], &b[i], t, &dst[i], n - i);
+}
+#endif
+
+/**
+ * spherical linear interpolation of 'n' pairs of unit quaternions, from a[i] 
+ * (t = 0) to b[i] (t = 1), along the shortest path. 'dst' may alias 'a' or 'b'.
+ * QUATERNION_SLERP_EXACT gives the same results as quaternion_slerpp. The 
+ * other tiers avoid acos and sin, and are vectorized, at the cost of a small 
+ * error in the result; it is largest for quaternions 180 degrees of rotation 
+ * apart, where it reaches about 1e-6 radians for ACCURATE, and 1e-4 for FAST
+ */
+void quaternion_slerp_n(const quat *a, const quat *b, float t, quat *dst, size_t n, 
+                        enum Quaternion_Slerp accuracy)
+{
+    assert(accuracy >= QUATERNION_SLERP_EXACT && accuracy <= QUATERNION_SLERP_FAST);
+
+    size_t i;
+    if(accuracy == QUATERNION_SLERP_EXACT)
+    {
+        for(i = 0; i < n; i++)
+        {
+            quat qa = a[i];
+            quat qb = b[i];
+            dst[i] = quaternion_slerpp(&qa, &qb, t);
+        }
+        return;
+    }
+
+    const struct slerp_tier *tier = &SLERP_TIERS[accuracy];
+    float bt[SLERP_MAX_TERMS];
+    float bd[SLERP_MAX_TERMS];
+    slerp_factors(tier, t, bt);
+    slerp_factors(tier, 1.0f - t, bd);
+
+#if CPU_X86
+    if(cpu_has(CPU_AVX))
+    {
+        quaternion_slerp_n_avx(a, b, t, dst, n, bt, bd, tier->nterms);
+        return;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        quaternion_slerp_n_sse2(a, b, t, dst, n, bt, bd, tier->nterms);
+        return;
+    }
+#endif
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = quaternion_slerp_approx(&a[i], &b[i], bt, bd, tier->nterms, t);
+    }
+}
+
+/**
+ * normalized linear interpolation of 'n' pairs of unit quaternions, from a[i]
+ * (t = 0) to b[i] (t = 1), along the shortest path. 'dst' may alias 'a' or 'b'.
+ * follows the same arc as slerp, but not at a constant speed
+ */
+void quaternion_nlerp_n(const quat *a, const quat *b, float t, quat *dst, size_t n)
+{
+#if CPU_X86
+    if(cpu_has(CPU_AVX))
+    {
+        quaternion_nlerp_n_avx(a, b, t, dst, n);
+        return;
+    } else if(cpu_has(CPU_SSE2))
+    {
+        quaternion_nlerp_n_sse2(a, b, t, dst, n);
+        return;
+    }
+#endif
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = quaternion_nlerp(&a[i], &b[i], t);
+    }
+}
@@ -11,6 +11,7 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "const.h"
@@ -96,6 +97,17 @@ typedef union vec4 {
 typedef vec4 quaternion;
 typedef vec4 quat;
 
+/**
+ * a structure-of-arrays stream of 3 dimensional vectors. Each member points
+ * to an array of components, element i is (x[i], y[i], z[i])
+ */
+typedef struct vec3_soa
+{
+    float *x;
+    float *y;
+    float *z;
+} vec3_soa;
+
 /*
 extern const float VEC4_ZERO[];
 extern const float VEC4_ONE[];
@@ -134,6 +146,7 @@ void    hvec3_set(hvec3 a, int16_t x, int16_t y, int16_t z);
 bool    hvec3_eq(hvec3 a, hvec3 b);
 
 // 2 Dimensional floating point vector
+#ifndef MATH_INLINE // defined inline by util/math/inline.h
 void    vec2_set(vec2 a, float x, float y);
 void    vec2_scale(vec2 a, float scale);
 void    vec2_copy(const vec2 src, vec2 dst);
@@ -142,9 +155,11 @@ void    vec2_add(const vec2 a, const vec2 b, vec2 dest);
 void    vec2_sub(const vec2 a, const vec2 b, vec2 dest);
 float   vec2_lensq(const vec2 a);
 void    vec2_normalize(vec2 a);
+#endif
 void    vec2_rand(vec2 res);
 
 /*{{{ 3 Dimensional floating point vectors */
+#ifndef MATH_INLINE
 vec3    vec3_setp(float x, float y, float z);
 vec3    vec3_copyp(const vec3 *src);
 bool    vec3_eqp(const vec3 *a, const vec3 *b);
@@ -160,6 +175,7 @@ void    vec3_scalep(vec3 *a, float val);
 vec3    vec3_crossp(const vec3 *a, const vec3 *b);
 vec3    vec3_projp(const vec3 *v, const vec3 *refaxis);
 vec3    vec3_orthp(const vec3 *v, const vec3 *refaxis);
+#endif
 vec3    vec3_avgp(int n, ...);
 vec3    vec3_wavgp(int n, ...);
 vec3    vec3_lavgp(int n, vec *list);
@@ -188,10 +204,26 @@ void    vec3_printp(const vec3 *a);
 #define vec3_lwavg(n, list, weight) vec3_lwavgp(n, list, weight);
 #define vec3_rand()         vec3_randp()
 #define vec3_print(a)       vec3_printp(&(a))
+
+// batch operations over 'n' elements, on SoA streams and arrays of vec3
+void    vec3_add_n(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n);
+void    vec3_sub_n(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n);
+void    vec3_scale_n(vec3_soa a, float val, size_t n);
+void    vec3_dot_n(vec3_soa a, vec3_soa b, float *dst, size_t n);
+void    vec3_cross_n(vec3_soa a, vec3_soa b, vec3_soa dst, size_t n);
+void    vec3_normalize_n(vec3_soa a, size_t n);
+
+void    vec3_addp_n(const vec3 *a, const vec3 *b, vec3 *dst, size_t n);
+void    vec3_subp_n(const vec3 *a, const vec3 *b, vec3 *dst, size_t n);
+void    vec3_scalep_n(vec3 *a, float val, size_t n);
+void    vec3_dotp_n(const vec3 *a, const vec3 *b, float *dst, size_t n);
+void    vec3_crossp_n(const vec3 *a, const vec3 *b, vec3 *dst, size_t n);
+void    vec3_normalizep_n(vec3 *a, size_t n);
 /*}}}*/
 
 /*{{{ 4 Dimensional floating point vectors */
 
+#ifndef MATH_INLINE
 vec4    vec4_setp(float x, float y, float z, float w);
 vec4    vec4_copyp(const vec4 *src);
 vec4    vec4_addp(const vec4 *a, const vec4 *b);
@@ -203,6 +235,7 @@ vec4    vec4_normalizedp(vec4 *a);
 void    vec4_scalep(vec4 *a, const float scale);
 vec4    vec4_projp(const vec4 *v, const vec4 *refaxis);
 vec4    vec4_orthp(const vec4 *v, const vec4 *refaxis);
+#endif
 void    vec4_printp(vec4 *a);
 //void    vec4_swizzlep(vec4 a, int x, int y, int z, int w);
 vec4    vec4_avg(int n, ...); //XXX: cannot make avgp?
@@ -219,10 +252,18 @@ vec4    vec4_avg(int n, ...); //XXX: cannot make avgp?
 #define vec4_proj(v, refaxis) vec4_projp(&(v), &(refaxis))
 #define vec4_orth(v, refaxis) vec4_orthp(&(v), &(refaxis))
 #define vec4_print(a) vec4_printp(&(a))
+
+// batch operations over arrays of 'n' vec4
+void    vec4_addp_n(const vec4 *a, const vec4 *b, vec4 *dst, size_t n);
+void    vec4_subp_n(const vec4 *a, const vec4 *b, vec4 *dst, size_t n);
+void    vec4_scalep_n(vec4 *a, float val, size_t n);
+void    vec4_dotp_n(const vec4 *a, const vec4 *b, float *dst, size_t n);
+void    vec4_normalizep_n(vec4 *a, size_t n);
 /*}}}*/
 
 /*{{{ quaternion vec4 alias functions*/
 
+#ifndef MATH_INLINE
 extern quat  (*quaternion_copyp)(const quat *src);
 extern float (*quaternion_dotp)(const quat *a, const quat *b);
 extern quat  (*quaternion_addp)(const quat *a, const quat *b);
@@ -235,7 +276,6 @@ quat    quaternion_set(float w, float x, float y, float z);
 quat    quaternion_set_rotation(float angle, vec3 axis);
 
 quat    quaternion_lerpp(quat *a, quat *b, float t);
-quat    quaternion_slerpp(quat *a, quat *b, float t);
 void    quaternion_rotatep(quat *a, float angle, vec3 axis);
 float   quaternion_normp(const quat *a);
 quat    quaternion_conjugatep(const quat *a);
@@ -245,14 +285,31 @@ quat    quaternion_imaginaryp(const quat *a);
 quat    quaternion_multp(const quat *a, const quat *b);
 quat    quaternion_divp(const quat *a, const quat *b);
 quat    quaternion_vecRotatep(quat *a, vec4 *b);
+#endif
+quat    quaternion_slerpp(quat *a, quat *b, float t);
 quat    quaternion_orientp(vec3 up, vec3 fwd);
 
+/**
+ * accuracy tiers of quaternion_slerp_n
+ */
+enum Quaternion_Slerp
+{
+    QUATERNION_SLERP_EXACT      = 0, ///< acos and sin, same as quaternion_slerpp
+    QUATERNION_SLERP_ACCURATE   = 1, ///< 12 term polynomial, error under 1e-6
+    QUATERNION_SLERP_FAST       = 2, ///< 6 term polynomial, error under 1e-4
+};
+
+// batch operations over arrays of 'n' quaternions
+void    quaternion_slerp_n(const quat *a, const quat *b, float t, quat *dst, size_t n, 
+                           enum Quaternion_Slerp accuracy);
+void    quaternion_nlerp_n(const quat *a, const quat *b, float t, quat *dst, size_t n);
+
 #define quaternion_copy(src)    quaternion_copyp(&(src))
 #define quaternion_dot(a, b)    quaternion_dotp(&(a), &(b))
-#define quaternion_add(a, b)    quaternion_add(&(a), &(b)
-#define quaternion_sub(a, b)    quaternion_sub(&(a), &(b)
-#define quaternion_normalize(a) quaternion_normalize(&(a))
-#define quaternion_lensq(a)     quaternion_lensq(&(a))
+#define quaternion_add(a, b)    quaternion_addp(&(a), &(b))
+#define quaternion_sub(a, b)    quaternion_subp(&(a), &(b))
+#define quaternion_normalize(a) quaternion_normalizep(&(a))
+#define quaternion_lensq(a)     quaternion_lensqp(&(a))
 
 #define quaternion_lerp(a, b, t)            quaternion_lerpp(&(a), &(b), t);
 #define quaternion_slerp(a, b, t)           quaternion_slerpp(&(a), &(b), t);
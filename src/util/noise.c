@@ -7,11 +7,17 @@
  */
 
 
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <float.h>
 
+#include "util/cpu.h"
 #include "util/random.h"
+#include "util/threadpool.h"
 #include "util/math/scalar.h"
 
 #include "noise.h"
@@ -19,6 +25,10 @@
 #define DOT2(a,b,x,y) ((a)*(x)+(b)*(y))
 #define DOT3(a,b,c,x,y,z) ((a)*(x)+(b)*(y)+(c)*(z))
 
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
 
 static float DEFAULT_GRAD[16 * 3] = 
 {
@@ -41,14 +51,70 @@ static float DEFAULT_GRAD[16 * 3] =
     0, -1, -1
 };
 
-static int GRAD_MASK = 0x0F; //MUST be a power of 2 - 1
-static float *GRAD = DEFAULT_GRAD;
+#define DEFAULT_SEED 55
+
+static NoiseContext default_context = {DEFAULT_SEED, 0x0F, DEFAULT_GRAD};
 static int initialized = 0;
 
-static int seed = 55;
+/**
+ * a 32 bit integer hash, used to fill the tables of a context from its seed
+ * without touching the shared random number generator
+ */
+static uint32_t noise_hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+/**
+ * sets 'grad' to a unit gradient, from two values uniform in [0, 1)
+ */
+static void noise_gradient(float *grad, float u, float v)
+{
+    float z = (u - 0.5f) * 2.0f;
+    float r = sqrtf(fmaxf(1.0f - z*z, 0.0f));
+    float t = 4.0f * PI * (v * 0.5f);
+    grad[0] = r * cosf(t);
+    grad[1] = r * sinf(t);
+    grad[2] = z;
+}
+
+/**
+ * creates a noise context with its own gradient table, generated from 's'.
+ * Contexts share no state, so each thread may use its own
+ */
+void noisecontext_init(NoiseContext *ctx, int s)
+{
+    ctx->seed = s;
+    ctx->grad = malloc(sizeof(float) * 3 * 1024);
+    ctx->gradmask = 0x03FF;
+
+    uint32_t h = noise_hash((uint32_t) s);
+    int i;
+    for(i = 0; i < 1024; i++)
+    {
+        h = noise_hash(h + 1);
+        float u = h / 4294967296.0f;
+        h = noise_hash(h + 1);
+        float v = h / 4294967296.0f;
+        noise_gradient(&ctx->grad[i * 3], u, v);
+    }
+}
+
+void noisecontext_finalize(NoiseContext *ctx)
+{
+    free(ctx->grad);
+    ctx->grad = NULL;
+}
 
 /**
- * sets a seed for the noise functions to follow
+ * sets a seed for the noise functions to follow. The default context's
+ * gradients are drawn from the shared random number generator, as they
+ * always have been, so its output is the same for the same generator state
  */
 void noise_init(int s)
 {
@@ -57,28 +123,38 @@ void noise_init(int s)
         noise_finalize();
     }
     initialized = 1;
-    seed = s;
-    GRAD = malloc(sizeof(float) * 3 *1024);
-    GRAD_MASK = 0x03FF;
+    default_context.seed = s;
+    default_context.grad = malloc(sizeof(float) * 3 * 1024);
+    default_context.gradmask = 0x03FF;
 
     int i;
     for(i = 0; i < 1024; i++)
     {
-        float z = (random_random() - 0.5f) * 2.0f;
-        float r = sqrtf(1.0f - z*z);
-        float t = 4.0f * PI * (random_random() * 0.5f);
-        float x = r * cosf(t);
-        float y = r * sinf(t);
-        GRAD[i * 3 + 0] = x;
-        GRAD[i * 3 + 1] = y;
-        GRAD[i * 3 + 2] = z;
+        float u = random_random();
+        float v = random_random();
+        noise_gradient(&default_context.grad[i * 3], u, v);
     }
 }
 
 void noise_finalize(void)
 {
-    free(GRAD);
-    GRAD = DEFAULT_GRAD;
+    if(initialized)
+    {
+        noisecontext_finalize(&default_context);
+        default_context.seed = DEFAULT_SEED;
+        default_context.grad = DEFAULT_GRAD;
+        default_context.gradmask = 0x0F;
+        initialized = 0;
+    }
+}
+
+/**
+ * the context behind the noise functions that do not take one. It is shared,
+ * and changed by noise_init
+ */
+const NoiseContext *noise_default(void)
+{
+    return &default_context;
 }
 
 /**
@@ -102,12 +178,34 @@ static inline float s_curve(float t)
     return (t*t*t*(10+t*(-15+(6*t))));
 }
 
+/**
+ * the derivative of s_curve at t
+ */
+static inline float s_curve_d(float t)
+{
+    return (30*t*t*(t*(t-2)+1));
+}
+
+/**
+ * the gradient of lerp(t, a, b) in 'dim' dimensions, given the gradients of
+ * 't', 'a' and 'b'
+ */
+static inline void lerp_d(float t, const float *dt, float a, const float *da,
+        float b, const float *db, float *ret, int dim)
+{
+    int i;
+    for(i = 0; i < dim; i++)
+    {
+        ret[i] = da[i] + dt[i] * (b - a) + t * (db[i] - da[i]);
+    }
+}
+
 /**
  * produces a random number from -1 to 1. The number is constant when the seed is the same
  */
-inline float noise1_random(int x)
+float noise1_random_ctx(const NoiseContext *ctx, int x)
 {
-    x += seed;
+    x += ctx->seed;
     x = (x<<13) ^ x;
     double t = (1.0f - ((x*(x*x*15731 + 789221) + 1376312589) & 0x7fffffff) / 1073741824.0f);
     return (float)t;
@@ -118,22 +216,22 @@ inline float noise1_random(int x)
  * coordinates of 'x' will have a random value, and each fractional coordinate of 
  * x will be an interpolation of the closest integer values
  */
-float noise1_value(float x)
+float noise1_value_ctx(const NoiseContext *ctx, float x)
 {
     int flx = floor(x);
-    float dx0 = noise1_random(flx);
-    float dx1 = noise1_random(flx + 1);
+    float dx0 = noise1_random_ctx(ctx, flx);
+    float dx1 = noise1_random_ctx(ctx, flx + 1);
     return lerp(x-flx, dx0, dx1);
 }
 
 /**
  * 1-dimensional perlin noise from -1 to 1.
  */
-float noise1_perlin(float x)
+float noise1_perlin_ctx(const NoiseContext *ctx, float x)
 {
     int flx = floor(x);
-    float dx0 = noise1_random(flx);
-    float dx1 = noise1_random(flx + 1);
+    float dx0 = noise1_random_ctx(ctx, flx);
+    float dx1 = noise1_random_ctx(ctx, flx + 1);
 
     float u = (x-flx) * dx0;
     float v = ((x-flx)-1) * dx1;
@@ -145,12 +243,12 @@ float noise1_perlin(float x)
  * defines the number of different 'octaves' to repeat
  * for the noise
  */
-float noise1_fracPerlin(float x, int n)
+float noise1_fracPerlin_ctx(const NoiseContext *ctx, float x, int n)
 {
     float sum = 0;
     int i;
     for(i = 1<<n; i>0; i = i>>1){
-        sum += (noise1_perlin(x * i)/i);
+        sum += (noise1_perlin_ctx(ctx, x * i)/i);
     }
     return sum;
 }
@@ -159,12 +257,12 @@ float noise1_fracPerlin(float x, int n)
  * terbulent noise. Perlin noise with discontinuous rates of change.
  * value between -1 and 1. n defines the number of 'octaves' to repeat
  */
-float noise1_terbulence(float x, int n)
+float noise1_terbulence_ctx(const NoiseContext *ctx, float x, int n)
 {
     float sum = 0;
     int i;
     for(i = 1<<n; i>0; i = i>>1)
-        sum += fabs(noise1_perlin(x*i)/i);
+        sum += fabs(noise1_perlin_ctx(ctx, x*i)/i);
     return sum * 2.0f - 1.0f;
 }
 
@@ -179,10 +277,10 @@ float noise1_terbulence(float x, int n)
 /**
  * random value from 2 given seeds. See noise_random1 above
  */
-inline float noise2_random(int x, int y)
+float noise2_random_ctx(const NoiseContext *ctx, int x, int y)
 {
-    x += seed;
-    y += seed;
+    x += ctx->seed;
+    y += ctx->seed;
     x += y * 71;
     x = (x >> 13) ^ x;
     return (1.0f - ((x * (x * x * 15731 + 789221) + 1376312589) & 0x7fffffff) / 1073741824.0f);
@@ -191,15 +289,15 @@ inline float noise2_random(int x, int y)
 /**
  * same as noise_random, except giving a different value for each given point
  */
-static void noise2_randGrad(int x, int y, float *xo, float *yo)
+static void noise2_randGrad(const NoiseContext *ctx, int x, int y, float *xo, float *yo)
 {
-    x += seed;
-    y += seed;
+    x += ctx->seed;
+    y += ctx->seed;
     int x1 = x  * 17 + y * 89;
     int y1 = x  * 31 + y * 71;
     x1 = ((x1 >> 17) ^ x1) & 0x7fffffff;
     y1 = ((y1 >> 17) ^ y1) & 0x7fffffff;
-    float *grad = &GRAD[(x1 * 3) & GRAD_MASK];
+    float *grad = &ctx->grad[(x1 * 3) & ctx->gradmask];
     *xo = grad[0];
     *yo = grad[1];
 }
@@ -208,14 +306,14 @@ static void noise2_randGrad(int x, int y, float *xo, float *yo)
  * 2 dimensional value noise. See 1 dimensional value noise above.
  * quick noise function with the downside being rectangular artifacts
  */
-float noise2_value(float x, float y)
+float noise2_value_ctx(const NoiseContext *ctx, float x, float y)
 {
     int flx = floor(x);
     int fly = floor(y);
-    float v0 = noise2_random(flx, fly);
-    float v1 = noise2_random(flx+1,fly);
-    float v2 = noise2_random(flx+1,fly+1);
-    float v3 = noise2_random(flx,fly+1);
+    float v0 = noise2_random_ctx(ctx, flx, fly);
+    float v1 = noise2_random_ctx(ctx, flx+1,fly);
+    float v2 = noise2_random_ctx(ctx, flx+1,fly+1);
+    float v3 = noise2_random_ctx(ctx, flx,fly+1);
 
     float px0 = lerp(s_curve(x-flx),v0,v1);
     float px1 = lerp(s_curve(x-flx),v3,v2);
@@ -225,7 +323,7 @@ float noise2_value(float x, float y)
 /**
  * produces 2 dimensional perlin noise
  */ 
-float noise2_perlin(float x, float y)
+float noise2_perlin_ctx(const NoiseContext *ctx, float x, float y)
 {
     int flx = floor(x);
     int fly = floor(y);
@@ -235,16 +333,16 @@ float noise2_perlin(float x, float y)
 
     float vx, vy;
     float s, t, u, v;
-    noise2_randGrad(flx, fly, &vx, &vy);
+    noise2_randGrad(ctx, flx, fly, &vx, &vy);
     s = DOT2(vx, vy, frx, fry);
 
-    noise2_randGrad(flx+1, fly, &vx, &vy); 
+    noise2_randGrad(ctx, flx+1, fly, &vx, &vy); 
     t = DOT2(vx, vy, frx - 1.0f, fry);
 
-    noise2_randGrad(flx+1, fly+1, &vx, &vy); 
+    noise2_randGrad(ctx, flx+1, fly+1, &vx, &vy); 
     u = DOT2(vx, vy, frx - 1.0f, fry - 1.0f);
 
-    noise2_randGrad(flx, fly+1, &vx, &vy); 
+    noise2_randGrad(ctx, flx, fly+1, &vx, &vy); 
     v = DOT2(vx, vy, frx, fry - 1.0f);
 
     float px0 = lerp(s_curve(frx), s, t);
@@ -256,12 +354,12 @@ float noise2_perlin(float x, float y)
 /**
  * produces 2 dimensional perlin fractal noise
  */
-float noise2_fracPerlin(float x, float y, int n)
+float noise2_fracPerlin_ctx(const NoiseContext *ctx, float x, float y, int n)
 {
     float sum = 0;
     int i;
     for(i = 1<<n; i>0; i = i>>1){
-        sum += (noise2_perlin(x * i, y * i)/i);
+        sum += (noise2_perlin_ctx(ctx, x * i, y * i)/i);
     }
     return sum;
 }
@@ -269,35 +367,111 @@ float noise2_fracPerlin(float x, float y, int n)
 /**
  * produces 2 dimensional perlin terbulent noise. 
  */
-float noise2_terbulence(float x, float y, int n)
+float noise2_terbulence_ctx(const NoiseContext *ctx, float x, float y, int n)
 {
     float sum = 0;
     int i;
     for(i = 1<<n; i>0; i = i>>1)
-        sum += fabs(noise2_perlin(x * i, y * i)/((float)i));
+        sum += fabs(noise2_perlin_ctx(ctx, x * i, y * i)/((float)i));
     return sum * 2.0f - 1.0f;
 }
 
+/**
+ * produces 2 dimensional ridged noise, from -1 to 1. Each octave is inverted
+ * and squared, turning the zero crossings of perlin noise into sharp ridges
+ */
+float noise2_ridged_ctx(const NoiseContext *ctx, float x, float y, int n)
+{
+    float sum = 0;
+    float weight = 0;
+    int i;
+    for(i = 1<<n; i>0; i = i>>1)
+    {
+        float r = 1.0f - fabs(noise2_perlin_ctx(ctx, x * i, y * i));
+        sum += r * r / i;
+        weight += 1.0f / i;
+    }
+    return sum / weight * 2.0f - 1.0f;
+}
+
+/**
+ * produces 2 dimensional perlin noise, the same as noise2_perlin, and stores
+ * its gradient (d/dx, d/dy) in 'grad'
+ */
+float noise2_perlin_d_ctx(const NoiseContext *ctx, float x, float y, float grad[2])
+{
+    int flx = floor(x);
+    int fly = floor(y);
+    float frx = x-flx;
+    float fry = y-fly;
+
+    // each corner value is a dot product, so its gradient is the corner gradient
+    float gs[2], gt[2], gu[2], gv[2];
+    float s, t, u, v;
+    noise2_randGrad(ctx, flx, fly, &gs[0], &gs[1]);
+    s = DOT2(gs[0], gs[1], frx, fry);
+
+    noise2_randGrad(ctx, flx+1, fly, &gt[0], &gt[1]);
+    t = DOT2(gt[0], gt[1], frx - 1.0f, fry);
+
+    noise2_randGrad(ctx, flx+1, fly+1, &gu[0], &gu[1]);
+    u = DOT2(gu[0], gu[1], frx - 1.0f, fry - 1.0f);
+
+    noise2_randGrad(ctx, flx, fly+1, &gv[0], &gv[1]);
+    v = DOT2(gv[0], gv[1], frx, fry - 1.0f);
+
+    float dsx[2] = {s_curve_d(frx), 0};
+    float dsy[2] = {0, s_curve_d(fry)};
+    float px0 = lerp(s_curve(frx), s, t);
+    float px1 = lerp(s_curve(frx), v, u);
+    float dpx0[2], dpx1[2];
+    lerp_d(s_curve(frx), dsx, s, gs, t, gt, dpx0, 2);
+    lerp_d(s_curve(frx), dsx, v, gv, u, gu, dpx1, 2);
+
+    lerp_d(s_curve(fry), dsy, px0, dpx0, px1, dpx1, grad, 2);
+    return lerp(s_curve(fry), px0, px1);
+}
+
+/**
+ * produces 2 dimensional perlin fractal noise, the same as noise2_fracPerlin, 
+ * and stores its gradient in 'grad'
+ */
+float noise2_fracPerlin_d_ctx(const NoiseContext *ctx, float x, float y, int n, float grad[2])
+{
+    float sum = 0;
+    float og[2];
+    int i;
+    grad[0] = grad[1] = 0;
+    for(i = 1<<n; i>0; i = i>>1){
+        sum += (noise2_perlin_d_ctx(ctx, x * i, y * i, og)/i);
+        // an octave scaled by i in both space and amplitude keeps a unit gradient
+        grad[0] += og[0];
+        grad[1] += og[1];
+    }
+    return sum;
+}
+
 /*
  * ************
  * 3D Functions
  * ************
  */
 
-static void noise3_randGrad(int x, int y, int z, float *xo, float *yo, float *zo)
+static void noise3_randGrad(const NoiseContext *ctx, int x, int y, int z, 
+        float *xo, float *yo, float *zo)
 {
-    x += seed;
-    y += seed;
-    z += seed;
+    x += ctx->seed;
+    y += ctx->seed;
+    z += ctx->seed;
     int x1 = x * 71 + y * 17 + z * 53;
     x1 = ((x1 >> 17) ^ x1) & 0x7fffffff;
-    float *grad = &GRAD[(x1 * 3) & GRAD_MASK];
+    float *grad = &ctx->grad[(x1 * 3) & ctx->gradmask];
     *xo = grad[0];
     *yo = grad[1];
     *zo = grad[2];
 }
 
-float noise3_perlin(float x, float y, float z)
+float noise3_perlin_ctx(const NoiseContext *ctx, float x, float y, float z)
 {
     int flx = floor(x);
     int fly = floor(y);
@@ -308,28 +482,28 @@ float noise3_perlin(float x, float y, float z)
 
     float vx, vy, vz;
     float o, p, q, r, s, t, u, v;
-    noise3_randGrad(flx, fly, flz, &vx, &vy, &vz);
+    noise3_randGrad(ctx, flx, fly, flz, &vx, &vy, &vz);
     o = DOT3(vx, vy, vz, frx, fry, frz);
 
-    noise3_randGrad(flx+1, fly, flz, &vx, &vy, &vz); 
+    noise3_randGrad(ctx, flx+1, fly, flz, &vx, &vy, &vz); 
     p = DOT3(vx, vy, vz, frx - 1.0f, fry, frz);
 
-    noise3_randGrad(flx+1, fly+1, flz, &vx, &vy, &vz); 
+    noise3_randGrad(ctx, flx+1, fly+1, flz, &vx, &vy, &vz); 
     q = DOT3(vx, vy, vz, frx - 1.0f, fry - 1.0f, frz);
 
-    noise3_randGrad(flx, fly+1, flz, &vx, &vy, &vz); 
+    noise3_randGrad(ctx, flx, fly+1, flz, &vx, &vy, &vz); 
     r = DOT3(vx, vy, vz, frx, fry - 1.0f, frz);
 
-    noise3_randGrad(flx, fly, flz+1, &vx, &vy, &vz);
+    noise3_randGrad(ctx, flx, fly, flz+1, &vx, &vy, &vz);
     s = DOT3(vx, vy, vz, frx, fry, frz - 1.0f);
 
-    noise3_randGrad(flx+1, fly, flz+1, &vx, &vy, &vz); 
+    noise3_randGrad(ctx, flx+1, fly, flz+1, &vx, &vy, &vz); 
     t = DOT3(vx, vy, vz, frx - 1.0f, fry, frz - 1.0f);
 
-    noise3_randGrad(flx+1, fly+1, flz+1, &vx, &vy, &vz); 
+    noise3_randGrad(ctx, flx+1, fly+1, flz+1, &vx, &vy, &vz); 
     u = DOT3(vx, vy, vz, frx - 1.0f, fry - 1.0f, frz - 1.0f);
 
-    noise3_randGrad(flx, fly+1, flz+1, &vx, &vy, &vz); 
+    noise3_randGrad(ctx, flx, fly+1, flz+1, &vx, &vy, &vz); 
     v = DOT3(vx, vy, vz, frx, fry - 1.0f, frz - 1.0f);
 
     float px0 = lerp(s_curve(frx), s, t);
@@ -347,12 +521,12 @@ float noise3_perlin(float x, float y, float z)
 /**
  * produces 3 dimensional perlin fractal noise
  */
-float noise3_fracPerlin(float x, float y, float z, int n)
+float noise3_fracPerlin_ctx(const NoiseContext *ctx, float x, float y, float z, int n)
 {
     float sum = 0;
     int i;
     for(i = 1<<n; i>0; i = i>>1){
-        sum += (noise3_perlin(x * i, y * i, z * i)/i);
+        sum += (noise3_perlin_ctx(ctx, x * i, y * i, z * i)/i);
     }
     return sum;
 }
@@ -360,12 +534,1105 @@ float noise3_fracPerlin(float x, float y, float z, int n)
 /**
  * produces 3 dimensional perlin terbulent noise. 
  */
-float noise3_terbulence(float x, float y, float z, int n)
+float noise3_terbulence_ctx(const NoiseContext *ctx, float x, float y, float z, int n)
+{
+    float sum = 0;
+    int i;
+    for(i = 1<<n; i>0; i = i>>1)
+        sum += fabs(noise3_perlin_ctx(ctx, x * i, y * i, z * i)/((float)i));
+    return sum * 2.0f - 1.0f;
+}
+
+/**
+ * produces 3 dimensional perlin noise, the same as noise3_perlin, and stores
+ * its gradient (d/dx, d/dy, d/dz) in 'grad'
+ */
+float noise3_perlin_d_ctx(const NoiseContext *ctx, float x, float y, float z, float grad[3])
+{
+    int flx = floor(x);
+    int fly = floor(y);
+    int flz = floor(z);
+    float frx = x-flx;
+    float fry = y-fly;
+    float frz = z-flz;
+
+    float go[3], gp[3], gq[3], gr[3], gs[3], gt[3], gu[3], gv[3];
+    float o, p, q, r, s, t, u, v;
+    noise3_randGrad(ctx, flx, fly, flz, &go[0], &go[1], &go[2]);
+    o = DOT3(go[0], go[1], go[2], frx, fry, frz);
+
+    noise3_randGrad(ctx, flx+1, fly, flz, &gp[0], &gp[1], &gp[2]);
+    p = DOT3(gp[0], gp[1], gp[2], frx - 1.0f, fry, frz);
+
+    noise3_randGrad(ctx, flx+1, fly+1, flz, &gq[0], &gq[1], &gq[2]);
+    q = DOT3(gq[0], gq[1], gq[2], frx - 1.0f, fry - 1.0f, frz);
+
+    noise3_randGrad(ctx, flx, fly+1, flz, &gr[0], &gr[1], &gr[2]);
+    r = DOT3(gr[0], gr[1], gr[2], frx, fry - 1.0f, frz);
+
+    noise3_randGrad(ctx, flx, fly, flz+1, &gs[0], &gs[1], &gs[2]);
+    s = DOT3(gs[0], gs[1], gs[2], frx, fry, frz - 1.0f);
+
+    noise3_randGrad(ctx, flx+1, fly, flz+1, &gt[0], &gt[1], &gt[2]);
+    t = DOT3(gt[0], gt[1], gt[2], frx - 1.0f, fry, frz - 1.0f);
+
+    noise3_randGrad(ctx, flx+1, fly+1, flz+1, &gu[0], &gu[1], &gu[2]);
+    u = DOT3(gu[0], gu[1], gu[2], frx - 1.0f, fry - 1.0f, frz - 1.0f);
+
+    noise3_randGrad(ctx, flx, fly+1, flz+1, &gv[0], &gv[1], &gv[2]);
+    v = DOT3(gv[0], gv[1], gv[2], frx, fry - 1.0f, frz - 1.0f);
+
+    float dsx[3] = {s_curve_d(frx), 0, 0};
+    float dsy[3] = {0, s_curve_d(fry), 0};
+    float dsz[3] = {0, 0, s_curve_d(frz)};
+
+    float px0 = lerp(s_curve(frx), s, t);
+    float px1 = lerp(s_curve(frx), v, u);
+    float px2 = lerp(s_curve(frx), o, p);
+    float px3 = lerp(s_curve(frx), r, q);
+    float dpx0[3], dpx1[3], dpx2[3], dpx3[3];
+    lerp_d(s_curve(frx), dsx, s, gs, t, gt, dpx0, 3);
+    lerp_d(s_curve(frx), dsx, v, gv, u, gu, dpx1, 3);
+    lerp_d(s_curve(frx), dsx, o, go, p, gp, dpx2, 3);
+    lerp_d(s_curve(frx), dsx, r, gr, q, gq, dpx3, 3);
+
+    float py0 = lerp(s_curve(fry), px0, px1);
+    float py1 = lerp(s_curve(fry), px2, px3);
+    float dpy0[3], dpy1[3];
+    lerp_d(s_curve(fry), dsy, px0, dpx0, px1, dpx1, dpy0, 3);
+    lerp_d(s_curve(fry), dsy, px2, dpx2, px3, dpx3, dpy1, 3);
+
+    lerp_d(s_curve(frz), dsz, py1, dpy1, py0, dpy0, grad, 3);
+    return lerp(s_curve(frz), py1, py0);
+}
+
+/**
+ * produces 3 dimensional perlin fractal noise, the same as noise3_fracPerlin,
+ * and stores its gradient in 'grad'
+ */
+float noise3_fracPerlin_d_ctx(const NoiseContext *ctx, float x, float y, float z, int n,
+        float grad[3])
+{
+    float sum = 0;
+    float og[3];
+    int i;
+    grad[0] = grad[1] = grad[2] = 0;
+    for(i = 1<<n; i>0; i = i>>1){
+        sum += (noise3_perlin_d_ctx(ctx, x * i, y * i, z * i, og)/i);
+        grad[0] += og[0];
+        grad[1] += og[1];
+        grad[2] += og[2];
+    }
+    return sum;
+}
+
+
+/*
+ * *****************
+ * Simplex Functions
+ * *****************
+ */
+
+/*
+ * simplex noise interpolates between the N+1 corners of the simplex around
+ * a point, instead of the 2^N corners of a grid cell. Each corner falls off
+ * radially, which removes the axis aligned artifacts of perlin noise.
+ * The skew (F) and unskew (G) factors map between simplex and grid space
+ */
+#define SIMPLEX_F2 0.366025403f // (sqrt(3) - 1) / 2
+#define SIMPLEX_G2 0.211324865f // (3 - sqrt(3)) / 6
+#define SIMPLEX_F3 (1.0f / 3.0f)
+#define SIMPLEX_G3 (1.0f / 6.0f)
+#define SIMPLEX_F4 0.309016994f // (sqrt(5) - 1) / 4
+#define SIMPLEX_G4 0.138196601f // (5 - sqrt(5)) / 20
+
+// the 12 cube edges, padded to 16 with a tetrahedron of them to avoid a modulo
+static const float SIMPLEX_GRAD3[16][3] =
+{
+    {1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0},
+    {1, 0, 1}, {-1, 0, 1}, {1, 0, -1}, {-1, 0, -1},
+    {0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1},
+    {1, 1, 0}, {-1, 1, 0}, {0, -1, 1}, {0, -1, -1}
+};
+
+static const float SIMPLEX_GRAD4[32][4] =
+{
+    {0, 1, 1, 1}, {0, 1, 1, -1}, {0, 1, -1, 1}, {0, 1, -1, -1},
+    {0, -1, 1, 1}, {0, -1, 1, -1}, {0, -1, -1, 1}, {0, -1, -1, -1},
+    {1, 0, 1, 1}, {1, 0, 1, -1}, {1, 0, -1, 1}, {1, 0, -1, -1},
+    {-1, 0, 1, 1}, {-1, 0, 1, -1}, {-1, 0, -1, 1}, {-1, 0, -1, -1},
+    {1, 1, 0, 1}, {1, 1, 0, -1}, {1, -1, 0, 1}, {1, -1, 0, -1},
+    {-1, 1, 0, 1}, {-1, 1, 0, -1}, {-1, -1, 0, 1}, {-1, -1, 0, -1},
+    {1, 1, 1, 0}, {1, 1, -1, 0}, {1, -1, 1, 0}, {1, -1, -1, 0},
+    {-1, 1, 1, 0}, {-1, 1, -1, 0}, {-1, -1, 1, 0}, {-1, -1, -1, 0}
+};
+
+/*
+ * a lattice point (x, y, z, w) hashes to the xor of x * SIMPLEX_HX, y * SIMPLEX_HY,
+ * and so on. Each term is found once per sample and stepped to the other corners
+ * by adding the constant
+ */
+#define SIMPLEX_HX 0x8da6b343u
+#define SIMPLEX_HY 0xd8163841u
+#define SIMPLEX_HZ 0xcb1ab31fu
+#define SIMPLEX_HW 0x165667b1u
+
+/**
+ * mixes the seed into a lattice hash, picking the gradient of a simplex corner.
+ * Only the high bits are well mixed
+ */
+static inline uint32_t noise_simplexHash(const NoiseContext *ctx, uint32_t h)
+{
+    return (h ^ (uint32_t) ctx->seed) * 0x27d4eb2du;
+}
+
+/**
+ * the contribution of a simplex corner at offset (x, y) from the sample point
+ */
+static inline float noise2_simplexCorner(const NoiseContext *ctx, uint32_t h, float x, float y)
+{
+    float t = 0.5f - x*x - y*y;
+    t = t > 0.0f ? t : 0.0f;
+    const float *g = SIMPLEX_GRAD3[noise_simplexHash(ctx, h) >> 28];
+    t *= t;
+    return t * t * DOT2(g[0], g[1], x, y);
+}
+
+/**
+ * 2 dimensional simplex noise, from -1 to 1
+ */
+float noise2_simplex_ctx(const NoiseContext *ctx, float x, float y)
+{
+    float s = (x + y) * SIMPLEX_F2;
+    float fi = floorf(x + s);
+    float fj = floorf(y + s);
+    int i = fi, j = fj;
+    float t = (fi + fj) * SIMPLEX_G2;
+    float x0 = x - (fi - t);
+    float y0 = y - (fj - t);
+
+    // the middle corner of the triangle, in grid space
+    int i1 = x0 > y0 ? 1 : 0;
+    int j1 = 1 - i1;
+
+    uint32_t hx = i * SIMPLEX_HX;
+    uint32_t hy = j * SIMPLEX_HY;
+    float n = noise2_simplexCorner(ctx, hx ^ hy, x0, y0);
+    n += noise2_simplexCorner(ctx, (hx + i1 * SIMPLEX_HX) ^ (hy + j1 * SIMPLEX_HY),
+                              x0 - i1 + SIMPLEX_G2, y0 - j1 + SIMPLEX_G2);
+    n += noise2_simplexCorner(ctx, (hx + SIMPLEX_HX) ^ (hy + SIMPLEX_HY),
+                              x0 - 1.0f + 2.0f * SIMPLEX_G2, y0 - 1.0f + 2.0f * SIMPLEX_G2);
+    return 70.0f * n;
+}
+
+static inline float noise3_simplexCorner(const NoiseContext *ctx, uint32_t h,
+        float x, float y, float z)
+{
+    float t = 0.6f - x*x - y*y - z*z;
+    t = t > 0.0f ? t : 0.0f;
+    const float *g = SIMPLEX_GRAD3[noise_simplexHash(ctx, h) >> 28];
+    t *= t;
+    return t * t * DOT3(g[0], g[1], g[2], x, y, z);
+}
+
+/**
+ * 3 dimensional simplex noise, from -1 to 1. Samples 4 corners to the 8 of
+ * noise3_perlin
+ */
+float noise3_simplex_ctx(const NoiseContext *ctx, float x, float y, float z)
+{
+    float s = (x + y + z) * SIMPLEX_F3;
+    float fi = floorf(x + s);
+    float fj = floorf(y + s);
+    float fk = floorf(z + s);
+    int i = fi, j = fj, k = fk;
+    float t = (fi + fj + fk) * SIMPLEX_G3;
+    float x0 = x - (fi - t);
+    float y0 = y - (fj - t);
+    float z0 = z - (fk - t);
+
+    // the 2nd and 3rd corners of the simplex, stepping along the largest offsets
+    int i1, j1, k1, i2, j2, k2;
+    if(x0 >= y0)
+    {
+        if(y0 >= z0)      { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+        else if(x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; }
+        else              { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; }
+    } else
+    {
+        if(y0 < z0)       { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; }
+        else if(x0 < z0)  { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; }
+        else              { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+    }
+
+    uint32_t hx = i * SIMPLEX_HX;
+    uint32_t hy = j * SIMPLEX_HY;
+    uint32_t hz = k * SIMPLEX_HZ;
+    float n = noise3_simplexCorner(ctx, hx ^ hy ^ hz, x0, y0, z0);
+    n += noise3_simplexCorner(ctx,
+            (hx + i1 * SIMPLEX_HX) ^ (hy + j1 * SIMPLEX_HY) ^ (hz + k1 * SIMPLEX_HZ),
+            x0 - i1 + SIMPLEX_G3, y0 - j1 + SIMPLEX_G3, z0 - k1 + SIMPLEX_G3);
+    n += noise3_simplexCorner(ctx,
+            (hx + i2 * SIMPLEX_HX) ^ (hy + j2 * SIMPLEX_HY) ^ (hz + k2 * SIMPLEX_HZ),
+            x0 - i2 + 2.0f * SIMPLEX_G3, y0 - j2 + 2.0f * SIMPLEX_G3, z0 - k2 + 2.0f * SIMPLEX_G3);
+    n += noise3_simplexCorner(ctx, (hx + SIMPLEX_HX) ^ (hy + SIMPLEX_HY) ^ (hz + SIMPLEX_HZ),
+            x0 - 1.0f + 3.0f * SIMPLEX_G3, y0 - 1.0f + 3.0f * SIMPLEX_G3, z0 - 1.0f + 3.0f * SIMPLEX_G3);
+    return 32.0f * n;
+}
+
+static inline float noise4_simplexCorner(const NoiseContext *ctx, uint32_t h,
+        float x, float y, float z, float w)
+{
+    float t = 0.6f - x*x - y*y - z*z - w*w;
+    t = t > 0.0f ? t : 0.0f;
+    const float *g = SIMPLEX_GRAD4[noise_simplexHash(ctx, h) >> 27];
+    t *= t;
+    return t * t * (g[0] * x + g[1] * y + g[2] * z + g[3] * w);
+}
+
+/**
+ * 4 dimensional simplex noise, from -1 to 1. Moving the 4th coordinate
+ * around a circle gives 3 dimensional noise that loops in time
+ */
+float noise4_simplex_ctx(const NoiseContext *ctx, float x, float y, float z, float w)
+{
+    float s = (x + y + z + w) * SIMPLEX_F4;
+    float fi = floorf(x + s);
+    float fj = floorf(y + s);
+    float fk = floorf(z + s);
+    float fl = floorf(w + s);
+    int i = fi, j = fj, k = fk, l = fl;
+    float t = (fi + fj + fk + fl) * SIMPLEX_G4;
+    float x0 = x - (fi - t);
+    float y0 = y - (fj - t);
+    float z0 = z - (fk - t);
+    float w0 = w - (fl - t);
+
+    // the simplex is found by ranking the offsets, largest first
+    int rx = (x0 > y0) + (x0 > z0) + (x0 > w0);
+    int ry = (y0 >= x0) + (y0 > z0) + (y0 > w0);
+    int rz = (z0 >= x0) + (z0 >= y0) + (z0 > w0);
+    int rw = (w0 >= x0) + (w0 >= y0) + (w0 >= z0);
+
+    uint32_t hx = i * SIMPLEX_HX;
+    uint32_t hy = j * SIMPLEX_HY;
+    uint32_t hz = k * SIMPLEX_HZ;
+    uint32_t hw = l * SIMPLEX_HW;
+    float n = noise4_simplexCorner(ctx, hx ^ hy ^ hz ^ hw, x0, y0, z0, w0);
+    int c;
+    for(c = 1; c <= 3; c++)
+    {
+        // the corner c steps along the simplex, stepping the c largest offsets
+        int i1 = rx >= 4 - c, j1 = ry >= 4 - c, k1 = rz >= 4 - c, l1 = rw >= 4 - c;
+        float g = c * SIMPLEX_G4;
+        uint32_t h = (hx + i1 * SIMPLEX_HX) ^ (hy + j1 * SIMPLEX_HY) ^
+                     (hz + k1 * SIMPLEX_HZ) ^ (hw + l1 * SIMPLEX_HW);
+        n += noise4_simplexCorner(ctx, h,
+                x0 - i1 + g, y0 - j1 + g, z0 - k1 + g, w0 - l1 + g);
+    }
+    float g = 4.0f * SIMPLEX_G4;
+    uint32_t h = (hx + SIMPLEX_HX) ^ (hy + SIMPLEX_HY) ^ (hz + SIMPLEX_HZ) ^ (hw + SIMPLEX_HW);
+    n += noise4_simplexCorner(ctx, h,
+            x0 - 1.0f + g, y0 - 1.0f + g, z0 - 1.0f + g, w0 - 1.0f + g);
+    return 27.0f * n;
+}
+
+/**
+ * fractal simplex noise, the octaves summed as in noise2_fracPerlin
+ */
+float noise2_fracSimplex_ctx(const NoiseContext *ctx, float x, float y, int n)
+{
+    float sum = 0;
+    int i;
+    for(i = 1<<n; i>0; i = i>>1){
+        sum += (noise2_simplex_ctx(ctx, x * i, y * i)/i);
+    }
+    return sum;
+}
+
+float noise3_fracSimplex_ctx(const NoiseContext *ctx, float x, float y, float z, int n)
+{
+    float sum = 0;
+    int i;
+    for(i = 1<<n; i>0; i = i>>1){
+        sum += (noise3_simplex_ctx(ctx, x * i, y * i, z * i)/i);
+    }
+    return sum;
+}
+
+float noise4_fracSimplex_ctx(const NoiseContext *ctx, float x, float y, float z, float w, int n)
+{
+    float sum = 0;
+    int i;
+    for(i = 1<<n; i>0; i = i>>1){
+        sum += (noise4_simplex_ctx(ctx, x * i, y * i, z * i, w * i)/i);
+    }
+    return sum;
+}
+
+/**
+ * terbulent simplex noise, as noise2_terbulence
+ */
+float noise2_terbulenceSimplex_ctx(const NoiseContext *ctx, float x, float y, int n)
+{
+    float sum = 0;
+    int i;
+    for(i = 1<<n; i>0; i = i>>1)
+        sum += fabs(noise2_simplex_ctx(ctx, x * i, y * i)/((float)i));
+    return sum * 2.0f - 1.0f;
+}
+
+float noise3_terbulenceSimplex_ctx(const NoiseContext *ctx, float x, float y, float z, int n)
+{
+    float sum = 0;
+    int i;
+    for(i = 1<<n; i>0; i = i>>1)
+        sum += fabs(noise3_simplex_ctx(ctx, x * i, y * i, z * i)/((float)i));
+    return sum * 2.0f - 1.0f;
+}
+
+float noise4_terbulenceSimplex_ctx(const NoiseContext *ctx, float x, float y, float z, float w, int n)
 {
     float sum = 0;
     int i;
     for(i = 1<<n; i>0; i = i>>1)
-        sum += fabs(noise3_perlin(x * i, y * i, z * i)/((float)i));
+        sum += fabs(noise4_simplex_ctx(ctx, x * i, y * i, z * i, w * i)/((float)i));
     return sum * 2.0f - 1.0f;
 }
 
+/*
+ * ***************
+ * Batch Functions
+ * ***************
+ */
+
+/*
+ * the kernels below follow the scalar functions operation for operation, so
+ * they give the same results. The lattice hashes need 32 bit integer
+ * multiplies, so the narrowest kernel is SSE4.1
+ */
+#if CPU_X86
+
+static inline CPU_TARGET("sse4.1") __m128 s_curve_sse41(__m128 t)
+{
+    __m128 poly = _mm_add_ps(_mm_set1_ps(-15), _mm_mul_ps(_mm_set1_ps(6), t));
+    poly = _mm_add_ps(_mm_set1_ps(10), _mm_mul_ps(t, poly));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), poly);
+}
+
+static inline CPU_TARGET("sse4.1") __m128 lerp_sse41(__m128 t, __m128 a, __m128 b)
+{
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+/**
+ * the offsets into the gradient table of 4 lattice hashes, as noise2_randGrad/noise3_randGrad
+ */
+static inline CPU_TARGET("sse4.1") __m128i noise_gradoffset_sse41(const NoiseContext *ctx, __m128i h)
+{
+    h = _mm_and_si128(_mm_xor_si128(_mm_srai_epi32(h, 17), h), _mm_set1_epi32(0x7fffffff));
+    h = _mm_mullo_epi32(h, _mm_set1_epi32(3));
+    return _mm_and_si128(h, _mm_set1_epi32(ctx->gradmask));
+}
+
+/**
+ * the dot product of the gradients at 'off' with (fx, fy, fz)
+ */
+static inline CPU_TARGET("sse4.1") __m128 noise_graddot_sse41(const NoiseContext *ctx, __m128i off,
+        __m128 fx, __m128 fy, __m128 fz, bool threed)
+{
+    int idx[4];
+    float g[3][4];
+    _mm_storeu_si128((__m128i*) idx, off);
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        g[0][i] = ctx->grad[idx[i]];
+        g[1][i] = ctx->grad[idx[i] + 1];
+        g[2][i] = ctx->grad[idx[i] + 2];
+    }
+    __m128 ret = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(g[0]), fx),
+                            _mm_mul_ps(_mm_loadu_ps(g[1]), fy));
+    if(threed)
+    {
+        ret = _mm_add_ps(ret, _mm_mul_ps(_mm_loadu_ps(g[2]), fz));
+    }
+    return ret;
+}
+
+static CPU_TARGET("sse4.1") __m128 noise2_perlin_sse41(const NoiseContext *ctx, __m128 x, __m128 y)
+{
+    __m128 flx = _mm_floor_ps(x);
+    __m128 fly = _mm_floor_ps(y);
+    __m128 frx = _mm_sub_ps(x, flx);
+    __m128 fry = _mm_sub_ps(y, fly);
+    __m128 frx1 = _mm_sub_ps(frx, _mm_set1_ps(1.0f));
+    __m128 fry1 = _mm_sub_ps(fry, _mm_set1_ps(1.0f));
+
+    // x * 17 + y * 89 at each corner, with the seed added to x and y
+    __m128i ix = _mm_add_epi32(_mm_cvttps_epi32(flx), _mm_set1_epi32(ctx->seed));
+    __m128i iy = _mm_add_epi32(_mm_cvttps_epi32(fly), _mm_set1_epi32(ctx->seed));
+    __m128i hx0 = _mm_mullo_epi32(ix, _mm_set1_epi32(17));
+    __m128i hx1 = _mm_add_epi32(hx0, _mm_set1_epi32(17));
+    __m128i hy0 = _mm_mullo_epi32(iy, _mm_set1_epi32(89));
+    __m128i hy1 = _mm_add_epi32(hy0, _mm_set1_epi32(89));
+
+    __m128 s = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(hx0, hy0)), frx, fry, frx, false);
+    __m128 t = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(hx1, hy0)), frx1, fry, frx, false);
+    __m128 u = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(hx1, hy1)), frx1, fry1, frx, false);
+    __m128 v = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(hx0, hy1)), frx, fry1, frx, false);
+
+    __m128 sx = s_curve_sse41(frx);
+    __m128 px0 = lerp_sse41(sx, s, t);
+    __m128 px1 = lerp_sse41(sx, v, u);
+    return lerp_sse41(s_curve_sse41(fry), px0, px1);
+}
+
+static CPU_TARGET("sse4.1") __m128 noise3_perlin_sse41(const NoiseContext *ctx, __m128 x, __m128 y, __m128 z)
+{
+    __m128 flx = _mm_floor_ps(x);
+    __m128 fly = _mm_floor_ps(y);
+    __m128 flz = _mm_floor_ps(z);
+    __m128 frx = _mm_sub_ps(x, flx);
+    __m128 fry = _mm_sub_ps(y, fly);
+    __m128 frz = _mm_sub_ps(z, flz);
+    __m128 frx1 = _mm_sub_ps(frx, _mm_set1_ps(1.0f));
+    __m128 fry1 = _mm_sub_ps(fry, _mm_set1_ps(1.0f));
+    __m128 frz1 = _mm_sub_ps(frz, _mm_set1_ps(1.0f));
+
+    // x * 71 + y * 17 + z * 53 at each corner, with the seed added to x, y and z
+    __m128i ix = _mm_add_epi32(_mm_cvttps_epi32(flx), _mm_set1_epi32(ctx->seed));
+    __m128i iy = _mm_add_epi32(_mm_cvttps_epi32(fly), _mm_set1_epi32(ctx->seed));
+    __m128i iz = _mm_add_epi32(_mm_cvttps_epi32(flz), _mm_set1_epi32(ctx->seed));
+    __m128i hx0 = _mm_mullo_epi32(ix, _mm_set1_epi32(71));
+    __m128i hx1 = _mm_add_epi32(hx0, _mm_set1_epi32(71));
+    __m128i hy0 = _mm_mullo_epi32(iy, _mm_set1_epi32(17));
+    __m128i hy1 = _mm_add_epi32(hy0, _mm_set1_epi32(17));
+    __m128i hz0 = _mm_mullo_epi32(iz, _mm_set1_epi32(53));
+    __m128i hz1 = _mm_add_epi32(hz0, _mm_set1_epi32(53));
+    __m128i h00 = _mm_add_epi32(hx0, hy0);
+    __m128i h10 = _mm_add_epi32(hx1, hy0);
+    __m128i h11 = _mm_add_epi32(hx1, hy1);
+    __m128i h01 = _mm_add_epi32(hx0, hy1);
+
+    __m128 o = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(h00, hz0)), frx, fry, frz, true);
+    __m128 p = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(h10, hz0)), frx1, fry, frz, true);
+    __m128 q = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(h11, hz0)), frx1, fry1, frz, true);
+    __m128 r = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(h01, hz0)), frx, fry1, frz, true);
+    __m128 s = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(h00, hz1)), frx, fry, frz1, true);
+    __m128 t = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(h10, hz1)), frx1, fry, frz1, true);
+    __m128 u = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(h11, hz1)), frx1, fry1, frz1, true);
+    __m128 v = noise_graddot_sse41(ctx, noise_gradoffset_sse41(ctx, _mm_add_epi32(h01, hz1)), frx, fry1, frz1, true);
+
+    __m128 sx = s_curve_sse41(frx);
+    __m128 px0 = lerp_sse41(sx, s, t);
+    __m128 px1 = lerp_sse41(sx, v, u);
+    __m128 px2 = lerp_sse41(sx, o, p);
+    __m128 px3 = lerp_sse41(sx, r, q);
+
+    __m128 sy = s_curve_sse41(fry);
+    __m128 py0 = lerp_sse41(sy, px0, px1);
+    __m128 py1 = lerp_sse41(sy, px2, px3);
+    return lerp_sse41(s_curve_sse41(frz), py1, py0);
+}
+
+static inline CPU_TARGET("avx2") __m256 s_curve_avx2(__m256 t)
+{
+    __m256 poly = _mm256_add_ps(_mm256_set1_ps(-15), _mm256_mul_ps(_mm256_set1_ps(6), t));
+    poly = _mm256_add_ps(_mm256_set1_ps(10), _mm256_mul_ps(t, poly));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), poly);
+}
+
+static inline CPU_TARGET("avx2") __m256 lerp_avx2(__m256 t, __m256 a, __m256 b)
+{
+    return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+static inline CPU_TARGET("avx2") __m256i noise_gradoffset_avx2(const NoiseContext *ctx, __m256i h)
+{
+    h = _mm256_and_si256(_mm256_xor_si256(_mm256_srai_epi32(h, 17), h),
+                         _mm256_set1_epi32(0x7fffffff));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32(3));
+    return _mm256_and_si256(h, _mm256_set1_epi32(ctx->gradmask));
+}
+
+static inline CPU_TARGET("avx2") __m256 noise_graddot_avx2(const NoiseContext *ctx, __m256i off,
+        __m256 fx, __m256 fy, __m256 fz, bool threed)
+{
+    __m256 ret = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(ctx->grad, off, 4), fx),
+                               _mm256_mul_ps(_mm256_i32gather_ps(ctx->grad + 1, off, 4), fy));
+    if(threed)
+    {
+        ret = _mm256_add_ps(ret, _mm256_mul_ps(_mm256_i32gather_ps(ctx->grad + 2, off, 4), fz));
+    }
+    return ret;
+}
+
+static CPU_TARGET("avx2") __m256 noise2_perlin_avx2(const NoiseContext *ctx, __m256 x, __m256 y)
+{
+    __m256 flx = _mm256_floor_ps(x);
+    __m256 fly = _mm256_floor_ps(y);
+    __m256 frx = _mm256_sub_ps(x, flx);
+    __m256 fry = _mm256_sub_ps(y, fly);
+    __m256 frx1 = _mm256_sub_ps(frx, _mm256_set1_ps(1.0f));
+    __m256 fry1 = _mm256_sub_ps(fry, _mm256_set1_ps(1.0f));
+
+    __m256i ix = _mm256_add_epi32(_mm256_cvttps_epi32(flx), _mm256_set1_epi32(ctx->seed));
+    __m256i iy = _mm256_add_epi32(_mm256_cvttps_epi32(fly), _mm256_set1_epi32(ctx->seed));
+    __m256i hx0 = _mm256_mullo_epi32(ix, _mm256_set1_epi32(17));
+    __m256i hx1 = _mm256_add_epi32(hx0, _mm256_set1_epi32(17));
+    __m256i hy0 = _mm256_mullo_epi32(iy, _mm256_set1_epi32(89));
+    __m256i hy1 = _mm256_add_epi32(hy0, _mm256_set1_epi32(89));
+
+    __m256 s = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(hx0, hy0)), frx, fry, frx, false);
+    __m256 t = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(hx1, hy0)), frx1, fry, frx, false);
+    __m256 u = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(hx1, hy1)), frx1, fry1, frx, false);
+    __m256 v = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(hx0, hy1)), frx, fry1, frx, false);
+
+    __m256 sx = s_curve_avx2(frx);
+    __m256 px0 = lerp_avx2(sx, s, t);
+    __m256 px1 = lerp_avx2(sx, v, u);
+    return lerp_avx2(s_curve_avx2(fry), px0, px1);
+}
+
+static CPU_TARGET("avx2") __m256 noise3_perlin_avx2(const NoiseContext *ctx, __m256 x, __m256 y, __m256 z)
+{
+    __m256 flx = _mm256_floor_ps(x);
+    __m256 fly = _mm256_floor_ps(y);
+    __m256 flz = _mm256_floor_ps(z);
+    __m256 frx = _mm256_sub_ps(x, flx);
+    __m256 fry = _mm256_sub_ps(y, fly);
+    __m256 frz = _mm256_sub_ps(z, flz);
+    __m256 frx1 = _mm256_sub_ps(frx, _mm256_set1_ps(1.0f));
+    __m256 fry1 = _mm256_sub_ps(fry, _mm256_set1_ps(1.0f));
+    __m256 frz1 = _mm256_sub_ps(frz, _mm256_set1_ps(1.0f));
+
+    __m256i ix = _mm256_add_epi32(_mm256_cvttps_epi32(flx), _mm256_set1_epi32(ctx->seed));
+    __m256i iy = _mm256_add_epi32(_mm256_cvttps_epi32(fly), _mm256_set1_epi32(ctx->seed));
+    __m256i iz = _mm256_add_epi32(_mm256_cvttps_epi32(flz), _mm256_set1_epi32(ctx->seed));
+    __m256i hx0 = _mm256_mullo_epi32(ix, _mm256_set1_epi32(71));
+    __m256i hx1 = _mm256_add_epi32(hx0, _mm256_set1_epi32(71));
+    __m256i hy0 = _mm256_mullo_epi32(iy, _mm256_set1_epi32(17));
+    __m256i hy1 = _mm256_add_epi32(hy0, _mm256_set1_epi32(17));
+    __m256i hz0 = _mm256_mullo_epi32(iz, _mm256_set1_epi32(53));
+    __m256i hz1 = _mm256_add_epi32(hz0, _mm256_set1_epi32(53));
+    __m256i h00 = _mm256_add_epi32(hx0, hy0);
+    __m256i h10 = _mm256_add_epi32(hx1, hy0);
+    __m256i h11 = _mm256_add_epi32(hx1, hy1);
+    __m256i h01 = _mm256_add_epi32(hx0, hy1);
+
+    __m256 o = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(h00, hz0)), frx, fry, frz, true);
+    __m256 p = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(h10, hz0)), frx1, fry, frz, true);
+    __m256 q = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(h11, hz0)), frx1, fry1, frz, true);
+    __m256 r = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(h01, hz0)), frx, fry1, frz, true);
+    __m256 s = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(h00, hz1)), frx, fry, frz1, true);
+    __m256 t = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(h10, hz1)), frx1, fry, frz1, true);
+    __m256 u = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(h11, hz1)), frx1, fry1, frz1, true);
+    __m256 v = noise_graddot_avx2(ctx, noise_gradoffset_avx2(ctx, _mm256_add_epi32(h01, hz1)), frx, fry1, frz1, true);
+
+    __m256 sx = s_curve_avx2(frx);
+    __m256 px0 = lerp_avx2(sx, s, t);
+    __m256 px1 = lerp_avx2(sx, v, u);
+    __m256 px2 = lerp_avx2(sx, o, p);
+    __m256 px3 = lerp_avx2(sx, r, q);
+
+    __m256 sy = s_curve_avx2(fry);
+    __m256 py0 = lerp_avx2(sy, px0, px1);
+    __m256 py1 = lerp_avx2(sy, px2, px3);
+    return lerp_avx2(s_curve_avx2(frz), py1, py0);
+}
+
+static CPU_TARGET("sse4.1") void noise2_perlin_n_sse41(const NoiseContext *ctx, const float *xs, const float *ys, int n, float *out)
+{
+    int i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(&out[i], noise2_perlin_sse41(ctx, _mm_loadu_ps(&xs[i]), _mm_loadu_ps(&ys[i])));
+    }
+    for(; i < n; i++)
+    {
+        out[i] = noise2_perlin_ctx(ctx, xs[i], ys[i]);
+    }
+}
+
+static CPU_TARGET("avx2") void noise2_perlin_n_avx2(const NoiseContext *ctx, const float *xs, const float *ys, int n, float *out)
+{
+    int i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(&out[i], noise2_perlin_avx2(ctx, _mm256_loadu_ps(&xs[i]), _mm256_loadu_ps(&ys[i])));
+    }
+    for(; i < n; i++)
+    {
+        out[i] = noise2_perlin_ctx(ctx, xs[i], ys[i]);
+    }
+}
+
+static CPU_TARGET("sse4.1") void noise3_perlin_n_sse41(const NoiseContext *ctx, const float *xs, const float *ys,
+        const float *zs, int n, float *out)
+{
+    int i;
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 v = noise3_perlin_sse41(ctx, _mm_loadu_ps(&xs[i]), _mm_loadu_ps(&ys[i]), _mm_loadu_ps(&zs[i]));
+        _mm_storeu_ps(&out[i], v);
+    }
+    for(; i < n; i++)
+    {
+        out[i] = noise3_perlin_ctx(ctx, xs[i], ys[i], zs[i]);
+    }
+}
+
+static CPU_TARGET("avx2") void noise3_perlin_n_avx2(const NoiseContext *ctx, const float *xs, const float *ys,
+        const float *zs, int n, float *out)
+{
+    int i;
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        __m256 v = noise3_perlin_avx2(ctx, _mm256_loadu_ps(&xs[i]), _mm256_loadu_ps(&ys[i]),
+                                      _mm256_loadu_ps(&zs[i]));
+        _mm256_storeu_ps(&out[i], v);
+    }
+    for(; i < n; i++)
+    {
+        out[i] = noise3_perlin_ctx(ctx, xs[i], ys[i], zs[i]);
+    }
+}
+#endif
+
+/**
+ * 2 dimensional perlin noise of 'n' points, out[i] = noise2_perlin_ctx(ctx, xs[i], ys[i])
+ */
+void noise2_perlin_n_ctx(const NoiseContext *ctx, const float *xs, const float *ys, int n, float *out)
+{
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        noise2_perlin_n_avx2(ctx, xs, ys, n, out);
+        return;
+    } else if(cpu_has(CPU_SSE41))
+    {
+        noise2_perlin_n_sse41(ctx, xs, ys, n, out);
+        return;
+    }
+#endif
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        out[i] = noise2_perlin_ctx(ctx, xs[i], ys[i]);
+    }
+}
+
+/**
+ * 3 dimensional perlin noise of 'n' points,
+ * out[i] = noise3_perlin_ctx(ctx, xs[i], ys[i], zs[i])
+ */
+void noise3_perlin_n_ctx(const NoiseContext *ctx, const float *xs, const float *ys, 
+        const float *zs, int n, float *out)
+{
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        noise3_perlin_n_avx2(ctx, xs, ys, zs, n, out);
+        return;
+    } else if(cpu_has(CPU_SSE41))
+    {
+        noise3_perlin_n_sse41(ctx, xs, ys, zs, n, out);
+        return;
+    }
+#endif
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        out[i] = noise3_perlin_ctx(ctx, xs[i], ys[i], zs[i]);
+    }
+}
+
+#define NOISE_GRID_CHUNK 256 //columns of a grid generated at a time, so the coordinates fit on the stack
+
+/**
+ * 2 dimensional perlin noise over a 'w' by 'h' grid of points. The point at
+ * column i and row j is (x0 + i * dx, y0 + j * dy), and its noise is stored in
+ * out[j * w + i]
+ */
+void noise2_perlin_grid_ctx(const NoiseContext *ctx, float x0, float y0, float dx, float dy, 
+        int w, int h, float *out)
+{
+    float xs[NOISE_GRID_CHUNK], ys[NOISE_GRID_CHUNK];
+    int c, i, j;
+    for(c = 0; c < w; c += NOISE_GRID_CHUNK)
+    {
+        int cw = w - c < NOISE_GRID_CHUNK ? w - c : NOISE_GRID_CHUNK;
+        for(i = 0; i < cw; i++)
+        {
+            xs[i] = x0 + (c + i) * dx;
+        }
+        for(j = 0; j < h; j++)
+        {
+            float y = y0 + j * dy;
+            for(i = 0; i < cw; i++)
+            {
+                ys[i] = y;
+            }
+            noise2_perlin_n_ctx(ctx, xs, ys, cw, &out[j * w + c]);
+        }
+    }
+}
+
+/*
+ * **********
+ * Generators
+ * **********
+ */
+
+#define NOISE_TILE 64
+
+/**
+ * the thread pool used by the generators, or NULL to run them on the calling
+ * thread
+ */
+static ThreadPool *noise_pool = NULL;
+
+typedef struct NoiseGenerator
+{
+    const NoiseContext *ctx;
+    int type;
+    int n;
+    float x0, y0;
+    float dx, dy;
+    int w, h;
+    int tilesw;             ///< number of tiles across
+    Noise_func *store;
+    void *arg;
+} NoiseGenerator;
+
+/**
+ * fills one tile, a row at a time. The octaves of each row are found with the
+ * batch perlin functions, and summed in the same order as noise2_fracPerlin,
+ * noise2_terbulence and noise2_ridged
+ */
+static void noise2_generate_task(void *arg, int task, int thread)
+{
+    NoiseGenerator *g = arg;
+    int tx = (task % g->tilesw) * NOISE_TILE;
+    int ty = (task / g->tilesw) * NOISE_TILE;
+    int tw = g->w - tx < NOISE_TILE ? g->w - tx : NOISE_TILE;
+    int th = g->h - ty < NOISE_TILE ? g->h - ty : NOISE_TILE;
+
+    float xs[NOISE_TILE], ox[NOISE_TILE], oy[NOISE_TILE];
+    float val[NOISE_TILE], sum[NOISE_TILE];
+    int i, j, k;
+    for(k = 0; k < tw; k++)
+    {
+        xs[k] = g->x0 + (tx + k) * g->dx;
+    }
+
+    for(j = ty; j < ty + th; j++)
+    {
+        float y = g->y0 + j * g->dy;
+        float weight = 0;
+        for(k = 0; k < tw; k++)
+        {
+            sum[k] = 0;
+        }
+
+        for(i = 1<<g->n; i>0; i = i>>1)
+        {
+            for(k = 0; k < tw; k++)
+            {
+                ox[k] = xs[k] * i;
+                oy[k] = y * i;
+            }
+            noise2_perlin_n_ctx(g->ctx, ox, oy, tw, val);
+
+            switch(g->type)
+            {
+                case NOISE_FRACTAL:
+                    for(k = 0; k < tw; k++)
+                    {
+                        sum[k] += val[k]/i;
+                    }
+                    break;
+                case NOISE_TERBULENCE:
+                    for(k = 0; k < tw; k++)
+                    {
+                        sum[k] += fabs(val[k]/((float)i));
+                    }
+                    break;
+                case NOISE_RIDGED:
+                    for(k = 0; k < tw; k++)
+                    {
+                        float r = 1.0f - fabs(val[k]);
+                        sum[k] += r * r / i;
+                    }
+                    weight += 1.0f / i;
+                    break;
+            }
+        }
+
+        if(g->type == NOISE_TERBULENCE)
+        {
+            for(k = 0; k < tw; k++)
+            {
+                sum[k] = sum[k] * 2.0f - 1.0f;
+            }
+        } else if(g->type == NOISE_RIDGED)
+        {
+            for(k = 0; k < tw; k++)
+            {
+                sum[k] = sum[k] / weight * 2.0f - 1.0f;
+            }
+        }
+        g->store(g->arg, tx, j, tw, sum);
+    }
+}
+
+/**
+ * sets the thread pool the generators split their tiles across. Pass NULL
+ * (the default) to run them on the calling thread. The pool must outlive any
+ * generator call that uses it
+ */
+void noise_threadpool(ThreadPool *pool)
+{
+    noise_pool = pool;
+}
+
+/**
+ * generates a 'w' by 'h' image of 2 dimensional noise. 'type' is one of
+ * Noise_Type, with 'n' octaves as in noise2_fracPerlin. The pixel at column i and
+ * row j samples (x0 + i * dx, y0 + j * dy), and gets the same value as the
+ * point function. Rows of up to NOISE_TILE pixels are passed to 'store', which
+ * may be called from several threads at once, never for the same pixel. 'ctx'
+ * may be NULL, to use the default context
+ */
+void noise2_generate(const NoiseContext *ctx, int type, int n,
+        float x0, float y0, float dx, float dy, int w, int h, Noise_func *store, void *arg)
+{
+    assert(type >= NOISE_FRACTAL && type <= NOISE_RIDGED);
+    NoiseGenerator g;
+    g.ctx = ctx ? ctx : &default_context;
+    g.type = type;
+    g.n = n;
+    g.x0 = x0;
+    g.y0 = y0;
+    g.dx = dx;
+    g.dy = dy;
+    g.w = w;
+    g.h = h;
+    g.tilesw = (w + NOISE_TILE - 1) / NOISE_TILE;
+    g.store = store;
+    g.arg = arg;
+
+    int ntasks = g.tilesw * ((h + NOISE_TILE - 1) / NOISE_TILE);
+    if(noise_pool)
+    {
+        threadpool_run(noise_pool, ntasks, noise2_generate_task, &g);
+    } else
+    {
+        int i;
+        for(i = 0; i < ntasks; i++)
+        {
+            noise2_generate_task(&g, i, 0);
+        }
+    }
+}
+
+typedef struct NoiseBuffer
+{
+    void *bits;
+    int w;
+} NoiseBuffer;
+
+static void noise2_store_float(void *arg, int x, int y, int n, const float *vals)
+{
+    NoiseBuffer *b = arg;
+    memcpy((float*) b->bits + y * b->w + x, vals, sizeof(float) * n);
+}
+
+static void noise2_store_byte(void *arg, int x, int y, int n, const float *vals)
+{
+    NoiseBuffer *b = arg;
+    uint8_t *dst = (uint8_t*) b->bits + y * b->w + x;
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        dst[i] = noise_tobyte(vals[i]);
+    }
+}
+
+/**
+ * generates noise into a 'w' by 'h' row major float buffer. See noise2_generate
+ */
+void noise2_fill(const NoiseContext *ctx, int type, int n,
+        float x0, float y0, float dx, float dy, int w, int h, float *out)
+{
+    NoiseBuffer b = {out, w};
+    noise2_generate(ctx, type, n, x0, y0, dx, dy, w, h, noise2_store_float, &b);
+}
+
+/**
+ * generates noise into a 'w' by 'h' row major byte buffer, mapping -1 to 0
+ * and 1 to 255. See noise2_generate
+ */
+void noise2_fill_bytes(const NoiseContext *ctx, int type, int n,
+        float x0, float y0, float dx, float dy, int w, int h, uint8_t *out)
+{
+    NoiseBuffer b = {out, w};
+    noise2_generate(ctx, type, n, x0, y0, dx, dy, w, h, noise2_store_byte, &b);
+}
+
+/*
+ * ***************
+ * Default Context
+ * ***************
+ */
+
+float noise1_random(int x)
+{
+    return noise1_random_ctx(&default_context, x);
+}
+
+float noise1_value(float x)
+{
+    return noise1_value_ctx(&default_context, x);
+}
+
+float noise1_perlin(float x)
+{
+    return noise1_perlin_ctx(&default_context, x);
+}
+
+float noise1_fracPerlin(float x, int n)
+{
+    return noise1_fracPerlin_ctx(&default_context, x, n);
+}
+
+float noise1_terbulence(float x, int n)
+{
+    return noise1_terbulence_ctx(&default_context, x, n);
+}
+
+float noise2_random(int x, int y)
+{
+    return noise2_random_ctx(&default_context, x, y);
+}
+
+float noise2_value(float x, float y)
+{
+    return noise2_value_ctx(&default_context, x, y);
+}
+
+float noise2_perlin(float x, float y)
+{
+    return noise2_perlin_ctx(&default_context, x, y);
+}
+
+float noise2_fracPerlin(float x, float y, int n)
+{
+    return noise2_fracPerlin_ctx(&default_context, x, y, n);
+}
+
+float noise2_terbulence(float x, float y, int n)
+{
+    return noise2_terbulence_ctx(&default_context, x, y, n);
+}
+
+float noise2_perlin_d(float x, float y, float grad[2])
+{
+    return noise2_perlin_d_ctx(&default_context, x, y, grad);
+}
+
+float noise2_fracPerlin_d(float x, float y, int n, float grad[2])
+{
+    return noise2_fracPerlin_d_ctx(&default_context, x, y, n, grad);
+}
+
+float noise2_ridged(float x, float y, int n)
+{
+    return noise2_ridged_ctx(&default_context, x, y, n);
+}
+
+float noise3_perlin(float x, float y, float z)
+{
+    return noise3_perlin_ctx(&default_context, x, y, z);
+}
+
+float noise3_fracPerlin(float x, float y, float z, int n)
+{
+    return noise3_fracPerlin_ctx(&default_context, x, y, z, n);
+}
+
+float noise3_terbulence(float x, float y, float z, int n)
+{
+    return noise3_terbulence_ctx(&default_context, x, y, z, n);
+}
+
+void noise2_perlin_n(const float *xs, const float *ys, int n, float *out)
+{
+    noise2_perlin_n_ctx(&default_context, xs, ys, n, out);
+}
+
+void noise2_perlin_grid(float x0, float y0, float dx, float dy, int w, int h, float *out)
+{
+    noise2_perlin_grid_ctx(&default_context, x0, y0, dx, dy, w, h, out);
+}
+
+void noise3_perlin_n(const float *xs, const float *ys, const float *zs, int n, float *out)
+{
+    noise3_perlin_n_ctx(&default_context, xs, ys, zs, n, out);
+}
+
+float noise3_perlin_d(float x, float y, float z, float grad[3])
+{
+    return noise3_perlin_d_ctx(&default_context, x, y, z, grad);
+}
+
+float noise3_fracPerlin_d(float x, float y, float z, int n, float grad[3])
+{
+    return noise3_fracPerlin_d_ctx(&default_context, x, y, z, n, grad);
+}
+
+float noise2_simplex(float x, float y)
+{
+    return noise2_simplex_ctx(&default_context, x, y);
+}
+
+float noise2_fracSimplex(float x, float y, int n)
+{
+    return noise2_fracSimplex_ctx(&default_context, x, y, n);
+}
+
+float noise2_terbulenceSimplex(float x, float y, int n)
+{
+    return noise2_terbulenceSimplex_ctx(&default_context, x, y, n);
+}
+
+float noise3_simplex(float x, float y, float z)
+{
+    return noise3_simplex_ctx(&default_context, x, y, z);
+}
+
+float noise3_fracSimplex(float x, float y, float z, int n)
+{
+    return noise3_fracSimplex_ctx(&default_context, x, y, z, n);
+}
+
+float noise3_terbulenceSimplex(float x, float y, float z, int n)
+{
+    return noise3_terbulenceSimplex_ctx(&default_context, x, y, z, n);
+}
+
+float noise4_simplex(float x, float y, float z, float w)
+{
+    return noise4_simplex_ctx(&default_context, x, y, z, w);
+}
+
+float noise4_fracSimplex(float x, float y, float z, float w, int n)
+{
+    return noise4_fracSimplex_ctx(&default_context, x, y, z, w, n);
+}
+
+float noise4_terbulenceSimplex(float x, float y, float z, float w, int n)
+{
+    return noise4_terbulenceSimplex_ctx(&default_context, x, y, z, w, n);
+}
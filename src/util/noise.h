@@ -9,8 +9,53 @@
 #ifndef _NOISE_H
 #define _NOISE_H
 
+#include <stdint.h>
+
+struct ThreadPool;
+
+/**
+ * the seed and gradient table behind the noise functions. Contexts share no
+ * state, so threads can each generate noise from their own without locking.
+ * The functions without a context use a shared default one, set by noise_init
+ */
+typedef struct NoiseContext
+{
+    int seed;
+    int gradmask;   ///< mask of gradient table offsets, a power of 2 - 1
+    float *grad;    ///< gradients, 3 floats each
+} NoiseContext;
+
+/**
+ * the octave sums of the noise generators
+ */
+enum Noise_Type
+{
+    NOISE_FRACTAL       = 0,    ///< as noise2_fracPerlin
+    NOISE_TERBULENCE    = 1,    ///< as noise2_terbulence
+    NOISE_RIDGED        = 2     ///< as noise2_ridged
+};
+
+/**
+ * receives 'n' generated values, for the pixels (x, y) to (x + n - 1, y)
+ */
+typedef void (Noise_func)(void *arg, int x, int y, int n, const float *vals);
+
+/**
+ * maps noise from [-1, 1] to a byte, [0, 255]
+ */
+static inline uint8_t noise_tobyte(float v)
+{
+    float b = v * 127.5f + 128.0f;
+    return b <= 0.0f ? 0 : b >= 255.0f ? 255 : (uint8_t) b;
+}
+
+void noisecontext_init(NoiseContext *ctx, int s);
+void noisecontext_finalize(NoiseContext *ctx);
+
 void noise_init(int s);
 void noise_finalize(void);
+const NoiseContext *noise_default(void);
+
 float noise1_random(int x);
 float noise1_value(float x);
 float noise1_perlin(float x);
@@ -22,11 +67,79 @@ float noise2_value(float x, float y);
 float noise2_perlin(float x, float y);
 float noise2_fracPerlin(float x, float y, int n);
 float noise2_terbulence(float x, float y, int n);
+float noise2_ridged(float x, float y, int n);
+float noise2_perlin_d(float x, float y, float grad[2]);
+float noise2_fracPerlin_d(float x, float y, int n, float grad[2]);
 
 float noise3_random(int x, int  y, int z);
 float noise3_value(float x, float y, float z);
 float noise3_perlin(float x, float y, float z);
 float noise3_fracPerlin(float x, float y, float z, int n);
 float noise3_terbulence(float x, float y, float z, int n);
+float noise3_perlin_d(float x, float y, float z, float grad[3]);
+float noise3_fracPerlin_d(float x, float y, float z, int n, float grad[3]);
+
+float noise2_simplex(float x, float y);
+float noise2_fracSimplex(float x, float y, int n);
+float noise2_terbulenceSimplex(float x, float y, int n);
+float noise3_simplex(float x, float y, float z);
+float noise3_fracSimplex(float x, float y, float z, int n);
+float noise3_terbulenceSimplex(float x, float y, float z, int n);
+float noise4_simplex(float x, float y, float z, float w);
+float noise4_fracSimplex(float x, float y, float z, float w, int n);
+float noise4_terbulenceSimplex(float x, float y, float z, float w, int n);
+
+// batch evaluation, the same results as the point functions
+void noise2_perlin_n(const float *xs, const float *ys, int n, float *out);
+void noise2_perlin_grid(float x0, float y0, float dx, float dy, int w, int h, float *out);
+void noise3_perlin_n(const float *xs, const float *ys, const float *zs, int n, float *out);
+
+// the same functions, with an explicit context
+float noise1_random_ctx(const NoiseContext *ctx, int x);
+float noise1_value_ctx(const NoiseContext *ctx, float x);
+float noise1_perlin_ctx(const NoiseContext *ctx, float x);
+float noise1_fracPerlin_ctx(const NoiseContext *ctx, float x, int n);
+float noise1_terbulence_ctx(const NoiseContext *ctx, float x, int n);
+
+float noise2_random_ctx(const NoiseContext *ctx, int x, int  y);
+float noise2_value_ctx(const NoiseContext *ctx, float x, float y);
+float noise2_perlin_ctx(const NoiseContext *ctx, float x, float y);
+float noise2_fracPerlin_ctx(const NoiseContext *ctx, float x, float y, int n);
+float noise2_terbulence_ctx(const NoiseContext *ctx, float x, float y, int n);
+float noise2_ridged_ctx(const NoiseContext *ctx, float x, float y, int n);
+float noise2_perlin_d_ctx(const NoiseContext *ctx, float x, float y, float grad[2]);
+float noise2_fracPerlin_d_ctx(const NoiseContext *ctx, float x, float y, int n, float grad[2]);
+
+float noise3_perlin_ctx(const NoiseContext *ctx, float x, float y, float z);
+float noise3_fracPerlin_ctx(const NoiseContext *ctx, float x, float y, float z, int n);
+float noise3_terbulence_ctx(const NoiseContext *ctx, float x, float y, float z, int n);
+float noise3_perlin_d_ctx(const NoiseContext *ctx, float x, float y, float z, float grad[3]);
+float noise3_fracPerlin_d_ctx(const NoiseContext *ctx, float x, float y, float z, int n,
+        float grad[3]);
+
+float noise2_simplex_ctx(const NoiseContext *ctx, float x, float y);
+float noise2_fracSimplex_ctx(const NoiseContext *ctx, float x, float y, int n);
+float noise2_terbulenceSimplex_ctx(const NoiseContext *ctx, float x, float y, int n);
+float noise3_simplex_ctx(const NoiseContext *ctx, float x, float y, float z);
+float noise3_fracSimplex_ctx(const NoiseContext *ctx, float x, float y, float z, int n);
+float noise3_terbulenceSimplex_ctx(const NoiseContext *ctx, float x, float y, float z, int n);
+float noise4_simplex_ctx(const NoiseContext *ctx, float x, float y, float z, float w);
+float noise4_fracSimplex_ctx(const NoiseContext *ctx, float x, float y, float z, float w, int n);
+float noise4_terbulenceSimplex_ctx(const NoiseContext *ctx, float x, float y, float z, float w, int n);
+
+void noise2_perlin_n_ctx(const NoiseContext *ctx, const float *xs, const float *ys, int n, float *out);
+void noise2_perlin_grid_ctx(const NoiseContext *ctx, float x0, float y0, float dx, float dy,
+        int w, int h, float *out);
+void noise3_perlin_n_ctx(const NoiseContext *ctx, const float *xs, const float *ys,
+        const float *zs, int n, float *out);
+
+// tiled generators, spread across the pool set with noise_threadpool
+void noise_threadpool(struct ThreadPool *pool);
+void noise2_generate(const NoiseContext *ctx, int type, int n,
+        float x0, float y0, float dx, float dy, int w, int h, Noise_func *store, void *arg);
+void noise2_fill(const NoiseContext *ctx, int type, int n,
+        float x0, float y0, float dx, float dy, int w, int h, float *out);
+void noise2_fill_bytes(const NoiseContext *ctx, int type, int n,
+        float x0, float y0, float dx, float dy, int w, int h, uint8_t *out);
 
 #endif
@@ -5,13 +5,23 @@
  * Brandon Surmanski
  */
 
+#include <assert.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
+#include <pthread.h>
 
+#include "util/cpu.h"
+#include "util/algo/sort.h"
 #include "util/math/const.h"
+#include "util/struct/iterator.h"
 #include "random.h"
 
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
 // Mersenne Twister constants
 #define MT_LEN              624
 #define MT_GENPARAM         397
@@ -39,8 +49,82 @@ void random_init(uint32_t seed)
     {
         MT[i] = (MT_INIT_CONST * (MT[i -1] ^ ((MT[i - 1] >> 30) + i))) & MT_32BITMASK; 
     }
+    MT_index = MT_LEN;
+}
+
+#if CPU_X86
+/*
+ * the refill below, W words at a time. Each new word only depends on words 
+ * that are at least W places away, or are not yet updated, so blocks of W 
+ * give the same values as the scalar loop
+ */
+static CPU_TARGET("sse2") void generate_new_MT_values_sse2(void)
+{
+    const __m128i high = _mm_set1_epi32(MT_HIGHBIT);
+    const __m128i low = _mm_set1_epi32(MT_LOWBITS);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i odd = _mm_set1_epi32(MT_GENODDMASK);
+
+    uint32_t y;
+    int i = 0, k = MT_GENPARAM;
+    while(i < MT_LEN - 1)
+    {
+        int end = i < MT_LEN - MT_GENPARAM ? MT_LEN - MT_GENPARAM : MT_LEN - 1;
+        for(; i + 4 <= end; i += 4, k += 4)
+        {
+            __m128i a = _mm_loadu_si128((__m128i*) &MT[i]);
+            __m128i b = _mm_loadu_si128((__m128i*) &MT[i + 1]);
+            __m128i m = _mm_loadu_si128((__m128i*) &MT[k]);
+            __m128i v = _mm_or_si128(_mm_and_si128(a, high), _mm_and_si128(b, low));
+            __m128i mag = _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(v, one), one), odd);
+            m = _mm_xor_si128(_mm_xor_si128(m, _mm_srli_epi32(v, 1)), mag);
+            _mm_storeu_si128((__m128i*) &MT[i], m);
+        }
+        for(; i < end; i++, k++)
+        {
+            y = (MT[i] & MT_HIGHBIT) | (MT[i+1] & MT_LOWBITS);
+            MT[i] = MT[k] ^ (y >> 1) ^ ((y & 0x1) ? MT_GENODDMASK : 0);
+        }
+        k -= MT_LEN;
+    }
+    y = (MT[MT_LEN - 1] & MT_HIGHBIT) | (MT[0] & MT_LOWBITS);
+    MT[MT_LEN - 1] = MT[MT_GENPARAM - 1] ^ (y >> 1) ^ ((y & 0x1) ? MT_GENODDMASK : 0);
 }
 
+static CPU_TARGET("avx2") void generate_new_MT_values_avx2(void)
+{
+    const __m256i high = _mm256_set1_epi32(MT_HIGHBIT);
+    const __m256i low = _mm256_set1_epi32(MT_LOWBITS);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i odd = _mm256_set1_epi32(MT_GENODDMASK);
+
+    uint32_t y;
+    int i = 0, k = MT_GENPARAM;
+    while(i < MT_LEN - 1)
+    {
+        int end = i < MT_LEN - MT_GENPARAM ? MT_LEN - MT_GENPARAM : MT_LEN - 1;
+        for(; i + 8 <= end; i += 8, k += 8)
+        {
+            __m256i a = _mm256_loadu_si256((__m256i*) &MT[i]);
+            __m256i b = _mm256_loadu_si256((__m256i*) &MT[i + 1]);
+            __m256i m = _mm256_loadu_si256((__m256i*) &MT[k]);
+            __m256i v = _mm256_or_si256(_mm256_and_si256(a, high), _mm256_and_si256(b, low));
+            __m256i mag = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(v, one), one), odd);
+            m = _mm256_xor_si256(_mm256_xor_si256(m, _mm256_srli_epi32(v, 1)), mag);
+            _mm256_storeu_si256((__m256i*) &MT[i], m);
+        }
+        for(; i < end; i++, k++)
+        {
+            y = (MT[i] & MT_HIGHBIT) | (MT[i+1] & MT_LOWBITS);
+            MT[i] = MT[k] ^ (y >> 1) ^ ((y & 0x1) ? MT_GENODDMASK : 0);
+        }
+        k -= MT_LEN;
+    }
+    y = (MT[MT_LEN - 1] & MT_HIGHBIT) | (MT[0] & MT_LOWBITS);
+    MT[MT_LEN - 1] = MT[MT_GENPARAM - 1] ^ (y >> 1) ^ ((y & 0x1) ? MT_GENODDMASK : 0);
+}
+#endif
+
 /**
  * generate new mersenne twister values (624 at a time).
  */
@@ -48,6 +132,19 @@ static void generate_new_MT_values(void)
 {
     static uint32_t GENMASK[] = {0, MT_GENODDMASK};
 
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        generate_new_MT_values_avx2();
+        return;
+    }
+    if(cpu_has(CPU_SSE2))
+    {
+        generate_new_MT_values_sse2();
+        return;
+    }
+#endif
+
     uint32_t y;
     int i;
     for(i = 0; i < MT_LEN - MT_GENPARAM; i++)
@@ -137,3 +234,625 @@ float random_gauss(float mu, float sigma)
     float z = cos(x2pi) * g2rad;
     return mu + (z * sigma);
 }
+
+/*
+ * **************
+ * Random Streams
+ * **************
+ */
+
+static inline uint64_t rotl64(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * the splitmix64 generator, used to expand a seed into generator state
+ */
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * steps lane 'l' of a stream, returning its next output
+ */
+static inline uint64_t randomstream_step(RandomStream *r, int l)
+{
+    uint64_t ret = rotl64(r->s[1][l] * 5, 7) * 9;
+    uint64_t t = r->s[1][l] << 17;
+    r->s[2][l] ^= r->s[0][l];
+    r->s[3][l] ^= r->s[1][l];
+    r->s[1][l] ^= r->s[2][l];
+    r->s[0][l] ^= r->s[3][l];
+    r->s[2][l] ^= t;
+    r->s[3][l] = rotl64(r->s[3][l], 45);
+    return ret;
+}
+
+/**
+ * advances lane 'l' by the polynomial 'jump', as the xoshiro256 jump functions
+ */
+static void randomstream_jumplane(RandomStream *r, int l, const uint64_t jump[4])
+{
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i, b;
+    for(i = 0; i < 4; i++)
+    {
+        for(b = 0; b < 64; b++)
+        {
+            if(jump[i] & (1ULL << b))
+            {
+                s0 ^= r->s[0][l];
+                s1 ^= r->s[1][l];
+                s2 ^= r->s[2][l];
+                s3 ^= r->s[3][l];
+            }
+            randomstream_step(r, l);
+        }
+    }
+    r->s[0][l] = s0;
+    r->s[1][l] = s1;
+    r->s[2][l] = s2;
+    r->s[3][l] = s3;
+}
+
+// 2^128 and 2^192 steps
+static const uint64_t RANDOM_JUMP[4] =
+    {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+static const uint64_t RANDOM_LONGJUMP[4] =
+    {0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL, 0x39109bb02acbe635ULL};
+
+/**
+ * seeds a stream. Its lanes start 2^128 steps apart
+ */
+void randomstream_init(RandomStream *r, uint64_t seed)
+{
+    int i, l;
+    for(i = 0; i < 4; i++)
+    {
+        r->s[i][0] = splitmix64(&seed);
+    }
+    for(l = 1; l < RANDOM_LANES; l++)
+    {
+        for(i = 0; i < 4; i++)
+        {
+            r->s[i][l] = r->s[i][l - 1];
+        }
+        randomstream_jumplane(r, l, RANDOM_JUMP);
+    }
+    r->lane = 0;
+}
+
+/**
+ * advances a stream by 2^192 steps of each lane, past any values it could
+ * produce in practice
+ */
+void randomstream_jump(RandomStream *r)
+{
+    int l;
+    for(l = 0; l < RANDOM_LANES; l++)
+    {
+        randomstream_jumplane(r, l, RANDOM_LONGJUMP);
+    }
+}
+
+/**
+ * splits off an independent stream into 'child', which continues where 'r'
+ * was. 'r' jumps ahead, so the two never overlap. Split a stream once per 
+ * worker thread to give each its own
+ */
+void randomstream_split(RandomStream *r, RandomStream *child)
+{
+    *child = *r;
+    randomstream_jump(r);
+}
+
+/**
+ * the next 64 random bits of a stream
+ */
+uint64_t randomstream_int64(RandomStream *r)
+{
+    uint64_t ret = randomstream_step(r, r->lane);
+    r->lane = (r->lane + 1) % RANDOM_LANES;
+    return ret;
+}
+
+/**
+ * an evenly distributed 32-bit integer
+ */
+uint32_t randomstream_int(RandomStream *r)
+{
+    return randomstream_int64(r) >> 32;
+}
+
+/**
+ * a random integer between [0, max)
+ */
+uint32_t randomstream_below(RandomStream *r, uint32_t max)
+{
+    return (uint32_t) (((uint64_t) randomstream_int(r) * max) >> 32);
+}
+
+/**
+ * random floating point value [0,1)
+ */
+float randomstream_random(RandomStream *r)
+{
+    return (randomstream_int64(r) >> 40) * (1.0f / 16777216.0f);
+}
+
+/**
+ * floating point random values uniformly distributed between [min,max)
+ */
+float randomstream_uniform(RandomStream *r, float min, float max)
+{
+    return min + ((max - min) * randomstream_random(r));
+}
+
+/**
+ * gaussian distribution random, as random_gauss
+ */
+float randomstream_gauss(RandomStream *r, float mu, float sigma)
+{
+    float x2pi = randomstream_random(r) * TWOPI;
+    float g2rad = sqrt(-2.0f * log(1.0f - randomstream_random(r)));
+    float z = cos(x2pi) * g2rad;
+    return mu + (z * sigma);
+}
+
+#if CPU_X86
+/**
+ * steps all lanes of a stream at once. 'x * 5' and 'x * 9' are shifts and
+ * adds, as AVX2 has no 64 bit multiply
+ */
+static inline CPU_TARGET("avx2") __m256i randomstream_step_avx2(__m256i *s)
+{
+    __m256i x = _mm256_add_epi64(_mm256_slli_epi64(s[1], 2), s[1]);
+    x = _mm256_or_si256(_mm256_slli_epi64(x, 7), _mm256_srli_epi64(x, 57));
+    __m256i ret = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+    __m256i t = _mm256_slli_epi64(s[1], 17);
+    s[2] = _mm256_xor_si256(s[2], s[0]);
+    s[3] = _mm256_xor_si256(s[3], s[1]);
+    s[1] = _mm256_xor_si256(s[1], s[2]);
+    s[0] = _mm256_xor_si256(s[0], s[3]);
+    s[2] = _mm256_xor_si256(s[2], t);
+    s[3] = _mm256_or_si256(_mm256_slli_epi64(s[3], 45), _mm256_srli_epi64(s[3], 19));
+    return ret;
+}
+
+/**
+ * the high 32 bits of each 64 bit lane
+ */
+static inline CPU_TARGET("avx2") __m128i random_high32_avx2(__m256i x)
+{
+    __m256i hi = _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(1, 3, 5, 7, 0, 0, 0, 0));
+    return _mm256_castsi256_si128(hi);
+}
+
+static CPU_TARGET("avx2") void random_fill_u32_avx2(RandomStream *r, uint32_t *out, size_t n)
+{
+    __m256i s[4];
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        s[i] = _mm256_loadu_si256((__m256i*) r->s[i]);
+    }
+    size_t j;
+    for(j = 0; j < n; j += RANDOM_LANES)
+    {
+        _mm_storeu_si128((__m128i*) &out[j], random_high32_avx2(randomstream_step_avx2(s)));
+    }
+    for(i = 0; i < 4; i++)
+    {
+        _mm256_storeu_si256((__m256i*) r->s[i], s[i]);
+    }
+}
+
+static CPU_TARGET("avx2") void random_fill_float_avx2(RandomStream *r, float *out, size_t n)
+{
+    __m256i s[4];
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        s[i] = _mm256_loadu_si256((__m256i*) r->s[i]);
+    }
+    __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+    size_t j;
+    for(j = 0; j < n; j += RANDOM_LANES)
+    {
+        __m128i bits = _mm_srli_epi32(random_high32_avx2(randomstream_step_avx2(s)), 8);
+        _mm_storeu_ps(&out[j], _mm_mul_ps(_mm_cvtepi32_ps(bits), scale));
+    }
+    for(i = 0; i < 4; i++)
+    {
+        _mm256_storeu_si256((__m256i*) r->s[i], s[i]);
+    }
+}
+#endif
+
+/**
+ * fills 'out' with 'n' random 32-bit integers, the same values as 'n' calls
+ * to randomstream_int
+ */
+void random_fill_u32(RandomStream *r, uint32_t *out, size_t n)
+{
+    size_t i = 0;
+    while(i < n && r->lane != 0)
+    {
+        out[i++] = randomstream_int(r);
+    }
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        size_t nlanes = (n - i) / RANDOM_LANES * RANDOM_LANES;
+        random_fill_u32_avx2(r, &out[i], nlanes);
+        i += nlanes;
+    }
+#endif
+    for(; i < n; i++)
+    {
+        out[i] = randomstream_int(r);
+    }
+}
+
+/**
+ * fills 'out' with 'n' random floats in [0,1), the same values as 'n' calls
+ * to randomstream_random
+ */
+void random_fill_float(RandomStream *r, float *out, size_t n)
+{
+    size_t i = 0;
+    while(i < n && r->lane != 0)
+    {
+        out[i++] = randomstream_random(r);
+    }
+#if CPU_X86
+    if(cpu_has(CPU_AVX2))
+    {
+        size_t nlanes = (n - i) / RANDOM_LANES * RANDOM_LANES;
+        random_fill_float_avx2(r, &out[i], nlanes);
+        i += nlanes;
+    }
+#endif
+    for(; i < n; i++)
+    {
+        out[i] = randomstream_random(r);
+    }
+}
+
+/*
+ * ******************
+ * Gaussian Ziggurats
+ * ******************
+ */
+
+// Marsaglia and Tsang's 128 layer ziggurat for the normal distribution
+#define ZIG_LAYERS  128
+#define ZIG_R       3.442619855899
+#define ZIG_AREA    9.91256303526217e-3
+#define ZIG_M1      2147483648.0
+
+static uint32_t zig_kn[ZIG_LAYERS];
+static float zig_wn[ZIG_LAYERS];
+static float zig_fn[ZIG_LAYERS];
+static pthread_once_t zig_once = PTHREAD_ONCE_INIT;
+
+static void zig_init(void)
+{
+    double dn = ZIG_R, tn = ZIG_R;
+    double q = ZIG_AREA / exp(-0.5 * dn * dn);
+    int i;
+
+    zig_kn[0] = (dn / q) * ZIG_M1;
+    zig_kn[1] = 0;
+    zig_wn[0] = q / ZIG_M1;
+    zig_wn[ZIG_LAYERS - 1] = dn / ZIG_M1;
+    zig_fn[0] = 1.0f;
+    zig_fn[ZIG_LAYERS - 1] = exp(-0.5 * dn * dn);
+    for(i = ZIG_LAYERS - 2; i >= 1; i--)
+    {
+        dn = sqrt(-2.0 * log(ZIG_AREA / dn + exp(-0.5 * dn * dn)));
+        zig_kn[i + 1] = (dn / tn) * ZIG_M1;
+        tn = dn;
+        zig_fn[i] = exp(-0.5 * dn * dn);
+        zig_wn[i] = dn / ZIG_M1;
+    }
+}
+
+/**
+ * a source of 32 random bits, for the few samples that miss the ziggurat's
+ * fast path
+ */
+typedef uint32_t (Random_bits)(void *arg);
+
+/**
+ * uniform in (0,1), never 0 so its log is finite
+ */
+static inline double zig_uniform(Random_bits *bits, void *arg)
+{
+    return ((bits(arg) >> 8) + 0.5) * (1.0 / 16777216.0);
+}
+
+/**
+ * the slow path of zig_normal, for samples outside the layers' rectangles
+ */
+static float zig_nfix(int32_t hz, uint32_t iz, Random_bits *bits, void *arg)
+{
+    for(;;)
+    {
+        double x = hz * (double) zig_wn[iz];
+        if(iz == 0) // the tail, past ZIG_R
+        {
+            double y;
+            do
+            {
+                x = -log(zig_uniform(bits, arg)) / ZIG_R;
+                y = -log(zig_uniform(bits, arg));
+            } while(y + y < x * x);
+            return hz > 0 ? ZIG_R + x : -ZIG_R - x;
+        }
+        if(zig_fn[iz] + zig_uniform(bits, arg) * (zig_fn[iz - 1] - zig_fn[iz]) < exp(-0.5 * x * x))
+        {
+            return x;
+        }
+
+        uint32_t u = bits(arg);
+        iz = u & (ZIG_LAYERS - 1);
+        hz = (int32_t) (u & ~(ZIG_LAYERS - 1));
+        uint32_t mag = hz < 0 ? -(uint32_t) hz : (uint32_t) hz;
+        if(mag < zig_kn[iz])
+        {
+            return hz * zig_wn[iz];
+        }
+    }
+}
+
+/**
+ * a standard normal sample from the 32 random bits 'u'. The low bits pick the
+ * layer and the rest give the signed position in it, so the two are not
+ * correlated. About 99% of samples need nothing else
+ */
+static inline float zig_normal(uint32_t u, Random_bits *bits, void *arg)
+{
+    uint32_t iz = u & (ZIG_LAYERS - 1);
+    int32_t hz = (int32_t) (u & ~(ZIG_LAYERS - 1));
+    uint32_t mag = hz < 0 ? -(uint32_t) hz : (uint32_t) hz;
+    if(mag < zig_kn[iz])
+    {
+        return hz * zig_wn[iz];
+    }
+    return zig_nfix(hz, iz, bits, arg);
+}
+
+static uint32_t random_bits(void *arg)
+{
+    return random_int();
+}
+
+static uint32_t randomstream_bits(void *arg)
+{
+    return randomstream_int(arg);
+}
+
+/**
+ * fills 'out' with 'n' gaussian distributed values, drawn from the global
+ * mersenne twister with the ziggurat method. Much faster than calling
+ * random_gauss 'n' times, though the values differ
+ */
+void random_gauss_n(float *out, size_t n, float mu, float sigma)
+{
+    pthread_once(&zig_once, zig_init);
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        out[i] = mu + zig_normal(random_int(), random_bits, NULL) * sigma;
+    }
+}
+
+/**
+ * as random_gauss_n, drawing from a stream. Its random bits are made in bulk
+ * with random_fill_u32
+ */
+void randomstream_gauss_n(RandomStream *r, float *out, size_t n, float mu, float sigma)
+{
+    pthread_once(&zig_once, zig_init);
+    uint32_t bits[256];
+    size_t i = 0;
+    while(i < n)
+    {
+        size_t j, nbits = n - i < 256 ? n - i : 256;
+        random_fill_u32(r, bits, nbits);
+        for(j = 0; j < nbits; j++)
+        {
+            out[i + j] = mu + zig_normal(bits[j], randomstream_bits, r) * sigma;
+        }
+        i += nbits;
+    }
+}
+
+/*
+ * ********
+ * Sampling
+ * ********
+ */
+
+#define offset(a,sz,b) ((void*)(((char*)(a)) + ((sz) * (b))))
+
+/**
+ * maps 32 random bits to an index in [0, n) without division
+ */
+static inline size_t random_index(uint32_t bits, size_t n)
+{
+    return (size_t) (((uint64_t) bits * n) >> 32);
+}
+
+/**
+ * builds an alias table for drawing indices [0, n) with probability
+ * proportional to 'weights', with Vose's method. Weights must not be
+ * negative, and at least one must be positive. Afterwards, each draw is one
+ * table lookup
+ */
+void randomalias_init(RandomAlias *a, const float *weights, int n)
+{
+    assert(n > 0);
+    a->n = n;
+    a->prob = malloc(sizeof(float) * n);
+    a->alias = malloc(sizeof(int) * n);
+
+    double sum = 0.0;
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        assert(weights[i] >= 0.0f);
+        sum += weights[i];
+    }
+    assert(sum > 0.0 && "alias table needs a positive weight");
+
+    // columns under and over the average weight, stacked from either end
+    double *scaled = malloc(sizeof(double) * n);
+    int *work = malloc(sizeof(int) * n);
+    int nsmall = 0, nlarge = n;
+    for(i = 0; i < n; i++)
+    {
+        scaled[i] = weights[i] * n / sum;
+        if(scaled[i] < 1.0)
+        {
+            work[nsmall++] = i;
+        } else
+        {
+            work[--nlarge] = i;
+        }
+    }
+
+    while(nsmall > 0 && nlarge < n)
+    {
+        int small = work[--nsmall];
+        int large = work[nlarge++];
+        a->prob[small] = scaled[small];
+        a->alias[small] = large;
+        scaled[large] -= 1.0 - scaled[small];
+        if(scaled[large] < 1.0)
+        {
+            work[nsmall++] = large;
+        } else
+        {
+            work[--nlarge] = large;
+        }
+    }
+
+    // whatever is left is full, up to rounding
+    while(nsmall > 0)
+    {
+        i = work[--nsmall];
+        a->prob[i] = 1.0f;
+        a->alias[i] = i;
+    }
+    while(nlarge < n)
+    {
+        i = work[nlarge++];
+        a->prob[i] = 1.0f;
+        a->alias[i] = i;
+    }
+
+    free(work);
+    free(scaled);
+}
+
+void randomalias_finalize(RandomAlias *a)
+{
+    free(a->prob);
+    free(a->alias);
+    a->prob = NULL;
+    a->alias = NULL;
+    a->n = 0;
+}
+
+static inline int randomalias_draw(const RandomAlias *a, uint32_t col, float u)
+{
+    int i = random_index(col, a->n);
+    return u < a->prob[i] ? i : a->alias[i];
+}
+
+/**
+ * a random index, weighted by the alias table 'a'
+ */
+int random_alias(const RandomAlias *a)
+{
+    uint32_t col = random_int();
+    return randomalias_draw(a, col, random_random());
+}
+
+int randomstream_alias(RandomStream *r, const RandomAlias *a)
+{
+    uint64_t x = randomstream_int64(r); // one draw gives the column and the coin
+    return randomalias_draw(a, x >> 32, (x & 0xffffff) * (1.0f / 16777216.0f));
+}
+
+static void random_shuffle_bits(void *base, size_t n, size_t sz, Random_bits *bits, void *arg)
+{
+    assert(n <= UINT32_MAX);
+    size_t i;
+    for(i = n; i > 1; i--)
+    {
+        size_t j = random_index(bits(arg), i);
+        if(j != i - 1)
+        {
+            sort_swap(offset(base, sz, j), offset(base, sz, i - 1), sz);
+        }
+    }
+}
+
+/**
+ * shuffles 'n' elements of size 'sz' in place, with Fisher-Yates
+ */
+void random_shuffle(void *base, size_t n, size_t sz)
+{
+    random_shuffle_bits(base, n, sz, random_bits, NULL);
+}
+
+void randomstream_shuffle(RandomStream *r, void *base, size_t n, size_t sz)
+{
+    random_shuffle_bits(base, n, sz, randomstream_bits, r);
+}
+
+static size_t random_reservoir_bits(Iterator *it, void *out, size_t k, size_t sz,
+                                    Random_bits *bits, void *arg)
+{
+    size_t t = 0;
+    void *v;
+    for(v = iterator_value(it); v; v = iterator_next(it), t++)
+    {
+        if(t < k)
+        {
+            memcpy(offset(out, sz, t), v, sz);
+        } else
+        {
+            size_t j = random_index(bits(arg), t + 1);
+            if(j < k)
+            {
+                memcpy(offset(out, sz, j), v, sz);
+            }
+        }
+    }
+    return t < k ? t : k;
+}
+
+/**
+ * picks 'k' elements of size 'sz' uniformly from the rest of an iterator,
+ * copying them to 'out', in one pass without knowing the length ahead of
+ * time. Returns the number picked, which is less than 'k' if the iterator
+ * runs out first. The picks are in no particular order
+ */
+size_t random_reservoir(Iterator *it, void *out, size_t k, size_t sz)
+{
+    return random_reservoir_bits(it, out, k, sz, random_bits, NULL);
+}
+
+size_t randomstream_reservoir(RandomStream *r, Iterator *it, void *out, size_t k, size_t sz)
+{
+    return random_reservoir_bits(it, out, k, sz, randomstream_bits, r);
+}
@@ -8,8 +8,36 @@
 #ifndef _RANDOM_H
 #define _RANDOM_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#define RANDOM_LANES 4
+
+struct iterator;
+
+/**
+ * an independent, reproducible stream of random numbers, for use by one thread
+ * at a time. It is RANDOM_LANES xoshiro256** generators, stepped in turn so
+ * bulk fills can step them all at once. Streams made by randomstream_split
+ * never overlap
+ */
+typedef struct RandomStream
+{
+    uint64_t s[4][RANDOM_LANES];    ///< generator states, word major
+    int lane;                       ///< lane of the next value
+} RandomStream;
+
+/**
+ * a table for drawing weighted random indices in constant time, Walker's
+ * alias method
+ */
+typedef struct RandomAlias
+{
+    int n;
+    float *prob;    ///< chance of keeping each column's own index
+    int *alias;     ///< index drawn otherwise
+} RandomAlias;
+
 void     random_init(uint32_t seed);
 uint32_t random_int(void);
 uint32_t random_below(uint32_t max);
@@ -17,5 +45,28 @@ uint32_t random_range(uint32_t min, uint32_t max);
 float    random_random(void);
 float    random_uniform(float min, float max);
 float    random_gauss(float mu, float sigma);
+void     random_gauss_n(float *out, size_t n, float mu, float sigma);
+
+void     randomstream_init(RandomStream *r, uint64_t seed);
+void     randomstream_jump(RandomStream *r);
+void     randomstream_split(RandomStream *r, RandomStream *child);
+uint64_t randomstream_int64(RandomStream *r);
+uint32_t randomstream_int(RandomStream *r);
+uint32_t randomstream_below(RandomStream *r, uint32_t max);
+float    randomstream_random(RandomStream *r);
+float    randomstream_uniform(RandomStream *r, float min, float max);
+float    randomstream_gauss(RandomStream *r, float mu, float sigma);
+void     random_fill_u32(RandomStream *r, uint32_t *out, size_t n);
+void     random_fill_float(RandomStream *r, float *out, size_t n);
+void     randomstream_gauss_n(RandomStream *r, float *out, size_t n, float mu, float sigma);
+
+void     randomalias_init(RandomAlias *a, const float *weights, int n);
+void     randomalias_finalize(RandomAlias *a);
+int      random_alias(const RandomAlias *a);
+int      randomstream_alias(RandomStream *r, const RandomAlias *a);
+void     random_shuffle(void *base, size_t n, size_t sz);
+void     randomstream_shuffle(RandomStream *r, void *base, size_t n, size_t sz);
+size_t   random_reservoir(struct iterator *it, void *out, size_t k, size_t sz);
+size_t   randomstream_reservoir(RandomStream *r, struct iterator *it, void *out, size_t k, size_t sz);
 
 #endif
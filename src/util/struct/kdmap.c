@@ -0,0 +1,343 @@
+/**
+ * kdmap.c
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ */
+
+#include <alloca.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "kdmap.h"
+
+#define MALLOC_THRESH 127 //nelements until malloc is used instead of alloca in tmp alloc for search
+
+typedef struct kdmapValue
+{
+    float distsq;
+    int node;
+} kdmapValue;
+
+typedef struct kdmapSearch
+{
+    const kdmap *m;
+    const float *point;
+    int found;
+    int max;
+    kdmapValue *list;   ///< the closest found, nearest first
+} kdmapSearch;
+
+typedef struct kdmapRange
+{
+    const kdmap *m;
+    const float *point;
+    float radius;
+    float radiussq;
+    kdmap_func *f;
+    void *arg;
+    int found;
+} kdmapRange;
+
+static const float *kdmap_pos(const kdmap *m, int i)
+{
+    return &m->points[(size_t) i * m->dimensions];
+}
+
+static float kdmap_distsq(const kdmap *m, const float point[], int i)
+{
+    const float *pos = kdmap_pos(m, i);
+    float sqsum = 0.0f;
+    int d;
+    for(d = 0; d < m->dimensions; d++)
+    {
+        sqsum += (point[d] - pos[d]) * (point[d] - pos[d]);
+    }
+    return sqsum;
+}
+
+/**
+ * maps the whole of 'filenm' read only, and sets 'length' to its size.
+ * Returns NULL if it cannot be mapped, or is too short to hold a header
+ */
+static void *kdmap_mapfile(const char *filenm, size_t *length)
+{
+    void *base = NULL;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filenm, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return NULL;
+    }
+    LARGE_INTEGER size;
+    if(GetFileSizeEx(file, &size) && size.QuadPart >= (LONGLONG) sizeof(kdmap_header))
+    {
+        //the view keeps the mapping open once its handle is closed
+        HANDLE map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(map)
+        {
+            base = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(map);
+        }
+        *length = (size_t) size.QuadPart;
+    }
+    CloseHandle(file);
+#else
+    int fd = open(filenm, O_RDONLY);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    if(!fstat(fd, &st) && st.st_size >= (off_t) sizeof(kdmap_header))
+    {
+        base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        base = base == MAP_FAILED ? NULL : base;
+        *length = st.st_size;
+    }
+    close(fd);
+#endif
+    return base;
+}
+
+static void kdmap_unmapfile(void *base, size_t length)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+#else
+    munmap(base, length);
+#endif
+}
+
+/**
+ * the size of a file with the nodes 'h' gives, or 0 if that overflows a size_t
+ */
+static size_t kdmap_filesize(const kdmap_header *h)
+{
+    size_t dims = h->dimensions;
+    size_t nodes = h->nnodes;
+    if(dims > (SIZE_MAX - sizeof(kdmap_node)) / sizeof(float))
+    {
+        return 0;
+    }
+    size_t nodesz = sizeof(kdmap_node) + dims * sizeof(float);
+    if(nodes > (SIZE_MAX - sizeof(kdmap_header)) / nodesz)
+    {
+        return 0;
+    }
+    return sizeof(kdmap_header) + nodes * nodesz;
+}
+
+/**
+ * maps a file written by kdtree_save. Returns 0 on success, or -1 if the
+ * file cannot be read or is not a tree. Only the header is checked, not the
+ * nodes
+ */
+int kdmap_open(kdmap *m, const char *filenm)
+{
+    memset(m, 0, sizeof(kdmap));
+    m->root = -1;
+
+    size_t length;
+    void *base = kdmap_mapfile(filenm, &length);
+    if(!base)
+    {
+        return -1;
+    }
+
+    const kdmap_header *h = base;
+    size_t nodes = (size_t) h->nnodes;
+    if(memcmp(h->magic, "KDT", 3) || h->version != KDMAP_VERSION ||
+       h->dimensions == 0 || h->dimensions > INT_MAX || h->nnodes > INT_MAX ||
+       h->root < -1 || h->root >= (int32_t) h->nnodes ||
+       length != kdmap_filesize(h))
+    {
+        kdmap_unmapfile(base, length);
+        return -1;
+    }
+
+    m->dimensions = h->dimensions;
+    m->root = h->root;
+    m->size = h->size;
+    m->nnodes = h->nnodes;
+    m->nodes = (const kdmap_node*) (h + 1);
+    m->points = (const float*) (m->nodes + nodes);
+    m->base = base;
+    m->length = length;
+    return 0;
+}
+
+/**
+ * unmaps the file of a tree
+ */
+void kdmap_close(kdmap *m)
+{
+    if(m->base)
+    {
+        kdmap_unmapfile(m->base, m->length);
+    }
+    memset(m, 0, sizeof(kdmap));
+    m->root = -1;
+}
+
+/**
+ * the number of points in the tree
+ */
+int kdmap_size(const kdmap *m)
+{
+    return m->size;
+}
+
+/**
+ * adds node 'i' to the sorted search list, if it is among the closest 'max'
+ * found so far
+ */
+static void kdmap_searchinsert(kdmapSearch *s, int i)
+{
+    if(s->m->nodes[i].value == KDMAP_NONE)
+    {
+        return;
+    }
+    float distsq = kdmap_distsq(s->m, s->point, i);
+    if(s->found == s->max && distsq >= s->list[s->found-1].distsq)
+    {
+        return;
+    }
+    int last = s->found < s->max ? s->found++ : s->found - 1;
+    int j;
+    for(j = last; j > 0 && s->list[j-1].distsq > distsq; j--)
+    {
+        s->list[j] = s->list[j-1];
+    }
+    s->list[j].distsq = distsq;
+    s->list[j].node = i;
+}
+
+static void kdmap_searchnode(kdmapSearch *s, int i)
+{
+    while(i >= 0)
+    {
+        const kdmap_node *n = &s->m->nodes[i];
+        kdmap_searchinsert(s, i);
+
+        float diff = s->point[n->axis] - kdmap_pos(s->m, i)[n->axis];
+        int side = diff > 0.0f ? 1 : 0;
+        kdmap_searchnode(s, n->children[side]);
+        if(s->found == s->max && diff * diff > s->list[s->found-1].distsq)
+        {
+            return;
+        }
+        i = n->children[!side];
+    }
+}
+
+/**
+ * the value index of the point closest to 'point', or KDMAP_NONE if the tree
+ * is empty. The point's position is copied to 'closest' if it is not NULL
+ */
+uint32_t kdmap_closest(const kdmap *m, const float point[], float closest[])
+{
+    kdmapValue best;
+    kdmapSearch s = {m, point, 0, 1, &best};
+    kdmap_searchnode(&s, m->root);
+    if(!s.found)
+    {
+        return KDMAP_NONE;
+    }
+    if(closest)
+    {
+        memcpy(closest, kdmap_pos(m, best.node), sizeof(float) * m->dimensions);
+    }
+    return m->nodes[best.node].value;
+}
+
+/**
+ * finds the 'n' points closest to 'point', nearest first. Their value
+ * indices go in 'values', and their squared distances in 'dists' if it is
+ * not NULL. Returns the number found, less than 'n' if the tree is smaller
+ */
+int kdmap_closestN(const kdmap *m, const float point[], int n, uint32_t *values, float *dists)
+{
+    kdmapSearch s = {m, point, 0, n, NULL};
+    if(n <= 0 || m->root < 0)
+    {
+        return 0;
+    } else if(n < MALLOC_THRESH)
+    {
+        s.list = alloca(sizeof(kdmapValue) * n);
+    } else
+    {
+        s.list = malloc(sizeof(kdmapValue) * n);
+    }
+
+    kdmap_searchnode(&s, m->root);
+
+    int i;
+    for(i = 0; i < s.found; i++)
+    {
+        values[i] = m->nodes[s.list[i].node].value;
+        if(dists)
+        {
+            dists[i] = s.list[i].distsq;
+        }
+    }
+
+    if(n >= MALLOC_THRESH)
+    {
+        free(s.list);
+    }
+    return s.found;
+}
+
+/**
+ * visits the points of the subtree at 'i' within the radius. Returns false
+ * once the callback ends the query
+ */
+static bool kdmap_rangenode(kdmapRange *r, int i)
+{
+    while(i >= 0)
+    {
+        const kdmap_node *n = &r->m->nodes[i];
+        const float *pos = kdmap_pos(r->m, i);
+        if(n->value != KDMAP_NONE && kdmap_distsq(r->m, r->point, i) <= r->radiussq)
+        {
+            r->found++;
+            if(r->f && !r->f(r->arg, n->value, pos))
+            {
+                return false;
+            }
+        }
+
+        float diff = r->point[n->axis] - pos[n->axis];
+        if(diff <= r->radius && !kdmap_rangenode(r, n->children[0]))
+        {
+            return false;
+        }
+        i = -diff <= r->radius ? n->children[1] : -1;
+    }
+    return true;
+}
+
+/**
+ * calls 'f' on each point within 'radius' of 'point', in no order, until it
+ * returns false. 'f' may be NULL to only count them. Returns the number of
+ * points visited
+ */
+int kdmap_within_radius(const kdmap *m, const float point[], float radius, kdmap_func *f, void *arg)
+{
+    kdmapRange r = {m, point, radius, radius * radius, f, arg, 0};
+    kdmap_rangenode(&r, m->root);
+    return r.found;
+}
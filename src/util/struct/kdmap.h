@@ -0,0 +1,70 @@
+/**
+ * kdmap.h
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * read only kdtrees, queried in place from a file written by kdtree_save.
+ * Opening one maps the file, so it takes no time however large the tree,
+ * and processes opening the same file share one copy of it. Opening checks
+ * the header and the file's size, but not the nodes: the child indices and
+ * axes of a corrupted file are used as they are, and read out of bounds
+ */
+
+#ifndef _KDMAP_H
+#define _KDMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define KDMAP_VERSION 1
+#define KDMAP_NONE 0xffffffffu  ///< the value of a removed point, or no point
+
+/**
+ * a file is this header, the nodes, then each node's coordinates in turn,
+ * in the byte order of the machine that wrote it
+ */
+typedef struct kdmap_header {
+    uint8_t     magic[3];       ///< the string "KDT" in a valid file
+    uint8_t     version;        ///< KDMAP_VERSION in a valid file
+    uint32_t    dimensions;
+    uint32_t    nnodes;         ///< nodes in the file, live or not
+    uint32_t    size;           ///< live points
+    int32_t     root;           ///< index of the root node, -1 when empty
+    uint8_t     PADDING[12];    ///< padding to 32 bytes
+} kdmap_header;
+
+typedef struct kdmap_node {
+    int32_t     children[2];    ///< node indices, -1 for no child
+    uint32_t    axis;
+    uint32_t    value;          ///< the value index given when saved, or KDMAP_NONE
+} kdmap_node;
+
+/**
+ * visits a point found by a range query, with the point's value index and
+ * position. Return false to end the query early
+ */
+typedef bool (kdmap_func)(void *arg, uint32_t value, const float pos[]);
+
+typedef struct kdmap {
+    int dimensions;
+    int root;
+    int size;
+    int nnodes;
+    const kdmap_node *nodes;
+    const float *points;    ///< the coordinates of each node in turn
+    void *base;             ///< the mapped file
+    size_t length;
+} kdmap;
+
+int         kdmap_open(kdmap *m, const char *filenm);
+void        kdmap_close(kdmap *m);
+int         kdmap_size(const kdmap *m);
+uint32_t    kdmap_closest(const kdmap *m, const float point[], float closest[]);
+int         kdmap_closestN(const kdmap *m, const float point[], int n,
+                           uint32_t *values, float *dists);
+int         kdmap_within_radius(const kdmap *m, const float point[], float radius,
+                                kdmap_func *f, void *arg);
+
+#endif
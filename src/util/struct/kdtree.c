@@ -12,21 +12,51 @@
 #include <string.h>
 #include <math.h>
 
-#include <alloca.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
+#include "util/threadpool.h"
+#include "kdmap.h"
 #include "kdtree.h"
 
+/*
+ * O_BINARY is needed by 'open' under Windows, and S_IRGRP and S_IROTH are
+ * not defined under MINGW
+ */
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+#ifndef S_IRGRP
+#define S_IRGRP 0
+#endif
+#ifndef S_IROTH
+#define S_IROTH 0
+#endif
+
 #define XAXIS 0
 #define YAXIS 1
 #define ZAXIS 2
 
 #define MALLOC_THRESH 127 //nelements until malloc is used instead of alloca in tmp alloc for search
 
+#define KDNODE_NONE -1
+#define KDNODE_FREE 0x1 //node is on the free list
+#define KDNODE_DEAD 0x2 //node was removed, but still splits its children
+
+#define KDTREE_ALPHA 0.7f //a subtree is rebuilt when one side holds more than this share
 
-typedef struct kdValue 
+#define KDTREE_TASK_MIN 4096 //smallest subtree kdtree_build hands to another thread
+#define KDTREE_BATCH_TASK 256 //queries per task of kdtree_closestN_batch
+
+#define KDFOREST_CHOICES 5 //a forest tree splits on one of this many highest spread coordinates
+#define KDFOREST_SAMPLE 64 //points sampled to measure a range's spread
+#define KDTREE_APPROX_STACK 1024 //branches until malloc is used instead of alloca in approximate search
+
+typedef struct kdValue
 {
     float distsq;
-    struct kdnode *node;
+    int node;
 } kdValue;
 
 typedef struct kdSearch
@@ -37,31 +67,122 @@ typedef struct kdSearch
     kdValue *list;
 } kdSearch;
 
+typedef struct kdBatch
+{
+    const kdtree *k;
+    const float *queries;
+    int nq;
+    int n;
+    void **out_vals;
+    float *out_dists;
+    kdValue *scratch;   ///< 'n' entries for each thread
+    int32_t *order;     ///< queries in the order to answer them, or NULL
+} kdBatch;
+
+/**
+ * a query, keyed by the leaf it falls into
+ */
+typedef struct kdQueryKey
+{
+    int32_t leaf;
+    int32_t q;
+} kdQueryKey;
+
+typedef struct kdRange
+{
+    const float *point;     ///< center of a radius query, or NULL for a box
+    float radius;
+    float radiussq;
+    const float *lo;        ///< corners of a box query
+    const float *hi;
+    kdtree_func *f;
+    void *arg;
+    int found;
+} kdRange;
+
+/**
+ * the output buffers of kdtree_within_radiusN and kdtree_within_boxN
+ */
+typedef struct kdRangeBuf
+{
+    int n;
+    int found;
+    void **buf;
+    float **closest;
+} kdRangeBuf;
+
 typedef struct kdnode {
-    uint16_t dim;
+    int32_t children[2];    ///< node indices, KDNODE_NONE for no child
+    int32_t parent;
+    int32_t handle;         ///< the handle of the point, while it is live
     uint16_t axis;
-    float *pos;
+    uint16_t flags;
     void *val;
-    struct kdnode *parent;
-    struct kdnode *children[2]; 
+    float pos[];            ///< the point, 'dimensions' floats
 } kdnode;
 
-static float distanceSq(float point1[], float point2[], int dim);
+/**
+ * a word of a point while building. Each point is its coordinates followed
+ * by its original index, so partitioning moves one block
+ */
+typedef union kdWord
+{
+    float f;
+    int32_t i;
+} kdWord;
+
+typedef struct kdBuild
+{
+    kdtree *k;
+    kdWord *rows;       ///< the points, reordered as they are partitioned
+    int rowlen;         ///< words per point, dimensions + 1
+    void **vals;
+    const int32_t *handles; ///< the handle of each point, or NULL for its index
+    int (*tasks)[4];    ///< subtrees left for the pool, as lo, hi, parent, axis
+    int ntasks;
+    int choices;        ///< split on one of this many highest spread coordinates, 0 to cycle
+    uint32_t seed;      ///< picks among them
+} kdBuild;
+
+/**
+ * a subtree not yet searched by an approximate search, and the least
+ * squared distance of any of its points
+ */
+typedef struct kdBranch
+{
+    float distsq;
+    int32_t node;
+    int32_t tree;
+} kdBranch;
+
+typedef struct kdApprox
+{
+    const kdtree *trees;
+    int ntrees;
+    kdSearch s;         ///< the closest points by handle
+    kdBranch *heap;     ///< branches, nearest first
+    int nheap;
+    int checks;         ///< nodes left to visit
+    float scale;        ///< (1 + eps)^2
+} kdApprox;
+
+static float distanceSq(const float point1[], const float point2[], int dim);
 static int knode_nextAxis(int axis, int dim);
 static int knode_otherSide(int side);
-static void kdnode_init(kdnode *k, kdnode *parent, float point[], int dim, void *val);
-static void kdnode_finalize(kdnode *n, void (*val_finalize(void *)));
-static void kdnode_insert(kdnode *n, float point[], void *val);
-static void kdnode_closest(kdnode *n, float point[], kdValue *val);
-static bool trySearchInsert(kdnode *n, kdSearch *s);
-static void kdnode_closestN(kdnode *n, kdSearch *s);
-static kdnode *kdnode_next(kdnode *n, kdnode *prev);
+static kdnode *kdtree_node(const kdtree *k, int i);
+static int kdtree_newnode(kdtree *k);
+static void kdtree_freenode(kdtree *k, int i);
+static int kdtree_link(kdtree *k, int i);
+static void kdnode_closest(const kdtree *k, int i, float point[], kdValue *val);
+static bool trySearchInsert(const kdtree *k, int i, kdSearch *s);
+static void kdnode_closestN(const kdtree *k, int i, kdSearch *s);
+static int kdnode_next(const kdtree *k, int i, int prev);
 
 /**
  * will find the squared distance between two points. the squared distance is useful
  * to reduce the number of sqrt operation necesarry.
- */ 
-static float distanceSq(float point1[], float point2[], int dim)
+ */
+static float distanceSq(const float point1[], const float point2[], int dim)
 {
     float sqsum = 0.0f;
     int i;
@@ -74,7 +195,7 @@ static float distanceSq(float point1[], float point2[], int dim)
 
 /**
  * gets the axis of children nodes, given the axis of the current node.
- */ 
+ */
 static int knode_nextAxis(int axis, int dim)
 {
     ++axis;
@@ -86,63 +207,90 @@ static int knode_nextAxis(int axis, int dim)
 }
 
 /**
- * returns the opposite child side, give a side. 
- */ 
+ * returns the opposite child side, give a side.
+ */
 static int knode_otherSide(int side)
 {
     return (side == 0 ? 1 : 0);
 }
 
 /**
- * initializer for a node
- */ 
-static void kdnode_init(kdnode *n, kdnode *parent, float point[], int dim, void *val)
+ * the node at index 'i'
+ */
+static kdnode *kdtree_node(const kdtree *k, int i)
+{
+    return (kdnode*) (((char*) k->nodes) + (size_t) i * k->stride);
+}
+
+/**
+ * hands out an unused node, from the free list or the end of the node array.
+ * This may move the array, so node pointers must be found again afterwards
+ */
+static int kdtree_newnode(kdtree *k)
 {
-    n->parent = parent; 
-    n->dim = dim;
-    
-    if(parent)
+    int i;
+    if(k->freelist != KDNODE_NONE)
     {
-        n->axis = knode_nextAxis(parent->axis, parent->dim);
-    } else 
+        i = k->freelist;
+        k->freelist = kdtree_node(k, i)->children[0];
+    } else
     {
-        n->axis = 0;
+        if(k->used == k->capacity)
+        {
+            k->capacity = k->capacity ? (int)(k->capacity * 1.6f) + 1 : 16;
+            k->nodes = realloc(k->nodes, k->capacity * k->stride);
+            assert(k->nodes);
+        }
+        i = k->used++;
     }
-
-    n->pos = malloc(sizeof(float) * dim); 
-    memcpy(n->pos, point, sizeof(float) * dim); 
-    n->val = val;
-    n->children[0] = 0;
-    n->children[1] = 0;
+    kdtree_node(k, i)->flags = 0;
+    return i;
 }
 
 /**
- * will finalize a node freeing any dependant memory, but will not free the node itself
+ * puts a node on the free list, for reuse by kdtree_newnode
  */
-static void kdnode_finalize(kdnode *n, void (*val_finalize(void *)))
-{        
-    if(n){
-        if(n->val && val_finalize){
-            val_finalize(n->val);
-        }
-        kdnode_finalize(n->children[0], val_finalize);
-        kdnode_finalize(n->children[1], val_finalize);
-        free(n->children[0]);
-        free(n->children[1]);
-    }
+static void kdtree_freenode(kdtree *k, int i)
+{
+    kdnode *n = kdtree_node(k, i);
+    n->flags = KDNODE_FREE;
+    n->val = NULL;
+    n->parent = KDNODE_NONE;
+    n->children[0] = k->freelist;
+    n->children[1] = KDNODE_NONE;
+    k->freelist = i;
 }
 
 /**
- * will recursively search for a spot for a node, and add it to the tree
- */ 
-static void kdnode_insert(kdnode *n, float point[], void *val)
+ * hangs the detached node 'i' below the leaf its point falls into. Returns
+ * the node's depth, 0 for the root
+ */
+static int kdtree_link(kdtree *k, int i)
 {
-    int side = (point[n->axis] > n->pos[n->axis] ? 1 : 0);
-    if(n->children[side]){
-        kdnode_insert(n->children[side], point, val);
-    } else {
-        n->children[side] = malloc(sizeof(kdnode));
-        kdnode_init(n->children[side], n, point, n->dim, val);
+    kdnode *n = kdtree_node(k, i);
+    n->children[0] = KDNODE_NONE;
+    n->children[1] = KDNODE_NONE;
+    if(k->root == KDNODE_NONE)
+    {
+        k->root = i;
+        n->parent = KDNODE_NONE;
+        n->axis = 0;
+        return 0;
+    }
+
+    int cur = k->root, depth = 1;
+    for(;; depth++)
+    {
+        kdnode *c = kdtree_node(k, cur);
+        int side = (n->pos[c->axis] > c->pos[c->axis] ? 1 : 0);
+        if(c->children[side] == KDNODE_NONE)
+        {
+            c->children[side] = i;
+            n->parent = cur;
+            n->axis = knode_nextAxis(c->axis, k->dimensions);
+            return depth;
+        }
+        cur = c->children[side];
     }
 }
 
@@ -150,89 +298,99 @@ static void kdnode_insert(kdnode *n, float point[], void *val)
  * will find the closest distance to a supplied point. the distance is passed around as
  * cdistsq, the squared of the distance, to reduce the number of expensive sqrt opperations
  */
-static void kdnode_closest(kdnode *n, float point[], kdValue *val)
+static void kdnode_closest(const kdtree *k, int i, float point[], kdValue *val)
 {
+    kdnode *n = kdtree_node(k, i);
     int side = (point[n->axis] > n->pos[n->axis] ? 1 : 0);
-    float node_dsq = distanceSq(point, n->pos, n->dim); 
-    if(node_dsq < val->distsq || val->node == NULL)
+    float node_dsq = distanceSq(point, n->pos, k->dimensions);
+    if(!(n->flags & KDNODE_DEAD) && node_dsq < val->distsq)
     {
         val->distsq = node_dsq;
-        val->node = n;
+        val->node = i;
     }
 
-    if(n->children[side]){
-            kdnode_closest(n->children[side], point, val);
+    if(n->children[side] != KDNODE_NONE){
+            kdnode_closest(k, n->children[side], point, val);
     }
 
     side = knode_otherSide(side);
-    if(n->children[side]){
-        float childAxisDist = fabs(point[n->axis] - n->pos[n->axis]);
-        if(childAxisDist <= val->distsq){
-            kdnode_closest(n->children[side], point, val);
+    if(n->children[side] != KDNODE_NONE){
+        float childAxisDist = point[n->axis] - n->pos[n->axis];
+        if(childAxisDist * childAxisDist <= val->distsq){
+            kdnode_closest(k, n->children[side], point, val);
         }
     }
 }
 
-static bool trySearchInsert(kdnode *n, kdSearch *s)
+/**
+ * adds node 'i' to the sorted search list, if it is among the closest 'max'
+ * found so far
+ */
+static bool trySearchInsert(const kdtree *k, int i, kdSearch *s)
 {
-    bool ret = false;
-    float node_dsq = distanceSq(s->point, n->pos, n->dim); 
-
-    if(!s->found) //list is empty
+    kdnode *n = kdtree_node(k, i);
+    if(n->flags & KDNODE_DEAD)
     {
-        s->list[0].distsq = node_dsq;
-        s->list[0].node = n;
-        s->found++;
-    } else if(s->found < s->max || node_dsq < s->list[s->found-1].distsq)
+        return false;
+    }
+    float node_dsq = distanceSq(s->point, n->pos, k->dimensions);
+    if(s->found == s->max && node_dsq >= s->list[s->found-1].distsq)
     {
-        int i;
-        for (i = s->found; i >= 0; i--)
-        {
-            if(i == 0 || node_dsq > s->list[i-1].distsq)
-            {
-                if(s->found < s->max)
-                {
-                    s->found++; 
-                }
-                //shift over current values, to make room for new node
-                memmove(&s->list[i+1], &s->list[i], (s->found - i) * sizeof(kdValue));
-
-                s->list[i].distsq = node_dsq;
-                s->list[i].node = n;
-                ret = true;
-                break;
-            }
-        }
+        return false;
     }
-    return ret;
+
+    int last = s->found < s->max ? s->found++ : s->found - 1;
+    int j;
+    for(j = last; j > 0 && s->list[j-1].distsq > node_dsq; j--)
+    {
+        s->list[j] = s->list[j-1]; //shift over farther values, to make room for new node
+    }
+    s->list[j].distsq = node_dsq;
+    s->list[j].node = i;
+    return true;
 }
 
-static void kdnode_closestN(kdnode *n, kdSearch *s)
+static void kdnode_closestN(const kdtree *k, int i, kdSearch *s)
 {
+    kdnode *n = kdtree_node(k, i);
     int side = (s->point[n->axis] > n->pos[n->axis] ? 1 : 0);
 
-    trySearchInsert(n, s);
+    trySearchInsert(k, i, s);
 
-    if(n->children[side]){
-            kdnode_closestN(n->children[side], s);
+    if(n->children[side] != KDNODE_NONE){
+            kdnode_closestN(k, n->children[side], s);
     }
 
     side = knode_otherSide(side);
-    if(n->children[side]){
-        float childAxisDist = fabs(s->point[n->axis] - n->pos[n->axis]);
-        if(s->found < s->max || childAxisDist <= s->list[s->max-1].distsq){
-            kdnode_closestN(n->children[side], s);
+    if(n->children[side] != KDNODE_NONE){
+        float childAxisDist = s->point[n->axis] - n->pos[n->axis];
+        if(s->found < s->max || childAxisDist * childAxisDist <= s->list[s->max-1].distsq){
+            kdnode_closestN(k, n->children[side], s);
         }
     }
 }
 
 /**
  * initializes the tree
- */ 
+ */
 void kdtree_init(kdtree *k, int dimensions)
 {
+    assert(dimensions > 0);
     k->dimensions = dimensions;
-    k->root = 0;
+    k->root = KDNODE_NONE;
+    k->size = 0;
+    k->dead = 0;
+    k->peak = 0;
+    k->used = 0;
+    k->capacity = 0;
+    k->freelist = KDNODE_NONE;
+    k->stride = sizeof(kdnode) + sizeof(float) * dimensions;
+    k->stride = (k->stride + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    k->nodes = NULL;
+    k->handles = NULL;
+    k->nhandles = 0;
+    k->handlecap = 0;
+    k->freehandle = KDNODE_NONE;
 }
 
 /**
@@ -240,161 +398,1453 @@ void kdtree_init(kdtree *k, int dimensions)
  * values are finalized with the method passed as 'val_finalize'. This method will not free
  * the allocation for the actial kdtree, and must be done externaly
  */
-void kdtree_finalize(kdtree *k, void (*val_finalize(void*)))
+void kdtree_finalize(kdtree *k, void (*val_finalize)(void*))
 {
-   kdnode_finalize(k->root, val_finalize);
-   free(k->root);
-   k->root = 0;
+    int i;
+    for(i = 0; i < k->used && val_finalize; i++)
+    {
+        kdnode *n = kdtree_node(k, i);
+        if(!(n->flags & (KDNODE_FREE | KDNODE_DEAD)) && n->val)
+        {
+            val_finalize(n->val);
+        }
+    }
+    free(k->handles);
+    free(k->nodes);
+    kdtree_init(k, k->dimensions);
 }
 
 /**
- * will find the proper position for a new node and add it to the tree
- */ 
-void kdtree_insert(kdtree *k, float point[], void *val)
+ * the thread pool kdtree_build splits subtrees across, or NULL to build on
+ * the calling thread
+ */
+static ThreadPool *kdtree_pool = NULL;
+
+/**
+ * sets the thread pool used by kdtree_build. Pass NULL (the default) to build
+ * on the calling thread. The pool must outlive any build that uses it
+ */
+void kdtree_threadpool(ThreadPool *pool)
 {
-    if(!k->root){
-        k->root = malloc(sizeof(kdnode));
-        kdnode_init(k->root, NULL, point, k->dimensions, val);
-    } else {
-        kdnode_insert(k->root, point, val);
-    }
+    kdtree_pool = pool;
 }
 
 /**
- * will return the closest point to a supplied x/y pair. If there are no points in the tree, 
- * return NULL
+ * the root of the subtree built from the range [lo, hi), which is always the
+ * range's middle
  */
-void *kdtree_closest(kdtree *k, float point[], float closest[])
+static int kdtree_rangeroot(int lo, int hi)
 {
-    if(!k || !k->root)
-        return NULL;
+    return lo < hi ? lo + (hi - lo) / 2 : KDNODE_NONE;
+}
 
-    kdValue val = {-1, NULL};
-    float distancesq = distanceSq(point, k->root->pos, k->dimensions);
-    kdnode_closest(k->root, point, &val);
-    if(closest)
+/**
+ * swaps points 'i' and 'j' of a build
+ */
+static inline void kdtree_buildswap(kdWord *a, kdWord *c, int rowlen)
+{
+    int d;
+    for(d = 0; d < rowlen; d++)
     {
-        memcpy(closest, val.node->pos, sizeof(float) * k->dimensions);
+        kdWord tmp = a[d];
+        a[d] = c[d];
+        c[d] = tmp;
     }
-    return val.node->val;
 }
 
-int kdtree_closestN(kdtree *k, float point[], int n, void **buf, float *closest[])
+/**
+ * reorders the points [left, right] so that point 'nth' has the coordinate on
+ * 'axis' it would have if the range were sorted on it, with no greater
+ * coordinates before it and no lesser ones after. This is Floyd and Rivest's
+ * select, which first narrows large ranges by selecting within a sample, so
+ * most points are only compared about once
+ */
+static void kdtree_select(kdBuild *b, int left, int right, int nth, int axis)
 {
-    kdSearch search;
-    search.point = point;
-    search.max = n;
-    search.found = 0;
+    const int rowlen = b->rowlen;
+    kdWord *rows = b->rows;
+    #define ROW(i) (&rows[(size_t) (i) * rowlen])
+    #define KEY(i) rows[(size_t) (i) * rowlen + axis].f
+    while(right > left)
+    {
+        if(right - left > 600)
+        {
+            double n = right - left + 1;
+            double i = nth - left + 1;
+            double z = log(n);
+            double s = 0.5 * exp(2.0 * z / 3.0);
+            double sd = 0.5 * sqrt(z * s * (n - s) / n) * (i < n / 2 ? -1.0 : 1.0);
+            int newleft = nth - i * s / n + sd;
+            int newright = nth + (n - i) * s / n + sd;
+            kdtree_select(b, newleft > left ? newleft : left,
+                    newright < right ? newright : right, nth, axis);
+        }
 
-    if(n <= 0)
+        float t = KEY(nth);
+        int i = left, j = right;
+        kdtree_buildswap(ROW(left), ROW(nth), rowlen);
+        if(KEY(right) > t)
+        {
+            kdtree_buildswap(ROW(right), ROW(left), rowlen);
+        }
+        while(i < j)
+        {
+            kdtree_buildswap(ROW(i), ROW(j), rowlen);
+            i++;
+            j--;
+            while(KEY(i) < t) i++;
+            while(KEY(j) > t) j--;
+        }
+        if(!(KEY(left) < t)) // the pivot, or a point equal to it, is at 'left'
+        {
+            kdtree_buildswap(ROW(left), ROW(j), rowlen);
+        } else
+        {
+            j++;
+            kdtree_buildswap(ROW(j), ROW(right), rowlen);
+        }
+        if(j <= nth)
+        {
+            left = j + 1;
+        }
+        if(nth <= j)
+        {
+            right = j - 1;
+        }
+    }
+    #undef KEY
+    #undef ROW
+}
+
+/**
+ * mixes the bits of 'x', for a random number that only depends on it
+ */
+static uint32_t kdtree_mix(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+/**
+ * picks the axis to split [lo, hi) on, at random among the b->choices
+ * coordinates whose values spread the most over a sample of the range. The
+ * pick depends only on the seed and the node, so a threaded build gives the
+ * same tree
+ */
+static int kdtree_spreadaxis(kdBuild *b, int lo, int hi, int mid)
+{
+    int dim = b->k->dimensions;
+    int n = hi - lo < KDFOREST_SAMPLE ? hi - lo : KDFOREST_SAMPLE;
+    int step = (hi - lo) / n;
+    float *mean = alloca(sizeof(float) * dim * 2);
+    float *var = &mean[dim];
+    int i, d;
+    memset(mean, 0, sizeof(float) * dim * 2);
+    for(i = 0; i < n; i++)
     {
-        return 0;
-    } else if (n < MALLOC_THRESH)
+        kdWord *row = &b->rows[(size_t) (lo + i * step) * b->rowlen];
+        for(d = 0; d < dim; d++)
+        {
+            mean[d] += row[d].f;
+        }
+    }
+    for(d = 0; d < dim; d++)
     {
-        search.list = alloca(sizeof(kdValue) * n); //stack alloc quickly for small values
-    } else 
+        mean[d] /= n;
+    }
+    for(i = 0; i < n; i++)
     {
-        search.list = malloc(sizeof(kdValue) * n); //rare malloc for large n values
+        kdWord *row = &b->rows[(size_t) (lo + i * step) * b->rowlen];
+        for(d = 0; d < dim; d++)
+        {
+            float diff = row[d].f - mean[d];
+            var[d] += diff * diff;
+        }
     }
 
-    kdnode_closestN(k->root, &search);
-
-    int i;
-    for(i = 0; i < search.found; i++)
+    // the highest spreads, greatest first
+    int top[KDFOREST_CHOICES];
+    int ntop = 0, j;
+    for(d = 0; d < dim; d++)
     {
-        if(buf)
+        if(ntop == b->choices && !(var[d] > var[top[ntop-1]]))
         {
-            buf[i] = search.list[i].node->val; 
+            continue;
         }
-
-        if(closest)
+        for(j = ntop < b->choices ? ntop++ : ntop - 1; j > 0 && var[top[j-1]] < var[d]; j--)
         {
-            closest[i] = search.list[i].node->pos;
+            top[j] = top[j-1];
         }
+        top[j] = d;
     }
+    return top[kdtree_mix(b->seed ^ (uint32_t) mid) % ntop];
+}
 
-    if(n >= MALLOC_THRESH)
+/**
+ * partitions [lo, hi) about its median on 'axis', and makes the median the
+ * node at the range's middle. Its children are the roots of the two halves
+ */
+static int kdtree_buildnode(kdBuild *b, int lo, int hi, int parent, int axis)
+{
+    kdtree *k = b->k;
+    int dim = k->dimensions;
+    int mid = kdtree_rangeroot(lo, hi);
+    if(b->choices)
     {
-        free(search.list);
+        axis = kdtree_spreadaxis(b, lo, hi, mid);
     }
+    kdtree_select(b, lo, hi - 1, mid, axis);
 
-    return search.found;
+    kdnode *n = kdtree_node(k, mid);
+    n->children[0] = kdtree_rangeroot(lo, mid);
+    n->children[1] = kdtree_rangeroot(mid + 1, hi);
+    n->parent = parent;
+    n->axis = axis;
+    n->flags = 0;
+    kdWord *row = &b->rows[(size_t) mid * b->rowlen];
+    n->val = b->vals ? b->vals[row[dim].i] : NULL;
+    n->handle = b->handles ? b->handles[row[dim].i] : row[dim].i;
+    k->handles[n->handle] = mid;
+    memcpy(n->pos, row, sizeof(float) * dim);
+    return mid;
 }
 
-void kdtree_removeClosest(kdtree *k, float point[], void (*val_finalize)(void*))
+static void kdtree_buildrange(kdBuild *b, int lo, int hi, int parent, int axis)
 {
-    kdValue val = {-1, NULL};
-    kdnode_closest(k->root, point, &val);
-    if(val.node)
+    if(lo < hi)
     {
-        //remove found node from parent
-        if(val.node->parent)
-        {
-            if(val.node->parent->children[0] == val.node)
-            {
-                val.node->parent->children[0] = NULL; 
-            } else if(val.node->parent->children[1] == val.node)
-            {
-                val.node->parent->children[1] = NULL; 
-            }
-        } else if(k->root == val.node) //remove if root
+        int mid = kdtree_buildnode(b, lo, hi, parent, axis);
+        axis = knode_nextAxis(axis, b->k->dimensions);
+        kdtree_buildrange(b, lo, mid, mid, axis);
+        kdtree_buildrange(b, mid + 1, hi, mid, axis);
+    }
+}
+
+/**
+ * builds the top 'depth' levels of the tree, leaving the subtrees below them
+ * as tasks
+ */
+static void kdtree_buildtop(kdBuild *b, int lo, int hi, int parent, int axis, int depth)
+{
+    if(lo >= hi)
+    {
+        return;
+    }
+    if(depth == 0 || hi - lo < KDTREE_TASK_MIN)
+    {
+        int *t = b->tasks[b->ntasks++];
+        t[0] = lo;
+        t[1] = hi;
+        t[2] = parent;
+        t[3] = axis;
+        return;
+    }
+    int mid = kdtree_buildnode(b, lo, hi, parent, axis);
+    axis = knode_nextAxis(axis, b->k->dimensions);
+    kdtree_buildtop(b, lo, mid, mid, axis, depth - 1);
+    kdtree_buildtop(b, mid + 1, hi, mid, axis, depth - 1);
+}
+
+static void kdtree_build_task(void *arg, int task, int thread)
+{
+    kdBuild *b = arg;
+    int *t = b->tasks[task];
+    kdtree_buildrange(b, t[0], t[1], t[2], t[3]);
+}
+
+/**
+ * replaces the nodes of a tree with a balanced tree of 'n' points, which get
+ * the handles in 'handles', or their indices if it is NULL. Nodes split on
+ * cycling axes if 'choices' is 0, as kdtree_spreadaxis otherwise
+ */
+static void kdtree_buildall(kdtree *k, const float *points, void **vals, const int32_t *handles, int n,
+        int choices, uint32_t seed)
+{
+    if(k->capacity < n)
+    {
+        k->capacity = n;
+        k->nodes = realloc(k->nodes, n * k->stride);
+        assert(k->nodes);
+    }
+    k->used = n;
+    k->size = n;
+    k->peak = n;
+    k->dead = 0;
+    k->freelist = KDNODE_NONE;
+    k->root = kdtree_rangeroot(0, n);
+    if(n <= 0)
+    {
+        return;
+    }
+
+    kdBuild b;
+    b.k = k;
+    b.rowlen = k->dimensions + 1;
+    b.rows = malloc(sizeof(kdWord) * b.rowlen * n);
+    b.vals = vals;
+    b.handles = handles;
+    b.tasks = NULL;
+    b.ntasks = 0;
+    b.choices = choices;
+    b.seed = seed;
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        kdWord *row = &b.rows[(size_t) i * b.rowlen];
+        memcpy(row, &points[(size_t) i * k->dimensions], sizeof(float) * k->dimensions);
+        row[k->dimensions].i = i;
+    }
+
+    if(kdtree_pool && n >= 2 * KDTREE_TASK_MIN)
+    {
+        // enough subtrees to keep every thread busy, as they differ in size
+        int depth = 0;
+        while((1 << depth) < 4 * threadpool_nthreads(kdtree_pool))
         {
-            k->root = NULL;
+            depth++;
         }
-        val.node->parent = NULL;
+        b.tasks = malloc(sizeof(int[4]) * (1 << depth));
+        kdtree_buildtop(&b, 0, n, KDNODE_NONE, 0, depth);
+        threadpool_run(kdtree_pool, b.ntasks, kdtree_build_task, &b);
+        free(b.tasks);
+    } else
+    {
+        kdtree_buildrange(&b, 0, n, KDNODE_NONE, 0);
+    }
+    free(b.rows);
+}
+
+/**
+ * builds a balanced tree from 'n' points at once, splitting each subtree at
+ * its median. 'points' holds the coordinates of each point in turn, and
+ * 'vals' the value of each point, or is NULL for no values. Point i gets the
+ * handle i. The tree must be empty. The nodes fill one array, and the
+ * subtrees below the first few levels are built in parallel on the pool set
+ * by kdtree_threadpool
+ */
+void kdtree_build(kdtree *k, const float *points, void **vals, int n)
+{
+    assert(k->size == 0 && k->nhandles == 0 && "kdtree_build needs an empty tree");
+    if(n <= 0)
+    {
+        return;
     }
-    //itterate over children an re-add to kdtree
-    Iterator iter;
-    kdtree_iter_init(k, &iter);
-    iter.value = val.node;
+    k->handles = malloc(sizeof(int) * n);
+    k->nhandles = n;
+    k->handlecap = n;
+    kdtree_buildall(k, points, vals, NULL, n, 0, 0);
+}
 
-    kdnode *iternode;
-    while((iternode = iterator_next(&iter)))
+/**
+ * rebuilds the whole tree balanced, dropping removed nodes. Handles stay
+ * the same, though the nodes behind them move. Removals and insertions
+ * rebuild the tree or parts of it as needed, so this is rarely worth
+ * calling
+ */
+void kdtree_rebuild(kdtree *k)
+{
+    int dim = k->dimensions;
+    float *points = malloc(sizeof(float) * dim * (k->size + 1));
+    void **vals = malloc(sizeof(void*) * (k->size + 1));
+    int32_t *handles = malloc(sizeof(int32_t) * (k->size + 1));
+    int i, n = 0;
+    for(i = 0; i < k->used; i++)
     {
-        kdtree_insert(k, iternode->pos, iternode->val);
+        kdnode *node = kdtree_node(k, i);
+        if(!(node->flags & (KDNODE_FREE | KDNODE_DEAD)))
+        {
+            memcpy(&points[(size_t) n * dim], node->pos, sizeof(float) * dim);
+            vals[n] = node->val;
+            handles[n] = node->handle;
+            n++;
+        }
     }
+    assert(n == k->size);
+    kdtree_buildall(k, points, vals, handles, n, 0, 0);
+    free(handles);
+    free(vals);
+    free(points);
+}
+
+/**
+ * the number of points in the tree
+ */
+int kdtree_size(kdtree *k)
+{
+    return k->size;
+}
 
-    //free old node value
-    if(val_finalize)
+static int kdnode_depth(const kdtree *k, int i)
+{
+    if(i == KDNODE_NONE)
     {
-        val_finalize(val.node->val);
+        return 0;
     }
+    kdnode *n = kdtree_node(k, i);
+    int l = kdnode_depth(k, n->children[0]);
+    int r = kdnode_depth(k, n->children[1]);
+    return 1 + (l > r ? l : r);
 }
 
+/**
+ * the number of nodes on the longest path from the root to a leaf
+ */
+int kdtree_depth(kdtree *k)
+{
+    return kdnode_depth(k, k->root);
+}
 
 /**
- * itterator next function
+ * hands out an unused handle
  */
-static void *kdtree_iter_next(void *k, Iterator *i)
+static int kdtree_newhandle(kdtree *k)
 {
-    kdnode *ret = NULL;
-    if(!i->value)
+    int h;
+    if(k->freehandle != KDNODE_NONE)
     {
-       ret = ((kdtree*)k)->root; 
+        h = k->freehandle;
+        k->freehandle = -2 - k->handles[h];
     } else
     {
-        ret = kdnode_next((kdnode*)i->value, NULL);    
+        if(k->nhandles == k->handlecap)
+        {
+            k->handlecap = k->handlecap ? (int)(k->handlecap * 1.6f) + 1 : 16;
+            k->handles = realloc(k->handles, sizeof(int) * k->handlecap);
+            assert(k->handles);
+        }
+        h = k->nhandles++;
+    }
+    return h;
+}
+
+/**
+ * puts a handle on the free list. Free handles hold -2 minus the next free
+ * handle, so they are all negative
+ */
+static void kdtree_freehandle(kdtree *k, int h)
+{
+    k->handles[h] = -2 - k->freehandle;
+    k->freehandle = h;
+}
+
+/**
+ * the node of a handle, which must be live
+ */
+static int kdtree_handlenode(const kdtree *k, int h)
+{
+    assert(h >= 0 && h < k->nhandles && k->handles[h] >= 0 && "invalid kdtree handle");
+    return k->handles[h];
+}
+
+/**
+ * counts the nodes of a subtree, removed nodes included
+ */
+static int kdnode_count(const kdtree *k, int i)
+{
+    int count = 0;
+    while(i != KDNODE_NONE)
+    {
+        kdnode *n = kdtree_node(k, i);
+        count += 1 + kdnode_count(k, n->children[0]);
+        i = n->children[1];
     }
-    return ret;
+    return count;
 }
 
-static kdnode *kdnode_next(kdnode *n, kdnode *prev)
+/**
+ * reorders the nodes in idx[lo, hi) so idx[nth] is in its sorted place by
+ * coordinate 'axis', as kdtree_select does for points
+ */
+static void kdtree_selectnodes(const kdtree *k, int32_t *idx, int lo, int hi, int nth, int axis)
 {
-    kdnode *ret = NULL;
-    if(n)
+    #define KEY(i) kdtree_node(k, idx[i])->pos[axis]
+    hi--;
+    while(hi > lo)
     {
-        if(!prev && n->children[0])
+        float pivot = KEY(lo + (hi - lo) / 2);
+        int i = lo, j = hi;
+        while(i <= j)
+        {
+            while(KEY(i) < pivot) i++;
+            while(KEY(j) > pivot) j--;
+            if(i <= j)
+            {
+                int32_t tmp = idx[i];
+                idx[i++] = idx[j];
+                idx[j--] = tmp;
+            }
+        }
+        if(nth <= j)
         {
-            return n->children[0]; 
-        } else if(prev != n->children[1] && n->children[1])
+            hi = j;
+        } else if(nth >= i)
+        {
+            lo = i;
+        } else
+        {
+            break;
+        }
+    }
+    #undef KEY
+}
+
+/**
+ * links the nodes idx[lo, hi) into a balanced subtree below 'parent'.
+ * Returns its root
+ */
+static int kdtree_relink(kdtree *k, int32_t *idx, int lo, int hi, int parent, int axis)
+{
+    if(lo >= hi)
+    {
+        return KDNODE_NONE;
+    }
+    int mid = kdtree_rangeroot(lo, hi);
+    kdtree_selectnodes(k, idx, lo, hi, mid, axis);
+    int next = knode_nextAxis(axis, k->dimensions);
+    kdnode *n = kdtree_node(k, idx[mid]);
+    n->parent = parent;
+    n->axis = axis;
+    n->children[0] = kdtree_relink(k, idx, lo, mid, idx[mid], next);
+    n->children[1] = kdtree_relink(k, idx, mid + 1, hi, idx[mid], next);
+    return idx[mid];
+}
+
+/**
+ * rebuilds the subtree at 'i' balanced, freeing its removed nodes. The live
+ * nodes keep their indices, so handles need no update
+ */
+static void kdtree_rebuildsub(kdtree *k, int i)
+{
+    kdnode *n = kdtree_node(k, i);
+    int parent = n->parent;
+    int axis = n->axis;
+    int side = parent != KDNODE_NONE && kdtree_node(k, parent)->children[1] == i;
+
+    int32_t *idx = malloc(sizeof(int32_t) * kdnode_count(k, i));
+    int nidx = 0, nlive = 0, j;
+    idx[nidx++] = i;
+    for(j = 0; j < nidx; j++)
+    {
+        kdnode *s = kdtree_node(k, idx[j]);
+        if(s->children[0] != KDNODE_NONE) idx[nidx++] = s->children[0];
+        if(s->children[1] != KDNODE_NONE) idx[nidx++] = s->children[1];
+    }
+    for(j = 0; j < nidx; j++)
+    {
+        if(kdtree_node(k, idx[j])->flags & KDNODE_DEAD)
+        {
+            kdtree_freenode(k, idx[j]);
+            k->dead--;
+        } else
+        {
+            idx[nlive++] = idx[j];
+        }
+    }
+
+    int root = kdtree_relink(k, idx, 0, nlive, parent, axis);
+    if(parent == KDNODE_NONE)
+    {
+        k->root = root;
+    } else
+    {
+        kdtree_node(k, parent)->children[side] = root;
+    }
+    free(idx);
+}
+
+/**
+ * keeps the tree's depth within log(n) / log(1 / KDTREE_ALPHA) after node 'i'
+ * was linked at 'depth', as in a scapegoat tree. If it is too deep, the
+ * lowest ancestor with one side holding too much of its subtree is rebuilt
+ */
+static void kdtree_balance(kdtree *k, int i, int depth)
+{
+    int nodes = k->size + k->dead;
+    if(depth <= 1 || depth <= logf(nodes) / logf(1.0f / KDTREE_ALPHA))
+    {
+        return;
+    }
+
+    int count = 1;
+    int parent = kdtree_node(k, i)->parent;
+    while(parent != KDNODE_NONE)
+    {
+        kdnode *p = kdtree_node(k, parent);
+        int sibling = p->children[p->children[0] == i ? 1 : 0];
+        int pcount = count + 1 + kdnode_count(k, sibling);
+        if(count > KDTREE_ALPHA * pcount)
+        {
+            kdtree_rebuildsub(k, parent);
+            return;
+        }
+        i = parent;
+        count = pcount;
+        parent = p->parent;
+    }
+    kdtree_rebuildsub(k, k->root);
+}
+
+/**
+ * will find the proper position for a new node and add it to the tree.
+ * Returns the handle of the point
+ */
+int kdtree_insert(kdtree *k, float point[], void *val)
+{
+    int h = kdtree_newhandle(k);
+    int i = kdtree_newnode(k);
+    kdnode *n = kdtree_node(k, i);
+    memcpy(n->pos, point, sizeof(float) * k->dimensions);
+    n->val = val;
+    n->handle = h;
+    k->handles[h] = i;
+    k->size++;
+    k->peak = k->size > k->peak ? k->size : k->peak;
+    kdtree_balance(k, i, kdtree_link(k, i));
+    return h;
+}
+
+/**
+ * detaches the leaf 'i' from its parent. Removed parents left as leaves are
+ * freed, as nothing depends on them any more
+ */
+static void kdtree_detach(kdtree *k, int i)
+{
+    int parent = kdtree_node(k, i)->parent;
+    while(parent != KDNODE_NONE)
+    {
+        kdnode *p = kdtree_node(k, parent);
+        p->children[p->children[0] == i ? 0 : 1] = KDNODE_NONE;
+        if(!(p->flags & KDNODE_DEAD) ||
+            p->children[0] != KDNODE_NONE || p->children[1] != KDNODE_NONE)
+        {
+            return;
+        }
+        i = parent;
+        parent = p->parent;
+        kdtree_freenode(k, i);
+        k->dead--;
+    }
+    k->root = KDNODE_NONE;
+}
+
+/**
+ * detaches the leaf 'i' as kdtree_detach, and frees it
+ */
+static void kdtree_freeleaf(kdtree *k, int i)
+{
+    kdtree_detach(k, i);
+    kdtree_freenode(k, i);
+}
+
+/**
+ * whether node 'i' has no children
+ */
+static bool kdnode_isleaf(const kdtree *k, int i)
+{
+    kdnode *n = kdtree_node(k, i);
+    return n->children[0] == KDNODE_NONE && n->children[1] == KDNODE_NONE;
+}
+
+/**
+ * rebuilds the whole tree once removed nodes reach a quarter of the live
+ * ones, or the tree has shrunk to half its size. Searches pass through
+ * removed nodes, so they cannot be left to pile up
+ */
+static void kdtree_checkshrink(kdtree *k)
+{
+    if(k->dead * 4 > k->size || k->size < k->peak / 2)
+    {
+        kdtree_rebuild(k);
+    }
+}
+
+/**
+ * removes the point with handle 'handle', and finalizes its value with
+ * 'val_finalize' if it is not NULL. The handle may be handed out again
+ */
+void kdtree_remove(kdtree *k, int handle, void (*val_finalize)(void*))
+{
+    int i = kdtree_handlenode(k, handle);
+    kdnode *n = kdtree_node(k, i);
+    if(val_finalize && n->val)
+    {
+        val_finalize(n->val);
+    }
+    kdtree_freehandle(k, handle);
+    k->size--;
+
+    if(kdnode_isleaf(k, i))
+    {
+        kdtree_freeleaf(k, i);
+    } else
+    {
+        n->flags |= KDNODE_DEAD;
+        n->val = NULL;
+        k->dead++;
+    }
+    kdtree_checkshrink(k);
+}
+
+/**
+ * moves the point with handle 'handle' to 'point'. Its handle and value stay
+ * the same
+ */
+void kdtree_move(kdtree *k, int handle, const float point[])
+{
+    int i = kdtree_handlenode(k, handle);
+    if(kdnode_isleaf(k, i))
+    {
+        kdnode *n = kdtree_node(k, i);
+        int parent = n->parent;
+        if(parent == KDNODE_NONE)
+        {
+            memcpy(n->pos, point, sizeof(float) * k->dimensions);
+            return;
+        }
+        kdtree_detach(k, i);
+        memcpy(n->pos, point, sizeof(float) * k->dimensions);
+        kdtree_balance(k, i, kdtree_link(k, i));
+        return;
+    }
+
+    //the node still splits its children, so leave it in place, removed
+    int j = kdtree_newnode(k);
+    kdnode *old = kdtree_node(k, i);
+    kdnode *n = kdtree_node(k, j);
+    memcpy(n->pos, point, sizeof(float) * k->dimensions);
+    n->val = old->val;
+    n->handle = handle;
+    k->handles[handle] = j;
+    old->flags |= KDNODE_DEAD;
+    old->val = NULL;
+    k->dead++;
+    kdtree_balance(k, j, kdtree_link(k, j));
+    kdtree_checkshrink(k);
+}
+
+/**
+ * the value of the point with handle 'handle'
+ */
+void *kdtree_value(kdtree *k, int handle)
+{
+    return kdtree_node(k, kdtree_handlenode(k, handle))->val;
+}
+
+/**
+ * the position of the point with handle 'handle', which changes if the
+ * tree does
+ */
+float const *kdtree_position(kdtree *k, int handle)
+{
+    return kdtree_node(k, kdtree_handlenode(k, handle))->pos;
+}
+
+/**
+ * will return the closest point to a supplied x/y pair. If there are no points in the tree,
+ * return NULL
+ */
+void *kdtree_closest(kdtree *k, float point[], float closest[])
+{
+    if(!k || k->root == KDNODE_NONE)
+        return NULL;
+
+    kdValue val = {INFINITY, KDNODE_NONE};
+    kdnode_closest(k, k->root, point, &val);
+    if(val.node == KDNODE_NONE)
+        return NULL;
+    kdnode *n = kdtree_node(k, val.node);
+    if(closest)
+    {
+        memcpy(closest, n->pos, sizeof(float) * k->dimensions);
+    }
+    return n->val;
+}
+
+int kdtree_closestN(kdtree *k, float point[], int n, void **buf, float *closest[])
+{
+    kdSearch search;
+    search.point = point;
+    search.max = n;
+    search.found = 0;
+
+    if(n <= 0 || k->root == KDNODE_NONE)
+    {
+        return 0;
+    } else if (n < MALLOC_THRESH)
+    {
+        search.list = alloca(sizeof(kdValue) * n); //stack alloc quickly for small values
+    } else
+    {
+        search.list = malloc(sizeof(kdValue) * n); //rare malloc for large n values
+    }
+
+    kdnode_closestN(k, k->root, &search);
+
+    int i;
+    for(i = 0; i < search.found; i++)
+    {
+        kdnode *node = kdtree_node(k, search.list[i].node);
+        if(buf)
+        {
+            buf[i] = node->val;
+        }
+
+        if(closest)
+        {
+            closest[i] = node->pos;
+        }
+    }
+
+    if(n >= MALLOC_THRESH)
+    {
+        free(search.list);
+    }
+
+    return search.found;
+}
+
+static void kdtree_closestN_task(void *arg, int task, int thread)
+{
+    kdBatch *b = arg;
+    const kdtree *k = b->k;
+    int q = task * KDTREE_BATCH_TASK;
+    int end = q + KDTREE_BATCH_TASK < b->nq ? q + KDTREE_BATCH_TASK : b->nq;
+
+    kdSearch search;
+    search.max = b->n;
+    search.list = &b->scratch[(size_t) thread * b->n];
+    for(; q < end; q++)
+    {
+        int qi = b->order ? b->order[q] : q;
+        search.point = (float*) &b->queries[(size_t) qi * k->dimensions];
+        search.found = 0;
+        kdnode_closestN(k, k->root, &search);
+
+        int i;
+        size_t out = (size_t) qi * b->n;
+        for(i = 0; i < b->n; i++)
+        {
+            bool found = i < search.found;
+            if(b->out_vals)
+            {
+                b->out_vals[out + i] = found ? kdtree_node(k, search.list[i].node)->val : NULL;
+            }
+            if(b->out_dists)
+            {
+                b->out_dists[out + i] = found ? search.list[i].distsq : INFINITY;
+            }
+        }
+    }
+}
+
+static int kdtree_querykey_cmp(const void *a, const void *b)
+{
+    const kdQueryKey *ka = a, *kb = b;
+    return ka->leaf < kb->leaf ? -1 : ka->leaf > kb->leaf;
+}
+
+/**
+ * orders queries by the leaf they fall into, so that queries answered one
+ * after another search the same part of the tree and find it in cache
+ */
+static int32_t *kdtree_queryorder(const kdtree *k, const float *queries, int nq)
+{
+    kdQueryKey *keys = malloc(sizeof(kdQueryKey) * nq);
+    int q;
+    for(q = 0; q < nq; q++)
+    {
+        const float *point = &queries[(size_t) q * k->dimensions];
+        int i = k->root, leaf = i;
+        while(i != KDNODE_NONE)
+        {
+            kdnode *n = kdtree_node(k, i);
+            leaf = i;
+            i = n->children[point[n->axis] > n->pos[n->axis] ? 1 : 0];
+        }
+        keys[q].leaf = leaf;
+        keys[q].q = q;
+    }
+    qsort(keys, nq, sizeof(kdQueryKey), kdtree_querykey_cmp);
+
+    int32_t *order = (int32_t*) keys; // compacted in place
+    for(q = 0; q < nq; q++)
+    {
+        order[q] = keys[q].q;
+    }
+    return order;
+}
+
+/**
+ * finds the 'n' closest points to each of 'nq' query points, which are stored
+ * one after another in 'queries'. The values of the points found for query q,
+ * closest first, go to out_vals[q * n] onwards, and their squared distances
+ * to out_dists[q * n] onwards. Either output may be NULL. If the tree has
+ * fewer than 'n' points, the extra values are NULL and their distances
+ * INFINITY. The queries are split across the pool set by kdtree_threadpool,
+ * and nothing is allocated per query. Returns the number of points found for
+ * each query
+ */
+int kdtree_closestN_batch(kdtree *k, const float *queries, int nq, int n,
+                          void **out_vals, float *out_dists)
+{
+    if(n <= 0 || nq <= 0)
+    {
+        return 0;
+    }
+
+    kdBatch b;
+    b.k = k;
+    b.queries = queries;
+    b.nq = nq;
+    b.n = n;
+    b.out_vals = out_vals;
+    b.out_dists = out_dists;
+    b.order = NULL;
+
+    int ntasks = (nq + KDTREE_BATCH_TASK - 1) / KDTREE_BATCH_TASK;
+    if(k->root == KDNODE_NONE)
+    {
+        size_t i;
+        for(i = 0; i < (size_t) nq * n; i++)
+        {
+            if(out_vals) out_vals[i] = NULL;
+            if(out_dists) out_dists[i] = INFINITY;
+        }
+        return 0;
+    }
+
+    if(nq >= KDTREE_BATCH_TASK)
+    {
+        b.order = kdtree_queryorder(k, queries, nq);
+    }
+    if(kdtree_pool && ntasks > 1)
+    {
+        b.scratch = malloc(sizeof(kdValue) * n * threadpool_nthreads(kdtree_pool));
+        threadpool_run(kdtree_pool, ntasks, kdtree_closestN_task, &b);
+        free(b.scratch);
+    } else
+    {
+        b.scratch = malloc(sizeof(kdValue) * n);
+        int i;
+        for(i = 0; i < ntasks; i++)
+        {
+            kdtree_closestN_task(&b, i, 0);
+        }
+        free(b.scratch);
+    }
+    free(b.order);
+    return n < k->size ? n : k->size;
+}
+
+/**
+ * visits the points of the subtree at 'i' in range 'r', skipping subtrees on
+ * the far side of a splitting plane. Returns false if the visitor ended the
+ * query
+ */
+static bool kdnode_range(const kdtree *k, int i, kdRange *r)
+{
+    while(i != KDNODE_NONE)
+    {
+        kdnode *n = kdtree_node(k, i);
+        float split = n->pos[n->axis];
+        bool inside, left, right;
+        if(r->point)
+        {
+            float c = r->point[n->axis];
+            inside = distanceSq(r->point, n->pos, k->dimensions) <= r->radiussq;
+            left = c - r->radius <= split;
+            right = c + r->radius >= split;
+        } else
+        {
+            int d;
+            inside = true;
+            for(d = 0; d < k->dimensions && inside; d++)
+            {
+                inside = r->lo[d] <= n->pos[d] && n->pos[d] <= r->hi[d];
+            }
+            left = r->lo[n->axis] <= split;
+            right = r->hi[n->axis] >= split;
+        }
+
+        if(inside && !(n->flags & KDNODE_DEAD))
+        {
+            r->found++;
+            if(r->f && !r->f(r->arg, n->val, n->pos))
+            {
+                return false;
+            }
+        }
+
+        //recurse into one side, and loop on the other
+        if(left && right)
+        {
+            if(!kdnode_range(k, n->children[0], r))
+            {
+                return false;
+            }
+            i = n->children[1];
+        } else
+        {
+            i = left ? n->children[0] : (right ? n->children[1] : KDNODE_NONE);
+        }
+    }
+    return true;
+}
+
+/**
+ * calls 'f' for each point within 'radius' of 'point', in no particular
+ * order, until it returns false. 'f' may be NULL to only count the points.
+ * Returns the number of points visited
+ */
+int kdtree_within_radius(kdtree *k, const float point[], float radius, kdtree_func *f, void *arg)
+{
+    kdRange r = {point, radius, radius * radius, NULL, NULL, f, arg, 0};
+    if(radius >= 0.0f)
+    {
+        kdnode_range(k, k->root, &r);
+    }
+    return r.found;
+}
+
+/**
+ * calls 'f' for each point inside the box from corner 'lo' to corner 'hi',
+ * edges included, as kdtree_within_radius
+ */
+int kdtree_within_box(kdtree *k, const float lo[], const float hi[], kdtree_func *f, void *arg)
+{
+    kdRange r = {NULL, 0.0f, 0.0f, lo, hi, f, arg, 0};
+    kdnode_range(k, k->root, &r);
+    return r.found;
+}
+
+static bool kdtree_rangebuf_add(void *arg, void *val, const float pos[])
+{
+    kdRangeBuf *b = arg;
+    if(b->found < b->n)
+    {
+        if(b->buf)
+        {
+            b->buf[b->found] = val;
+        }
+        if(b->closest)
+        {
+            b->closest[b->found] = (float*) pos;
+        }
+    }
+    b->found++;
+    return true;
+}
+
+/**
+ * stores the values and positions of up to 'n' points within 'radius' of
+ * 'point' in 'buf' and 'closest', either of which may be NULL. They are in no
+ * particular order. Returns the number of points in range, which may be
+ * more than 'n'
+ */
+int kdtree_within_radiusN(kdtree *k, const float point[], float radius, int n, void **buf, float *closest[])
+{
+    kdRangeBuf b = {n, 0, buf, closest};
+    kdtree_within_radius(k, point, radius, kdtree_rangebuf_add, &b);
+    return b.found;
+}
+
+/**
+ * stores up to 'n' points inside a box, as kdtree_within_radiusN
+ */
+int kdtree_within_boxN(kdtree *k, const float lo[], const float hi[], int n, void **buf, float *closest[])
+{
+    kdRangeBuf b = {n, 0, buf, closest};
+    kdtree_within_box(k, lo, hi, kdtree_rangebuf_add, &b);
+    return b.found;
+}
+
+/**
+ * adds a branch to the heap of an approximate search
+ */
+static void kdtree_branchpush(kdApprox *a, float distsq, int node, int tree)
+{
+    int i = a->nheap++;
+    while(i > 0 && a->heap[(i - 1) / 2].distsq > distsq)
+    {
+        a->heap[i] = a->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    a->heap[i].distsq = distsq;
+    a->heap[i].node = node;
+    a->heap[i].tree = tree;
+}
+
+/**
+ * takes the nearest branch off the heap of an approximate search
+ */
+static kdBranch kdtree_branchpop(kdApprox *a)
+{
+    kdBranch top = a->heap[0];
+    kdBranch last = a->heap[--a->nheap];
+    int i = 0, c;
+    while((c = 2 * i + 1) < a->nheap)
+    {
+        if(c + 1 < a->nheap && a->heap[c + 1].distsq < a->heap[c].distsq)
+        {
+            c++;
+        }
+        if(!(a->heap[c].distsq < last.distsq))
+        {
+            break;
+        }
+        a->heap[i] = a->heap[c];
+        i = c;
+    }
+    a->heap[i] = last;
+    return top;
+}
+
+/**
+ * whether an approximate search may skip points at least 'distsq' away
+ */
+static bool kdtree_approxdone(const kdApprox *a, float distsq)
+{
+    return a->s.found == a->s.max && distsq * a->scale >= a->s.list[a->s.found-1].distsq;
+}
+
+/**
+ * adds a point to the closest found by an approximate search. The list is
+ * kept by handle, as each tree of a forest has its own copy of the point
+ */
+static void kdtree_approxinsert(kdApprox *a, const kdnode *n, float distsq)
+{
+    kdSearch *s = &a->s;
+    int j;
+    if(s->found == s->max && distsq >= s->list[s->found-1].distsq)
+    {
+        return;
+    }
+    for(j = 0; j < s->found; j++)
+    {
+        if(s->list[j].node == n->handle)
+        {
+            return;
+        }
+    }
+    int last = s->found < s->max ? s->found++ : s->found - 1;
+    for(j = last; j > 0 && s->list[j-1].distsq > distsq; j--)
+    {
+        s->list[j] = s->list[j-1];
+    }
+    s->list[j].distsq = distsq;
+    s->list[j].node = n->handle;
+}
+
+/**
+ * follows the query down from node 'i' of tree 't' to a leaf, leaving the
+ * sides it passes by on the heap
+ */
+static void kdtree_approxdescend(kdApprox *a, int t, int i)
+{
+    const kdtree *k = &a->trees[t];
+    const float *point = a->s.point;
+    while(i != KDNODE_NONE && a->checks > 0)
+    {
+        kdnode *n = kdtree_node(k, i);
+        a->checks--;
+        if(!(n->flags & KDNODE_DEAD))
+        {
+            kdtree_approxinsert(a, n, distanceSq(point, n->pos, k->dimensions));
+        }
+
+        float diff = point[n->axis] - n->pos[n->axis];
+        int side = diff > 0.0f ? 1 : 0;
+        int other = n->children[knode_otherSide(side)];
+        if(other != KDNODE_NONE && !kdtree_approxdone(a, diff * diff))
+        {
+            kdtree_branchpush(a, diff * diff, other, t);
+        }
+        i = n->children[side];
+    }
+}
+
+/**
+ * finds the 'n' points closest to 'point' over 'ntrees' trees of the same
+ * points, searching the nearest branches of all the trees first. The search
+ * ends when no branch can hold a point 'scale' times closer, in squared
+ * distance, than the 'n'th found, or after visiting 'checks' nodes
+ */
+static int kdtree_approx(const kdtree *trees, int ntrees, float point[], int n, float eps, int checks,
+        void **buf, float *closest[])
+{
+    int t, nodes = 0;
+    for(t = 0; t < ntrees; t++)
+    {
+        nodes += trees[t].used;
+    }
+    if(n <= 0 || trees[0].root == KDNODE_NONE)
+    {
+        return 0;
+    }
+
+    kdApprox a;
+    a.trees = trees;
+    a.ntrees = ntrees;
+    a.s.found = 0;
+    a.s.max = n;
+    a.s.point = point;
+    a.checks = checks > 0 && checks < nodes ? checks : nodes;
+    a.scale = (1.0f + eps) * (1.0f + eps);
+    a.nheap = 0;
+    int heapcap = a.checks + ntrees;
+    if(n < MALLOC_THRESH)
+    {
+        a.s.list = alloca(sizeof(kdValue) * n);
+    } else
+    {
+        a.s.list = malloc(sizeof(kdValue) * n);
+    }
+    if(heapcap < KDTREE_APPROX_STACK)
+    {
+        a.heap = alloca(sizeof(kdBranch) * heapcap);
+    } else
+    {
+        a.heap = malloc(sizeof(kdBranch) * heapcap);
+    }
+
+    for(t = 0; t < ntrees; t++)
+    {
+        kdtree_approxdescend(&a, t, trees[t].root);
+    }
+    while(a.nheap > 0 && a.checks > 0)
+    {
+        kdBranch b = kdtree_branchpop(&a);
+        if(kdtree_approxdone(&a, b.distsq))
+        {
+            break;
+        }
+        kdtree_approxdescend(&a, b.tree, b.node);
+    }
+
+    int i;
+    for(i = 0; i < a.s.found; i++)
+    {
+        kdnode *node = kdtree_node(&trees[0], trees[0].handles[a.s.list[i].node]);
+        if(buf)
+        {
+            buf[i] = node->val;
+        }
+
+        if(closest)
+        {
+            closest[i] = node->pos;
+        }
+    }
+
+    if(n >= MALLOC_THRESH)
+    {
+        free(a.s.list);
+    }
+    if(heapcap >= KDTREE_APPROX_STACK)
+    {
+        free(a.heap);
+    }
+    return a.s.found;
+}
+
+/**
+ * finds the 'n' points about closest to 'point', as kdtree_closestN. Each
+ * point found is at most 1 + 'eps' times as far as the exact one, as long
+ * as the search visits fewer than 'checks' nodes. Nodes are visited nearest
+ * branch first, so a small budget still finds most of the closest points.
+ * A 'checks' of 0 or less sets no budget, and an 'eps' of 0 with no budget
+ * gives the exact points
+ */
+int kdtree_closestN_approx(kdtree *k, float point[], int n, float eps, int checks,
+        void **buf, float *closest[])
+{
+    return kdtree_approx(k, 1, point, n, eps, checks, buf, closest);
+}
+
+/**
+ * a forest of 'ntrees' trees of 'dimensions' coordinates
+ */
+void kdforest_init(kdforest *f, int dimensions, int ntrees)
+{
+    assert(ntrees > 0);
+    f->dimensions = dimensions;
+    f->ntrees = ntrees;
+    f->trees = malloc(sizeof(kdtree) * ntrees);
+    int t;
+    for(t = 0; t < ntrees; t++)
+    {
+        kdtree_init(&f->trees[t], dimensions);
+    }
+}
+
+/**
+ * frees a forest, and calls 'val_finalize' on each value if it is not NULL
+ */
+void kdforest_finalize(kdforest *f, void (*val_finalize)(void*))
+{
+    int t;
+    for(t = 0; t < f->ntrees; t++)
+    {
+        kdtree_finalize(&f->trees[t], t == 0 ? val_finalize : NULL);
+    }
+    free(f->trees);
+    f->trees = NULL;
+    f->ntrees = 0;
+}
+
+/**
+ * builds each tree of the forest from 'n' points, as kdtree_build. Rather
+ * than cycling through the axes, which leaves most coordinates of long
+ * vectors unsplit, each node splits at random on one of the coordinates
+ * spreading the most, seeded by 'seed'. The trees differ where a search is
+ * likely to miss, so searching them together finds more of the closest
+ * points for the same number of nodes visited. A forest of one tree always
+ * splits on the coordinate spreading the most
+ */
+void kdforest_build(kdforest *f, const float *points, void **vals, int n, uint32_t seed)
+{
+    int t;
+    for(t = 0; t < f->ntrees; t++)
+    {
+        kdtree *k = &f->trees[t];
+        assert(k->size == 0 && k->nhandles == 0 && "kdforest_build needs an empty forest");
+        if(n <= 0)
+        {
+            continue;
+        }
+        k->handles = malloc(sizeof(int) * n);
+        k->nhandles = n;
+        k->handlecap = n;
+        kdtree_buildall(k, points, vals, NULL, n, f->ntrees > 1 ? KDFOREST_CHOICES : 1,
+                kdtree_mix(seed + t));
+    }
+}
+
+/**
+ * finds the 'n' points about closest to 'point' over all the trees of the
+ * forest, as kdtree_closestN_approx. 'checks' counts the nodes of all the
+ * trees
+ */
+int kdforest_closestN(kdforest *f, float point[], int n, float eps, int checks,
+        void **buf, float *closest[])
+{
+    return kdtree_approx(f->trees, f->ntrees, point, n, eps, checks, buf, closest);
+}
+
+/**
+ * writes the tree to a file that kdmap_open can query in place. Each
+ * point's value is saved as the index 'f' gives it, or as its handle if 'f'
+ * is NULL, which for a tree from kdtree_build is the point's index. Removed
+ * points are kept as splitting nodes, so rebuild a tree with many of them
+ * first. Returns 0 on success, or -1 on error
+ */
+int kdtree_save(kdtree *k, const char *filenm, kdtree_index_func *f, void *arg)
+{
+    kdmap_header h;
+    memset(&h, 0, sizeof(kdmap_header));
+    memcpy(h.magic, "KDT", 3);
+    h.version = KDMAP_VERSION;
+    h.dimensions = k->dimensions;
+    h.nnodes = k->used;
+    h.size = k->size;
+    h.root = k->root;
+
+    size_t nodes_sz = sizeof(kdmap_node) * k->used;
+    size_t points_sz = sizeof(float) * k->dimensions * k->used;
+    kdmap_node *nodes = malloc(nodes_sz + points_sz + 1);
+    float *points = (float*) &nodes[k->used];
+    int i;
+    for(i = 0; i < k->used; i++)
+    {
+        kdnode *n = kdtree_node(k, i);
+        bool unused = n->flags & KDNODE_FREE; //on the free list, its links are stale
+        nodes[i].children[0] = unused ? KDNODE_NONE : n->children[0];
+        nodes[i].children[1] = unused ? KDNODE_NONE : n->children[1];
+        nodes[i].axis = n->axis;
+        nodes[i].value = n->flags & (KDNODE_FREE | KDNODE_DEAD) ? KDMAP_NONE :
+                         f ? f(arg, n->val) : (uint32_t) n->handle;
+        memcpy(&points[(size_t) i * k->dimensions], n->pos, sizeof(float) * k->dimensions);
+    }
+
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+    int fd = open(filenm, O_CREAT | O_WRONLY | O_TRUNC | O_BINARY, mode);
+    int err = fd < 0 ||
+              write(fd, &h, sizeof(kdmap_header)) != sizeof(kdmap_header) ||
+              write(fd, nodes, nodes_sz + points_sz) != (ssize_t) (nodes_sz + points_sz);
+    if(fd >= 0 && close(fd))
+    {
+        err = 1;
+    }
+    free(nodes);
+    return err ? -1 : 0;
+}
+
+/**
+ * removes the point closest to 'point', as kdtree_remove
+ */
+void kdtree_removeClosest(kdtree *k, float point[], void (*val_finalize)(void*))
+{
+    if(k->root == KDNODE_NONE)
+    {
+        return;
+    }
+
+    kdValue val = {INFINITY, KDNODE_NONE};
+    kdnode_closest(k, k->root, point, &val);
+    if(val.node != KDNODE_NONE)
+    {
+        kdtree_remove(k, kdtree_node(k, val.node)->handle, val_finalize);
+    }
+}
+
+
+/**
+ * itterator next function
+ */
+static void *kdtree_iter_next(void *tree, Iterator *i)
+{
+    kdtree *k = tree;
+    int next;
+    if(!i->value)
+    {
+        next = k->root;
+    } else
+    {
+        int cur = ((char*) i->value - (char*) k->nodes) / k->stride;
+        next = kdnode_next(k, cur, KDNODE_NONE);
+    }
+    while(next != KDNODE_NONE && (kdtree_node(k, next)->flags & KDNODE_DEAD))
+    {
+        next = kdnode_next(k, next, KDNODE_NONE);
+    }
+    return next == KDNODE_NONE ? NULL : kdtree_node(k, next);
+}
+
+/**
+ * the node after 'i' in a preorder walk, having come up from 'prev', or from
+ * i's parent when 'prev' is KDNODE_NONE
+ */
+static int kdnode_next(const kdtree *k, int i, int prev)
+{
+    while(i != KDNODE_NONE)
+    {
+        kdnode *n = kdtree_node(k, i);
+        if(prev == KDNODE_NONE && n->children[0] != KDNODE_NONE)
         {
-            return n->children[1]; 
-        } else //already traversed children, traverse upward
+            return n->children[0];
+        } else if(prev != n->children[1] && n->children[1] != KDNODE_NONE)
         {
-            ret = kdnode_next(n->parent, n);
+            return n->children[1];
         }
+        //already traversed children, traverse upward
+        prev = i;
+        i = n->parent;
     }
-    return ret;
+    return KDNODE_NONE;
 }
 
 void kdtree_iter_init(kdtree *k, Iterator *i)
@@ -403,7 +1853,8 @@ void kdtree_iter_init(kdtree *k, Iterator *i)
     assert(i);
 
     iterator_init(i, k, kdtree_iter_next);
-    i->value = k->root;
+    i->value = NULL;
+    i->value = kdtree_iter_next(k, i);
 }
 
 void *kdtree_iter_value(Iterator *i)
@@ -423,47 +1874,48 @@ float const *kdtree_iter_position(Iterator *i)
  * will find the closest distance to a supplied point. the distance is passed around as
  * cdistsq, the squared of the distance, to reduce the number of expensive sqrt opperations
  */
-static void kdnode_closest2(kdnode *n, float point[], float *distsq, Iterator *it)
+static void kdnode_closest2(const kdtree *k, int i, float point[], float *distsq, Iterator *it)
 {
+    kdnode *n = kdtree_node(k, i);
     int side = (point[n->axis] > n->pos[n->axis] ? 1 : 0);
-    float node_dsq = distanceSq(point, n->pos, n->dim); 
-    if(node_dsq < *distsq || it->iterable == NULL)
+    float node_dsq = distanceSq(point, n->pos, k->dimensions);
+    if(!(n->flags & KDNODE_DEAD) && (node_dsq < *distsq || it->iterable == NULL))
     {
         *distsq = node_dsq;
         it->iterable = n;
     }
 
-    if(n->children[side]){
-            kdnode_closest2(n->children[side], point, distsq, it);
+    if(n->children[side] != KDNODE_NONE){
+            kdnode_closest2(k, n->children[side], point, distsq, it);
     }
 
     side = knode_otherSide(side);
-    if(n->children[side]){
-        float childAxisDist = fabs(point[n->axis] - n->pos[n->axis]);
-        if(childAxisDist < *distsq){
-            kdnode_closest2(n->children[side], point, distsq, it);
+    if(n->children[side] != KDNODE_NONE){
+        float childAxisDist = point[n->axis] - n->pos[n->axis];
+        if(childAxisDist * childAxisDist < *distsq){
+            kdnode_closest2(k, n->children[side], point, distsq, it);
         }
     }
 }
 
 void *kdtree_closest2(kdtree *k, float point[], Iterator *it)
 {
-    if(!k || !k->root)
+    if(!k || k->root == KDNODE_NONE)
         return NULL;
 
-    //guarentee that 'it' is a valid value 
+    //guarentee that 'it' is a valid value
     if(!it)
     {
         it = alloca(sizeof(Iterator));
     }
-    it->iterable = k->root;
-    it->value = k->root->val;
+    it->iterable = NULL;
+    it->value = NULL;
     //TODO: double check func below, and dec_func
     //it->inc_func = kdtree_nextclosest;
 
-    float distancesq = distanceSq(point, k->root->pos, k->dimensions);
-    kdnode_closest2(k->root, point, &distancesq, it);
-    it->value = ((kdnode*)it->iterable)->val;
+    float distancesq = INFINITY;
+    kdnode_closest2(k, k->root, point, &distancesq, it);
+    it->value = it->iterable ? ((kdnode*)it->iterable)->val : NULL;
     return it->value; //TODO
 }
 
@@ -9,29 +9,94 @@
 #define _KDTREE_H
 
 #include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #include "iterator.h"
 
 typedef void* kditerator;
 
+/**
+ * visits a point found by a range query, with the point's value and position.
+ * Return false to end the query early
+ */
+typedef bool (kdtree_func)(void *arg, void *val, const float pos[]);
+
+/**
+ * the index kdtree_save stores for a value
+ */
+typedef uint32_t (kdtree_index_func)(void *arg, void *val);
+
+struct ThreadPool;
+
+/**
+ * the nodes are kept in one array, with their coordinates inline, and refer
+ * to each other by index. Indices stay valid as the array grows. Each point
+ * also has a handle, which stays the same while the point is in the tree,
+ * even as the tree rebalances
+ */
 typedef struct kdtree {
     int dimensions;
-    struct kdnode *root; 
+    int root;               ///< index of the root node, -1 when empty
+    int size;               ///< number of points in the tree
+    int dead;               ///< removed nodes, kept until a rebuild as they split others
+    int peak;               ///< largest size since the last full rebuild
+    int used;               ///< number of nodes handed out, live or free
+    int capacity;           ///< number of nodes allocated
+    int freelist;           ///< first free node below 'used', -1 if none
+    size_t stride;          ///< bytes per node
+    struct kdnode *nodes;
+    int *handles;           ///< the node of each handle
+    int nhandles;           ///< number of handles handed out, live or free
+    int handlecap;          ///< number of handles allocated
+    int freehandle;         ///< first free handle, -1 if none
 } kdtree;
 
+/**
+ * several trees of the same points, split differently, for approximate
+ * searches of long vectors. Each tree holds its own copy of the points
+ */
+typedef struct kdforest {
+    int dimensions;
+    int ntrees;
+    kdtree *trees;
+} kdforest;
+
 void kdtree_init(kdtree *k, int dimensions);
-void kdtree_finalize(kdtree *k, void (*val_finalize(void*)));
-void kdtree_insert(kdtree *k, float point[], void *val);
+void kdtree_finalize(kdtree *k, void (*val_finalize)(void*));
+void kdtree_threadpool(struct ThreadPool *pool);
+void kdtree_build(kdtree *k, const float *points, void **vals, int n);
+void kdtree_rebuild(kdtree *k);
+int kdtree_size(kdtree *k);
+int kdtree_depth(kdtree *k);
+int kdtree_insert(kdtree *k, float point[], void *val);
+void kdtree_remove(kdtree *k, int handle, void (*val_finalize)(void*));
+void kdtree_move(kdtree *k, int handle, const float point[]);
+void *kdtree_value(kdtree *k, int handle);
+float const *kdtree_position(kdtree *k, int handle);
 void *kdtree_closest(kdtree *k, float point[], float closest[]);
 int kdtree_closestN(kdtree *k, float point[], int n, void **buf, float *closest[]);
+int kdtree_closestN_batch(kdtree *k, const float *queries, int nq, int n,
+                          void **out_vals, float *out_dists);
+int kdtree_within_radius(kdtree *k, const float point[], float radius, kdtree_func *f, void *arg);
+int kdtree_within_box(kdtree *k, const float lo[], const float hi[], kdtree_func *f, void *arg);
+int kdtree_within_radiusN(kdtree *k, const float point[], float radius, int n, void **buf, float *closest[]);
+int kdtree_within_boxN(kdtree *k, const float lo[], const float hi[], int n, void **buf, float *closest[]);
+int kdtree_closestN_approx(kdtree *k, float point[], int n, float eps, int checks,
+                           void **buf, float *closest[]);
 void kdtree_removeClosest(kdtree *k, float point[], void (*val_finalize)(void*));
+int kdtree_save(kdtree *k, const char *filenm, kdtree_index_func *f, void *arg);
+
+void kdforest_init(kdforest *f, int dimensions, int ntrees);
+void kdforest_finalize(kdforest *f, void (*val_finalize)(void*));
+void kdforest_build(kdforest *f, const float *points, void **vals, int n, uint32_t seed);
+int kdforest_closestN(kdforest *f, float point[], int n, float eps, int checks,
+                      void **buf, float *closest[]);
 
 //itteration and node functions
 void kdtree_iter_init(kdtree *k, Iterator *i);
 void *kdtree_iter_value(Iterator *i);
 float const *kdtree_iter_position(Iterator *i);
-//TODO: a balance function
-//
 //TODO: replace other function with iterable
 void *kdtree_closest2(kdtree *k, float point[], Iterator *it);
 void *kdtree_nextclosest(kdtree *k, Iterator *it);
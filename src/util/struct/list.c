@@ -9,6 +9,7 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,118 +17,188 @@
 
 #define DEFAULT_MAX 10
 
+#define LIST_NONE -1
+#define LIST_FREE -2 //'prev' of an entry on the free list
+
 struct list_ent
 {
-    struct list_ent *next;
-    struct list_ent *prev;
+    int32_t next;   ///< index of the next entry, or of the next free entry
+    int32_t prev;   ///< index of the previous entry, or LIST_FREE
     char data[];
 };
 
-static size_t entry_size(List *l);
-static bool isvalid_entry(List *l, struct list_ent *e);
-static void invalidate_entry(List *l, struct list_ent *e);
-static void invalidate_slice(List *l, struct list_ent *start, int n);
+static struct list_ent *entry(List *l, int i);
+static int entry_index(List *l, void *data);
+static bool isvalid_entry(List *l, int i);
 static void resize(List *l, size_t n);
-static struct list_ent *findinvalid(List *l);
+static int newentry(List *l);
+static void freeentry(List *l, int i);
+static void unlink_entry(List *l, int i);
+static void link_between(List *l, int i, int prev, int next);
+static void *setiterator(List *l, Iterator *it, int i);
 
-static size_t entry_size(List *l)
+/**
+ * the entry at index 'i'. Entries are 'entry_size' apart in the pool
+ */
+static struct list_ent *entry(List *l, int i)
 {
-    return l->element_size + sizeof(struct list_ent);
+    return (struct list_ent*) ((char*) l->pool + (size_t) i * l->entry_size);
 }
 
 /**
- * an invalid entry is one where there is no next, previous, or data
+ * the index of the entry holding 'data'
  */
-static bool isvalid_entry(List *l, struct list_ent *e)
+static int entry_index(List *l, void *data)
 {
-    return e->next || e->prev || l->first == e;
+    return ((char*) data - offsetof(struct list_ent, data) - (char*) l->pool) / l->entry_size;
 }
 
 /**
- * sets an entry to an invalid state
+ * an invalid entry is one on the free list, or never handed out
  */
-static void invalidate_entry(List *l, struct list_ent *e)
+static bool isvalid_entry(List *l, int i)
 {
-    memset(e, 0x00, entry_size(l)); //TODO: setting data unnecessary
+    return i >= 0 && i < l->used && entry(l, i)->prev != LIST_FREE;
 }
 
 /**
- * sets a slice of entries to an invalid state
+ * grows the pool to 'n' entries. Entries keep their indices, though the
+ * pool may move
  */
-static void invalidate_slice(List *l, struct list_ent *start, int n)
+static void resize(List *l, size_t n)
 {
-    memset(start, 0x00, entry_size(l) * n); //TODO: setting data unnecessary
+    if(n <= l->max)
+    {
+        return;
+    }
+    l->max = n;
+    l->pool = realloc(l->pool, l->max * l->entry_size);
+    assert(l->pool);
 }
 
+/**
+ * hands out an unused entry, from the free list if it has any
+ */
+static int newentry(List *l)
+{
+    int i;
+    if(l->freelist != LIST_NONE)
+    {
+        i = l->freelist;
+        l->freelist = entry(l, i)->next;
+    } else
+    {
+        if(l->used == l->max)
+        {
+            resize(l, (size_t)(l->max * 1.6f) + 1);
+        }
+        i = l->used++;
+    }
+    return i;
+}
 
-static void resize(List *l, size_t n)
+/**
+ * puts entry 'i' on the free list
+ */
+static void freeentry(List *l, int i)
 {
-    if(n < l->max)
+    struct list_ent *e = entry(l, i);
+    e->prev = LIST_FREE;
+    e->next = l->freelist;
+    l->freelist = i;
+}
+
+/**
+ * knits up the neighbours of entry 'i', leaving it out of the list
+ */
+static void unlink_entry(List *l, int i)
+{
+    struct list_ent *e = entry(l, i);
+    if(e->next != LIST_NONE)
     {
-        assert(false && "List shrink not yet impl");
-        //TODO: shrink
+        entry(l, e->next)->prev = e->prev;
+    } else
+    {
+        l->last = e->prev;
     }
 
-    int old_max = l->max;
-    l->max = n; 
-    l->pool = realloc(l->pool, l->max * entry_size(l));
-    invalidate_slice(l, &l->pool[old_max], l->max - old_max); //invalidate all new entries
+    if(e->prev != LIST_NONE)
+    {
+        entry(l, e->prev)->next = e->next;
+    } else
+    {
+        l->first = e->next;
+    }
 }
 
 /**
- * will find an invalid List entry for reuse as a future list node
+ * splices entry 'i' in between 'prev' and 'next', either of which may be
+ * LIST_NONE for the ends of the list
  */
-static struct list_ent *findinvalid(List *l)
+static void link_between(List *l, int i, int prev, int next)
 {
-    struct list_ent *found = NULL;
-    int search_start = l->last_avail_index;
-    if(l->length < l->max)
+    struct list_ent *e = entry(l, i);
+    e->prev = prev;
+    e->next = next;
+    if(prev != LIST_NONE)
     {
-        int i;
-        for(i = search_start; i < l->max && !found; i++) //search above last index
-        {
-            if(!isvalid_entry(l, &l->pool[i]))
-            {
-                l->last_avail_index = i;
-                found = &l->pool[i];
-            }
-        }
+        entry(l, prev)->next = i;
+    } else
+    {
+        l->first = i;
+    }
 
-        for(i = 0; i < search_start && !found; i++) //search below last index
-        {
-            if(!isvalid_entry(l, &l->pool[i]))
-            {
-                l->last_avail_index = i;
-                found = &l->pool[i];
-            }
-        }
+    if(next != LIST_NONE)
+    {
+        entry(l, next)->prev = i;
+    } else
+    {
+        l->last = i;
+    }
+}
+
+/**
+ * points 'it' at entry 'i', or past the end for LIST_NONE
+ */
+static void *setiterator(List *l, Iterator *it, int i)
+{
+    void *ret = i == LIST_NONE ? NULL : entry(l, i)->data;
+    if(it)
+    {
+        it->iterable = l;
+        it->value = ret;
+        it->inc_func = list_next;
+        it->dec_func = list_prev;
     }
-    return found;
+    return ret;
 }
 
 void list_init(List *l, size_t element_size)
 {
     l->element_size = element_size;
+    // keep the data of each entry aligned
+    l->entry_size = (sizeof(struct list_ent) + element_size + 7) & ~(size_t) 7;
     l->length = 0;
     l->max = DEFAULT_MAX;
-    l->last_avail_index = 0;
-    l->pool = calloc(l->max, entry_size(l)); //zeroed out members are unused nodes
-    l->first = NULL;
-    l->last = NULL;
+    l->used = 0;
+    l->freelist = LIST_NONE;
+    l->pool = malloc(l->max * l->entry_size);
+    l->first = LIST_NONE;
+    l->last = LIST_NONE;
 }
 
 void list_finalize(List *l, void (*finalizer)(void*v))
 {
-    if(l->first && finalizer)
+    if(finalizer)
     {
-        struct list_ent *iter = l->first; 
-        while(iter)
+        int i;
+        for(i = l->first; i != LIST_NONE; i = entry(l, i)->next)
         {
-            finalizer(iter->data); 
-            iter = iter->next;
+            finalizer(entry(l, i)->data);
         }
     }
     free(l->pool);
+    l->pool = NULL;
 }
 
 bool list_isempty(List *l)
@@ -146,282 +217,124 @@ size_t list_datasize(List *l)
 }
 
 /**
- * will make sure that the list has space for at least 'n' objects
+ * will make sure that the list has space for at least 'n' more objects, so
+ * adding them will not move the entries
  */
 void list_reserve(List *l, size_t n)
 {
-    if(l->length + n >= l->max)
-    {
-        resize(l, l->length + n);
-    }
+    resize(l, l->used + n);
 }
 
 void list_addfront(List *l, void *element)
 {
-    if(l->length >= l->max)
-    {
-        resize(l, (size_t)(l->length * 1.6f));
-    }
-
-    struct list_ent *new_front = findinvalid(l);
-    assert(new_front);
-
-    if(l->length > 0)
-    {
-        l->first->prev = new_front;
-    } else 
-    {
-        l->last = new_front; 
-    }
-
-    new_front->next = l->first;
-    new_front->prev = NULL;
-    l->first = new_front;
-    memcpy(new_front->data, element, l->element_size);
+    int i = newentry(l);
+    memcpy(entry(l, i)->data, element, l->element_size);
+    link_between(l, i, LIST_NONE, l->first);
     l->length++;
 }
 
 void list_addback(List *l, void *element)
 {
-    if(l->length == l->max)
-    {
-        resize(l, (size_t)(l->length * 1.6f));
-    }
-
-    struct list_ent *new_back = findinvalid(l);
-    assert(new_back);
-
-    if(l->length > 0)
-    {
-        l->last->next = new_back;
-    } else 
-    {
-        l->first = new_back;
-    }
-
-    new_back->next = NULL;
-    new_back->prev = l->last;
-    l->last = new_back;
-    memcpy(new_back->data, element, l->element_size);
+    int i = newentry(l);
+    memcpy(entry(l, i)->data, element, l->element_size);
+    link_between(l, i, l->last, LIST_NONE);
     l->length++;
 }
 
+/**
+ * adds an element after the one 'i' points to. As with all additions, the
+ * entries may move if the list grows, leaving 'i' to be set again
+ */
 void list_addafter(List *l, Iterator *i, void *element)
 {
-    if(l->length == l->max)
-    {
-        resize(l, (size_t)(l->length * 1.6f));
-    }
-    struct list_ent *new_ent = findinvalid(l);
-    assert(new_ent);
-    
-    struct list_ent *ent = i->iterable;
-    new_ent->next = ent->next;
-    new_ent->prev = ent;
-    memcpy(new_ent->data, element, l->element_size);
-    ent->next = new_ent;
+    int ent = entry_index(l, i->value);
+    int new_ent = newentry(l);
+    memcpy(entry(l, new_ent)->data, element, l->element_size);
+    link_between(l, new_ent, ent, entry(l, ent)->next);
+    l->length++;
 }
 
+/**
+ * adds an element before the one 'i' points to, as list_addafter
+ */
 void list_addbefore(List *l, Iterator *i, void *element)
 {
-    if(l->length == l->max)
-    {
-        resize(l, (size_t)(l->length * 1.6f));
-    }
-    struct list_ent *new_ent = findinvalid(l);
-    assert(new_ent);
-    
-    struct list_ent *ent = i->iterable;
-    new_ent->prev = ent->prev;
-    new_ent->next = ent;
-    memcpy(new_ent->data, element, l->element_size);
-    ent->prev = new_ent;
+    int ent = entry_index(l, i->value);
+    int new_ent = newentry(l);
+    memcpy(entry(l, new_ent)->data, element, l->element_size);
+    link_between(l, new_ent, entry(l, ent)->prev, ent);
+    l->length++;
 }
 
+/**
+ * removes the element 'i' points to. Its entry is reused by a later addition
+ */
 void list_remove(List *l, Iterator *i)
 {
-    struct list_ent *ent = i->iterable;
-    struct list_ent *next = ent->next;
-    struct list_ent *prev = ent->prev;
-
-    if(next)
-    {
-        next->prev = prev;
-    } else
-    {
-        l->last = prev;
-    }
-
-    if(prev)
-    {
-        prev->next = next;
-    } else
-    {
-        l->first = next;
-    }
-
-    invalidate_entry(l, ent);
+    int ent = entry_index(l, i->value);
+    assert(isvalid_entry(l, ent) && "removing a removed list entry");
+    unlink_entry(l, ent);
+    freeentry(l, ent);
     l->length--;
 }
 
 void *list_get(List *l, Iterator *i)
 {
-    struct list_ent *ent = i->iterable;
-    return ent->data;
+    return i->value;
 }
 
 void *list_first(List *l, Iterator *it)
 {
-    void *ret = NULL;
-
-    if(l->first)
-    {
-        if(it)
-        {
-            it->iterable = l->first;
-            it->value = &l->first->data;
-            it->inc_func = list_next;
-            it->dec_func = list_prev;
-        }
-        ret = &l->first->data;
-    } else if (it)
-    {
-        it->iterable = NULL;
-        it->value = NULL;
-        it->inc_func = NULL;
-        it->dec_func = NULL;
-    }
-
-    return ret;
+    return setiterator(l, it, l->first);
 }
 
 void *list_last(List *l, Iterator *it)
 {
-    void *ret = NULL;
-
-    if(l->last)
-    {
-        if(it)
-        {
-            it->iterable = l->last;
-            it->value = &l->last->data;
-            it->inc_func = list_next;
-            it->dec_func = list_prev;
-        }
-        ret = &l->last->data;
-    } else if (it)
-    {
-        it->iterable = NULL;
-        it->value = NULL;
-        it->inc_func = NULL;
-        it->dec_func = NULL;
-    }
-
-    return ret;
+    return setiterator(l, it, l->last);
 }
 
 void *list_next(void *lst, Iterator *i)
 {
-    void *ret = NULL;
-    struct list_ent *ent = i->iterable; 
-    ent = ent->next;
-    if(ent)
-    {
-        i->iterable = ent;
-        i->value = &ent->data;
-        ret = &ent->data;
-    } else 
+    List *l = lst;
+    if(!i->value)
     {
-        i->value = NULL;
+        return NULL;
     }
-    return ret;
+    return setiterator(l, i, entry(l, entry_index(l, i->value))->next);
 }
 
-void *list_prev(void *l, Iterator *i)
+void *list_prev(void *lst, Iterator *i)
 {
-    struct list_ent *ent = i->iterable; 
-    ent = ent->prev;
-    i->iterable = ent;
-    i->value = ent->data;
-    return ent->data;
+    List *l = lst;
+    if(!i->value)
+    {
+        return NULL;
+    }
+    return setiterator(l, i, entry(l, entry_index(l, i->value))->prev);
 }
 
 void list_movebefore(List *l, Iterator *before, Iterator *from)
 {
-    struct list_ent *before_ent = before->iterable;
-    struct list_ent *ent = from->iterable;
-
-    //knit up neighbors of 'ent' before moving
-    if(ent->next)
-    {
-        ent->next->prev = ent->prev; 
-    } else 
+    int before_ent = entry_index(l, before->value);
+    int ent = entry_index(l, from->value);
+    if(ent == before_ent)
     {
-        l->last = ent->prev;
+        return;
     }
-
-    if(ent->prev)
-    {
-        ent->prev->next = ent->next;
-    } else 
-    {
-        l->first = ent->next;
-    }
-
-    //splice in ent where it needs to go
-    ent->prev = before_ent->prev;
-    ent->next = before_ent;
-
-    // knit previous to ent, or make it the front
-    if(before_ent->prev)
-    {
-        before_ent->prev->next = ent;
-    } else 
-    {
-        l->first = ent;
-    }
-
-    // knit up loose ent of where we are inserting before
-    before_ent->prev = ent;
+    unlink_entry(l, ent);
+    link_between(l, ent, entry(l, before_ent)->prev, before_ent);
 }
 
 void list_moveafter(List *l, Iterator *after, Iterator *from)
 {
-    struct list_ent *after_ent = after->iterable;
-    struct list_ent *ent = from->iterable;
-
-    // knit neighbors of 'ent' before moving
-    if(ent->next)
-    {
-        ent->next->prev = ent->prev; 
-    } else 
-    {
-        l->last = ent->prev;
-    }
-
-    if(ent->prev)
+    int after_ent = entry_index(l, after->value);
+    int ent = entry_index(l, from->value);
+    if(ent == after_ent)
     {
-        ent->prev->next = ent->next;
-    } else 
-    {
-        l->first = ent->next;
-    }
-
-    //splice in ent where it needs to go
-    ent->prev = after_ent;
-    ent->next = after_ent->next;
-
-    // knit next to ent, or make it the back
-    if(after_ent->next)
-    {
-        after_ent->next->prev = ent;
-    } else 
-    {
-        l->first = ent;
+        return;
     }
-
-    //knit up loose connection of neighbor
-    after_ent->next = ent;
+    unlink_entry(l, ent);
+    link_between(l, ent, after_ent, entry(l, after_ent)->next);
 }
 
 void list_tobuffer(List *l, void *b)
@@ -439,12 +352,63 @@ void list_tobuffer(List *l, void *b)
     }
 }
 
+/**
+ * the index of the entry 'i' points to. Indices stay the same as the list
+ * grows, so unlike iterators they may be kept across additions
+ */
+size_t list_index(List *l, Iterator *i)
+{
+    return entry_index(l, i->value);
+}
+
+/**
+ * points 'it' at the entry with index 'index', and returns its element
+ */
+void *list_at(List *l, size_t index, Iterator *it)
+{
+    assert(isvalid_entry(l, index) && "list index of a removed entry");
+    return setiterator(l, it, index);
+}
+
+/**
+ * moves the entries to the front of the pool in list order, and frees the
+ * rest of it. 'remap', if it is not NULL, is told the old and new index of
+ * each entry that moves, so kept indices can be updated and iterators set
+ * again with list_at. An index may be both one entry's old index and
+ * another's new one, so collect the moves before applying them. Iterating a
+ * compacted list reads the pool in order
+ */
+void list_compact(List *l, List_remap_func *remap, void *arg)
+{
+    size_t max = l->length > DEFAULT_MAX ? l->length : DEFAULT_MAX;
+    struct list_ent *pool = malloc(max * l->entry_size);
+    assert(pool);
+
+    int i, n = 0;
+    for(i = l->first; i != LIST_NONE; i = entry(l, i)->next, n++)
+    {
+        struct list_ent *e = (struct list_ent*) ((char*) pool + (size_t) n * l->entry_size);
+        memcpy(e->data, entry(l, i)->data, l->element_size);
+        e->prev = n - 1;
+        e->next = n + 1 < l->length ? n + 1 : LIST_NONE;
+        if(remap && i != n)
+        {
+            remap(arg, i, n);
+        }
+    }
+
+    free(l->pool);
+    l->pool = pool;
+    l->max = max;
+    l->used = l->length;
+    l->freelist = LIST_NONE;
+    l->first = l->length ? 0 : LIST_NONE;
+    l->last = l->length ? l->length - 1 : LIST_NONE;
+}
+
 void list_clear(List *l, void (*finalizer)(void *v))
 {
-    l->length = 0;
-    l->max = DEFAULT_MAX;
-    l->last_avail_index = 0;
-    l->pool = realloc(l->pool, l->max * entry_size(l));
-    l->first = NULL;
-    l->last = NULL;
+    size_t element_size = l->element_size;
+    list_finalize(l, finalizer);
+    list_init(l, element_size);
 }
@@ -17,15 +17,27 @@
 
 struct list_ent;
 
+/**
+ * tells a caller an entry moved from index 'from' to index 'to'
+ */
+typedef void (List_remap_func)(void *arg, size_t from, size_t to);
+
+/**
+ * the entries are kept in one pool, and refer to each other by index, so
+ * the list stays whole as the pool grows. Removed entries are kept on a free
+ * list for the next addition
+ */
 typedef struct List
 {
     size_t element_size;
+    size_t entry_size;      ///< bytes per entry, its links and element
     size_t length;
-    size_t max;
-    unsigned int last_avail_index;
-    struct list_ent *pool; ///< pool of entries, raw memory of storage
-    struct list_ent *first;///< first entry of list
-    struct list_ent *last; ///< last entry of list
+    size_t max;             ///< number of entries allocated
+    size_t used;            ///< number of entries handed out, live or free
+    int freelist;           ///< first free entry below 'used', -1 if none
+    int first;              ///< index of the first entry, -1 when empty
+    int last;               ///< index of the last entry, -1 when empty
+    struct list_ent *pool;  ///< pool of entries, raw memory of storage
 } List;
 
 void list_init(List *l, size_t element_size);
@@ -48,6 +60,9 @@ void *list_prev(void *l, Iterator *i); //serves as iterator function
 void list_movebefore(List *l, Iterator *before, Iterator *from);
 void list_moveafter(List *l, Iterator *after, Iterator *from);
 void list_tobuffer(List *l, void *buf);
+size_t list_index(List *l, Iterator *i);
+void *list_at(List *l, size_t index, Iterator *it);
+void list_compact(List *l, List_remap_func *remap, void *arg);
 void list_clear(List *l, void (*finalizer)(void *v));
 
 #endif
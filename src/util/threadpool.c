@@ -0,0 +1,189 @@
+/**
+ * threadpool.c
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "threadpool.h"
+
+struct worker_arg
+{
+    ThreadPool *pool;
+    int thread;
+};
+
+/**
+ * takes tasks from the current batch until none are left. expects the pool to
+ * be locked, and returns with it locked
+ */
+static void threadpool_work(ThreadPool *p, int thread)
+{
+    while(p->next_task < p->ntasks)
+    {
+        int task = p->next_task++;
+        pthread_mutex_unlock(&p->lock);
+        p->func(p->arg, task, thread);
+        pthread_mutex_lock(&p->lock);
+
+        p->nfinished++;
+        if(p->nfinished == p->ntasks)
+        {
+            pthread_cond_broadcast(&p->done_cond);
+        }
+    }
+}
+
+static void *threadpool_worker(void *varg)
+{
+    struct worker_arg *warg = varg;
+    ThreadPool *p = warg->pool;
+    int thread = warg->thread;
+    free(warg);
+
+    unsigned int seen = 0;
+    pthread_mutex_lock(&p->lock);
+    while(!p->quit)
+    {
+        if(p->batch != seen)
+        {
+            seen = p->batch;
+            threadpool_work(p, thread);
+        } else
+        {
+            pthread_cond_wait(&p->work_cond, &p->lock);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/**
+ * @returns the number of online processors, at least 1
+ */
+int threadpool_ncpus(void)
+{
+    int ret = 1;
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    ret = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    ret = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return ret > 0 ? ret : 1;
+}
+
+/**
+ * starts a pool of 'nthreads' threads. The thread calling threadpool_run counts
+ * as one of them, so nthreads - 1 workers are created. If 'nthreads' is 0 or 
+ * less, one thread per processor is used
+ */
+void threadpool_init(ThreadPool *p, int nthreads)
+{
+    if(nthreads <= 0)
+    {
+        nthreads = threadpool_ncpus();
+    }
+
+    p->nthreads = nthreads;
+    p->func = NULL;
+    p->arg = NULL;
+    p->ntasks = 0;
+    p->next_task = 0;
+    p->nfinished = 0;
+    p->batch = 0;
+    p->quit = false;
+    pthread_mutex_init(&p->run_lock, NULL);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work_cond, NULL);
+    pthread_cond_init(&p->done_cond, NULL);
+
+    p->workers = malloc(sizeof(pthread_t) * nthreads);
+    int i;
+    for(i = 1; i < nthreads; i++)
+    {
+        struct worker_arg *warg = malloc(sizeof(struct worker_arg));
+        warg->pool = p;
+        warg->thread = i;
+        pthread_create(&p->workers[i], NULL, threadpool_worker, warg);
+    }
+}
+
+/**
+ * stops and joins all worker threads. Must not be called while a batch is running
+ */
+void threadpool_finalize(ThreadPool *p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->quit = true;
+    pthread_cond_broadcast(&p->work_cond);
+    pthread_mutex_unlock(&p->lock);
+
+    int i;
+    for(i = 1; i < p->nthreads; i++)
+    {
+        pthread_join(p->workers[i], NULL);
+    }
+    free(p->workers);
+    p->workers = NULL;
+
+    pthread_cond_destroy(&p->done_cond);
+    pthread_cond_destroy(&p->work_cond);
+    pthread_mutex_destroy(&p->lock);
+    pthread_mutex_destroy(&p->run_lock);
+}
+
+int threadpool_nthreads(ThreadPool *p)
+{
+    return p->nthreads;
+}
+
+/**
+ * runs f(arg, task, thread) for every task in [0, ntasks) across the pool, and 
+ * returns once all of them are finished. The calling thread runs tasks as 
+ * thread 0. A pool runs one batch at a time; concurrent callers wait their turn,
+ * so tasks must not call threadpool_run on their own pool
+ */
+void threadpool_run(ThreadPool *p, int ntasks, ThreadPool_func *f, void *arg)
+{
+    if(ntasks <= 0)
+    {
+        return;
+    }
+
+    if(p->nthreads == 1 || ntasks == 1)
+    {
+        int i;
+        for(i = 0; i < ntasks; i++)
+        {
+            f(arg, i, 0);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&p->run_lock);
+    pthread_mutex_lock(&p->lock);
+    p->func = f;
+    p->arg = arg;
+    p->ntasks = ntasks;
+    p->next_task = 0;
+    p->nfinished = 0;
+    p->batch++;
+    pthread_cond_broadcast(&p->work_cond);
+
+    threadpool_work(p, 0);
+    while(p->nfinished < p->ntasks)
+    {
+        pthread_cond_wait(&p->done_cond, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    pthread_mutex_unlock(&p->run_lock);
+}
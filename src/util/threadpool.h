@@ -0,0 +1,46 @@
+/**
+ * threadpool.h
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * fixed pool of worker threads that run a batch of indexed tasks
+ */
+
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+/**
+ * a task function. 'task' is the index of the task in the batch [0, ntasks),
+ * 'thread' is the index of the thread running it [0, nthreads), useful to 
+ * select per-thread scratch memory
+ */
+typedef void (ThreadPool_func)(void *arg, int task, int thread);
+
+typedef struct ThreadPool
+{
+    int nthreads;               ///< number of threads, including the caller of threadpool_run
+    pthread_t *workers;
+    pthread_mutex_t run_lock;   ///< serializes callers of threadpool_run
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   ///< signaled when a new batch is posted
+    pthread_cond_t done_cond;   ///< signaled when the last task of a batch finishes
+    ThreadPool_func *func;
+    void *arg;
+    int ntasks;
+    int next_task;
+    int nfinished;
+    unsigned int batch;
+    bool quit;
+} ThreadPool;
+
+void threadpool_init(ThreadPool *p, int nthreads);
+void threadpool_finalize(ThreadPool *p);
+int  threadpool_nthreads(ThreadPool *p);
+void threadpool_run(ThreadPool *p, int ntasks, ThreadPool_func *f, void *arg);
+int  threadpool_ncpus(void);
+
+#endif
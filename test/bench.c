@@ -0,0 +1,1079 @@
+/**
+ * bench.c
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * microbenchmarks. Each SIMD path is timed against the scalar path of the
+ * same function, by disabling processor features through cpu_disable
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "clockwork/util/cpu.h"
+#include "clockwork/util/noise.h"
+#include "clockwork/util/random.h"
+#include "clockwork/util/threadpool.h"
+#include "clockwork/util/time.h"
+#include "clockwork/util/math/dualquat.h"
+#include "clockwork/util/math/matrix.h"
+#include "clockwork/util/math/scalar.h"
+#include "clockwork/util/math/vec.h"
+#include "clockwork/util/struct/kdmap.h"
+#include "clockwork/util/struct/kdtree.h"
+#include "clockwork/util/struct/list.h"
+
+#include "bench.h"
+
+#define BENCH_BEGIN(msg) printf("***Benchmark %s***\n", msg)
+#define BENCH_END(msg) printf("\n")
+#define BENCH_REPORT(msg, scalar, simd) \
+    printf("%-28s scalar: %8.2fms  simd: %8.2fms  (x%.2f)\n", msg, scalar, simd, (scalar) / (simd))
+#define BENCH_REPORT_THREADS(msg, single, threaded, nthreads) \
+    printf("%-28s 1 thread: %8.2fms  %d threads: %8.2fms  (x%.2f)\n", \
+            msg, single, nthreads, threaded, (single) / (threaded))
+#define BENCH_COMPARE(msg, a_label, a, b_label, b) \
+    printf("%-28s %s: %8.2fms  %s: %8.2fms  (x%.2f)\n", msg, a_label, a, b_label, b, (a) / (b))
+
+#define BENCH_MAT4_ITER 2000000
+#define BENCH_NPOINTS   100000
+#define BENCH_PASSES    100
+#define BENCH_MATN      512
+#define BENCH_NQUATS    4096
+#define BENCH_QUAT_PASSES 500
+#define BENCH_NSCALARS  (1 << 16)
+#define BENCH_SCALAR_PASSES 100
+#define BENCH_NOISE_GRID 512
+#define BENCH_NOISE_PASSES 10
+#define BENCH_NOISE_IMAGE 2048
+#define BENCH_NOISE_OCTAVES 4
+#define BENCH_NRANDOMS (1 << 20)
+#define BENCH_RANDOM_PASSES 20
+#define BENCH_KDTREE_POINTS 1000000
+#define BENCH_KDTREE_QUERIES 100000
+#define BENCH_KDTREE_K 8
+#define BENCH_KDTREE_RANGE 64       // holds the ~34 points within the radius
+#define BENCH_KDTREE_RADIUS 0.02f
+#define BENCH_KDTREE_LIVE 100000
+#define BENCH_KDTREE_CHURN 1000000
+#define BENCH_KDTREE_FEATDIM 64
+#define BENCH_KDTREE_FEATURES 100000
+#define BENCH_KDTREE_FEATQUERIES 1000
+#define BENCH_LIST_CHURN 1000000
+
+// same size as Mesh_vert, positions are the first 3 floats
+typedef struct bench_vert
+{
+    float position[3];
+    uint8_t data[20];
+} bench_vert;
+
+static float bench_mat4_mult(void)
+{
+    mat4 a, b;
+    mat4_identity(a);
+    mat4_identity(b);
+    mat4_rotate(b, 0.01f, 1.0f, 1.0f, 0.0f);
+    mat4_translate(b, 0.001f, 0.0f, 0.0f);
+
+    struct timeval t;
+    timeval_tick(&t);
+    int i;
+    for(i = 0; i < BENCH_MAT4_ITER; i++)
+    {
+        mat4_mult(a, b, a);
+    }
+    return timeval_tick(&t);
+}
+
+static float bench_mat4_mult_affine(void)
+{
+    mat4 a, b;
+    mat4_identity(a);
+    mat4_identity(b);
+    mat4_rotate(b, 0.01f, 1.0f, 1.0f, 0.0f);
+    mat4_translate(b, 0.001f, 0.0f, 0.0f);
+
+    struct timeval t;
+    timeval_tick(&t);
+    int i;
+    for(i = 0; i < BENCH_MAT4_ITER; i++)
+    {
+        mat4_mult_affine(a, b, a);
+    }
+    return timeval_tick(&t);
+}
+
+static float bench_dualquat_mult(void)
+{
+    vec3 axis = vec3_setp(1.0f, 1.0f, 0.0f);
+    vec3 offset = vec3_setp(0.001f, 0.0f, 0.0f);
+    quat q = quaternion_set_rotation(0.01f, axis);
+    dualquat a = dualquat_identity();
+    dualquat b = dualquat_set(&q, &offset);
+
+    struct timeval t;
+    timeval_tick(&t);
+    int i;
+    for(i = 0; i < BENCH_MAT4_ITER; i++)
+    {
+        a = dualquat_multp(&a, &b);
+    }
+    float ms = timeval_tick(&t);
+    if(a.real.w > 2.0f) // keep the chain live
+    {
+        printf("!");
+    }
+    return ms;
+}
+
+static float bench_mat4_transform(bench_vert *verts)
+{
+    mat4 m;
+    mat4_identity(m);
+    mat4_rotate(m, 0.01f, 0.0f, 1.0f, 0.0f);
+
+    struct timeval t;
+    timeval_tick(&t);
+    int i;
+    for(i = 0; i < BENCH_PASSES; i++)
+    {
+        mat4_transform_points(m, verts[0].position, verts[0].position, 
+                BENCH_NPOINTS, sizeof(bench_vert));
+    }
+    return timeval_tick(&t);
+}
+
+static float bench_matn_mult(matn a, matn b, matn c)
+{
+    struct timeval t;
+    timeval_tick(&t);
+    matn_mult(a, BENCH_MATN, b, c);
+    return timeval_tick(&t);
+}
+
+static float bench_matn_solve(matn a, float *b, float *x)
+{
+    struct timeval t;
+    timeval_tick(&t);
+    matn_solvelu(a, BENCH_MATN, b, x);
+    return timeval_tick(&t);
+}
+
+static void bench_matn(void)
+{
+    int n = BENCH_MATN;
+    matn a = malloc(sizeof(float) * n * n);
+    matn b = malloc(sizeof(float) * n * n);
+    matn c = malloc(sizeof(float) * n * n);
+    float *v = malloc(sizeof(float) * n);
+    float *x = malloc(sizeof(float) * n);
+    int i;
+    for(i = 0; i < n * n; i++)
+    {
+        a[i] = (float) rand() / RAND_MAX - 0.5f;
+        b[i] = (float) rand() / RAND_MAX - 0.5f;
+    }
+    for(i = 0; i < n; i++)
+    {
+        v[i] = (float) rand() / RAND_MAX;
+    }
+
+    float scalar, simd, threaded;
+    ThreadPool pool;
+    threadpool_init(&pool, 0);
+
+    cpu_disable(~0);
+    scalar = bench_matn_mult(a, b, c);
+    cpu_disable(0);
+    simd = bench_matn_mult(a, b, c);
+    BENCH_REPORT("matn_mult 512", scalar, simd);
+    matn_threadpool(&pool);
+    threaded = bench_matn_mult(a, b, c);
+    matn_threadpool(NULL);
+    BENCH_REPORT_THREADS("matn_mult 512", simd, threaded, threadpool_nthreads(&pool));
+
+    cpu_disable(~0);
+    scalar = bench_matn_solve(a, v, x);
+    cpu_disable(0);
+    simd = bench_matn_solve(a, v, x);
+    BENCH_REPORT("matn_solvelu 512", scalar, simd);
+    matn_threadpool(&pool);
+    threaded = bench_matn_solve(a, v, x);
+    matn_threadpool(NULL);
+    BENCH_REPORT_THREADS("matn_solvelu 512", simd, threaded, threadpool_nthreads(&pool));
+
+    threadpool_finalize(&pool);
+    free(x);
+    free(v);
+    free(c);
+    free(b);
+    free(a);
+}
+
+void bench_matrix(void)
+{
+    BENCH_BEGIN("Matrix");
+    float scalar, simd;
+
+    cpu_disable(~0);
+    scalar = bench_mat4_mult();
+    cpu_disable(0);
+    simd = bench_mat4_mult();
+    BENCH_REPORT("mat4_mult", scalar, simd);
+
+    cpu_disable(~0);
+    scalar = bench_mat4_mult_affine();
+    cpu_disable(0);
+    simd = bench_mat4_mult_affine();
+    BENCH_REPORT("mat4_mult_affine", scalar, simd);
+
+    bench_vert *verts = calloc(BENCH_NPOINTS, sizeof(bench_vert));
+    cpu_disable(~0);
+    scalar = bench_mat4_transform(verts);
+    cpu_disable(0);
+    simd = bench_mat4_transform(verts);
+    BENCH_REPORT("mat4_transform_points", scalar, simd);
+    free(verts);
+
+    bench_matn();
+    BENCH_END("Matrix");
+}
+
+static quat bench_randquat(void)
+{
+    quat q;
+    q.x = (float) rand() / RAND_MAX - 0.5f;
+    q.y = (float) rand() / RAND_MAX - 0.5f;
+    q.z = (float) rand() / RAND_MAX - 0.5f;
+    q.w = (float) rand() / RAND_MAX - 0.5f;
+    quaternion_normalizep(&q);
+    return q;
+}
+
+/**
+ * angle in radians between the rotation of 'q' and the slerp of 'a' and 'b', 
+ * computed in double precision
+ */
+static double bench_slerp_error(const quat *a, const quat *b, float t, const quat *q)
+{
+    double cosom = (double) a->x * b->x + (double) a->y * b->y + 
+                   (double) a->z * b->z + (double) a->w * b->w;
+    double sign = cosom < 0.0 ? -1.0 : 1.0;
+    cosom = fmin(cosom * sign, 1.0);
+    double omega = acos(cosom);
+    double wa = 1.0 - t;
+    double wb = t;
+    if(omega > 1e-9)
+    {
+        wa = sin((1.0 - t) * omega) / sin(omega);
+        wb = sin(t * omega) / sin(omega);
+    }
+    wb *= sign;
+
+    double ref[4] = {wa * a->x + wb * b->x, wa * a->y + wb * b->y, 
+                     wa * a->z + wb * b->z, wa * a->w + wb * b->w};
+    double val[4] = {q->x, q->y, q->z, q->w};
+    double rlen = 0.0, vlen = 0.0, dot = 0.0;
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        rlen += ref[i] * ref[i];
+        vlen += val[i] * val[i];
+        dot += ref[i] * val[i];
+    }
+    rlen = sqrt(rlen);
+    vlen = sqrt(vlen);
+    sign = dot < 0.0 ? -1.0 : 1.0;
+
+    // the angle between q and ref as 4-vectors is 2 * atan(|q - ref| / |q + ref|),
+    // which is stable near 0, and the rotation angle is twice that
+    double diff = 0.0, sum = 0.0;
+    for(i = 0; i < 4; i++)
+    {
+        double r = sign * ref[i] / rlen;
+        double v = val[i] / vlen;
+        diff += (v - r) * (v - r);
+        sum += (v + r) * (v + r);
+    }
+    return 4.0 * atan2(sqrt(diff), sqrt(sum));
+}
+
+static float bench_slerp(quat *a, quat *b, quat *dst, int tier)
+{
+    struct timeval t;
+    timeval_tick(&t);
+    int i;
+    for(i = 0; i < BENCH_QUAT_PASSES; i++)
+    {
+        if(tier < 0)
+        {
+            quaternion_nlerp_n(a, b, 0.3f, dst, BENCH_NQUATS);
+        } else
+        {
+            quaternion_slerp_n(a, b, 0.3f, dst, BENCH_NQUATS, tier);
+        }
+    }
+    return timeval_tick(&t);
+}
+
+/**
+ * times each slerp tier, and reports its maximum angular error against a 
+ * double precision slerp, over random pairs (some of them nearly opposite) and
+ * blend weights in [0, 1]
+ */
+void bench_quaternion(void)
+{
+    BENCH_BEGIN("Quaternion");
+    const char *names[] = {"slerp exact", "slerp accurate", "slerp fast", "nlerp"};
+    const int tiers[] = {QUATERNION_SLERP_EXACT, QUATERNION_SLERP_ACCURATE, 
+                         QUATERNION_SLERP_FAST, -1};
+    quat *a = malloc(sizeof(quat) * BENCH_NQUATS);
+    quat *b = malloc(sizeof(quat) * BENCH_NQUATS);
+    quat *dst = malloc(sizeof(quat) * BENCH_NQUATS);
+    int i, j, k;
+    for(i = 0; i < BENCH_NQUATS; i++)
+    {
+        a[i] = bench_randquat();
+        b[i] = bench_randquat();
+        if(i % 8 == 0) // close to 180 degrees of rotation apart, the worst case
+        {
+            b[i] = a[i];
+            b[i].x = -a[i].w;
+            b[i].y = a[i].z;
+            b[i].z = -a[i].y;
+            b[i].w = a[i].x + 0.001f;
+            quaternion_normalizep(&b[i]);
+        }
+    }
+
+    for(k = 0; k < 4; k++)
+    {
+        double maxerr = 0.0;
+        for(j = 0; j <= 16; j++)
+        {
+            float t = j / 16.0f;
+            if(tiers[k] < 0)
+            {
+                quaternion_nlerp_n(a, b, t, dst, BENCH_NQUATS);
+            } else
+            {
+                quaternion_slerp_n(a, b, t, dst, BENCH_NQUATS, tiers[k]);
+            }
+            for(i = 0; i < BENCH_NQUATS; i++)
+            {
+                maxerr = fmax(maxerr, bench_slerp_error(&a[i], &b[i], t, &dst[i]));
+            }
+        }
+
+        float scalar, simd;
+        cpu_disable(~0);
+        scalar = bench_slerp(a, b, dst, tiers[k]);
+        cpu_disable(0);
+        simd = bench_slerp(a, b, dst, tiers[k]);
+        BENCH_REPORT(names[k], scalar, simd);
+        printf("%-28s max angular error: %.3g rad\n", names[k], maxerr);
+    }
+
+    free(dst);
+    free(b);
+    free(a);
+    float mat4_ms = bench_mat4_mult_affine();
+    float dq_ms = bench_dualquat_mult();
+    printf("%-28s mat4 affine: %8.2fms  dualquat: %8.2fms  (x%.2f)\n", 
+            "bone compose", mat4_ms, dq_ms, mat4_ms / dq_ms);
+    BENCH_END("Quaternion");
+}
+
+enum bench_func
+{
+    BENCH_SIN,
+    BENCH_COS,
+    BENCH_EXP,
+    BENCH_ATAN2,
+    BENCH_ASIN,
+    BENCH_ACOS,
+    BENCH_NFUNCS,
+};
+
+/**
+ * runs function 'f' over the inputs, with libm (mode 0), the fast scalar 
+ * approximation (mode 1), or its array version (mode 2)
+ */
+static float bench_transcendental(int f, int mode, const float *x, const float *y, float *dst)
+{
+    struct timeval t;
+    timeval_tick(&t);
+    int p, i;
+    for(p = 0; p < BENCH_SCALAR_PASSES; p++)
+    {
+        if(mode == 2)
+        {
+            switch(f)
+            {
+                case BENCH_SIN: fsin_n(x, dst, BENCH_NSCALARS); break;
+                case BENCH_COS: fcos_n(x, dst, BENCH_NSCALARS); break;
+                case BENCH_EXP: fexp_n(x, dst, BENCH_NSCALARS); break;
+                case BENCH_ATAN2: fatan2_n(y, x, dst, BENCH_NSCALARS); break;
+            }
+            continue;
+        }
+
+        for(i = 0; i < BENCH_NSCALARS; i++)
+        {
+            switch(f)
+            {
+                case BENCH_SIN: dst[i] = mode ? fsin(x[i]) : sinf(x[i]); break;
+                case BENCH_COS: dst[i] = mode ? fcos(x[i]) : cosf(x[i]); break;
+                case BENCH_EXP: dst[i] = mode ? fexp(x[i]) : expf(x[i]); break;
+                case BENCH_ATAN2: dst[i] = mode ? fatan2(y[i], x[i]) : atan2f(y[i], x[i]); break;
+                case BENCH_ASIN: dst[i] = mode ? fasin(y[i]) : asinf(y[i]); break;
+                case BENCH_ACOS: dst[i] = mode ? facos(y[i]) : acosf(y[i]); break;
+            }
+        }
+    }
+    return timeval_tick(&t);
+}
+
+/**
+ * error of 'val' against the double precision result of 'f', in units in the 
+ * last place of the float result
+ */
+static double bench_ulp_error(int f, float x, float y, float val)
+{
+    double ref = 0.0;
+    switch(f)
+    {
+        case BENCH_SIN: ref = sin(x); break;
+        case BENCH_COS: ref = cos(x); break;
+        case BENCH_EXP: ref = exp(x); break;
+        case BENCH_ATAN2: ref = atan2(y, x); break;
+        case BENCH_ASIN: ref = asin(y); break;
+        case BENCH_ACOS: ref = acos(y); break;
+    }
+    float fref = fabs(ref);
+    double ulp = nextafterf(fref, INFINITY) - fref;
+    return fabs(val - ref) / ulp;
+}
+
+/**
+ * compares the fast transcendental functions of scalar.h with libm. The array
+ * versions run on the fastest available instruction set. sin, cos and atan2 
+ * inputs are in [-100, 100], exp in [-80, 80], asin and acos in [-1, 1]
+ */
+void bench_scalar(void)
+{
+    BENCH_BEGIN("Transcendental");
+    const char *names[] = {"sin", "cos", "exp", "atan2", "asin", "acos"};
+    float *x = malloc(sizeof(float) * BENCH_NSCALARS);
+    float *xe = malloc(sizeof(float) * BENCH_NSCALARS);
+    float *y = malloc(sizeof(float) * BENCH_NSCALARS);
+    float *yu = malloc(sizeof(float) * BENCH_NSCALARS);
+    float *dst = malloc(sizeof(float) * BENCH_NSCALARS);
+    int f, i;
+    for(i = 0; i < BENCH_NSCALARS; i++)
+    {
+        x[i] = 200.0f * rand() / RAND_MAX - 100.0f;
+        xe[i] = 160.0f * rand() / RAND_MAX - 80.0f;
+        y[i] = 200.0f * rand() / RAND_MAX - 100.0f;
+        yu[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+    }
+
+    printf("%-8s %12s %12s %12s %10s\n", "function", "libm (ms)", "fast (ms)", "array (ms)", "max ulp");
+    for(f = 0; f < BENCH_NFUNCS; f++)
+    {
+        const float *fx = f == BENCH_EXP ? xe : x;
+        const float *fy = f == BENCH_ASIN || f == BENCH_ACOS ? yu : y;
+        float libm = bench_transcendental(f, 0, fx, fy, dst);
+        float fast = bench_transcendental(f, 1, fx, fy, dst);
+
+        double maxerr = 0.0;
+        for(i = 0; i < BENCH_NSCALARS; i++)
+        {
+            maxerr = fmax(maxerr, bench_ulp_error(f, fx[i], fy[i], dst[i]));
+        }
+
+        if(f <= BENCH_ATAN2)
+        {
+            float array = bench_transcendental(f, 2, fx, fy, dst);
+            printf("%-8s %12.2f %12.2f %12.2f %10.2f\n", names[f], libm, fast, array, maxerr);
+        } else
+        {
+            printf("%-8s %12.2f %12.2f %12s %10.2f\n", names[f], libm, fast, "-", maxerr);
+        }
+    }
+
+    free(dst);
+    free(yu);
+    free(y);
+    free(xe);
+    free(x);
+    BENCH_END("Transcendental");
+}
+
+static float bench_noise2_grid(float *dst)
+{
+    struct timeval t;
+    int i;
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_NOISE_PASSES; i++)
+    {
+        noise2_perlin_grid(0.5f * i, 0.0f, 0.05f, 0.05f, BENCH_NOISE_GRID, BENCH_NOISE_GRID, dst);
+    }
+    return timeval_tick(&t);
+}
+
+static float bench_noise3_n(const float *x, const float *y, const float *z, float *dst, int n)
+{
+    struct timeval t;
+    int i;
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_NOISE_PASSES; i++)
+    {
+        noise3_perlin_n(x, y, z, n, dst);
+    }
+    return timeval_tick(&t);
+}
+
+static float bench_noise2_pixels(float *dst)
+{
+    struct timeval t;
+    int i, j;
+    timeval_tick(&t);
+    for(j = 0; j < BENCH_NOISE_IMAGE; j++)
+    {
+        for(i = 0; i < BENCH_NOISE_IMAGE; i++)
+        {
+            dst[j * BENCH_NOISE_IMAGE + i] = noise2_fracPerlin(i * 0.01f, j * 0.01f, BENCH_NOISE_OCTAVES);
+        }
+    }
+    return timeval_tick(&t);
+}
+
+static float bench_noise2_fill(float *dst)
+{
+    struct timeval t;
+    timeval_tick(&t);
+    noise2_fill(NULL, NOISE_FRACTAL, BENCH_NOISE_OCTAVES, 0.0f, 0.0f, 0.01f, 0.01f,
+            BENCH_NOISE_IMAGE, BENCH_NOISE_IMAGE, dst);
+    return timeval_tick(&t);
+}
+
+void bench_noise(void)
+{
+    BENCH_BEGIN("Noise");
+    int n = BENCH_NOISE_GRID * BENCH_NOISE_GRID;
+    float *dst = malloc(sizeof(float) * n);
+    float *x = malloc(sizeof(float) * n * 3);
+    float *y = x + n;
+    float *z = y + n;
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        x[i] = 100.0f * rand() / RAND_MAX;
+        y[i] = 100.0f * rand() / RAND_MAX;
+        z[i] = 100.0f * rand() / RAND_MAX;
+    }
+
+    float scalar, simd;
+    cpu_disable(~0);
+    scalar = bench_noise2_grid(dst);
+    cpu_disable(0);
+    simd = bench_noise2_grid(dst);
+    BENCH_REPORT("noise2_perlin_grid 512", scalar, simd);
+
+    cpu_disable(~0);
+    scalar = bench_noise3_n(x, y, z, dst, n);
+    cpu_disable(0);
+    simd = bench_noise3_n(x, y, z, dst, n);
+    BENCH_REPORT("noise3_perlin_n", scalar, simd);
+    free(x);
+    free(dst);
+
+    // per pixel point calls, against the tiled generator
+    float threaded;
+    dst = malloc(sizeof(float) * BENCH_NOISE_IMAGE * BENCH_NOISE_IMAGE);
+    scalar = bench_noise2_pixels(dst);
+    simd = bench_noise2_fill(dst);
+    BENCH_COMPARE("noise2 2048 image", "per pixel", scalar, "noise2_fill", simd);
+    ThreadPool pool;
+    threadpool_init(&pool, 0);
+    noise_threadpool(&pool);
+    threaded = bench_noise2_fill(dst);
+    noise_threadpool(NULL);
+    BENCH_REPORT_THREADS("noise2_fill 2048", simd, threaded, threadpool_nthreads(&pool));
+    threadpool_finalize(&pool);
+    free(dst);
+    BENCH_END("Noise");
+}
+
+static float bench_random_u32(RandomStream *r, uint32_t *dst)
+{
+    struct timeval t;
+    int i;
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_RANDOM_PASSES; i++)
+    {
+        random_fill_u32(r, dst, BENCH_NRANDOMS);
+    }
+    return timeval_tick(&t);
+}
+
+static float bench_random_float(RandomStream *r, float *dst)
+{
+    struct timeval t;
+    int i;
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_RANDOM_PASSES; i++)
+    {
+        random_fill_float(r, dst, BENCH_NRANDOMS);
+    }
+    return timeval_tick(&t);
+}
+
+void bench_random(void)
+{
+    BENCH_BEGIN("Random");
+    uint32_t *u = malloc(sizeof(uint32_t) * BENCH_NRANDOMS);
+    float *f = malloc(sizeof(float) * BENCH_NRANDOMS);
+    RandomStream r;
+    randomstream_init(&r, 1);
+
+    float scalar, simd;
+    struct timeval t;
+    int i, j;
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_RANDOM_PASSES; i++)
+    {
+        for(j = 0; j < BENCH_NRANDOMS; j++)
+        {
+            u[j] = random_int();
+        }
+    }
+    scalar = timeval_tick(&t);
+    simd = bench_random_u32(&r, u);
+    BENCH_COMPARE("random u32", "random_int", scalar, "fill_u32", simd);
+
+    cpu_disable(~0);
+    scalar = bench_random_u32(&r, u);
+    cpu_disable(0);
+    simd = bench_random_u32(&r, u);
+    BENCH_REPORT("random_fill_u32", scalar, simd);
+
+    cpu_disable(~0);
+    scalar = bench_random_float(&r, f);
+    cpu_disable(0);
+    simd = bench_random_float(&r, f);
+    BENCH_REPORT("random_fill_float", scalar, simd);
+
+    cpu_disable(~0);
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_RANDOM_PASSES; i++)
+    {
+        for(j = 0; j < BENCH_NRANDOMS; j++)
+        {
+            u[j] = random_int();
+        }
+    }
+    scalar = timeval_tick(&t);
+    cpu_disable(0);
+    for(i = 0; i < BENCH_RANDOM_PASSES; i++)
+    {
+        for(j = 0; j < BENCH_NRANDOMS; j++)
+        {
+            u[j] = random_int();
+        }
+    }
+    simd = timeval_tick(&t);
+    BENCH_REPORT("random_int (mersenne refill)", scalar, simd);
+
+    for(i = 0; i < BENCH_RANDOM_PASSES; i++)
+    {
+        for(j = 0; j < BENCH_NRANDOMS; j++)
+        {
+            f[j] = random_gauss(0.0f, 1.0f);
+        }
+    }
+    scalar = timeval_tick(&t);
+    for(i = 0; i < BENCH_RANDOM_PASSES; i++)
+    {
+        random_gauss_n(f, BENCH_NRANDOMS, 0.0f, 1.0f);
+    }
+    simd = timeval_tick(&t);
+    BENCH_COMPARE("random gauss", "random_gauss", scalar, "random_gauss_n", simd);
+
+    for(i = 0; i < BENCH_RANDOM_PASSES; i++)
+    {
+        randomstream_gauss_n(&r, f, BENCH_NRANDOMS, 0.0f, 1.0f);
+    }
+    simd = timeval_tick(&t);
+    BENCH_COMPARE("random gauss", "random_gauss", scalar, "randomstream_gauss_n", simd);
+
+    float weights[256], total = 0.0f;
+    RandomAlias alias;
+    for(i = 0; i < 256; i++)
+    {
+        weights[i] = randomstream_random(&r);
+        total += weights[i];
+    }
+    randomalias_init(&alias, weights, 256);
+    timeval_tick(&t);
+    for(j = 0; j < BENCH_NRANDOMS; j++)
+    {
+        float pick = randomstream_random(&r) * total;
+        for(i = 0; i < 255 && pick >= weights[i]; i++)
+        {
+            pick -= weights[i];
+        }
+        u[j] = i;
+    }
+    scalar = timeval_tick(&t);
+    for(j = 0; j < BENCH_NRANDOMS; j++)
+    {
+        u[j] = randomstream_alias(&r, &alias);
+    }
+    simd = timeval_tick(&t);
+    BENCH_COMPARE("weighted pick (256)", "scan", scalar, "alias", simd);
+    randomalias_finalize(&alias);
+
+    free(f);
+    free(u);
+    BENCH_END("Random");
+}
+
+static float bench_kdtree_queries(kdtree *k, const float *queries)
+{
+    struct timeval t;
+    int i;
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_KDTREE_QUERIES; i++)
+    {
+        kdtree_closest(k, (float*) &queries[i * 3], NULL);
+    }
+    return timeval_tick(&t);
+}
+
+void bench_kdtree(void)
+{
+    BENCH_BEGIN("KD-Tree");
+    float *pts = malloc(sizeof(float) * 3 * BENCH_KDTREE_POINTS);
+    float *queries = malloc(sizeof(float) * 3 * BENCH_KDTREE_QUERIES);
+    RandomStream r;
+    randomstream_init(&r, 1);
+    random_fill_float(&r, pts, 3 * BENCH_KDTREE_POINTS);
+    random_fill_float(&r, queries, 3 * BENCH_KDTREE_QUERIES);
+
+    kdtree inserted, built;
+    float before, after, serial, threaded;
+    struct timeval t;
+    int i;
+    kdtree_init(&inserted, 3);
+    kdtree_init(&built, 3);
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_KDTREE_POINTS; i++)
+    {
+        kdtree_insert(&inserted, &pts[i * 3], NULL);
+    }
+    before = timeval_tick(&t);
+    kdtree_build(&built, pts, NULL, BENCH_KDTREE_POINTS);
+    serial = timeval_tick(&t);
+    BENCH_COMPARE("kdtree 1M points", "insert", before, "build", serial);
+
+    before = bench_kdtree_queries(&inserted, queries);
+    after = bench_kdtree_queries(&built, queries);
+    BENCH_COMPARE("kdtree_closest", "inserted", before, "built", after);
+
+    ThreadPool pool;
+    threadpool_init(&pool, 0);
+    kdtree_finalize(&built, NULL);
+    kdtree_threadpool(&pool);
+    timeval_tick(&t);
+    kdtree_build(&built, pts, NULL, BENCH_KDTREE_POINTS);
+    threaded = timeval_tick(&t);
+    kdtree_threadpool(NULL);
+    BENCH_REPORT_THREADS("kdtree_build 1M", serial, threaded, threadpool_nthreads(&pool));
+
+    // a saved tree is ready as soon as it is mapped. The first queries fault
+    // its pages in from the page cache
+    kdmap map;
+    kdtree_save(&built, "bench_kdmap.kdt", NULL, NULL);
+    timeval_tick(&t);
+    kdmap_open(&map, "bench_kdmap.kdt");
+    after = timeval_tick(&t);
+    BENCH_COMPARE("kdtree 1M ready", "build", serial, "kdmap_open", after);
+    before = bench_kdtree_queries(&built, queries);
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_KDTREE_QUERIES; i++)
+    {
+        kdmap_closest(&map, &queries[i * 3], NULL);
+    }
+    after = timeval_tick(&t);
+    BENCH_COMPARE("closest", "kdtree", before, "kdmap", after);
+    kdmap_close(&map);
+    remove("bench_kdmap.kdt");
+
+    void **near = malloc(sizeof(void*) * BENCH_KDTREE_K * BENCH_KDTREE_QUERIES);
+    float *dists = malloc(sizeof(float) * BENCH_KDTREE_K * BENCH_KDTREE_QUERIES);
+    float *nearpos[BENCH_KDTREE_K];
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_KDTREE_QUERIES; i++)
+    {
+        kdtree_closestN(&built, &queries[i * 3], BENCH_KDTREE_K, &near[i * BENCH_KDTREE_K], nearpos);
+    }
+    before = timeval_tick(&t);
+    kdtree_closestN_batch(&built, queries, BENCH_KDTREE_QUERIES, BENCH_KDTREE_K, near, dists);
+    serial = timeval_tick(&t);
+    BENCH_COMPARE("kdtree_closestN", "one by one", before, "batch", serial);
+
+    kdtree_threadpool(&pool);
+    timeval_tick(&t);
+    kdtree_closestN_batch(&built, queries, BENCH_KDTREE_QUERIES, BENCH_KDTREE_K, near, dists);
+    threaded = timeval_tick(&t);
+    kdtree_threadpool(NULL);
+    BENCH_REPORT_THREADS("kdtree_closestN_batch", serial, threaded, threadpool_nthreads(&pool));
+
+    // the points within a radius, found before by a closestN large enough
+    // to hold them all
+    void *inrange[BENCH_KDTREE_RANGE];
+    float *inpos[BENCH_KDTREE_RANGE];
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_KDTREE_QUERIES; i++)
+    {
+        kdtree_closestN(&built, &queries[i * 3], BENCH_KDTREE_RANGE, inrange, inpos);
+    }
+    before = timeval_tick(&t);
+    for(i = 0; i < BENCH_KDTREE_QUERIES; i++)
+    {
+        kdtree_within_radiusN(&built, &queries[i * 3], BENCH_KDTREE_RADIUS,
+                BENCH_KDTREE_RANGE, inrange, inpos);
+    }
+    after = timeval_tick(&t);
+    BENCH_COMPARE("points in radius", "closestN", before, "within_radiusN", after);
+
+    free(dists);
+    free(near);
+    threadpool_finalize(&pool);
+
+    // a mix of small moves, removals and inserts on a tree of 100k points.
+    // Query times and depth should stay those of a fresh build
+    kdtree churn;
+    int *handles = malloc(sizeof(int) * BENCH_KDTREE_LIVE);
+    float p[3];
+    kdtree_init(&churn, 3);
+    kdtree_build(&churn, pts, NULL, BENCH_KDTREE_LIVE);
+    for(i = 0; i < BENCH_KDTREE_LIVE; i++)
+    {
+        handles[i] = i;
+    }
+    printf("%-28s %10s %12s %8s\n", "kdtree churn ops", "ops (ms)", "query (ms)", "depth");
+    printf("%-28d %10s %12.2f %8d\n", 0, "-", bench_kdtree_queries(&churn, queries),
+            kdtree_depth(&churn));
+    for(i = 0; i < BENCH_KDTREE_CHURN; )
+    {
+        timeval_tick(&t);
+        int end = i + BENCH_KDTREE_CHURN / 4;
+        for(; i < end; i++)
+        {
+            int j = randomstream_below(&r, BENCH_KDTREE_LIVE);
+            random_fill_float(&r, p, 3);
+            if(i & 1)
+            {
+                const float *old = kdtree_position(&churn, handles[j]);
+                int c;
+                for(c = 0; c < 3; c++)
+                {
+                    p[c] = fminf(fmaxf(old[c] + (p[c] - 0.5f) * 0.02f, 0.0f), 1.0f);
+                }
+                kdtree_move(&churn, handles[j], p);
+            } else
+            {
+                kdtree_remove(&churn, handles[j], NULL);
+                handles[j] = kdtree_insert(&churn, p, NULL);
+            }
+        }
+        float ops = timeval_tick(&t);
+        printf("%-28d %10.2f %12.2f %8d\n", i, ops, bench_kdtree_queries(&churn, queries),
+                kdtree_depth(&churn));
+    }
+    before = bench_kdtree_queries(&churn, queries);
+    kdtree_rebuild(&churn);
+    after = bench_kdtree_queries(&churn, queries);
+    BENCH_COMPARE("kdtree_closest", "churned", before, "rebuilt", after);
+    kdtree_finalize(&churn, NULL);
+    free(handles);
+
+    // 64 coordinate features near an 8 dimensional subspace. Exact search
+    // visits most of the tree, while a forest with a budget finds most of
+    // the same points
+    const int fdim = BENCH_KDTREE_FEATDIM;
+    float *feat = malloc(sizeof(float) * fdim * BENCH_KDTREE_FEATURES);
+    float *fq = malloc(sizeof(float) * fdim * BENCH_KDTREE_FEATQUERIES);
+    void **fvals = malloc(sizeof(void*) * BENCH_KDTREE_FEATURES);
+    void **exact = malloc(sizeof(void*) * BENCH_KDTREE_K * BENCH_KDTREE_FEATQUERIES);
+    float basis[8 * BENCH_KDTREE_FEATDIM], latent[8];
+    random_fill_float(&r, basis, 8 * fdim);
+    for(i = 0; i < BENCH_KDTREE_FEATURES + BENCH_KDTREE_FEATQUERIES; i++)
+    {
+        float *v = i < BENCH_KDTREE_FEATURES ? &feat[(size_t) i * fdim]
+                                             : &fq[(size_t) (i - BENCH_KDTREE_FEATURES) * fdim];
+        int c, l;
+        random_fill_float(&r, latent, 8);
+        random_fill_float(&r, v, fdim);
+        for(c = 0; c < fdim; c++)
+        {
+            v[c] *= 0.05f;
+            for(l = 0; l < 8; l++)
+            {
+                v[c] += latent[l] * basis[l * fdim + c];
+            }
+        }
+        if(i < BENCH_KDTREE_FEATURES)
+        {
+            fvals[i] = (void*)(intptr_t) i;
+        }
+    }
+
+    kdtree exacttree;
+    kdtree_init(&exacttree, fdim);
+    kdtree_build(&exacttree, feat, fvals, BENCH_KDTREE_FEATURES);
+    timeval_tick(&t);
+    for(i = 0; i < BENCH_KDTREE_FEATQUERIES; i++)
+    {
+        kdtree_closestN(&exacttree, &fq[i * fdim], BENCH_KDTREE_K, &exact[i * BENCH_KDTREE_K], nearpos);
+    }
+    before = timeval_tick(&t);
+    kdtree_finalize(&exacttree, NULL);
+
+    static const int ntrees[] = {1, 4, 8};
+    static const int checks[] = {64, 256, 1024};
+    printf("%-28s %8s %8s %10s %8s %8s\n", "kdforest_closestN", "trees", "checks", "time (ms)", "speedup", "recall");
+    int f, c;
+    for(f = 0; f < 3; f++)
+    {
+        kdforest forest;
+        kdforest_init(&forest, fdim, ntrees[f]);
+        kdforest_build(&forest, feat, fvals, BENCH_KDTREE_FEATURES, 1);
+        for(c = 0; c < 3; c++)
+        {
+            void *found[BENCH_KDTREE_K];
+            int hits = 0, a, b;
+            after = 0.0f;
+            for(i = 0; i < BENCH_KDTREE_FEATQUERIES; i++)
+            {
+                timeval_tick(&t);
+                int nfound = kdforest_closestN(&forest, &fq[i * fdim], BENCH_KDTREE_K, 0.0f, checks[c], found, NULL);
+                after += timeval_tick(&t);
+                for(a = 0; a < nfound; a++)
+                {
+                    for(b = 0; b < BENCH_KDTREE_K; b++)
+                    {
+                        hits += found[a] == exact[i * BENCH_KDTREE_K + b];
+                    }
+                }
+            }
+            printf("%-28s %8d %8d %10.2f %7.1fx %7.1f%%\n", "", ntrees[f], checks[c], after, before / after,
+                    100.0f * hits / (BENCH_KDTREE_K * BENCH_KDTREE_FEATQUERIES));
+        }
+        kdforest_finalize(&forest, NULL);
+    }
+    printf("%-28s exact closestN: %8.2fms\n", "", before);
+    free(exact);
+    free(fvals);
+    free(fq);
+    free(feat);
+
+    kdtree_finalize(&built, NULL);
+    kdtree_finalize(&inserted, NULL);
+    free(queries);
+    free(pts);
+    BENCH_END("KD-Tree");
+}
+
+/**
+ * sums a list in order, to time iterating it
+ */
+static float bench_list_iterate(List *l, uint64_t *sum)
+{
+    struct timeval t;
+    Iterator it;
+    int rep;
+    timeval_tick(&t);
+    for(rep = 0; rep < 10; rep++)
+    {
+        list_first(l, &it);
+        while(iterator_value(&it))
+        {
+            *sum += *(int*) iterator_value(&it);
+            iterator_next(&it);
+        }
+    }
+    return timeval_tick(&t);
+}
+
+void bench_list(void)
+{
+    BENCH_BEGIN("List");
+    static const int lengths[] = {1000, 10000, 100000, 1000000};
+    RandomStream r;
+    struct timeval t;
+    int i, j;
+    uint64_t sum = 0;
+    randomstream_init(&r, 1);
+
+    // removing a random entry and adding one back take the same steps
+    // however long the list is, as entries go on and come off the free
+    // list. Longer lists only cost more in cache misses
+    printf("%-28s %8s %10s %12s\n", "list churn", "length", "ops (ms)", "ns per op");
+    for(j = 0; j < 4; j++)
+    {
+        List l;
+        Iterator it;
+        size_t *idx = malloc(sizeof(size_t) * lengths[j]);
+        list_init(&l, sizeof(int));
+        for(i = 0; i < lengths[j]; i++)
+        {
+            list_addback(&l, &i);
+            list_last(&l, &it);
+            idx[i] = list_index(&l, &it);
+        }
+        timeval_tick(&t);
+        for(i = 0; i < BENCH_LIST_CHURN; i++)
+        {
+            int k = randomstream_below(&r, lengths[j]);
+            list_at(&l, idx[k], &it);
+            list_remove(&l, &it);
+            if(i & 1)
+            {
+                list_addback(&l, &i);
+                list_last(&l, &it);
+            } else
+            {
+                list_addfront(&l, &i);
+                list_first(&l, &it);
+            }
+            idx[k] = list_index(&l, &it);
+        }
+        float ops = timeval_tick(&t);
+        printf("%-28s %8d %10.2f %12.1f\n", "", lengths[j], ops, ops * 1e6f / BENCH_LIST_CHURN);
+
+        // churn leaves the entries scattered over the pool
+        if(j == 3)
+        {
+            float before = bench_list_iterate(&l, &sum);
+            list_compact(&l, NULL, NULL);
+            float after = bench_list_iterate(&l, &sum);
+            BENCH_COMPARE("list iterate", "churned", before, "compacted", after);
+        }
+        list_finalize(&l, NULL);
+        free(idx);
+    }
+    if(sum == 1)
+    {
+        printf("!");
+    }
+    BENCH_END("List");
+}
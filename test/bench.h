@@ -0,0 +1,21 @@
+/**
+ * bench.h
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * microbenchmarks, run with the '--bench' argument
+ */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+void bench_kdtree(void);
+void bench_list(void);
+void bench_matrix(void);
+void bench_noise(void);
+void bench_quaternion(void);
+void bench_random(void);
+void bench_scalar(void);
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * inline.c
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * tests the header only math from util/math/inline.h. It has to be in its own
+ * file, since the inline functions replace the out of line ones
+ */
+
+#include "clockwork/util/math/inline.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_BEGIN(msg) printf("Testing %s\n",msg)
+#define TEST_END(msg) printf("Passed %s\n",msg)
+
+#define INLINE_CALLS inline_calls_inline
+#include "inline_calls.h"
+
+int inline_calls_ref(float *out);
+void test_inline(void);
+
+void test_inline(void)
+{
+    TEST_BEGIN("Inline Math");
+    mat4 m, t;
+    mat4_identity(m);
+    mat4_translate(m, 1.0f, 2.0f, 3.0f);
+    mat4_scale(m, 2.0f, 2.0f, 2.0f); // p -> 2p + (2, 4, 6)
+    mat4_mult_affine(m, m, t);
+    vec4 v = vec4_setp(1.0f, 1.0f, 1.0f, 1.0f);
+    mat4_multVec(t, &v);
+    assert(feq(v.x, 10.0f) && feq(v.y, 16.0f) && feq(v.z, 22.0f) && feq(v.w, 1.0f));
+    mat4_mult(m, m, m);
+    assert(mat4_isaffine(m) && memcmp(m, t, sizeof(mat4)) == 0);
+
+    vec3 x = vec3_setp(1.0f, 0.0f, 0.0f);
+    vec3 y = vec3_setp(0.0f, 1.0f, 0.0f);
+    vec3 z = vec3_crossp(&x, &y);
+    assert(feq(z.z, 1.0f) && feq(vec3_dotp(&z, &x), 0.0f));
+
+    quat q = quaternion_set_rotation(PI / 2.0f, z);
+    quat p = quaternion_set(0.0f, 1.0f, 0.0f, 0.0f);
+    quat r = quaternion_vecRotatep(&q, &p);
+    assert(feq(r.x, 0.0f) && feq(r.y, 1.0f));
+    r = quaternion_divp(&q, &q);
+    assert(feq(r.w, 1.0f) && feq(quaternion_lensqp(&r), 1.0f));
+
+    //every inline function must give the same bits as its out of line one.
+    //that holds as long as neither is built to contract into fma
+    static float inl[INLINE_CALLS_MAX], ref[INLINE_CALLS_MAX];
+    int n = inline_calls_inline(inl);
+    assert(n <= INLINE_CALLS_MAX && n == inline_calls_ref(ref));
+    assert(memcmp(inl, ref, sizeof(float) * n) == 0);
+    TEST_END("Inline Math");
+}
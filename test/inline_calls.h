@@ -0,0 +1,197 @@
+/**
+ * inline_calls.h
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * calls every function of util/math/inline.h on fixed arguments, and writes
+ * each result to a buffer. Included once where the math functions are the
+ * inline ones, and once where they are the out of line ones, each time with
+ * INLINE_CALLS defined as the name to give the function, so the two buffers
+ * can be compared bit for bit. Results that are bool or int are stored as
+ * floats, and only the x, y and z of a vec3 are stored
+ */
+
+#define INLINE_CALLS_MAX 4096 //floats written at most
+
+#define PUTF(f)     out[n++] = (f)
+#define PUT2(v)     PUTF((v)[0]); PUTF((v)[1])
+#define PUT3(v)     PUTF((v).x); PUTF((v).y); PUTF((v).z)
+#define PUT4(v)     PUT3(v); PUTF((v).w)
+#define PUTM(m)     memcpy(&out[n], m, sizeof(mat4)); n += 16
+
+int INLINE_CALLS(float *out);
+
+/**
+ * returns the number of floats written to 'out'
+ */
+int INLINE_CALLS(float *out)
+{
+    static const float vals[8] = {0.0f, 1.0f, -2.5f, 3.75f, 1.0f / 3.0f, -0.0625f, 1e-7f, 7.0f};
+    int n = 0, k;
+    for(k = 0; k < 8; k++)
+    {
+        float a = vals[k], b = vals[(k + 1) % 8], c = vals[(k + 3) % 8], d = vals[(k + 6) % 8];
+
+        //scalar
+        PUTF(feq(a, b));
+        PUTF(feq(a, a + 1e-7f));
+        PUTF(fcmp(a, b));
+        PUTF(fcmp(b, a));
+        PUTF(fcmp(a, a));
+        PUTF(fsq(a));
+        PUTF(fclamp(a, -1.0f, 1.0f));
+
+        //vec2
+        vec2 p2, q2, r2;
+        vec2_set(p2, a, b);
+        vec2_set(q2, c, d);
+        PUT2(p2);
+        vec2_copy(p2, r2);
+        PUT2(r2);
+        vec2_scale(r2, c);
+        PUT2(r2);
+        PUTF(vec2_dot(p2, q2));
+        vec2_add(p2, q2, r2);
+        PUT2(r2);
+        vec2_sub(p2, q2, r2);
+        PUT2(r2);
+        PUTF(vec2_lensq(p2));
+        vec2_copy(q2, r2);
+        vec2_normalize(r2);
+        PUT2(r2);
+
+        //vec3
+        vec3 x3 = vec3_setp(a, b, c);
+        vec3 y3 = vec3_setp(d, a, c);
+        vec3 t3 = vec3_copyp(&x3);
+        ivec3 i3 = vec3_cmpp(&x3, &y3);
+        PUT3(x3);
+        PUT3(t3);
+        PUTF(vec3_eqp(&x3, &y3));
+        PUTF(vec3_eqp(&x3, &t3));
+        PUT3(i3);
+        PUTF(vec3_dotp(&x3, &y3));
+        PUTF(vec3_lensqp(&x3));
+        PUTF(vec3_lenp(&x3));
+        t3 = vec3_addp(&x3, &y3);
+        PUT3(t3);
+        t3 = vec3_subp(&x3, &y3);
+        PUT3(t3);
+        PUTF(vec3_distsqp(&x3, &y3));
+        t3 = y3;
+        vec3_normalizep(&t3);
+        PUT3(t3);
+        vec3_scalep(&t3, d);
+        PUT3(t3);
+        t3 = vec3_crossp(&x3, &y3);
+        PUT3(t3);
+        t3 = vec3_projp(&x3, &y3);
+        PUT3(t3);
+        t3 = vec3_orthp(&x3, &y3);
+        PUT3(t3);
+
+        //vec4
+        vec4 x4 = vec4_setp(a, b, c, d);
+        vec4 y4 = vec4_setp(c, d, b, 1.0f);
+        vec4 t4 = vec4_copyp(&x4);
+        PUT4(x4);
+        PUT4(t4);
+        t4 = vec4_addp(&x4, &y4);
+        PUT4(t4);
+        t4 = vec4_subp(&x4, &y4);
+        PUT4(t4);
+        PUTF(vec4_dotp(&x4, &y4));
+        PUTF(vec4_lensqp(&x4));
+        t4 = x4;
+        vec4_normalizep(&t4);
+        PUT4(t4);
+        t4 = vec4_normalizedp(&x4);
+        PUT4(t4);
+        vec4_scalep(&t4, c);
+        PUT4(t4);
+        t4 = vec4_projp(&x4, &y4);
+        PUT4(t4);
+        t4 = vec4_orthp(&x4, &y4);
+        PUT4(t4);
+
+        //quaternions
+        quat qa = quaternion_set(a, b, c, d);
+        quat qb = quaternion_set_rotation(c, x3);
+        quat qt = quaternion_copyp(&qa);
+        PUT4(qa);
+        PUT4(qb);
+        PUT4(qt);
+        PUTF(quaternion_dotp(&qa, &qb));
+        qt = quaternion_addp(&qa, &qb);
+        PUT4(qt);
+        qt = quaternion_subp(&qa, &qb);
+        PUT4(qt);
+        qt = qa;
+        quaternion_normalizep(&qt);
+        PUT4(qt);
+        PUTF(quaternion_lensqp(&qa));
+        qt = quaternion_identity();
+        PUT4(qt);
+        qt = quaternion_lerpp(&qa, &qb, b);
+        PUT4(qt);
+        PUTF(quaternion_normp(&qa));
+        qt = quaternion_conjugatep(&qa);
+        PUT4(qt);
+        qt = quaternion_inversep(&qb);
+        PUT4(qt);
+        qt = quaternion_realp(&qa);
+        PUT4(qt);
+        qt = quaternion_imaginaryp(&qa);
+        PUT4(qt);
+        qt = quaternion_multp(&qa, &qb);
+        PUT4(qt);
+        qt = quaternion_divp(&qa, &qb);
+        PUT4(qt);
+        qt = qa;
+        quaternion_rotatep(&qt, d, y3);
+        PUT4(qt);
+        qt = quaternion_vecRotatep(&qb, &y4);
+        PUT4(qt);
+
+        //mat4
+        mat4 ma, mb, mt;
+        mat4_setv(ma, x4, y4, vec4_setp(d, c, a, 0.5f), vec4_setp(b, a, 2.0f, 1.0f));
+        PUTM(ma);
+        mat4_identity(mb);
+        mat4_set(mb, 1, 2, a);
+        mat4_set(mb, 3, 0, c);
+        PUTM(mb);
+        PUTF(mat4_get(ma, 2, 1));
+        t4 = mat4_getv(ma, 3);
+        PUT4(t4);
+        mat4_copy(ma, mt);
+        PUTM(mt);
+        mat4_transpose(mt);
+        PUTM(mt);
+        mat4_scale(mt, a, b, c);
+        PUTM(mt);
+        mat4_scalev(mt, y4.v);
+        PUTM(mt);
+        mat4_translate(mt, b, c, d);
+        PUTM(mt);
+        mat4_translatev(mt, x4.v);
+        PUTM(mt);
+        mat4_mult(ma, mb, mt);
+        PUTM(mt);
+        PUTF(mat4_isaffine(ma));
+        PUTF(mat4_isaffine(mb));
+        mat4_mult_affine(mb, ma, mt);
+        PUTM(mt);
+        t4 = x4;
+        mat4_multVec(ma, &t4);
+        PUT4(t4);
+    }
+    return n;
+}
+
+#undef PUTF
+#undef PUT2
+#undef PUT3
+#undef PUT4
+#undef PUTM
@@ -0,0 +1,18 @@
+/**
+ * inline_ref.c
+ * clockwork
+ * October 18, 2026
+ * Brandon Surmanski
+ *
+ * the out of line math functions on the arguments inline.c uses, for it to
+ * compare the header only ones against
+ */
+
+#include <string.h>
+
+#include "clockwork/util/math/scalar.h"
+#include "clockwork/util/math/vec.h"
+#include "clockwork/util/math/matrix.h"
+
+#define INLINE_CALLS inline_calls_ref
+#include "inline_calls.h"
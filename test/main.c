@@ -10,22 +10,34 @@
 #include <assert.h>
 #include <errno.h>
 #include <float.h>
+#include <math.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "clockwork/util/math/stats.h"
+#include "clockwork/util/cpu.h"
 #include "clockwork/util/hash.h"
+#include "clockwork/util/noise.h"
+#include "clockwork/util/random.h"
 #include "clockwork/util/math/vec.h"
 #include "clockwork/util/math/scalar.h"
+#include "clockwork/util/math/half.h"
 #include "clockwork/util/math/tri.h"
 #include "clockwork/util/math/matrix.h"
+#include "clockwork/util/math/dualquat.h"
+#include "clockwork/util/math/sparse.h"
 #include "clockwork/util/math/convert.h"
 #include "clockwork/util/struct/iterator.h"
+#include "clockwork/util/struct/kdmap.h"
 #include "clockwork/util/struct/kdtree.h"
 #include "clockwork/util/struct/list.h"
 #include "clockwork/util/str.h"
+#include "clockwork/util/threadpool.h"
+
+#include "bench.h"
 
 #define SECTION_BEGIN(msg) printf("***Testing %s***\n",msg)
 #define SECTION_END(msg) printf("***Passed %s***\n\n",msg)
@@ -42,6 +54,10 @@ void test_vec(void);
 void test_str(void);
 void test_matrix(void);
 void test_mesh(void);
+void test_inline(void);
+void test_noise(void);
+void test_random(void);
+void test_kdtree(void);
 bool unit_test(bool ignore);
 
 //OpenGL ability
@@ -79,10 +95,128 @@ void test_str(void)
     SECTION_END("str");
 }
 
+#define TEST_BATCH_N 19 //two 8 wide blocks, or four 4 wide, and a tail of 3
+#define TEST_BATCH_OUT (49 * TEST_BATCH_N)
+
+/**
+ * copies the components of 'TEST_BATCH_N' vectors to 'out', leaving out the
+ * padding of each, and returns the end of the copy
+ */
+static float *test_vec3_out(float *out, const vec3 *v)
+{
+    int i;
+    for(i = 0; i < TEST_BATCH_N; i++, out += 3)
+    {
+        memcpy(out, v[i].v, sizeof(float) * 3);
+    }
+    return out;
+}
+
+/**
+ * runs every batch vector kernel on the same inputs, one after another
+ * into 'out', so the kernels of each instruction set can be compared
+ */
+static void test_vec_batch(float *out)
+{
+    float sa[3][TEST_BATCH_N], sb[3][TEST_BATCH_N];
+    vec3 va[TEST_BATCH_N], vb[TEST_BATCH_N];
+    vec4 wa[TEST_BATCH_N], wb[TEST_BATCH_N];
+    int i, c;
+    for(i = 0; i < TEST_BATCH_N; i++)
+    {
+        for(c = 0; c < 4; c++)
+        {
+            float x = sinf(i * 1.3f + c * 0.7f) * 4.0f;
+            float y = cosf(i * 0.9f - c * 1.1f) * 3.0f;
+            if(i == 5) // a zero vector for the normalizes
+            {
+                x = 0.0f;
+            }
+            if(c < 3)
+            {
+                sa[c][i] = va[i].v[c] = x;
+                sb[c][i] = vb[i].v[c] = y;
+            }
+            wa[i].v[c] = x;
+            wb[i].v[c] = y;
+        }
+    }
+
+    vec3_soa a = {sa[0], sa[1], sa[2]}, b = {sb[0], sb[1], sb[2]};
+    vec3_soa dst = {out, out + TEST_BATCH_N, out + 2 * TEST_BATCH_N};
+    #define NEXT_SOA(k) (dst.x += (k) * TEST_BATCH_N, dst.y += (k) * TEST_BATCH_N, \
+                         dst.z += (k) * TEST_BATCH_N, out += (k) * TEST_BATCH_N)
+    vec3_add_n(a, b, dst, TEST_BATCH_N);
+    NEXT_SOA(3);
+    vec3_sub_n(a, b, dst, TEST_BATCH_N);
+    NEXT_SOA(3);
+    vec3_cross_n(a, b, dst, TEST_BATCH_N);
+    NEXT_SOA(3);
+    vec3_dot_n(a, b, out, TEST_BATCH_N);
+    out += TEST_BATCH_N;
+    vec3_scale_n(b, 1.7f, TEST_BATCH_N);
+    vec3_normalize_n(a, TEST_BATCH_N);
+    for(c = 0; c < 3; c++)
+    {
+        memcpy(out, sb[c], sizeof(sb[c]));
+        memcpy(out + 3 * TEST_BATCH_N, sa[c], sizeof(sa[c]));
+        out += TEST_BATCH_N;
+    }
+    out += 3 * TEST_BATCH_N;
+    #undef NEXT_SOA
+
+    vec3 v3[TEST_BATCH_N];
+    vec4 v4[TEST_BATCH_N];
+    vec3_addp_n(va, vb, v3, TEST_BATCH_N);
+    out = test_vec3_out(out, v3);
+    vec3_subp_n(va, vb, v3, TEST_BATCH_N);
+    out = test_vec3_out(out, v3);
+    vec3_crossp_n(va, vb, v3, TEST_BATCH_N);
+    out = test_vec3_out(out, v3);
+    vec3_dotp_n(va, vb, out, TEST_BATCH_N);
+    out += TEST_BATCH_N;
+    vec3_scalep_n(vb, 1.7f, TEST_BATCH_N);
+    out = test_vec3_out(out, vb);
+    vec3_normalizep_n(va, TEST_BATCH_N);
+    out = test_vec3_out(out, va);
+
+    vec4_addp_n(wa, wb, v4, TEST_BATCH_N);
+    memcpy(out, v4, sizeof(v4));
+    out += 4 * TEST_BATCH_N;
+    vec4_subp_n(wa, wb, v4, TEST_BATCH_N);
+    memcpy(out, v4, sizeof(v4));
+    out += 4 * TEST_BATCH_N;
+    vec4_dotp_n(wa, wb, out, TEST_BATCH_N);
+    out += TEST_BATCH_N;
+    vec4_scalep_n(wb, 1.7f, TEST_BATCH_N);
+    memcpy(out, wb, sizeof(wb));
+    out += 4 * TEST_BATCH_N;
+    vec4_normalizep_n(wa, TEST_BATCH_N);
+    memcpy(out, wa, sizeof(wa));
+}
+
+/**
+ * the angle of the rotation taking 'e' to 'q', which need not be normalized
+ */
+static double test_quat_angle(const quat *q, const quat *e)
+{
+    double dot = 0.0, qsq = 0.0, esq = 0.0;
+    int k;
+    for(k = 0; k < 4; k++)
+    {
+        dot += (double) q->v[k] * e->v[k];
+        qsq += (double) q->v[k] * q->v[k];
+        esq += (double) e->v[k] * e->v[k];
+    }
+    double cross = qsq * esq - dot * dot;
+    return 2.0 * atan2(sqrt(cross > 0.0 ? cross : 0.0), fabs(dot));
+}
+
 //vec.h
 void test_vec(void)
 {
     SECTION_BEGIN("Vector Math");
+    int t;
     //htof
     TEST_BEGIN("Half-To-Float");
     assert(feq(htof(32767), 1.0f));
@@ -94,6 +228,44 @@ void test_vec(void)
     assert(feq(uhtof(0), 0.0f));
     assert(feq(uhtof(65535), 1.0f));
     TEST_END("Unsigned-Half-To-Float");
+    TEST_BEGIN("IEEE Half");
+    assert(f32_to_f16(1.0f) == HALF_ONE);
+    assert(f32_to_f16(65520.0f) == HALF_INF);
+    assert(f32_to_f16(-2.0f) == 0xC000);
+    assert(f32_to_f16(5.960464477539063e-8f) == 0x0001); // smallest subnormal
+    assert(f32_to_f16(1.0f + 1.0f / 2048.0f) == HALF_ONE); // tie, to even
+    assert(feq(f16_to_f32(0x7BFF), HALF_MAX));
+    float hsrc[19], hdst[19];
+    half hbits[19];
+    for(t = 0; t < 19; t++)
+    {
+        hsrc[t] = (t - 9) * 0.3f;
+    }
+    f32_to_f16_n(hsrc, hbits, 19);
+    f16_to_f32_n(hbits, hdst, 19);
+    for(t = 0; t < 19; t++)
+    {
+        assert(hbits[t] == f32_to_f16(hsrc[t]));
+        assert(fabs(hdst[t] - hsrc[t]) <= fabs(hsrc[t]) / 2048.0f);
+    }
+    TEST_END("IEEE Half");
+    TEST_BEGIN("Fast Transcendentals");
+    float tx[7] = {-50.0f, -3.0f, -0.4f, 0.0f, 0.7f, 2.5f, 81.0f};
+    float tsin[7];
+    fsin_n(tx, tsin, 7);
+    for(t = 0; t < 7; t++)
+    {
+        float one = fsin(tx[t]);
+        assert(memcmp(&tsin[t], &one, sizeof(float)) == 0);
+        assert(fabs(fsin(tx[t]) - sin(tx[t])) < 1e-6f);
+        assert(fabs(fcos(tx[t]) - cos(tx[t])) < 1e-6f);
+        assert(fabs(fexp(tx[t]) / exp(tx[t]) - 1.0) < 1e-6f);
+        assert(fabs(fatan2(tx[t], 0.3f) - atan2(tx[t], 0.3f)) < 1e-6f);
+        assert(fabs(fatan2(0.3f, tx[t]) - atan2(0.3f, tx[t])) < 1e-6f);
+        assert(fabs(fasin(tx[t] / 81.0f) - asin(tx[t] / 81.0f)) < 1e-6f);
+        assert(fabs(facos(tx[t] / 81.0f) - acos(tx[t] / 81.0f)) < 1e-6f);
+    }
+    TEST_END("Fast Transcendentals");
     //vector average
     TEST_BEGIN("Averaging");
     vec3 a = {1,2,3};
@@ -105,6 +277,121 @@ void test_vec(void)
     vec3_avg(res, 4, a, b, c, d);
     assert(vec3_eq(res, tot));
     TEST_END("Averaging");
+    //batch functions must match the single vector functions exactly
+    TEST_BEGIN("Batch Normalize");
+    vec3 batch[5] = {{{1,2,3}}, {{0,0,0}}, {{-4,0.5f,2}}, {{9,9,9}}, {{0,-3,0}}};
+    vec3 single[5];
+    int i;
+    for(i = 0; i < 5; i++)
+    {
+        single[i] = batch[i];
+        vec3_normalizep(&single[i]);
+    }
+    vec3_normalizep_n(batch, 5);
+    for(i = 0; i < 5; i++)
+    {
+        assert(memcmp(batch[i].v, single[i].v, sizeof(float) * 3) == 0);
+    }
+    TEST_END("Batch Normalize");
+    TEST_BEGIN("Batch Kernels");
+    {
+        //the scalar loops, then SSE2, then everything the processor has
+        static const int disable[3] = {~0, CPU_AVX2, 0};
+        float *scalar = malloc(sizeof(float) * TEST_BATCH_OUT);
+        float *simd = malloc(sizeof(float) * TEST_BATCH_OUT);
+        cpu_disable(disable[0]);
+        test_vec_batch(scalar);
+        for(i = 1; i < 3; i++)
+        {
+            cpu_disable(disable[i]);
+            test_vec_batch(simd);
+            assert(memcmp(scalar, simd, sizeof(float) * TEST_BATCH_OUT) == 0);
+        }
+        cpu_disable(0);
+        free(simd);
+        free(scalar);
+    }
+    TEST_END("Batch Kernels");
+    TEST_BEGIN("Batch Slerp");
+    vec3 zaxis = {{0, 0, 1}};
+    quat qa[9], qb[9], qexact[9], qfast[9];
+    for(i = 0; i < 9; i++)
+    {
+        qa[i] = quaternion_set_rotation(0.1f * i, zaxis);
+        qb[i] = quaternion_set_rotation(-0.2f * i, zaxis);
+    }
+    quaternion_slerp_n(qa, qb, 0.25f, qexact, 9, QUATERNION_SLERP_EXACT);
+    quaternion_slerp_n(qa, qb, 0.25f, qfast, 9, QUATERNION_SLERP_ACCURATE);
+    for(i = 0; i < 9; i++)
+    {
+        quat expect = quaternion_set_rotation(0.1f * i - 0.25f * 0.3f * i, zaxis);
+        assert(fabs(quaternion_dotp(&qexact[i], &expect)) > 1.0f - 1e-6f);
+        assert(fabs(quaternion_dotp(&qfast[i], &expect)) > 1.0f - 1e-6f);
+    }
+    {
+        //pairs about different axes, up to nearly opposite rotations. -b is
+        //the same rotation as b, so the short path gives the same result
+        static const int disable[3] = {~0, CPU_AVX, 0};
+        static const float tfast[4] = {0.0f, 0.1f, 0.5f, 0.77f};
+        quat fa[TEST_BATCH_N], fb[TEST_BATCH_N], fneg[TEST_BATCH_N];
+        quat fexact[TEST_BATCH_N], ffast[TEST_BATCH_N], fflip[TEST_BATCH_N];
+        int j, k;
+        for(i = 0; i < TEST_BATCH_N; i++)
+        {
+            vec3 axa = {{sinf(i * 1.3f), cosf(i * 0.7f), sinf(i * 2.1f + 1.0f)}};
+            vec3 axb = {{cosf(i * 0.9f), sinf(i * 1.7f + 0.5f), cosf(i * 0.4f)}};
+            vec3_normalizep(&axa);
+            vec3_normalizep(&axb);
+            fa[i] = quaternion_set_rotation(i * 0.37f - 3.0f, axa);
+            fb[i] = quaternion_set_rotation(3.1f - i * 0.29f, axb);
+            for(k = 0; k < 4; k++)
+            {
+                fneg[i].v[k] = -fb[i].v[k];
+            }
+        }
+        for(j = 0; j < 3; j++)
+        {
+            cpu_disable(disable[j]);
+            for(t = 0; t < 4; t++)
+            {
+                quaternion_slerp_n(fa, fb, tfast[t], fexact, TEST_BATCH_N, QUATERNION_SLERP_EXACT);
+                quaternion_slerp_n(fa, fb, tfast[t], ffast, TEST_BATCH_N, QUATERNION_SLERP_FAST);
+                quaternion_slerp_n(fa, fneg, tfast[t], fflip, TEST_BATCH_N, QUATERNION_SLERP_FAST);
+                for(i = 0; i < TEST_BATCH_N; i++)
+                {
+                    assert(test_quat_angle(&ffast[i], &fexact[i]) < 1e-4);
+                    assert(memcmp(&ffast[i], &fflip[i], sizeof(quat)) == 0);
+                }
+            }
+        }
+
+        //a cosine of -0 is not in the other hemisphere, on any path
+        static const int tiers[2] = {QUATERNION_SLERP_ACCURATE, QUATERNION_SLERP_FAST};
+        quat fscalar[3][TEST_BATCH_N];
+        for(i = 0; i < TEST_BATCH_N; i += 2)
+        {
+            fa[i] = quaternion_set(1.0f, -0.0f, -0.0f, -0.0f);
+            fb[i] = quaternion_set(-0.0f, 1.0f, 0.0f, 0.0f);
+        }
+        for(j = 0; j < 3; j++)
+        {
+            cpu_disable(disable[j]);
+            for(k = 0; k < 3; k++)
+            {
+                quat *dst = j ? ffast : fscalar[k];
+                if(k < 2)
+                {
+                    quaternion_slerp_n(fa, fb, 0.3f, dst, TEST_BATCH_N, tiers[k]);
+                } else
+                {
+                    quaternion_nlerp_n(fa, fb, 0.3f, dst, TEST_BATCH_N);
+                }
+                assert(memcmp(dst, fscalar[k], sizeof(fscalar[k])) == 0);
+            }
+        }
+        cpu_disable(0);
+    }
+    TEST_END("Batch Slerp");
     SECTION_END("Vector Math\n");
 }
 
@@ -119,9 +406,438 @@ void test_matrix(void)
     vec4_print(q);
     //TODO: assert q = (0,0,0,1);
     TEST_END("Quaternion Conversion");
+    TEST_BEGIN("Affine Inverse");
+    mat4 a, inv, res;
+    mat4_identity(a);
+    mat4_rotate(a, 0.7f, 1.0f, 2.0f, 3.0f);
+    mat4_scale(a, 2.0f, 3.0f, 0.5f);
+    mat4_translate(a, 1.0f, -2.0f, 5.0f);
+    assert(mat4_isaffine(a));
+    mat4_inverse_affine(a, inv);
+    mat4_mult_affine(inv, a, res);
+    int i;
+    for(i = 0; i < 16; i++)
+    {
+        assert(fabs(res[i] - (i % 5 == 0 ? 1.0f : 0.0f)) < 1e-5f);
+    }
+    TEST_END("Affine Inverse");
+    TEST_BEGIN("SIMD Transforms");
+    {
+        //the scalar path, then SSE2, then everything the processor has
+        static const int disable[3] = {~0, CPU_AVX, 0};
+        //Mesh_vert like elements, 32 bytes with the position first
+        float verts[13][8], out[3][13][8], inplace[3][13][8];
+        mat4 prod[3], self[3], ma, mb;
+        int j, k;
+        for(i = 0; i < 16; i++)
+        {
+            ma[i] = sinf(i * 0.37f) * 2.0f;
+            mb[i] = cosf(i * 0.61f) - 0.3f;
+        }
+        for(i = 0; i < 13; i++)
+        {
+            for(j = 0; j < 8; j++)
+            {
+                verts[i][j] = sinf(i * 1.7f + j) * 5.0f;
+            }
+        }
+        for(k = 0; k < 3; k++)
+        {
+            cpu_disable(disable[k]);
+            mat4_mult(ma, mb, prod[k]);
+            memcpy(self[k], ma, sizeof(mat4));
+            mat4_mult(self[k], mb, self[k]);
+            memcpy(out[k], verts, sizeof(verts));
+            mat4_transform_points(ma, &verts[0][0], &out[k][0][0], 13, sizeof(verts[0]));
+            memcpy(inplace[k], verts, sizeof(verts));
+            mat4_transform_points(ma, &inplace[k][0][0], &inplace[k][0][0], 13, sizeof(verts[0]));
+        }
+        cpu_disable(0);
+        assert(memcmp(self[0], prod[0], sizeof(mat4)) == 0);
+        assert(memcmp(inplace[0], out[0], sizeof(verts)) == 0);
+        for(k = 1; k < 3; k++)
+        {
+            assert(memcmp(prod[k], prod[0], sizeof(mat4)) == 0);
+            assert(memcmp(self[k], prod[0], sizeof(mat4)) == 0);
+            assert(memcmp(out[k], out[0], sizeof(verts)) == 0);
+            assert(memcmp(inplace[k], out[0], sizeof(verts)) == 0);
+        }
+        for(i = 0; i < 13; i++)
+        {
+            //only the position is written
+            assert(memcmp(&out[0][i][3], &verts[i][3], sizeof(float) * 5) == 0);
+        }
+    }
+    TEST_END("SIMD Transforms");
+    TEST_BEGIN("Dual Quaternion");
+    vec3 daxis = vec3_setp(0.0f, 0.0f, 1.0f);
+    vec3 doff = vec3_setp(1.0f, 2.0f, 3.0f);
+    quat dq90 = quaternion_set_rotation(PI / 2.0f, daxis);
+    dualquat dqa = dualquat_set(&dq90, &doff);
+    vec3 dp = vec3_setp(1.0f, 0.0f, 0.0f);
+    vec3 dres = dualquat_transformp(&dqa, &dp);
+    assert(fabs(dres.x - 1.0f) < 1e-5f && fabs(dres.y - 3.0f) < 1e-5f && fabs(dres.z - 3.0f) < 1e-5f);
+    dualquat dqb = dualquat_multp(&dqa, &dqa);
+    mat4 dm;
+    dualquat_to_mat4(&dqa, dm);
+    mat4_mult_affine(dm, dm, res);
+    dualquat_to_mat4(&dqb, dm);
+    for(i = 0; i < 16; i++)
+    {
+        assert(fabs(dm[i] - res[i]) < 1e-5f);
+    }
+    dualquat dqc = mat4_to_dualquat(dm);
+    dres = dualquat_translationp(&dqc);
+    assert(fabs(dres.x + 1.0f) < 1e-5f && fabs(dres.y - 3.0f) < 1e-5f && fabs(dres.z - 6.0f) < 1e-5f);
+    dualquat dqs[2] = {dqa, dualquat_inversep(&dqa)};
+    float dw[2] = {0.5f, 0.5f};
+    dqc = dualquat_blend(dqs, dw, 2); // halfway, no rotation or translation
+    dres = dualquat_transformp(&dqc, &dp);
+    assert(fabs(dres.x - 1.0f) < 1e-5f && fabs(dres.y) < 1e-5f);
+    TEST_END("Dual Quaternion");
+    TEST_BEGIN("Pivoted LU");
+    // zero leading entry, needs a row swap
+    float an[9] = {0, 2, 1,
+                   1, 1, 1,
+                   2, 1, 3};
+    float bn[3] = {7, 6, 13};
+    float xn[3];
+    matn_solvelu(an, 3, bn, xn);
+    assert(fabs(xn[0] - 1.0f) < 1e-5f);
+    assert(fabs(xn[1] - 2.0f) < 1e-5f);
+    assert(fabs(xn[2] - 3.0f) < 1e-5f);
+    assert(fabs(matn_det(an, 3) + 3.0f) < 1e-5f);
+    TEST_END("Pivoted LU");
+    TEST_BEGIN("Sparse CG");
+    // 1D poisson system, 4 on the diagonal (added in two parts), -1 off of it
+    SparseBuilder sb;
+    SparseMatrix sm;
+    sparsebuilder_init(&sb, 16, 16);
+    for(i = 0; i < 16; i++)
+    {
+        sparsebuilder_add(&sb, i, i, 3.0f);
+        sparsebuilder_add(&sb, i, i, 1.0f);
+        if(i > 0) sparsebuilder_add(&sb, i, i - 1, -1.0f);
+        if(i < 15) sparsebuilder_add(&sb, i, i + 1, -1.0f);
+    }
+    sparse_init(&sm, &sb);
+    sparsebuilder_finalize(&sb);
+    assert(sm.nnz == 46);
+    assert(feq(sparse_get(&sm, 3, 3), 4.0f));
+    assert(feq(sparse_get(&sm, 3, 9), 0.0f));
+    float sx[16], sbv[16], sr[16];
+    int p;
+    for(p = SPARSE_NONE; p <= SPARSE_IC; p++)
+    {
+        for(i = 0; i < 16; i++)
+        {
+            sx[i] = 0.0f;
+            sbv[i] = (float) i;
+        }
+        assert(sparse_solvecg(&sm, sbv, sx, p, 1e-6f, 100) >= 0);
+        sparse_vmult(&sm, sx, sr);
+        for(i = 0; i < 16; i++)
+        {
+            assert(fabs(sr[i] - sbv[i]) < 1e-4f);
+        }
+    }
+    sparse_finalize(&sm);
+    TEST_END("Sparse CG");
     SECTION_END("Matrix Math");
 }
 
+void test_noise(void)
+{
+    SECTION_BEGIN("Noise");
+    //batch noise must match the point functions, up to contraction into fma
+    TEST_BEGIN("Perlin Grid");
+    //wider than the columns the grid is generated in at a time
+    float grid[300 * 5];
+    int i, j;
+    noise2_perlin_grid(-3.3f, 1.7f, 0.37f, 0.91f, 300, 5, grid);
+    for(j = 0; j < 5; j++)
+    {
+        for(i = 0; i < 300; i++)
+        {
+            float expect = noise2_perlin(-3.3f + i * 0.37f, 1.7f + j * 0.91f);
+            assert(fabs(grid[j * 300 + i] - expect) < 1e-6f);
+        }
+    }
+    TEST_END("Perlin Grid");
+    TEST_BEGIN("Perlin Batch");
+    float xs[19], ys[19], zs[19], out[19];
+    for(i = 0; i < 19; i++)
+    {
+        xs[i] = i * 1.13f - 9.0f;
+        ys[i] = i * -0.71f + 2.5f;
+        zs[i] = i * 0.29f;
+    }
+    noise3_perlin_n(xs, ys, zs, 19, out);
+    for(i = 0; i < 19; i++)
+    {
+        float expect = noise3_perlin(xs[i], ys[i], zs[i]);
+        assert(fabs(out[i] - expect) < 1e-6f);
+    }
+    TEST_END("Perlin Batch");
+    TEST_BEGIN("Noise Context");
+    NoiseContext ca, cb, cc;
+    float seeded[19];
+    noisecontext_init(&ca, 7);
+    noisecontext_init(&cb, 8);
+    noisecontext_init(&cc, 7);
+    bool differ = false;
+    for(i = 0; i < 19; i++)
+    {
+        float va = noise3_perlin_ctx(&ca, xs[i], ys[i], zs[i]);
+        float vc = noise3_perlin_ctx(&cc, xs[i], ys[i], zs[i]);
+        assert(memcmp(&va, &vc, sizeof(float)) == 0);
+        differ |= fabs(va - noise3_perlin_ctx(&cb, xs[i], ys[i], zs[i])) > 1e-3f;
+    }
+    assert(differ);
+    //the default context draws from the shared generator
+    random_init(5);
+    noise_init(7);
+    for(i = 0; i < 19; i++)
+    {
+        seeded[i] = noise3_perlin(xs[i], ys[i], zs[i]);
+    }
+    random_init(5);
+    noise_init(7);
+    for(i = 0; i < 19; i++)
+    {
+        float vd = noise3_perlin(xs[i], ys[i], zs[i]);
+        assert(memcmp(&vd, &seeded[i], sizeof(float)) == 0);
+    }
+    noise_finalize();
+    for(i = 0; i < 19; i++)
+    {
+        float vd = noise3_perlin(xs[i], ys[i], zs[i]);
+        assert(memcmp(&vd, &out[i], sizeof(float)) == 0);
+    }
+    noisecontext_finalize(&cc);
+    noisecontext_finalize(&cb);
+    noisecontext_finalize(&ca);
+    TEST_END("Noise Context");
+    TEST_BEGIN("Simplex");
+    for(i = 0; i < 1000; i++)
+    {
+        float x = i * 0.731f - 300.0f, y = i * -0.377f, z = i * 0.113f, w = i * 1.07f;
+        float s2 = noise2_simplex(x, y);
+        float s3 = noise3_simplex(x, y, z);
+        float s4 = noise4_simplex(x, y, z, w);
+        assert(fabs(s2) <= 1.0f && fabs(s3) <= 1.0f && fabs(s4) <= 1.0f);
+        assert(fabs(noise2_simplex(x + 1e-3f, y) - s2) < 0.02f);
+        assert(fabs(noise3_simplex(x, y + 1e-3f, z) - s3) < 0.02f);
+        assert(fabs(noise4_simplex(x, y, z, w + 1e-3f) - s4) < 0.02f);
+    }
+    TEST_END("Simplex");
+    TEST_BEGIN("Noise Generator");
+    float img[70 * 67];
+    uint8_t bimg[70 * 67];
+    ThreadPool pool;
+    threadpool_init(&pool, 3);
+    int type, pass;
+    for(pass = 0; pass < 2; pass++)
+    {
+        noise_threadpool(pass ? &pool : NULL);
+        for(type = NOISE_FRACTAL; type <= NOISE_RIDGED; type++)
+        {
+            noise2_fill(NULL, type, 3, -2.0f, 5.0f, 0.03f, 0.05f, 70, 67, img);
+            noise2_fill_bytes(NULL, type, 3, -2.0f, 5.0f, 0.03f, 0.05f, 70, 67, bimg);
+            for(i = 0; i < 70 * 67; i++)
+            {
+                float x = -2.0f + (i % 70) * 0.03f, y = 5.0f + (i / 70) * 0.05f;
+                float expect = type == NOISE_FRACTAL ? noise2_fracPerlin(x, y, 3) :
+                               type == NOISE_TERBULENCE ? noise2_terbulence(x, y, 3) :
+                               noise2_ridged(x, y, 3);
+                assert(fabs(img[i] - expect) < 1e-5f);
+                assert(bimg[i] == noise_tobyte(img[i]));
+            }
+        }
+    }
+    noise_threadpool(NULL);
+    threadpool_finalize(&pool);
+    TEST_END("Noise Generator");
+    //analytic gradients against central differences
+    TEST_BEGIN("Noise Derivatives");
+    noise_init(3);
+    for(i = 0; i < 200; i++)
+    {
+        float x = i * 0.173f - 17.0f, y = i * 0.291f, z = i * -0.057f, h = 1e-3f;
+        float g2[2], g3[3], f2[2], f3[3];
+        assert(fabs(noise2_perlin_d(x, y, g2) - noise2_perlin(x, y)) < 1e-6f);
+        assert(fabs(noise3_perlin_d(x, y, z, g3) - noise3_perlin(x, y, z)) < 1e-6f);
+        assert(fabs(noise2_fracPerlin_d(x, y, 2, f2) - noise2_fracPerlin(x, y, 2)) < 1e-5f);
+        assert(fabs(noise3_fracPerlin_d(x, y, z, 2, f3) - noise3_fracPerlin(x, y, z, 2)) < 1e-5f);
+        assert(fabs(g2[0] - (noise2_perlin(x + h, y) - noise2_perlin(x - h, y)) / (2 * h)) < 1e-2f);
+        assert(fabs(g2[1] - (noise2_perlin(x, y + h) - noise2_perlin(x, y - h)) / (2 * h)) < 1e-2f);
+        assert(fabs(g3[0] - (noise3_perlin(x + h, y, z) - noise3_perlin(x - h, y, z)) / (2 * h)) < 1e-2f);
+        assert(fabs(g3[1] - (noise3_perlin(x, y + h, z) - noise3_perlin(x, y - h, z)) / (2 * h)) < 1e-2f);
+        assert(fabs(g3[2] - (noise3_perlin(x, y, z + h) - noise3_perlin(x, y, z - h)) / (2 * h)) < 1e-2f);
+        assert(fabs(f2[0] - (noise2_fracPerlin(x + h, y, 2) - noise2_fracPerlin(x - h, y, 2)) / (2 * h)) < 5e-2f);
+        assert(fabs(f3[2] - (noise3_fracPerlin(x, y, z + h, 2) - noise3_fracPerlin(x, y, z - h, 2)) / (2 * h)) < 5e-2f);
+    }
+    noise_finalize();
+    TEST_END("Noise Derivatives");
+    SECTION_END("Noise");
+}
+
+/**
+ * iterates a zero terminated int array
+ */
+static void *test_intarray_next(void *iterable, Iterator *i)
+{
+    int *next = ((int*) i->value) + 1;
+    return *next ? next : NULL;
+}
+
+/**
+ * the index kdtree_save stores for the test values, which count from 1
+ */
+static uint32_t test_kdtree_index(void *arg, void *val)
+{
+    return (intptr_t) val - 1;
+}
+
+void test_random(void)
+{
+    SECTION_BEGIN("Random");
+    TEST_BEGIN("Random Stream");
+    RandomStream a, b, c;
+    uint32_t ubulk[103], usingle[103];
+    float fbulk[103];
+    int i;
+    randomstream_init(&a, 1234);
+    randomstream_init(&b, 1234);
+    randomstream_int(&a); // bulk fills must match from any lane
+    randomstream_int(&b);
+    random_fill_u32(&a, ubulk, 103);
+    random_fill_float(&a, fbulk, 103);
+    for(i = 0; i < 103; i++)
+    {
+        usingle[i] = randomstream_int(&b);
+    }
+    assert(memcmp(ubulk, usingle, sizeof(ubulk)) == 0);
+    for(i = 0; i < 103; i++)
+    {
+        float f = randomstream_random(&b);
+        assert(memcmp(&fbulk[i], &f, sizeof(float)) == 0);
+        assert(f >= 0.0f && f < 1.0f);
+    }
+    randomstream_split(&a, &c);
+    assert(randomstream_int(&c) == randomstream_int(&b));
+    assert(randomstream_int(&a) != randomstream_int(&b));
+    TEST_END("Random Stream");
+
+    TEST_BEGIN("Mersenne Refill");
+    uint32_t scalar[2000];
+    cpu_disable(~0);
+    random_init(42);
+    for(i = 0; i < 2000; i++)
+    {
+        scalar[i] = random_int();
+    }
+    cpu_disable(0);
+    random_init(42);
+    for(i = 0; i < 2000; i++)
+    {
+        assert(random_int() == scalar[i]);
+    }
+    TEST_END("Mersenne Refill");
+
+    TEST_BEGIN("Gaussian Batch");
+    float *g = malloc(sizeof(float) * 100000);
+    double mean, var;
+    int k;
+    for(k = 0; k < 2; k++)
+    {
+        if(k == 0)
+        {
+            random_gauss_n(g, 100000, 3.0f, 2.0f);
+        } else
+        {
+            randomstream_gauss_n(&a, g, 100000, 3.0f, 2.0f);
+        }
+        mean = var = 0.0;
+        for(i = 0; i < 100000; i++)
+        {
+            mean += g[i];
+        }
+        mean /= 100000;
+        for(i = 0; i < 100000; i++)
+        {
+            var += (g[i] - mean) * (g[i] - mean);
+        }
+        var /= 100000;
+        assert(fabs(mean - 3.0) < 0.05);
+        assert(fabs(var - 4.0) < 0.1);
+    }
+    free(g);
+    TEST_END("Gaussian Batch");
+
+    TEST_BEGIN("Weighted Sampling");
+    float weights[5] = {1.0f, 2.0f, 3.0f, 4.0f, 0.0f};
+    int counts[5] = {0};
+    RandomAlias alias;
+    randomalias_init(&alias, weights, 5);
+    for(i = 0; i < 100000; i++)
+    {
+        counts[randomstream_alias(&a, &alias)]++;
+    }
+    for(i = 0; i < 5; i++)
+    {
+        assert(fabs(counts[i] / 100000.0 - weights[i] / 10.0) < 0.01);
+    }
+    assert(counts[4] == 0);
+    randomalias_finalize(&alias);
+
+    struct { int v; char pad[8]; } deck[100];
+    int seen[100] = {0};
+    for(i = 0; i < 100; i++)
+    {
+        deck[i].v = i;
+    }
+    random_shuffle(deck, 100, sizeof(deck[0]));
+    for(i = 0; i < 100; i++)
+    {
+        seen[deck[i].v]++;
+    }
+    for(i = 0; i < 100; i++)
+    {
+        assert(seen[i] == 1);
+    }
+
+    Iterator it;
+    int nums[101], picks[10], all[100];
+    for(i = 0; i < 100; i++)
+    {
+        nums[i] = i + 1;
+    }
+    nums[100] = 0;
+    iterator_init(&it, NULL, test_intarray_next);
+    it.value = nums;
+    assert(randomstream_reservoir(&a, &it, picks, 10, sizeof(int)) == 10);
+    memset(seen, 0, sizeof(seen));
+    for(i = 0; i < 10; i++)
+    {
+        assert(picks[i] >= 1 && picks[i] <= 100 && !seen[picks[i] - 1]);
+        seen[picks[i] - 1] = 1;
+    }
+    it.value = nums;
+    assert(random_reservoir(&it, all, 200, sizeof(int)) == 100);
+    TEST_END("Weighted Sampling");
+    SECTION_END("Random");
+}
+
+/**
+ * records where each entry moved in the compaction test
+ */
+static void test_list_remap(void *arg, size_t from, size_t to)
+{
+    size_t *moved = arg;
+    moved[from] = to;
+}
+
 void test_list(void)
 {
     SECTION_BEGIN("List");
@@ -160,14 +876,573 @@ void test_list(void)
     {
         printf("bufn: %d\n", buf[i]);
     }
+    list_finalize(&list, NULL);
+
+    TEST_BEGIN("Free List");
+    {
+        //a mirror of the list in an array, kept in the same order
+        int mirror[512], nmirror = 0, op, j;
+        int *out = malloc(sizeof(mirror));
+        RandomStream r;
+        randomstream_init(&r, 3);
+        list_init(&list, sizeof(int));
+        for(op = 0; op < 20000; op++)
+        {
+            uint32_t choice = randomstream_below(&r, 6);
+            int at = nmirror ? randomstream_below(&r, nmirror) : 0;
+            if(nmirror && (choice < 2 || nmirror == 512))
+            {
+                list_first(&list, &it);
+                for(j = 0; j < at; j++)
+                {
+                    iterator_next(&it);
+                }
+                assert(*(int*) list_get(&list, &it) == mirror[at]);
+                if(choice == 0 || nmirror == 512)
+                {
+                    list_remove(&list, &it);
+                    memmove(&mirror[at], &mirror[at + 1], sizeof(int) * (nmirror - at - 1));
+                    nmirror--;
+                } else
+                {
+                    Iterator to;
+                    list_last(&list, &to);
+                    list_moveafter(&list, &to, &it);
+                    n = mirror[at];
+                    memmove(&mirror[at], &mirror[at + 1], sizeof(int) * (nmirror - at - 1));
+                    mirror[nmirror - 1] = n;
+                }
+            } else if(choice == 2 || !nmirror)
+            {
+                list_addfront(&list, &op);
+                memmove(&mirror[1], mirror, sizeof(int) * nmirror++);
+                mirror[0] = op;
+            } else if(choice == 3)
+            {
+                list_addback(&list, &op);
+                mirror[nmirror++] = op;
+            } else
+            {
+                list_last(&list, &it);
+                for(j = nmirror - 1; j > at; j--)
+                {
+                    list_prev(&list, &it);
+                }
+                at += choice == 4; //after, or before
+                if(choice == 4)
+                {
+                    list_addafter(&list, &it, &op);
+                } else
+                {
+                    list_addbefore(&list, &it, &op);
+                }
+                memmove(&mirror[at + 1], &mirror[at], sizeof(int) * (nmirror++ - at));
+                mirror[at] = op;
+            }
+
+            assert(list_length(&list) == nmirror);
+            if(op % 100 == 0)
+            {
+                list_tobuffer(&list, out);
+                assert(memcmp(out, mirror, sizeof(int) * nmirror) == 0);
+            }
+        }
+        list_finalize(&list, NULL);
+        free(out);
+    }
+    TEST_END("Free List");
+
+    TEST_BEGIN("Compaction");
+    {
+        size_t kept[100], moved[1000];
+        int values[100];
+        list_init(&list, sizeof(int));
+        for(i = 0; i < 1000; i++)
+        {
+            list_addback(&list, &i);
+        }
+        //remove all but every 10th, keeping the index of each kept entry
+        list_first(&list, &it);
+        for(i = 0; i < 1000; i++)
+        {
+            Iterator cur = it;
+            iterator_next(&it);
+            if(i % 10)
+            {
+                list_remove(&list, &cur);
+            } else
+            {
+                kept[i / 10] = list_index(&list, &cur);
+                values[i / 10] = i;
+            }
+        }
+        for(i = 0; i < 1000; i++)
+        {
+            moved[i] = i;
+        }
+        list_compact(&list, test_list_remap, moved);
+        assert(list_length(&list) == 100);
+        for(i = 0; i < 100; i++)
+        {
+            assert(*(int*) list_at(&list, moved[kept[i]], &it) == values[i]);
+            assert(list_index(&list, &it) == i);
+        }
+        list_first(&list, &it);
+        for(i = 0; iterator_value(&it); i++)
+        {
+            assert(*(int*) iterator_value(&it) == i * 10);
+            iterator_next(&it);
+        }
+        assert(i == 100);
+        n = -1;
+        list_addfront(&list, &n);
+        assert(*(int*) list_first(&list, NULL) == -1 && list_length(&list) == 101);
+        list_clear(&list, NULL);
+        assert(list_isempty(&list) && list_first(&list, NULL) == NULL);
+        list_finalize(&list, NULL);
+    }
+    TEST_END("Compaction");
     SECTION_END("List");
 }
 
+void test_kdtree(void)
+{
+    SECTION_BEGIN("KD-Tree");
+    TEST_BEGIN("Bulk Build");
+    const int n = 20000;
+    float *pts = malloc(sizeof(float) * 3 * n);
+    float *dists = malloc(sizeof(float) * n);
+    void **vals = malloc(sizeof(void*) * n);
+    RandomStream r;
+    ThreadPool pool;
+    Iterator it;
+    int i, j, pass, depth = 0;
+    randomstream_init(&r, 99);
+    random_fill_float(&r, pts, 3 * n);
+    for(i = 0; i < n; i++)
+    {
+        vals[i] = (void*) (intptr_t) (i + 1);
+    }
+    while((1 << depth) <= n)
+    {
+        depth++;
+    }
+    threadpool_init(&pool, 3);
+    for(pass = 0; pass < 2; pass++)
+    {
+        kdtree k;
+        kdtree_threadpool(pass ? &pool : NULL);
+        kdtree_init(&k, 3);
+        kdtree_build(&k, pts, vals, n);
+        assert(kdtree_size(&k) == n);
+        assert(kdtree_depth(&k) == depth);
+
+        for(j = 0; j < 200; j++)
+        {
+            float q[3], found[3];
+            void *near[8];
+            float *nearpos[8];
+            int best = 0, closer = 0;
+            random_fill_float(&r, q, 3);
+            for(i = 0; i < n; i++)
+            {
+                float dx = pts[i*3] - q[0], dy = pts[i*3+1] - q[1], dz = pts[i*3+2] - q[2];
+                dists[i] = dx * dx + dy * dy + dz * dz;
+                best = dists[i] < dists[best] ? i : best;
+            }
+            assert(kdtree_closest(&k, q, found) == vals[best]);
+            assert(memcmp(found, &pts[best*3], sizeof(found)) == 0);
+
+            assert(kdtree_closestN(&k, q, 8, near, nearpos) == 8);
+            assert(near[0] == vals[best]);
+            float last = dists[(intptr_t) near[7] - 1];
+            for(i = 0; i < n; i++)
+            {
+                closer += dists[i] < last;
+            }
+            assert(closer == 7);
+        }
+
+        float extra[3] = {0.5f, 0.5f, 0.5f};
+        kdtree_insert(&k, extra, NULL);
+        kdtree_removeClosest(&k, extra, NULL);
+        kdtree_removeClosest(&k, &pts[0], NULL);
+        assert(kdtree_closest(&k, &pts[0], NULL) != vals[0]);
+        assert(kdtree_size(&k) == n - 1);
+        kdtree_iter_init(&k, &it);
+        for(i = 0; iterator_value(&it); i++)
+        {
+            iterator_next(&it);
+        }
+        assert(i == n - 1);
+        kdtree_finalize(&k, NULL);
+    }
+    TEST_END("Bulk Build");
+
+    TEST_BEGIN("Batch Queries");
+    kdtree k;
+    const int nq = 1000;
+    float *queries = malloc(sizeof(float) * 3 * nq);
+    void **bvals = malloc(sizeof(void*) * 6 * nq);
+    float *bdists = malloc(sizeof(float) * 6 * nq);
+    random_fill_float(&r, queries, 3 * nq);
+    kdtree_init(&k, 3);
+    kdtree_build(&k, pts, vals, n);
+    for(pass = 0; pass < 2; pass++)
+    {
+        kdtree_threadpool(pass ? &pool : NULL);
+        assert(kdtree_closestN_batch(&k, queries, nq, 6, bvals, bdists) == 6);
+        for(j = 0; j < nq; j++)
+        {
+            void *near[6];
+            float *nearpos[6];
+            kdtree_closestN(&k, &queries[j * 3], 6, near, nearpos);
+            assert(memcmp(near, &bvals[j * 6], sizeof(near)) == 0);
+            for(i = 1; i < 6; i++)
+            {
+                assert(bdists[j * 6 + i - 1] <= bdists[j * 6 + i]);
+            }
+        }
+    }
+    kdtree_finalize(&k, NULL);
+    kdtree_init(&k, 3);
+    kdtree_insert(&k, pts, vals[0]);
+    assert(kdtree_closestN_batch(&k, queries, 2, 3, bvals, bdists) == 1);
+    assert(bvals[0] == vals[0] && bvals[1] == NULL && isinf(bdists[5]));
+    kdtree_finalize(&k, NULL);
+    free(bdists);
+    free(bvals);
+    free(queries);
+
+    kdtree_threadpool(NULL);
+    threadpool_finalize(&pool);
+    TEST_END("Batch Queries");
+
+    TEST_BEGIN("Range Queries");
+    kdtree_init(&k, 3);
+    kdtree_build(&k, pts, vals, n);
+    for(j = 0; j < 50; j++)
+    {
+        float c[3], lo[3], hi[3], radius = 0.02f + 0.1f * j / 50;
+        void *inbuf[16];
+        float *inpos[16];
+        int inradius = 0, inbox = 0;
+        random_fill_float(&r, c, 3);
+        for(i = 0; i < 3; i++)
+        {
+            lo[i] = c[i] - radius;
+            hi[i] = c[i] + radius * 0.5f;
+        }
+        for(i = 0; i < n; i++)
+        {
+            float dx = pts[i*3] - c[0], dy = pts[i*3+1] - c[1], dz = pts[i*3+2] - c[2];
+            inradius += dx * dx + dy * dy + dz * dz <= radius * radius;
+            inbox += lo[0] <= pts[i*3] && pts[i*3] <= hi[0] &&
+                     lo[1] <= pts[i*3+1] && pts[i*3+1] <= hi[1] &&
+                     lo[2] <= pts[i*3+2] && pts[i*3+2] <= hi[2];
+        }
+        assert(kdtree_within_radius(&k, c, radius, NULL, NULL) == inradius);
+        assert(kdtree_within_box(&k, lo, hi, NULL, NULL) == inbox);
+        assert(kdtree_within_radiusN(&k, c, radius, 16, inbuf, inpos) == inradius);
+        for(i = 0; i < inradius && i < 16; i++)
+        {
+            assert(memcmp(inpos[i], &pts[((intptr_t) inbuf[i] - 1) * 3], sizeof(float) * 3) == 0);
+        }
+    }
+    kdtree_finalize(&k, NULL);
+    TEST_END("Range Queries");
+
+    TEST_BEGIN("Dynamic Updates");
+    {
+        //mirror of the tree by handle, a NULL value marks a free handle
+        int cap = 2000, live = 0, op;
+        int *handles = malloc(sizeof(int) * cap);
+        void **mirror = calloc(cap, sizeof(void*));
+        float *mpos = malloc(sizeof(float) * 3 * cap);
+        kdtree_init(&k, 3);
+        for(op = 0; op < 20000; op++)
+        {
+            uint32_t choice = randomstream_below(&r, 8);
+            if(live < 1000 && (choice < 4 || live == 0))
+            {
+                float p[3];
+                random_fill_float(&r, p, 3);
+                //skewed inserts to force rebuilds
+                p[0] = p[0] * 0.01f + op * 0.00005f;
+                int h = kdtree_insert(&k, p, (void*)(intptr_t)(op + 1));
+                assert(h >= 0 && h < cap && !mirror[h]);
+                mirror[h] = (void*)(intptr_t)(op + 1);
+                memcpy(&mpos[h * 3], p, sizeof(p));
+                handles[live++] = h;
+            } else
+            {
+                j = randomstream_below(&r, live);
+                int h = handles[j];
+                if(choice < 6)
+                {
+                    kdtree_remove(&k, h, NULL);
+                    mirror[h] = NULL;
+                    handles[j] = handles[--live];
+                } else
+                {
+                    random_fill_float(&r, &mpos[h * 3], 3);
+                    kdtree_move(&k, h, &mpos[h * 3]);
+                }
+            }
+            assert(kdtree_size(&k) == live);
+
+            if(op % 500 == 0 && live)
+            {
+                float q[3], best = INFINITY, d;
+                void *bestval = NULL, *near[4];
+                random_fill_float(&r, q, 3);
+                for(i = 0; i < live; i++)
+                {
+                    float *mp = &mpos[handles[i] * 3];
+                    d = (mp[0]-q[0])*(mp[0]-q[0]) + (mp[1]-q[1])*(mp[1]-q[1]) + (mp[2]-q[2])*(mp[2]-q[2]);
+                    if(d < best)
+                    {
+                        best = d;
+                        bestval = mirror[handles[i]];
+                    }
+                    assert(kdtree_value(&k, handles[i]) == mirror[handles[i]]);
+                    assert(memcmp(kdtree_position(&k, handles[i]), mp, sizeof(float) * 3) == 0);
+                }
+                assert(kdtree_closest(&k, q, NULL) == bestval);
+                assert(kdtree_closestN(&k, q, 4, near, NULL) == (live < 4 ? live : 4));
+                assert(near[0] == bestval);
+                assert(kdtree_within_radius(&k, q, 2.0f, NULL, NULL) == live);
+                assert(kdtree_depth(&k) <= 2 + logf(live + 1) / logf(1.0f / 0.7f) * 2);
+
+                int count = 0;
+                kdtree_iter_init(&k, &it);
+                while(iterator_value(&it))
+                {
+                    count++;
+                    iterator_next(&it);
+                }
+                assert(count == live);
+            }
+        }
+        while(live)
+        {
+            kdtree_remove(&k, handles[--live], NULL);
+        }
+        assert(kdtree_size(&k) == 0 && kdtree_closest(&k, pts, NULL) == NULL);
+        kdtree_finalize(&k, NULL);
+        free(mpos);
+        free(mirror);
+        free(handles);
+
+        //moving the last child out of a removed node frees it
+        float line[7] = {0, 1, 2, 3, 4, 5, 6}, far[2] = {10, 11};
+        void *lvals[7] = {(void*) 1, (void*) 2, (void*) 3, (void*) 4, (void*) 5, (void*) 6, (void*) 7};
+        kdtree_init(&k, 1);
+        kdtree_build(&k, line, lvals, 7);
+        kdtree_remove(&k, 1, NULL);
+        assert(k.dead == 1);
+        kdtree_move(&k, 0, &far[0]);
+        kdtree_move(&k, 2, &far[1]);
+        assert(k.dead == 0 && kdtree_size(&k) == 6);
+        assert(kdtree_closest(&k, far, NULL) == (void*) 1);
+        assert(kdtree_within_radius(&k, line, 7.0f, NULL, NULL) == 4);
+        kdtree_finalize(&k, NULL);
+    }
+    TEST_END("Dynamic Updates");
+
+    TEST_BEGIN("Approximate Search");
+    {
+        //long vectors near a low dimensional subspace, as features tend to be
+        int dim = 16, npts = 5000, nnear = 8, hits = 0, total = 0;
+        float *feat = malloc(sizeof(float) * dim * npts);
+        void **fvals = malloc(sizeof(void*) * npts);
+        float basis[4 * 16], latent[4], q[16];
+        void *exact[8], *approx[8];
+        float *exactpos[8], *approxpos[8];
+        kdforest f;
+        random_fill_float(&r, basis, 4 * dim);
+        for(i = 0; i < npts; i++)
+        {
+            random_fill_float(&r, latent, 4);
+            random_fill_float(&r, &feat[i * dim], dim);
+            for(j = 0; j < dim; j++)
+            {
+                feat[i * dim + j] *= 0.05f;
+                for(pass = 0; pass < 4; pass++)
+                {
+                    feat[i * dim + j] += latent[pass] * basis[pass * dim + j];
+                }
+            }
+            fvals[i] = (void*)(intptr_t)(i + 1);
+        }
+        kdtree_init(&k, dim);
+        kdtree_build(&k, feat, fvals, npts);
+        for(pass = 1; pass <= 4; pass *= 2)
+        {
+            kdforest_init(&f, dim, pass);
+            kdforest_build(&f, feat, fvals, npts, pass);
+            for(j = 0; j < 100; j++)
+            {
+                memcpy(q, &feat[randomstream_below(&r, npts) * dim], sizeof(q));
+                q[0] += 0.01f;
+                assert(kdtree_closestN(&k, q, nnear, exact, exactpos) == nnear);
+
+                //no budget and no error is exact
+                assert(kdtree_closestN_approx(&k, q, nnear, 0.0f, 0, approx, NULL) == nnear);
+                assert(memcmp(approx, exact, sizeof(exact)) == 0);
+                assert(kdtree_closestN_approx(&k, q, nnear, 0.0f, 0, NULL, approxpos) == nnear);
+                assert(memcmp(approxpos, exactpos, sizeof(exactpos)) == 0);
+                assert(kdforest_closestN(&f, q, nnear, 0.0f, 0, approx, NULL) == nnear);
+                assert(memcmp(approx, exact, sizeof(exact)) == 0);
+
+                //each point within 1 + eps of the exact one
+                assert(kdforest_closestN(&f, q, nnear, 0.5f, 0, approx, approxpos) == nnear);
+                for(i = 0; i < nnear; i++)
+                {
+                    float de = 0.0f, da = 0.0f;
+                    int c;
+                    for(c = 0; c < dim; c++)
+                    {
+                        de += (exactpos[i][c] - q[c]) * (exactpos[i][c] - q[c]);
+                        da += (approxpos[i][c] - q[c]) * (approxpos[i][c] - q[c]);
+                    }
+                    assert(da <= de * 1.5f * 1.5f * 1.0001f);
+                }
+
+                //a budget still finds most of them
+                assert(kdforest_closestN(&f, q, nnear, 0.0f, 256, approx, NULL) == nnear);
+                for(i = 0; i < nnear; i++)
+                {
+                    int c;
+                    for(c = 0; c < nnear; c++)
+                    {
+                        hits += approx[i] == exact[c];
+                    }
+                }
+                total += nnear;
+            }
+            kdforest_finalize(&f, NULL);
+        }
+        assert(hits > total * 3 / 4);
+        kdtree_finalize(&k, NULL);
+        free(fvals);
+        free(feat);
+    }
+    TEST_END("Approximate Search");
+
+    TEST_BEGIN("Memory Mapped");
+    {
+        const char *filenm = "test_kdmap.kdt";
+        kdmap m;
+        uint32_t mvals[8];
+        float mdists[8], mpos[3];
+        void *near[8];
+        float *nearpos[8];
+        kdtree_init(&k, 3);
+        kdtree_build(&k, pts, vals, n);
+        for(pass = 0; pass < 2; pass++)
+        {
+            if(pass == 1)
+            {
+                //removed points stay as splitting nodes in the file
+                for(i = 0; i < n; i += 3)
+                {
+                    kdtree_remove(&k, i, NULL);
+                }
+            }
+            assert(kdtree_save(&k, filenm, pass ? test_kdtree_index : NULL, NULL) == 0);
+            assert(kdmap_open(&m, filenm) == 0);
+            assert(kdmap_size(&m) == kdtree_size(&k));
+            for(j = 0; j < 200; j++)
+            {
+                float q[3];
+                random_fill_float(&r, q, 3);
+                void *val = kdtree_closest(&k, q, NULL);
+                assert(kdmap_closest(&m, q, mpos) == (intptr_t) val - 1);
+                assert(memcmp(mpos, &pts[((intptr_t) val - 1) * 3], sizeof(mpos)) == 0);
+                assert(kdmap_closestN(&m, q, 8, mvals, mdists) == 8);
+                assert(kdtree_closestN(&k, q, 8, near, nearpos) == 8);
+                for(i = 0; i < 8; i++)
+                {
+                    assert(mvals[i] == (intptr_t) near[i] - 1);
+                    assert(i == 0 || mdists[i-1] <= mdists[i]);
+                }
+                assert(kdmap_within_radius(&m, q, 0.05f, NULL, NULL) ==
+                       kdtree_within_radius(&k, q, 0.05f, NULL, NULL));
+            }
+            kdmap_close(&m);
+        }
+        kdtree_finalize(&k, NULL);
+
+        kdtree_init(&k, 3);
+        assert(kdtree_save(&k, filenm, NULL, NULL) == 0);
+        assert(kdmap_open(&m, filenm) == 0);
+        assert(kdmap_size(&m) == 0 && kdmap_closest(&m, pts, NULL) == KDMAP_NONE);
+        assert(kdmap_closestN(&m, pts, 8, mvals, NULL) == 0);
+        kdmap_close(&m);
+        kdtree_finalize(&k, NULL);
+
+        FILE *file = fopen(filenm, "wb");
+        fputs("not a tree", file);
+        fclose(file);
+        assert(kdmap_open(&m, filenm) == -1);
+
+        //headers of the right size, but no tree
+        kdmap_header h = {{'K', 'D', 'T'}, KDMAP_VERSION, 0, 1, 1, 0};
+        kdmap_node node = {{-1, -1}, 0, 0};
+        file = fopen(filenm, "wb");
+        fwrite(&h, sizeof(h), 1, file);
+        fwrite(&node, sizeof(node), 1, file);
+        fclose(file);
+        assert(kdmap_open(&m, filenm) == -1);
+        h.dimensions = 3;
+        h.nnodes = 0;
+        h.size = 0;
+        h.root = -2;
+        file = fopen(filenm, "wb");
+        fwrite(&h, sizeof(h), 1, file);
+        fclose(file);
+        assert(kdmap_open(&m, filenm) == -1);
+        //sizes that wrap around to the size of the header alone
+        h.dimensions = 0xfffffffcu;
+        h.nnodes = 1u << 30;
+        h.root = 0;
+        file = fopen(filenm, "wb");
+        fwrite(&h, sizeof(h), 1, file);
+        fclose(file);
+        assert(kdmap_open(&m, filenm) == -1);
+        remove(filenm);
+        assert(kdmap_open(&m, filenm) == -1);
+    }
+    TEST_END("Memory Mapped");
+
+    free(vals);
+    free(dists);
+    free(pts);
+    SECTION_END("KD-Tree");
+}
+
 int main(int argc, char **argv)
 {
+    if(argc > 1 && strcmp(argv[1], "--bench") == 0)
+    {
+        bench_kdtree();
+        bench_list();
+        bench_matrix();
+        bench_noise();
+        bench_quaternion();
+        bench_random();
+        bench_scalar();
+        return 0;
+    }
+
     test_str();
     test_vec();
     test_matrix();
+    test_inline();
+    test_noise();
+    test_random();
     test_stats(); 
     test_list();
+    test_kdtree();
 }